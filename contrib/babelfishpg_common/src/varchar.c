@@ -1352,6 +1352,133 @@ check_collation_set(Oid collid)
 	}
 }
 
+/*
+ * Fast path for case-insensitive collations
+ *
+ * Under an untailored ICU collation compared at primary or secondary
+ * strength, strings made of printable ASCII only are equal exactly when
+ * they are equal after ASCII case folding: each of those characters has a
+ * single primary weight of its own, none is ignorable and there are no
+ * contractions among them. Such collations, which include the default
+ * *_CI_AS ones, can then skip ICU for equality of ASCII data.
+ */
+#define ASCII_CI_NOT_ASCII	(-1)
+
+static bool
+collation_has_ascii_ci_equality(Oid collid, pg_locale_t mylocale)
+{
+	static Oid	cached_collid = InvalidOid;
+	static bool cached_result = false;
+	bool		result = false;
+
+	if (collid == cached_collid)
+		return cached_result;
+
+#ifdef USE_ICU
+	if (mylocale->provider == COLLPROVIDER_ICU)
+	{
+		UCollator  *ucol = mylocale->info.icu.ucol;
+		UErrorCode	status = U_ZERO_ERROR;
+		UColAttributeValue strength;
+		int32_t		rules_len = 0;
+
+		strength = ucol_getAttribute(ucol, UCOL_STRENGTH, &status);
+		result = (strength == UCOL_PRIMARY || strength == UCOL_SECONDARY) &&
+			ucol_getAttribute(ucol, UCOL_CASE_LEVEL, &status) == UCOL_OFF &&
+			ucol_getAttribute(ucol, UCOL_ALTERNATE_HANDLING, &status) == UCOL_NON_IGNORABLE &&
+			ucol_getAttribute(ucol, UCOL_NUMERIC_COLLATION, &status) == UCOL_OFF;
+		(void) ucol_getRules(ucol, &rules_len);
+		result = result && rules_len == 0 && U_SUCCESS(status);
+	}
+#endif
+
+	cached_collid = collid;
+	cached_result = result;
+	return result;
+}
+
+#define ASCII_ONES		UINT64CONST(0x0101010101010101)
+#define ASCII_HIGHS		UINT64CONST(0x8080808080808080)
+/* true if any byte of w is below n, for n <= 128 */
+#define ASCII_HAS_LESS(w, n)	((((w) - ASCII_ONES * (n)) & ~(w) & ASCII_HIGHS) != 0)
+/* true if all eight bytes of w are in 0x20..0x7E */
+#define ASCII_IS_PRINTABLE_WORD(w) \
+	(((w) & ASCII_HIGHS) == 0 && !ASCII_HAS_LESS(w, 0x20) && \
+	 !ASCII_HAS_LESS((w) ^ (ASCII_ONES * 0x7F), 1))
+
+static inline bool
+ascii_is_printable(unsigned char c)
+{
+	return c >= 0x20 && c <= 0x7E;
+}
+
+static bool
+ascii_all_printable(const char *s, int len)
+{
+	int			i = 0;
+
+	for (; i + 8 <= len; i += 8)
+	{
+		uint64		w;
+
+		memcpy(&w, s + i, sizeof(w));
+		if (!ASCII_IS_PRINTABLE_WORD(w))
+			return false;
+	}
+	for (; i < len; i++)
+	{
+		if (!ascii_is_printable((unsigned char) s[i]))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Compare two strings for equality ignoring ASCII case, eight bytes at a
+ * time while they are bytewise equal. Returns 1 if equal, 0 if not, or
+ * ASCII_CI_NOT_ASCII if either has a byte outside printable ASCII.
+ */
+static int
+ascii_ci_equal(const char *a, int len1, const char *b, int len2)
+{
+	int			i = 0;
+	bool		equal = true;
+
+	if (len1 != len2)
+	{
+		if (!ascii_all_printable(a, len1) || !ascii_all_printable(b, len2))
+			return ASCII_CI_NOT_ASCII;
+		return 0;
+	}
+
+	while (i < len1)
+	{
+		if (i + 8 <= len1)
+		{
+			uint64		wa;
+			uint64		wb;
+
+			memcpy(&wa, a + i, sizeof(wa));
+			memcpy(&wb, b + i, sizeof(wb));
+			if (wa == wb && ASCII_IS_PRINTABLE_WORD(wa))
+			{
+				i += 8;
+				continue;
+			}
+		}
+
+		/* this byte differs or isn't known to be printable, look closer */
+		if (!ascii_is_printable((unsigned char) a[i]) ||
+			!ascii_is_printable((unsigned char) b[i]))
+			return ASCII_CI_NOT_ASCII;
+		if (pg_ascii_tolower((unsigned char) a[i]) != pg_ascii_tolower((unsigned char) b[i]))
+			equal = false;
+		i++;
+	}
+
+	return equal ? 1 : 0;
+}
+
 Datum
 varchareq(PG_FUNCTION_ARGS)
 {
@@ -1361,6 +1488,7 @@ varchareq(PG_FUNCTION_ARGS)
 				len2;
 	bool		result;
 	Oid			collid = PG_GET_COLLATION();
+	pg_locale_t mylocale = NULL;
 
 	check_collation_set(collid);
 
@@ -1369,7 +1497,7 @@ varchareq(PG_FUNCTION_ARGS)
 
 	if (lc_collate_is_c(collid) ||
 		collid == DEFAULT_COLLATION_OID ||
-		pg_newlocale_from_collation(collid)->deterministic)
+		(mylocale = pg_newlocale_from_collation(collid))->deterministic)
 	{
 		/*
 		 * Since we only care about equality or not-equality, we can avoid all
@@ -1382,8 +1510,16 @@ varchareq(PG_FUNCTION_ARGS)
 	}
 	else
 	{
-		result = (varstr_cmp(VARDATA_ANY(arg1), len1, VARDATA_ANY(arg2), len2,
-							 collid) == 0);
+		int			eq = ASCII_CI_NOT_ASCII;
+
+		if (collation_has_ascii_ci_equality(collid, mylocale))
+			eq = ascii_ci_equal(VARDATA_ANY(arg1), len1, VARDATA_ANY(arg2), len2);
+
+		if (eq != ASCII_CI_NOT_ASCII)
+			result = (eq == 1);
+		else
+			result = (varstr_cmp(VARDATA_ANY(arg1), len1, VARDATA_ANY(arg2), len2,
+								 collid) == 0);
 	}
 
 	PG_FREE_IF_COPY(arg1, 0);
@@ -1401,6 +1537,7 @@ varcharne(PG_FUNCTION_ARGS)
 				len2;
 	bool		result;
 	Oid			collid = PG_GET_COLLATION();
+	pg_locale_t mylocale = NULL;
 
 	check_collation_set(collid);
 
@@ -1409,7 +1546,7 @@ varcharne(PG_FUNCTION_ARGS)
 
 	if (lc_collate_is_c(collid) ||
 		collid == DEFAULT_COLLATION_OID ||
-		pg_newlocale_from_collation(collid)->deterministic)
+		(mylocale = pg_newlocale_from_collation(collid))->deterministic)
 	{
 		/*
 		 * Since we only care about equality or not-equality, we can avoid all
@@ -1422,8 +1559,16 @@ varcharne(PG_FUNCTION_ARGS)
 	}
 	else
 	{
-		result = (varstr_cmp(VARDATA_ANY(arg1), len1, VARDATA_ANY(arg2), len2,
-							 collid) != 0);
+		int			eq = ASCII_CI_NOT_ASCII;
+
+		if (collation_has_ascii_ci_equality(collid, mylocale))
+			eq = ascii_ci_equal(VARDATA_ANY(arg1), len1, VARDATA_ANY(arg2), len2);
+
+		if (eq != ASCII_CI_NOT_ASCII)
+			result = (eq == 0);
+		else
+			result = (varstr_cmp(VARDATA_ANY(arg1), len1, VARDATA_ANY(arg2), len2,
+								 collid) != 0);
 	}
 
 	PG_FREE_IF_COPY(arg1, 0);
@@ -1537,6 +1682,9 @@ varcharcmp(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(cmp);
 }
 
+/* Longest key, in bytes, whose sort key hashvarchar() builds on the stack */
+#define HASH_SORTKEY_BUFSIZE 256
+
 /*
  * varchar needs a specialized hash function because we want to ignore
  * trailing blanks in comparisons.
@@ -1574,20 +1722,44 @@ hashvarchar(PG_FUNCTION_ARGS)
 		{
 			int32_t		ulen = -1;
 			UChar	   *uchar = NULL;
+			UChar		ubuf[HASH_SORTKEY_BUFSIZE];
 			Size		bsize;
-			uint8_t    *buf;
+			uint8_t		sbuf[HASH_SORTKEY_BUFSIZE * 2];
+			uint8_t    *buf = sbuf;
 
-			ulen = icu_to_uchar(&uchar, keydata, keylen);
+			/*
+			 * ASCII converts to the same UTF-16 in every server encoding, so
+			 * short ASCII keys can skip the converter and the allocations.
+			 */
+			if (keylen <= HASH_SORTKEY_BUFSIZE)
+			{
+				for (ulen = 0; ulen < keylen; ulen++)
+				{
+					if (IS_HIGHBIT_SET(keydata[ulen]))
+						break;
+					ubuf[ulen] = (UChar) keydata[ulen];
+				}
+				if (ulen == keylen)
+					uchar = ubuf;
+			}
+			if (uchar == NULL)
+				ulen = icu_to_uchar(&uchar, keydata, keylen);
 
 			bsize = ucol_getSortKey(mylocale->info.icu.ucol,
-									uchar, ulen, NULL, 0);
-			buf = palloc(bsize);
-			ucol_getSortKey(mylocale->info.icu.ucol,
-							uchar, ulen, buf, bsize);
+									uchar, ulen, sbuf, sizeof(sbuf));
+			if (bsize > sizeof(sbuf))
+			{
+				buf = palloc(bsize);
+				ucol_getSortKey(mylocale->info.icu.ucol,
+								uchar, ulen, buf, bsize);
+			}
 
 			result = hash_any(buf, bsize);
 
-			pfree(buf);
+			if (buf != sbuf)
+				pfree(buf);
+			if (uchar != ubuf)
+				pfree(uchar);
 		}
 		else
 #endif
@@ -39,6 +39,7 @@ bool	tds_ssl_encrypt = false;
 int 	tds_default_protocol_version = 0;
 int32_t tds_default_packet_size = 4096;
 int	tds_debug_log_level = 1;
+int	tds_send_ring_depth = 4;
 #ifdef FAULT_INJECTOR
 static bool TdsFaultInjectionEnabled = false;
 #endif
@@ -262,6 +263,19 @@ TdsDefineGucs(void)
 		NULL,
 		NULL);
 
+	DefineCustomIntVariable(
+		"babelfishpg_tds.tds_send_ring_depth",
+		gettext_noop("Sets the number of packets that can be waiting "
+			"to be sent to a client before the session blocks"),
+		NULL,
+		&tds_send_ring_depth,
+		4, 1, TDS_MAX_SEND_RING_DEPTH,
+		PGC_SIGHUP,
+		GUC_NOT_IN_SAMPLE,
+		NULL,
+		NULL,
+		NULL);
+
 	DefineCustomIntVariable(
 		"babelfishpg_tds.tds_debug_log_level",
 		gettext_noop("Sets the tds debug log level"),
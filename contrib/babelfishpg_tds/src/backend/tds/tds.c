@@ -34,8 +34,10 @@
 #include "storage/backendid.h"
 #include "storage/ipc.h"
 #include "storage/lwlock.h"
+#include "storage/proc.h"
 #include "storage/shmem.h"
 #include "storage/sinvaladt.h"
+#include "storage/spin.h"
 #include "utils/builtins.h"
 #include "utils/guc.h"
 #include "utils/elog.h"
@@ -118,6 +120,9 @@ typedef struct TdsStatus
 	int		encrypt_option;
 
 	int16		database_id;
+
+	/* Published by tdsstat_report_wire_stats() */
+	TdsWireStats wire_stats;
 } TdsStatus;
 
 typedef struct LocalTdsStatus
@@ -144,6 +149,29 @@ static TdsStatus *TdsStatusArray = NULL;
 static TdsStatus *MyTdsStatusEntry;
 static LocalTdsStatus *localTdsStatusTable = NULL;
 
+/* Wire-level counters of the connections that have ended */
+typedef struct TdsWireStatsTotals
+{
+	slock_t		mutex;
+	TdsWireStats stats;
+} TdsWireStatsTotals;
+
+static TdsWireStatsTotals *TdsEndedWireStats = NULL;
+
+static const char *const TdsStatRequestTypeNames[TDS_STAT_NUM_REQUEST_TYPES] = {
+	"SQL_BATCH",
+	"RPC_SP_EXECUTESQL",
+	"RPC_SP_PREPARE",
+	"RPC_SP_EXECUTE",
+	"RPC_SP_PREPEXEC",
+	"RPC_SP_UNPREPARE",
+	"RPC_SP_CURSOR",
+	"RPC_PROCEDURE",
+	"BULK_LOAD",
+	"TXN_MGMT",
+	"ATTENTION"
+};
+
 uint32_t MyTdsClientVersion = 0;
 uint32_t MyTdsClientPid = -1;
 char *MyTdsLibraryName = NULL;
@@ -181,6 +209,11 @@ static void tds_stats_shmem_shutdown(int code, Datum arg);
 
 static void tdsstat_read_current_status(void);
 static LocalTdsStatus * tdsstat_fetch_stat_local_tdsentry (int beid);
+static void AccumulateWireStats(TdsWireStats *dst, const TdsWireStats *src);
+static void PutWireStatsRow(Tuplestorestate *tupstore, TupleDesc tupdesc,
+							int pid, const TdsWireStats *stats);
+static void PutRequestStatsRows(Tuplestorestate *tupstore, TupleDesc tupdesc,
+								int pid, const TdsWireStats *stats);
 
 /*
  * Module initialization function
@@ -275,6 +308,7 @@ tds_memsize()
 	size = add_size(size, TdsLibraryNameBufferSize());
 	size = add_size(size, TdsHostNameBufferSize());
 	size = add_size(size, TdsLanguageBufferSize());
+	size = add_size(size, sizeof(TdsWireStatsTotals));
 	return size;
 }
 
@@ -363,6 +397,16 @@ tds_status_shmem_startup(void)
 		}
 	}
 
+	/* Create or attach to the counters of the ended connections */
+	TdsEndedWireStats = (TdsWireStatsTotals *)
+		ShmemInitStruct("TDS ended wire stats", sizeof(TdsWireStatsTotals), &found);
+
+	if (!found)
+	{
+		MemSet(TdsEndedWireStats, 0, sizeof(TdsWireStatsTotals));
+		SpinLockInit(&TdsEndedWireStats->mutex);
+	}
+
 	LWLockRelease(AddinShmemInitLock);
 
 	/* If we're in the postmaster (or a standalone backend...), set up a shmem
@@ -393,6 +437,23 @@ tds_stats_shmem_shutdown(int code, Datum arg)
 	if (TdsStatusArray == NULL)
 		return;
 
+	/*
+	 * Move the wire-level counters of this connection over to the totals of
+	 * the ended ones, so that they don't get lost or counted twice.
+	 */
+	if (MyTdsStatusEntry != NULL)
+	{
+		volatile TdsStatus *vtdsentry = MyTdsStatusEntry;
+
+		SpinLockAcquire(&TdsEndedWireStats->mutex);
+		AccumulateWireStats(&TdsEndedWireStats->stats, &TdsWireCounters);
+		SpinLockRelease(&TdsEndedWireStats->mutex);
+
+		PGSTAT_BEGIN_WRITE_ACTIVITY(vtdsentry);
+		MemSet(unvolatize(TdsWireStats *, &vtdsentry->wire_stats), 0, sizeof(TdsWireStats));
+		PGSTAT_END_WRITE_ACTIVITY(vtdsentry);
+	}
+
 	return;
 }
 
@@ -489,6 +550,7 @@ tdsstat_bestart(void)
 
 	ltdsentry.encrypt_option = MyTdsEncryptOption;
 	ltdsentry.database_id = 0;
+	memcpy(&ltdsentry.wire_stats, &TdsWireCounters, sizeof(TdsWireStats));
 
 	/*
 	 * We're ready to enter the critical section that fills the shared-memory
@@ -852,6 +914,210 @@ TdsSetDatabaseStatVariable(int16 db_id)
 	PGSTAT_END_WRITE_ACTIVITY(vtdsentry);
 }
 
+/*
+ * tdsstat_report_wire_stats - publish the wire-level counters of this
+ * connection
+ *
+ * Called once per response rather than from the send and receive paths, so
+ * that these only have to bump TdsWireCounters.
+ */
+void
+tdsstat_report_wire_stats(void)
+{
+	volatile TdsStatus *vtdsentry = MyTdsStatusEntry;
+
+	PGSTAT_BEGIN_WRITE_ACTIVITY(vtdsentry);
+
+	memcpy(unvolatize(TdsWireStats *, &vtdsentry->wire_stats),
+		   &TdsWireCounters,
+		   sizeof(TdsWireStats));
+
+	PGSTAT_END_WRITE_ACTIVITY(vtdsentry);
+}
+
+/*
+ * tdsstat_count_request - count a request and the time it took to process
+ */
+void
+tdsstat_count_request(TdsStatRequestType type, uint64 durationUs)
+{
+	TdsRequestStats *stats = &TdsWireCounters.requests[type];
+	uint64		bound = 100;
+	int			i;
+
+	stats->count++;
+	stats->totalUs += durationUs;
+	if (durationUs > stats->maxUs)
+		stats->maxUs = durationUs;
+
+	for (i = 0; i < TDS_STAT_NUM_LATENCY_BUCKETS - 1 && durationUs >= bound; i++)
+		bound *= 10;
+	stats->latency[i]++;
+}
+
+static void
+AccumulateWireStats(TdsWireStats *dst, const TdsWireStats *src)
+{
+	int			i;
+	int			j;
+
+	dst->bytesSent += src->bytesSent;
+	dst->packetsSent += src->packetsSent;
+	dst->writes += src->writes;
+	dst->flushes += src->flushes;
+	dst->sendWaitUs += src->sendWaitUs;
+	dst->stalls += src->stalls;
+	dst->bytesReceived += src->bytesReceived;
+	dst->packetsReceived += src->packetsReceived;
+	dst->reads += src->reads;
+	dst->recvWaitUs += src->recvWaitUs;
+	dst->rowTokens += src->rowTokens;
+	dst->colMetadataTokens += src->colMetadataTokens;
+	dst->doneTokens += src->doneTokens;
+	dst->infoTokens += src->infoTokens;
+	dst->errorTokens += src->errorTokens;
+	dst->envChangeTokens += src->envChangeTokens;
+	dst->returnValueTokens += src->returnValueTokens;
+	dst->returnStatusTokens += src->returnStatusTokens;
+
+	for (i = 0; i < TDS_STAT_NUM_REQUEST_TYPES; i++)
+	{
+		dst->requests[i].count += src->requests[i].count;
+		dst->requests[i].totalUs += src->requests[i].totalUs;
+		dst->requests[i].maxUs = Max(dst->requests[i].maxUs, src->requests[i].maxUs);
+		for (j = 0; j < TDS_STAT_NUM_LATENCY_BUCKETS; j++)
+			dst->requests[i].latency[j] += src->requests[i].latency[j];
+	}
+}
+
+static void
+PutWireStatsRow(Tuplestorestate *tupstore, TupleDesc tupdesc,
+				int pid, const TdsWireStats *stats)
+{
+	Datum		values[19];
+	bool		nulls[19];
+
+	Assert(tupdesc->natts == lengthof(values));
+	MemSet(nulls, false, sizeof(nulls));
+
+	/* The connections that have ended have no session id */
+	if (pid != 0)
+		values[0] = Int32GetDatum(pid);
+	else
+		nulls[0] = true;
+
+	values[1] = Int64GetDatum(stats->bytesSent);
+	values[2] = Int64GetDatum(stats->packetsSent);
+	values[3] = Int64GetDatum(stats->writes);
+	values[4] = Int64GetDatum(stats->flushes);
+	values[5] = Int64GetDatum(stats->sendWaitUs);
+	values[6] = Int64GetDatum(stats->stalls);
+	values[7] = Int64GetDatum(stats->bytesReceived);
+	values[8] = Int64GetDatum(stats->packetsReceived);
+	values[9] = Int64GetDatum(stats->reads);
+	values[10] = Int64GetDatum(stats->recvWaitUs);
+	values[11] = Int64GetDatum(stats->rowTokens);
+	values[12] = Int64GetDatum(stats->colMetadataTokens);
+	values[13] = Int64GetDatum(stats->doneTokens);
+	values[14] = Int64GetDatum(stats->infoTokens);
+	values[15] = Int64GetDatum(stats->errorTokens);
+	values[16] = Int64GetDatum(stats->envChangeTokens);
+	values[17] = Int64GetDatum(stats->returnValueTokens);
+	values[18] = Int64GetDatum(stats->returnStatusTokens);
+
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+}
+
+static void
+PutRequestStatsRows(Tuplestorestate *tupstore, TupleDesc tupdesc,
+					int pid, const TdsWireStats *stats)
+{
+	int			i;
+	int			j;
+
+	for (i = 0; i < TDS_STAT_NUM_REQUEST_TYPES; i++)
+	{
+		const TdsRequestStats *req = &stats->requests[i];
+		Datum		values[5 + TDS_STAT_NUM_LATENCY_BUCKETS];
+		bool		nulls[5 + TDS_STAT_NUM_LATENCY_BUCKETS];
+
+		if (req->count == 0)
+			continue;
+
+		Assert(tupdesc->natts == lengthof(values));
+		MemSet(nulls, false, sizeof(nulls));
+
+		if (pid != 0)
+			values[0] = Int32GetDatum(pid);
+		else
+			nulls[0] = true;
+
+		values[1] = CStringGetTextDatum(TdsStatRequestTypeNames[i]);
+		values[2] = Int64GetDatum(req->count);
+		values[3] = Int64GetDatum(req->totalUs);
+		values[4] = Int64GetDatum(req->maxUs);
+		for (j = 0; j < TDS_STAT_NUM_LATENCY_BUCKETS; j++)
+			values[5 + j] = Int64GetDatum(req->latency[j]);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+}
+
+/*
+ * Walk the TDS connections that are still alive, or only the one of the
+ * given pid, and hand their wire-level counters to 'put'.  With pid -1 the
+ * connections that have ended are reported as well, with no session id.
+ */
+static void
+tds_stat_put_wire_stats(Tuplestorestate *tupstore, TupleDesc tupdesc, int pid,
+						void (*put) (Tuplestorestate *, TupleDesc, int, const TdsWireStats *))
+{
+	int			beid;
+
+	tdsstat_read_current_status();
+
+	for (beid = 1; beid <= localNumBackends; beid++)
+	{
+		TdsStatus  *tdsentry = &localTdsStatusTable[beid - 1].tdsStatus;
+		PGPROC	   *proc;
+
+		if (tdsentry->st_procpid <= 0)
+			continue;
+		if (pid != -1 && tdsentry->st_procpid != pid)
+			continue;
+
+		/* Entries are left behind when the connection ends */
+		proc = BackendIdGetProc(beid);
+		if (proc == NULL || proc->pid != tdsentry->st_procpid)
+			continue;
+
+		put(tupstore, tupdesc, tdsentry->st_procpid, &tdsentry->wire_stats);
+	}
+
+	if (pid == -1)
+	{
+		TdsWireStats ended;
+
+		SpinLockAcquire(&TdsEndedWireStats->mutex);
+		memcpy(&ended, &TdsEndedWireStats->stats, sizeof(TdsWireStats));
+		SpinLockRelease(&TdsEndedWireStats->mutex);
+
+		put(tupstore, tupdesc, 0, &ended);
+	}
+}
+
+void
+tds_stat_get_wire_stats(Tuplestorestate *tupstore, TupleDesc tupdesc, int pid)
+{
+	tds_stat_put_wire_stats(tupstore, tupdesc, pid, PutWireStatsRow);
+}
+
+void
+tds_stat_get_request_stats(Tuplestorestate *tupstore, TupleDesc tupdesc, int pid)
+{
+	tds_stat_put_wire_stats(tupstore, tupdesc, pid, PutRequestStatsRows);
+}
+
 /*
  * For table-valued parameter that's not handled by pltsql, we set up a hook so
  * that we can look up a TVP's underlying table.
@@ -197,6 +197,8 @@ pe_tds_init(void)
 	pltsql_plugin_handler_ptr->get_stat_values = &tds_stat_get_activity;
 	pltsql_plugin_handler_ptr->invalidate_stat_view = &invalidate_stat_table;
 	pltsql_plugin_handler_ptr->get_host_name = &get_tds_host_name;
+	pltsql_plugin_handler_ptr->get_wire_stats = &tds_stat_get_wire_stats;
+	pltsql_plugin_handler_ptr->get_request_stats = &tds_stat_get_request_stats;
 
 	invalidate_stat_table_hook = invalidate_stat_table;
 	guc_newval_hook = TdsSetGucStatVariable;
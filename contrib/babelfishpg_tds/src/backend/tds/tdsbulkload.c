@@ -20,6 +20,7 @@
 #include "utils/guc.h"
 #include "lib/stringinfo.h"
 #include "pgstat.h"
+#include "utils/memutils.h"
 
 #include "src/include/tds_instr.h"
 #include "src/include/tds_int.h"
@@ -33,6 +34,7 @@ void ProcessBCPRequest(TDSRequest request);
 static void FetchMoreBcpData(StringInfo *message, int dataLenToRead);
 static void FetchMoreBcpPlpData(StringInfo *message, int dataLenToRead);
 static int ReadBcpPlp(ParameterToken temp, StringInfo *message, TDSRequestBulkLoad request);
+static void EnlargeBulkLoadRowData(TDSRequestBulkLoad request);
 uint64_t offset = 0;
 
 #define COLUMNMETADATA_HEADER_LEN			sizeof(uint32_t) + sizeof(uint16) + 1
@@ -90,6 +92,7 @@ static void
 FetchMoreBcpData(StringInfo *message, int dataLenToRead)
 {
 	StringInfo temp;
+	MemoryContext oldcontext;
 	int ret;
 
 	/* Unlikely that message will be NULL. */
@@ -107,8 +110,14 @@ FetchMoreBcpData(StringInfo *message, int dataLenToRead)
 				(errcode(ERRCODE_PROTOCOL_VIOLATION),
 					errmsg("Trying to read more data than available in BCP request.")));
 
+	/*
+	 * The message outlives the batch arena we may be decoding in, so keep
+	 * the new buffer in the same context as the old one.
+	 */
+	oldcontext = MemoryContextSwitchTo(GetMemoryChunkContext(*message));
 	temp = makeStringInfo();
 	appendBinaryStringInfo(temp, (*message)->data + offset, (*message)->len - offset);
+	MemoryContextSwitchTo(oldcontext);
 
 	if ((*message)->data)
 		pfree((*message)->data);
@@ -212,7 +221,6 @@ GetBulkLoadRequest(StringInfo message)
 	TDSInstrumentation(INSTR_TDS_BULK_LOAD_REQUEST);
 
 	request = palloc0(sizeof(TDSRequestBulkLoadData));
-	request->rowData 		= NIL;
 	request->reqType 		= TDS_REQUEST_BULK_LOAD;
 
 	if(unlikely((uint8_t)message->data[offset] != TDS_TOKEN_COLMETADATA))
@@ -466,9 +474,18 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 	BulkLoadColMetaData *colmetadata = request->colMetaData;
 	int retStatus = 0;
 	uint32_t len;
-	StringInfo temp = palloc0(sizeof(StringInfoData));
+	StringInfo temp;
+	MemoryContext oldcontext;
+
+	/*
+	 * Everything decoded for the previous batch has been inserted by now, so
+	 * recycle its memory instead of freeing it piecemeal.
+	 */
+	MemoryContextReset(request->batchContext);
+	oldcontext = MemoryContextSwitchTo(request->batchContext);
+
+	temp = palloc0(sizeof(StringInfoData));
 	request->rowCount = 0;
-	request->rowData = NIL;
 	request->currentBatchSize = 0;
 
 	CheckMessageHasEnoughBytesToRead(&message, 1);
@@ -479,11 +496,17 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 			&& request->rowCount < pltsql_plugin_handler_ptr->get_insert_bulk_rows_per_batch())
 	{
 		int i = 0; /* Current Column Number. */
-		BulkLoadRowData *rowData = palloc0(sizeof(BulkLoadRowData));
-		request->rowCount++;
+		Datum *values;
+		bool *nulls;
 
-		rowData->columnValues = palloc0(request->colCount * sizeof(Datum));
-		rowData->isNull 	  = palloc0(request->colCount * sizeof(bool));
+		if (request->rowCount == request->rowCapacity)
+			EnlargeBulkLoadRowData(request);
+
+		/* Decode straight into this row's slice of the batch arrays. */
+		values = &request->rowValues[request->rowCount * request->colCount];
+		nulls = &request->rowNulls[request->rowCount * request->colCount];
+		MemSet(nulls, false, request->colCount * sizeof(bool));
+		request->rowCount++;
 
 		offset++;
 		request->currentBatchSize++;
@@ -516,7 +539,7 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 
 						if (len == 0) /* null */
 						{
-							rowData->isNull[i] = true;
+							nulls[i] = true;
 							i++;
 							continue;
 						}
@@ -536,37 +559,37 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 					{
 						case TDS_TYPE_INTEGER:
 						case TDS_TYPE_BIT:
-							rowData->columnValues[i] = TdsTypeIntegerToDatum(temp, colmetadata[i].maxLen);
+							values[i] = TdsTypeIntegerToDatum(temp, colmetadata[i].maxLen);
 						break;
 						case TDS_TYPE_FLOAT:
-							rowData->columnValues[i] = TdsTypeFloatToDatum(temp, colmetadata[i].maxLen);
+							values[i] = TdsTypeFloatToDatum(temp, colmetadata[i].maxLen);
 						break;
 						case TDS_TYPE_TIME:
-							rowData->columnValues[i] = TdsTypeTimeToDatum(temp, colmetadata[i].scale, len);
+							values[i] = TdsTypeTimeToDatum(temp, colmetadata[i].scale, len);
 						break;
 						case TDS_TYPE_DATE:
-							rowData->columnValues[i] = TdsTypeDateToDatum(temp);
+							values[i] = TdsTypeDateToDatum(temp);
 						break;
 						case TDS_TYPE_DATETIME2:
-							rowData->columnValues[i] = TdsTypeDatetime2ToDatum(temp, colmetadata[i].scale, temp->len);
+							values[i] = TdsTypeDatetime2ToDatum(temp, colmetadata[i].scale, temp->len);
 						break;
 						case TDS_TYPE_DATETIMEN:
 							if (colmetadata[i].maxLen == TDS_MAXLEN_SMALLDATETIME)
-								rowData->columnValues[i] = TdsTypeSmallDatetimeToDatum(temp);
+								values[i] = TdsTypeSmallDatetimeToDatum(temp);
 							else
-								rowData->columnValues[i] = TdsTypeDatetimeToDatum(temp);
+								values[i] = TdsTypeDatetimeToDatum(temp);
 						break;
 						case TDS_TYPE_DATETIMEOFFSET:
-							rowData->columnValues[i] = TdsTypeDatetimeoffsetToDatum(temp, colmetadata[i].scale, temp->len);
+							values[i] = TdsTypeDatetimeoffsetToDatum(temp, colmetadata[i].scale, temp->len);
 						break;
 						case TDS_TYPE_MONEYN:
 							if (colmetadata[i].maxLen == TDS_MAXLEN_SMALLMONEY)
-								rowData->columnValues[i] = TdsTypeSmallMoneyToDatum(temp);
+								values[i] = TdsTypeSmallMoneyToDatum(temp);
 							else
-								rowData->columnValues[i] = TdsTypeMoneyToDatum(temp);
+								values[i] = TdsTypeMoneyToDatum(temp);
 						break;
 						case TDS_TYPE_UNIQUEIDENTIFIER:
-							rowData->columnValues[i] = TdsTypeUIDToDatum(temp);
+							values[i] = TdsTypeUIDToDatum(temp);
 						break;
 					}
 
@@ -591,7 +614,7 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 					request->currentBatchSize++;
 					if (len == 0) /* null */
 					{
-						rowData->isNull[i] = true;
+						nulls[i] = true;
 						i++;
 						continue;
 					}
@@ -607,7 +630,7 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 					temp->cursor = 0;
 
 					/* Create and store the appropriate datum for this column. */
-					rowData->columnValues[i] = TdsTypeNumericToDatum(temp, colmetadata[i].scale);
+					values[i] = TdsTypeNumericToDatum(temp, colmetadata[i].scale);
 
 					offset += len;
 					request->currentBatchSize += len;
@@ -644,7 +667,7 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 						}
 						else /* null */
 						{
-							rowData->isNull[i] = true;
+							nulls[i] = true;
 							i++;
 							continue;
 						}
@@ -658,7 +681,7 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 						CheckPLPStatusNotOK(request, retStatus, i);
 						if (token->isNull) /* null */
 						{
-							rowData->isNull[i] = true;
+							nulls[i] = true;
 							i++;
 							token->isNull = false;
 							continue;
@@ -675,15 +698,15 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 					{
 						case TDS_TYPE_CHAR:
 						case TDS_TYPE_VARCHAR:
-							rowData->columnValues[i] = TdsTypeVarcharToDatum(temp, colmetadata[i].collation, colmetadata[i].columnTdsType);
+							values[i] = TdsTypeVarcharToDatum(temp, colmetadata[i].collation, colmetadata[i].columnTdsType);
 						break;
 						case TDS_TYPE_NCHAR:
 						case TDS_TYPE_NVARCHAR:
-							rowData->columnValues[i] = TdsTypeNCharToDatum(temp);
+							values[i] = TdsTypeNCharToDatum(temp);
 						break;
 						case TDS_TYPE_BINARY:
 						case TDS_TYPE_VARBINARY:
-							rowData->columnValues[i] = TdsTypeVarbinaryToDatum(temp);
+							values[i] = TdsTypeVarbinaryToDatum(temp);
 						break;
 					}
 					/*
@@ -706,7 +729,7 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 					request->currentBatchSize++;
 					if (dataTextPtrLen == 0) /* null */
 					{
-						rowData->isNull[i] = true;
+						nulls[i] = true;
 						i++;
 						continue;
 					}
@@ -723,7 +746,7 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 					request->currentBatchSize += sizeof(uint32_t);
 					if (len == 0) /* null */
 					{
-						rowData->isNull[i] = true;
+						nulls[i] = true;
 						i++;
 						continue;
 					}
@@ -742,13 +765,13 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 					switch(colmetadata[i].columnTdsType)
 					{
 						case TDS_TYPE_TEXT:
-							rowData->columnValues[i] = TdsTypeVarcharToDatum(temp, colmetadata[i].collation, colmetadata[i].columnTdsType);
+							values[i] = TdsTypeVarcharToDatum(temp, colmetadata[i].collation, colmetadata[i].columnTdsType);
 						break;
 						case TDS_TYPE_NTEXT:
-							rowData->columnValues[i] = TdsTypeNCharToDatum(temp);
+							values[i] = TdsTypeNCharToDatum(temp);
 						break;
 						case TDS_TYPE_IMAGE:
-							rowData->columnValues[i] = TdsTypeVarbinaryToDatum(temp);
+							values[i] = TdsTypeVarbinaryToDatum(temp);
 						break;
 					}
 
@@ -764,7 +787,7 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 					CheckPLPStatusNotOK(request, retStatus, i);
 					if (token->isNull) /* null */
 					{
-						rowData->isNull[i] = true;
+						nulls[i] = true;
 						i++;
 						token->isNull = false;
 						continue;
@@ -773,7 +796,7 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 					pfree(temp);
 					temp = TdsGetPlpStringInfoBufferFromToken(message->data, token);
 					/* Create and store the appropriate datum for this column. */
-					rowData->columnValues[i] = TdsTypeXMLToDatum(temp);
+					values[i] = TdsTypeXMLToDatum(temp);
 
 					/* We do not free temp pointer since it can be re-used for the next iteration. */
 					pfree(temp->data);
@@ -790,7 +813,7 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 
 					if (len == 0) /* null */
 					{
-						rowData->isNull[i] = true;
+						nulls[i] = true;
 						i++;
 						continue;
 					}
@@ -806,7 +829,7 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 					temp->cursor = 0;
 
 					/* Create and store the appropriate datum for this column. */
-					rowData->columnValues[i] = TdsTypeSqlVariantToDatum(temp);
+					values[i] = TdsTypeSqlVariantToDatum(temp);
 
 					offset += len;
 					request->currentBatchSize += len;
@@ -815,7 +838,6 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 			}
 			i++;
 		}
-		request->rowData = lappend(request->rowData, rowData);
 		CheckMessageHasEnoughBytesToRead(&message, 1);
 	}
 
@@ -835,6 +857,7 @@ SetBulkLoadRowData(TDSRequestBulkLoad request, StringInfo message)
 						request->rowCount, (uint8_t)message->data[offset])));
 
 	pfree(temp);
+	MemoryContextSwitchTo(oldcontext);
 	return message;
 }
 
@@ -853,14 +876,13 @@ ProcessBCPRequest(TDSRequest request)
 	TdsErrorContext->err_text = "Processing Bulk Load Request";
 	pgstat_report_activity(STATE_RUNNING, "Processing Bulk Load Request");
 
+	/* Arena for the decoded values of one batch, reset before every batch. */
+	req->batchContext = AllocSetContextCreate(CurrentMemoryContext,
+											  "TDS Bulk Load Batch",
+											  ALLOCSET_DEFAULT_SIZES);
+
 	while (1)
 	{
-		int nargs = 0;
-		Datum *values = NULL;
-		bool *nulls = NULL;
-		int count = 0;
-		ListCell 	*lc;
-
 		PG_TRY();
 		{
 			message = SetBulkLoadRowData(req, message);
@@ -896,30 +918,12 @@ ProcessBCPRequest(TDSRequest request)
 			break;
 		}
 
-		nargs = req->colCount * req->rowCount;
-		values = palloc0(nargs * sizeof(Datum));
-		nulls = palloc0(nargs * sizeof(bool));
-
-		/* Flaten and create a 1-D array of Value & Datums */
-		foreach (lc, req->rowData)
-		{
-			BulkLoadRowData *row = (BulkLoadRowData *) lfirst(lc);
-			for(int currentColumn = 0; currentColumn < req->colCount; currentColumn++)
-			{
-				if (row->isNull[currentColumn]) /* null */
-					nulls[count] = row->isNull[currentColumn];
-				else
-					values[count] = row->columnValues[currentColumn];
-				count++;
-			}
-		}
-
-		if (req->rowData) /* If any row exists then do an insert. */
+		if (req->rowCount > 0) /* If any row exists then do an insert. */
 		{
 			PG_TRY();
 			{
 				retValue += pltsql_plugin_handler_ptr->bulk_load_callback(req->colCount,
-											req->rowCount, values, nulls);
+											req->rowCount, req->rowValues, req->rowNulls);
 			}
 			PG_CATCH();
 			{
@@ -951,16 +955,12 @@ ProcessBCPRequest(TDSRequest request)
 				PG_RE_THROW();
 			}
 			PG_END_TRY();
-			/* Free the List of Rows. */
-			list_free_deep(req->rowData);
-			req->rowData = NIL;
-			if (values)
-				pfree(values);
-			if (nulls)
-				pfree(nulls);
 		}
 	}
 
+	MemoryContextDelete(req->batchContext);
+	req->batchContext = NULL;
+
 	/* Send Done Token if rows processed is a positive number. Command type - execute (0xf0). */
 	if (retValue >= 0)
 		TdsSendDone(TDS_TOKEN_DONE, TDS_DONE_COUNT, 0xf0, retValue);
@@ -985,6 +985,38 @@ ProcessBCPRequest(TDSRequest request)
 	offset = 0;
 }
 
+/*
+ * EnlargeBulkLoadRowData - Grows the flattened row arrays of the request.
+ *
+ * The arrays live outside the batch arena and keep their size across
+ * batches, so after the first batch of a load no further allocation is
+ * needed.
+ */
+static void
+EnlargeBulkLoadRowData(TDSRequestBulkLoad request)
+{
+	MemoryContext oldcontext;
+	int 		newCapacity;
+
+	oldcontext = MemoryContextSwitchTo(GetMemoryChunkContext(request));
+	newCapacity = Max(request->rowCapacity * 2, 64);
+	newCapacity = Min(newCapacity, pltsql_plugin_handler_ptr->get_insert_bulk_rows_per_batch());
+	newCapacity = Max(newCapacity, request->rowCount + 1);
+
+	if (request->rowValues == NULL)
+	{
+		request->rowValues = palloc(newCapacity * request->colCount * sizeof(Datum));
+		request->rowNulls = palloc(newCapacity * request->colCount * sizeof(bool));
+	}
+	else
+	{
+		request->rowValues = repalloc(request->rowValues, newCapacity * request->colCount * sizeof(Datum));
+		request->rowNulls = repalloc(request->rowNulls, newCapacity * request->colCount * sizeof(bool));
+	}
+	request->rowCapacity = newCapacity;
+	MemoryContextSwitchTo(oldcontext);
+}
+
 static int
 ReadBcpPlp(ParameterToken temp, StringInfo *message, TDSRequestBulkLoad request)
 {
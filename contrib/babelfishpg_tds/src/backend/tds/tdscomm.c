@@ -26,35 +26,77 @@
 #include "utils/guc.h"
 #include "utils/memutils.h"
 
+#include "portability/instr_time.h"
+
 #include "src/include/tds_debug.h"
 #include "src/include/tds_int.h"
+#include "src/include/guc.h"
 #include "src/include/faultinjection.h"
 
 /* Globals */
 MemoryContext	TdsMemoryContext = NULL;
+TdsWireStats	TdsWireCounters;
 
+/*
+ * Socket buffers and the request buffer live in a context of their own, which
+ * unlike TdsMemoryContext is not reset when the connection is reset, so that
+ * a pooled connection keeps them from one client to the next.
+ */
+static MemoryContext TdsCommMemoryContext = NULL;
 
 static uint32_t TdsBufferSize;
-static char		*TdsSendBuffer;
+static char		*TdsSendBuffer;		/* Packet being filled, one of the ring */
 static int		TdsSendCur;			/* Next index to store a byte in TdsSendBuffer */
-static int		TdsSendStart;		/* Next index to send a byte in TdsSendBuffer */
 static uint8_t	TdsSendMessageType; /* Current TDS message in progress */
 
+/*
+ * Output ring.  Complete packets are queued here and sent whenever the
+ * socket takes them without blocking, so that we only have to wait for the
+ * client once all of the ring is waiting to be sent.
+ */
+static char		*TdsSendRing;		/* TdsSendRingDepth packets of TdsBufferSize */
+static int		*TdsSendRingLen;	/* Length of each queued packet */
+static int		TdsSendRingDepth;
+static int		TdsSendRingHead;	/* Oldest queued packet */
+static int		TdsSendRingQueued;	/* Number of queued packets */
+static int		TdsSendStart;		/* Bytes of the oldest queued packet sent */
+
+#define TdsSendRingSlot(i) \
+	(TdsSendRing + (size_t) ((i) % TdsSendRingDepth) * TdsBufferSize)
+
 static bool		TdsDoProcessHeader;	/* Header is processed or not. */
 static char		*TdsRecvBuffer;
 static int		TdsRecvStart;		/* Next index to read a byte from TdsRecvBuffer */
 static int		TdsRecvEnd;			/* End of data available in TdsRecvBuffer */
 static uint8_t	TdsRecvMessageType; /* Current TDS message in progress */
 static uint8_t	TdsRecvPacketStatus;
+
+/*
+ * Requests are put together in TdsMessage, which is kept from one request to
+ * the next instead of being grown from scratch every time.  If the requests
+ * of a while have all been much smaller than it, it is shrunk back.
+ */
+#define TDS_MESSAGE_INITIAL_SIZE	8192
+#define TDS_MESSAGE_SHRINK_WINDOW	64
+
+static StringInfoData TdsMessage;
+static int		TdsMessageHighWater;	/* Largest request in this window */
+static int		TdsMessageCount;		/* Requests in this window */
 static int		TdsLeftInPacket;
+static bool		TdsRecvIdle;		/* Waiting for the client to start a request */
 
 static TdsSecureSocketApi tds_secure_read;
 static TdsSecureSocketApi tds_secure_write;
+static TdsSecureSocketVecApi tds_secure_writev;
 
 
 /* Internal functions */
 static void		SocketSetNonblocking(bool nonblocking);
 static int		InternalFlush(bool);
+static int		InternalSend(bool block);
+static int		InternalSendBlocking(void);
+static int		InternalFlushWithData(char *data, size_t len);
+static void		TdsAllocSendRing(void);
 static void		TdsConsumedBytes(int bytes);
 
 /* Inline functions */
@@ -73,14 +115,30 @@ InternalPutbytes(void *bytes, size_t len)
 
 	while (len > 0)
 	{
-		/* If buffer is full, then flush it out */
+		/* If buffer is full, then queue it for sending */
 		if (TdsSendCur >= TdsBufferSize)
 		{
-			SocketSetNonblocking(false);
 			if (InternalFlush(false))
 				return EOF;
 		}
 		amount = TdsBufferSize - TdsSendCur;
+
+		/*
+		 * If the data doesn't fit, send the packet with the rest of it taken
+		 * straight from the caller's memory.  More data follows, so this is
+		 * never the last packet.  With TLS, the packet has to be put together
+		 * in the buffer anyway.
+		 */
+		if (amount < len && TdsSendRingQueued == 0 && !MyProcPort->ssl_in_use)
+		{
+			SocketSetNonblocking(false);
+			if (InternalFlushWithData((char *) s, amount))
+				return EOF;
+			s += amount;
+			len -= amount;
+			continue;
+		}
+
 		if (amount > len)
 			amount = len;
 		memcpy(TdsSendBuffer + TdsSendCur, s, amount);
@@ -159,10 +217,25 @@ TdsReadsocket(void)
 	for (;;)
 	{
 		int			r;
+		instr_time	start;
+		instr_time	duration;
 
+		INSTR_TIME_SET_CURRENT(start);
 		r = tds_secure_read(MyProcPort, TdsRecvBuffer + TdsRecvEnd,
 							TdsBufferSize - TdsRecvEnd);
 
+		/*
+		 * Time spent waiting for the next request is the client's think
+		 * time, only count reads in the middle of one.
+		 */
+		if (!TdsRecvIdle)
+		{
+			INSTR_TIME_SET_CURRENT(duration);
+			INSTR_TIME_SUBTRACT(duration, start);
+			TdsWireCounters.reads++;
+			TdsWireCounters.recvWaitUs += INSTR_TIME_GET_MICROSEC(duration);
+		}
+
 		if (r < 0)
 		{
 			if (errno == EINTR)
@@ -188,6 +261,8 @@ TdsReadsocket(void)
 		}
 		/* r contains number of bytes read, so just incr length */
 		TdsRecvEnd += r;
+		TdsRecvIdle = false;
+		TdsWireCounters.bytesReceived += r;
 		return 0;
 	}
 
@@ -235,6 +310,7 @@ TdsProcessHeader(void)
 
 	TdsLeftInPacket = data16 - TDS_PACKET_HEADER_SIZE;
 	TdsRecvStart += TDS_PACKET_HEADER_SIZE;
+	TdsWireCounters.packetsReceived++;
 
 	/* [BABEL-648] TDS packet with no TDS data is valid packet.*/
 	if (TdsLeftInPacket < 0)
@@ -330,7 +406,7 @@ TdsFillHeader(bool lastPacket)
 	/* Packet status */
 	TdsSendBuffer[1] = (lastPacket) ? 0x1 : 0x0;
 	/* Packet length including header */
-	net16 = pg_hton16(TdsSendCur - TdsSendStart);
+	net16 = pg_hton16(TdsSendCur);
 	memcpy(TdsSendBuffer + 2, &net16, sizeof(net16));
 	net16 = 0;
 	memcpy(TdsSendBuffer + 4, &net16, sizeof(net16)); /* TODO  get server pid */
@@ -339,36 +415,111 @@ TdsFillHeader(bool lastPacket)
 }
 
 /* --------------------------------
- *	InternalFlush - flush pending output
+ *	InternalFlush - queue the current packet for sending
  *
- * Returns 0 if OK (meaning everything was sent, or operation would block
- * and the socket is in non-blocking mode), or EOF if trouble.
+ * The last packet of a message is sent right away, together with anything
+ * else queued, and so are all queued packets if the ring is full.  Other
+ * than that we only send what the socket takes without blocking.
+ *
+ * Returns 0 if OK, or EOF if trouble.
  * --------------------------------
  */
 static int
 InternalFlush(bool lastPacket)
 {
-	static int	lastReportedSendErrno = 0;
+	int			rc;
 
-	char	   *bufptr = TdsSendBuffer + TdsSendStart;
-	char	   *bufend = TdsSendBuffer + TdsSendCur;
+	TdsErrorContext->err_text = "TDS InternalFlush - Sending data to the client";
 
-      TdsErrorContext->err_text = "TDS InternalFlush - Sending data to the client";
-	/* Writing the packet for the first time */
-	if (TdsSendStart == 0)
-	{
-		TdsFillHeader(lastPacket);
-	}
+	TdsFillHeader(lastPacket);
+	TdsSendRingLen[(TdsSendRingHead + TdsSendRingQueued) % TdsSendRingDepth] = TdsSendCur;
+	TdsSendRingQueued++;
 
 	if (lastPacket)
+	{
 		TdsSendMessageType = 0;
+		rc = InternalSendBlocking();
+	}
+	else
+	{
+		rc = InternalSend(false);
+
+		if (rc == 0 && TdsSendRingQueued == TdsSendRingDepth)
+		{
+			/* No room for the next packet, wait for the client */
+			TdsWireCounters.stalls++;
+			rc = InternalSendBlocking();
+		}
+	}
+
+	/* Start the next packet */
+	TdsSendBuffer = TdsSendRingSlot(TdsSendRingHead + TdsSendRingQueued);
+	TdsSendCur = TDS_PACKET_HEADER_SIZE;
+
+	/* Pick up a new ring depth between messages */
+	if (lastPacket && TdsSendRingQueued == 0 &&
+		TdsSendRingDepth != tds_send_ring_depth)
+		TdsAllocSendRing();
+
+	return rc;
+}
+
+/* --------------------------------
+ *	InternalSend - send queued packets
+ *
+ * In blocking mode, sends all of them.  Otherwise, sends as much as the
+ * socket takes without blocking.  Queued packets go out with a single
+ * writev(), or with TLS, a single write of those that are adjacent in
+ * memory.
+ *
+ * Returns 0 if OK (meaning everything was sent, or operation would block
+ * and we're not blocking), or EOF if trouble.
+ * --------------------------------
+ */
+static int
+InternalSend(bool block)
+{
+	static int	lastReportedSendErrno = 0;
+
+	SocketSetNonblocking(!block);
 
-	while (bufptr < bufend)
+	while (TdsSendRingQueued > 0)
 	{
-		int			r;
+		ssize_t		r;
+		int			i;
+
+		if (!MyProcPort->ssl_in_use)
+		{
+			struct iovec iov[TDS_MAX_SEND_RING_DEPTH];
+
+			for (i = 0; i < TdsSendRingQueued; i++)
+			{
+				int			slot = (TdsSendRingHead + i) % TdsSendRingDepth;
+
+				iov[i].iov_base = TdsSendRingSlot(slot);
+				iov[i].iov_len = TdsSendRingLen[slot];
+				DebugPrintBytes("TDS InternalSend", iov[i].iov_base, iov[i].iov_len);
+			}
+			iov[0].iov_base = (char *) iov[0].iov_base + TdsSendStart;
+			iov[0].iov_len -= TdsSendStart;
+
+			r = tds_secure_writev(MyProcPort, iov, TdsSendRingQueued);
+		}
+		else
+		{
+			char	   *bufptr = TdsSendRingSlot(TdsSendRingHead) + TdsSendStart;
+			size_t		len = TdsSendRingLen[TdsSendRingHead] - TdsSendStart;
+
+			/* Full packets that don't wrap around are contiguous */
+			for (i = 1; i < TdsSendRingQueued &&
+					TdsSendRingHead + i < TdsSendRingDepth &&
+					TdsSendRingLen[TdsSendRingHead + i - 1] == TdsBufferSize; i++)
+				len += TdsSendRingLen[TdsSendRingHead + i];
 
-		DebugPrintBytes("TDS InternalFlush", bufptr, bufend - bufptr);
-		r = tds_secure_write(MyProcPort, bufptr, bufend - bufptr);
+			DebugPrintBytes("TDS InternalSend", bufptr, len);
+			r = tds_secure_write(MyProcPort, bufptr, len);
+		}
+		TdsWireCounters.writes++;
 
 		if (r <= 0)
 		{
@@ -408,7 +559,10 @@ InternalFlush(bool lastPacket)
 			 * flag that'll cause the next CHECK_FOR_INTERRUPTS to terminate
 			 * the connection.
 			 */
+			TdsSendRingHead = (TdsSendRingHead + TdsSendRingQueued) % TdsSendRingDepth;
+			TdsSendRingQueued = 0;
 			TdsSendStart = 0;
+			TdsSendBuffer = TdsSendRingSlot(TdsSendRingHead);
 			TdsSendCur = TDS_PACKET_HEADER_SIZE;
 			ClientConnectionLost = 1;
 			InterruptPending = 1;
@@ -416,15 +570,161 @@ InternalFlush(bool lastPacket)
 		}
 
 		lastReportedSendErrno = 0;	/* reset after any successful send */
-		bufptr += r;
+
+		/* Retire the packets that are completely sent */
+		TdsWireCounters.bytesSent += r;
 		TdsSendStart += r;
+		while (TdsSendRingQueued > 0 &&
+			   TdsSendStart >= TdsSendRingLen[TdsSendRingHead])
+		{
+			TdsSendStart -= TdsSendRingLen[TdsSendRingHead];
+			TdsSendRingHead = (TdsSendRingHead + 1) % TdsSendRingDepth;
+			TdsSendRingQueued--;
+			TdsWireCounters.packetsSent++;
+		}
 	}
 
-	TdsSendStart = 0;
+	return 0;
+}
+
+/* --------------------------------
+ *	InternalSendBlocking - send all queued packets, counting the time it
+ *	takes the client to take them
+ * --------------------------------
+ */
+static int
+InternalSendBlocking(void)
+{
+	instr_time	start;
+	instr_time	duration;
+	int			rc;
+
+	INSTR_TIME_SET_CURRENT(start);
+	rc = InternalSend(true);
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+
+	TdsWireCounters.flushes++;
+	TdsWireCounters.sendWaitUs += INSTR_TIME_GET_MICROSEC(duration);
+	return rc;
+}
+
+/* --------------------------------
+ *	InternalFlushWithData - send a packet made of the buffered data and
+ *	'len' more bytes at 'data'
+ *
+ * The packet header and the buffered data go out together with the caller's
+ * data in a single writev(), without copying the latter into the send
+ * buffer.  The packet is never the last one of the message.  The socket must
+ * be in blocking mode.
+ *
+ * Returns 0 if OK, or EOF if trouble.
+ * --------------------------------
+ */
+static int
+InternalFlushWithData(char *data, size_t len)
+{
+	static int	lastReportedSendErrno = 0;
+	struct iovec iov[2];
+	int			iovcnt = 2;
+	int			idx = 0;
+	instr_time	start;
+	instr_time	duration;
+
+	TdsErrorContext->err_text = "TDS InternalFlushWithData - Sending data to the client";
+	Assert(TdsSendRingQueued == 0 && TdsSendCur + len <= TdsBufferSize);
+
+	/* The header accounts for both parts */
+	TdsSendCur += len;
+	TdsFillHeader(false);
+	TdsSendCur -= len;
+
+	iov[0].iov_base = TdsSendBuffer;
+	iov[0].iov_len = TdsSendCur;
+	iov[1].iov_base = data;
+	iov[1].iov_len = len;
+
+	DebugPrintBytes("TDS InternalFlushWithData", TdsSendBuffer, TdsSendCur);
+	DebugPrintBytes("TDS InternalFlushWithData", data, len);
+
+	INSTR_TIME_SET_CURRENT(start);
+	TdsWireCounters.flushes++;
+
+	while (idx < iovcnt)
+	{
+		ssize_t		r;
+
+		r = tds_secure_writev(MyProcPort, &iov[idx], iovcnt - idx);
+		TdsWireCounters.writes++;
+
+		if (r <= 0)
+		{
+			if (errno == EINTR)
+				continue;		/* Ok if we were interrupted */
+
+			/* See InternalFlush() */
+			if (errno != lastReportedSendErrno)
+			{
+				lastReportedSendErrno = errno;
+				ereport(COMMERROR,
+						(errcode_for_socket_access(),
+						 errmsg("could not send data to client: %m")));
+			}
+
+			TdsSendCur = TDS_PACKET_HEADER_SIZE;
+			ClientConnectionLost = 1;
+			InterruptPending = 1;
+			return EOF;
+		}
+
+		lastReportedSendErrno = 0;	/* reset after any successful send */
+		TdsWireCounters.bytesSent += r;
+
+		/* Skip over whatever was written */
+		while (idx < iovcnt && (size_t) r >= iov[idx].iov_len)
+			r -= iov[idx++].iov_len;
+		if (idx < iovcnt)
+		{
+			iov[idx].iov_base = (char *) iov[idx].iov_base + r;
+			iov[idx].iov_len -= r;
+		}
+	}
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+	TdsWireCounters.sendWaitUs += INSTR_TIME_GET_MICROSEC(duration);
+
 	TdsSendCur = TDS_PACKET_HEADER_SIZE;
+	TdsWireCounters.packetsSent++;
 	return 0;
 }
 
+/* --------------------------------
+ * TdsAllocSendRing - (re)allocate the output ring
+ *
+ * Must only be called when nothing is queued or being filled.
+ * --------------------------------
+ */
+static void
+TdsAllocSendRing(void)
+{
+	Assert(TdsSendRingQueued == 0 && TdsSendCur == TDS_PACKET_HEADER_SIZE);
+
+	if (TdsSendRing != NULL)
+	{
+		pfree(TdsSendRing);
+		pfree(TdsSendRingLen);
+	}
+
+	TdsSendRingDepth = tds_send_ring_depth;
+	TdsSendRing = MemoryContextAlloc(TdsCommMemoryContext,
+									 (Size) TdsSendRingDepth * TdsBufferSize);
+	TdsSendRingLen = MemoryContextAllocZero(TdsCommMemoryContext,
+											TdsSendRingDepth * sizeof(int));
+	TdsSendRingHead = TdsSendRingQueued = TdsSendStart = 0;
+	TdsSendBuffer = TdsSendRing;
+}
+
 /* --------------------------------
  * TdsCommInit - Setup TDS comm context
  * --------------------------------
@@ -432,10 +732,12 @@ InternalFlush(bool lastPacket)
 void
 TdsCommInit(uint32_t bufferSize,
 			   TdsSecureSocketApi secure_read,
-			   TdsSecureSocketApi secure_write)
+			   TdsSecureSocketApi secure_write,
+			   TdsSecureSocketVecApi secure_writev)
 {
 	tds_secure_read = secure_read;
 	tds_secure_write = secure_write;
+	tds_secure_writev = secure_writev;
 	TdsDoProcessHeader = true;
 
 	/*
@@ -446,6 +748,9 @@ TdsCommInit(uint32_t bufferSize,
 	TdsMemoryContext = AllocSetContextCreate(TopMemoryContext,
 											 "TDS Listener",
 											 ALLOCSET_DEFAULT_SIZES);
+	TdsCommMemoryContext = AllocSetContextCreate(TopMemoryContext,
+												 "TDS Comm Buffers",
+												 ALLOCSET_DEFAULT_SIZES);
 
 	TdsBufferSize = bufferSize;
 
@@ -454,23 +759,38 @@ TdsCommInit(uint32_t bufferSize,
 
 /* --------------------------------
  * TdsCommReset - Reset TDS variables and allocate socket buffers
+ *
+ * The buffers are only allocated the first time around, a connection reset
+ * reuses them.
  * --------------------------------
  */
 void
 TdsCommReset(void)
 {
-	MemoryContext	oldContext;
-
 	TdsRecvMessageType = TdsSendMessageType = 0;
 	TdsRecvPacketStatus = 0;
 	TdsRecvStart = TdsRecvEnd = TdsLeftInPacket = 0;
-	TdsSendStart = 0;
+	TdsSendRingQueued = 0;
 	TdsSendCur = TDS_PACKET_HEADER_SIZE;
 
-	oldContext = MemoryContextSwitchTo(TdsMemoryContext);
-	TdsRecvBuffer = palloc(TdsBufferSize);
-	TdsSendBuffer = palloc(TdsBufferSize);
-	MemoryContextSwitchTo(oldContext);
+	if (TdsRecvBuffer == NULL)
+		TdsRecvBuffer = MemoryContextAlloc(TdsCommMemoryContext, TdsBufferSize);
+
+	if (TdsSendRing == NULL || TdsSendRingDepth != tds_send_ring_depth)
+		TdsAllocSendRing();
+	else
+	{
+		TdsSendRingHead = TdsSendStart = 0;
+		TdsSendBuffer = TdsSendRing;
+	}
+
+	if (TdsMessage.data == NULL)
+	{
+		TdsMessage.data = MemoryContextAlloc(TdsCommMemoryContext,
+											 TDS_MESSAGE_INITIAL_SIZE);
+		TdsMessage.maxlen = TDS_MESSAGE_INITIAL_SIZE;
+		resetStringInfo(&TdsMessage);
+	}
 }
 
 /* --------------------------------
@@ -485,11 +805,17 @@ TdsCommShutdown(void)
 	 * Both send and receive buffers should not have any
 	 * valid data at this point in time
 	 */
-	Assert(TdsSendStart == 0 && TdsSendCur == TDS_PACKET_HEADER_SIZE);
+	Assert(TdsSendRingQueued == 0 && TdsSendCur == TDS_PACKET_HEADER_SIZE);
 	Assert(TdsRecvStart == TdsRecvEnd && TdsLeftInPacket == 0);
 
-	pfree(TdsSendBuffer);
-	pfree(TdsRecvBuffer);
+	TdsSendRing = NULL;
+	TdsRecvBuffer = NULL;
+	TdsMessage.data = NULL;
+	if (TdsCommMemoryContext != NULL)
+	{
+		MemoryContextDelete(TdsCommMemoryContext);
+		TdsCommMemoryContext = NULL;
+	}
 	if (TdsMemoryContext != NULL)
 	{
 		MemoryContextDelete(TdsMemoryContext);
@@ -516,25 +842,27 @@ TdsSetBufferSize(uint32_t newSize)
 	 * Both send and receive buffers should not have any
 	 * valid data at this point in time
 	 */
-	if (TdsSendStart != 0 ||
+	if (TdsSendRingQueued != 0 ||
 		TdsSendCur != TDS_PACKET_HEADER_SIZE ||
 		TdsRecvStart != TdsRecvEnd ||
 		TdsLeftInPacket != 0)
 	{
 		TDS_DEBUG(TDS_DEBUG1, "TDS buffers in inconsistent state; "
-			 "TdsSendStart: %d TdsSendCur: %d TdsRecvStart: %d "
+			 "TdsSendRingQueued: %d TdsSendCur: %d TdsRecvStart: %d "
 			 "TdsRecvEnd: %d TdsLeftInPacket: %d",
-			 TdsSendStart, TdsSendCur, TdsRecvStart,
+			 TdsSendRingQueued, TdsSendCur, TdsRecvStart,
 			 TdsRecvEnd, TdsLeftInPacket);
 		ereport(FATAL,
 				(errcode(ERRCODE_PROTOCOL_VIOLATION),
 				 errmsg("TDS buffers in inconsistent state")));
 	}
 
-	TdsSendBuffer = repalloc(TdsSendBuffer, newSize);
-	TdsRecvBuffer = repalloc(TdsRecvBuffer, newSize);
+	/* Nothing to keep, so don't let repalloc() copy it */
+	pfree(TdsRecvBuffer);
+	TdsRecvBuffer = MemoryContextAlloc(TdsCommMemoryContext, newSize);
 
 	TdsBufferSize = newSize;
+	TdsAllocSendRing();
 	TdsRecvStart = TdsRecvEnd = TdsLeftInPacket = 0;
 }
 
@@ -675,6 +1003,28 @@ TdsPutbytes(void *s, size_t len)
 	return res;
 }
 
+/* --------------------------------
+ *	TdsReserveSendBuffer - reserve room for len bytes in the current packet
+ *
+ *	Returns a pointer the caller must fill with exactly len bytes, or NULL
+ *	if the current packet doesn't have that much room left.  In that case
+ *	nothing is reserved and the caller falls back to TdsPutbytes() and
+ *	friends, which split the data across packets.
+ * --------------------------------
+ */
+char *
+TdsReserveSendBuffer(size_t len)
+{
+	char	   *p;
+
+	if (TdsSendCur + len > TdsBufferSize)
+		return NULL;
+
+	p = TdsSendBuffer + TdsSendCur;
+	TdsSendCur += len;
+	return p;
+}
+
 /* --------------------------------
  *      TdsPutDate - send one 24-bit unsigned integer
  *      		in LITTLE_ENDIAN
@@ -848,10 +1198,26 @@ TdsPutFloat8LE(float8 value)
 int
 TdsSocketFlush(void)
 {
-	SocketSetNonblocking(false);
 	return InternalFlush(true);
 }
 
+/* --------------------------------
+ *	TdsSendPending - send queued packets if the socket takes them
+ *
+ *	Called between rows, so that packets go out while we produce the
+ *	next ones.  Never blocks.
+ *
+ *	returns 0 if OK, EOF if trouble
+ * --------------------------------
+ */
+int
+TdsSendPending(void)
+{
+	if (TdsSendRingQueued == 0)
+		return 0;
+	return InternalSend(false);
+}
+
 int
 TdsReadNextPendingBcpRequest(StringInfo message)
 {
@@ -895,6 +1261,53 @@ TdsDiscardAllPendingBcpRequest()
 	return 0;
 }
 
+/* --------------------------------
+ * TdsGetMessageBuffer - the buffer to put the next request together in
+ *
+ * The buffer comes back empty.  It must not be handed out again while the
+ * request read into it is in use, so call this only to read a new one.
+ * --------------------------------
+ */
+StringInfo
+TdsGetMessageBuffer(void)
+{
+	resetStringInfo(&TdsMessage);
+	return &TdsMessage;
+}
+
+/* --------------------------------
+ * TdsReleaseMessageBuffer - done with the request in the message buffer
+ *
+ * Shrinks the buffer if all of the requests of the last while would have fit
+ * in a quarter of it.
+ * --------------------------------
+ */
+void
+TdsReleaseMessageBuffer(void)
+{
+	int			newSize;
+
+	TdsMessageHighWater = Max(TdsMessageHighWater, TdsMessage.len);
+	if (++TdsMessageCount < TDS_MESSAGE_SHRINK_WINDOW)
+		return;
+
+	if (TdsMessage.maxlen > TDS_MESSAGE_INITIAL_SIZE &&
+		TdsMessageHighWater < TdsMessage.maxlen / 4)
+	{
+		newSize = TDS_MESSAGE_INITIAL_SIZE;
+		while (newSize <= TdsMessageHighWater)
+			newSize *= 2;
+
+		pfree(TdsMessage.data);
+		TdsMessage.data = MemoryContextAlloc(TdsCommMemoryContext, newSize);
+		TdsMessage.maxlen = newSize;
+		resetStringInfo(&TdsMessage);
+	}
+
+	TdsMessageHighWater = 0;
+	TdsMessageCount = 0;
+}
+
 /* --------------------------------
  * TdsReadNextRequest - Read new request
  *
@@ -909,6 +1322,10 @@ TdsReadNextRequest(StringInfo message, uint8_t *status, uint8_t *messageType)
 {
 	int		readBytes = 0;
 	bool	isFirst = true;
+
+	/* Nothing buffered, so the next read waits for the client */
+	TdsRecvIdle = (TdsRecvStart == TdsRecvEnd);
+
 	while(1)
 	{
 		if (TdsReadNextBuffer() == EOF)
@@ -966,7 +1383,7 @@ TdsReadMessage(StringInfo message, uint8_t messageType)
 	uint8_t status;
 
 	/* Make sure that last write is flushed */
-	if (TdsSendStart != 0 || TdsSendCur != TDS_PACKET_HEADER_SIZE)
+	if (TdsSendRingQueued != 0 || TdsSendCur != TDS_PACKET_HEADER_SIZE)
 		ereport(FATAL,
 				(errcode(ERRCODE_PROTOCOL_VIOLATION),
 				 errmsg("TDS last write did not flush")));
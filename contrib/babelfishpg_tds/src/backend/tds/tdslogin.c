@@ -1819,7 +1819,7 @@ TdsClientInit(void)
 	 AddWaitEventToSet(FeBeWaitSet, WL_LATCH_SET, -1, MyLatch, NULL);
 	 AddWaitEventToSet(FeBeWaitSet, WL_POSTMASTER_DEATH, -1, NULL, NULL);
 	 TdsCommInit(TDS_DEFAULT_INIT_PACKET_SIZE,
-					tds_secure_read, tds_secure_write);
+					tds_secure_read, tds_secure_write, tds_secure_writev);
 }
 
 /*
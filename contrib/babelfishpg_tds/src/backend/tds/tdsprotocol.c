@@ -37,6 +37,7 @@
 #include "parser/parser.h"
 #include "parser/parse_coerce.h"
 #include "port/pg_bswap.h"
+#include "portability/instr_time.h"
 #include "tcop/pquery.h"
 #include "utils/fmgroids.h"
 #include "utils/guc.h"
@@ -76,6 +77,7 @@ ResetConnection	resetCon = NULL;
 static void ResetTDSConnection(void);
 static TDSRequest GetTDSRequest(bool *resetProtocol);
 static void ProcessTDSRequest(TDSRequest request);
+static TdsStatRequestType GetRequestStatType(TDSRequest request);
 
 /*
  * TDSDiscardAll - copy of DiscardAll
@@ -172,9 +174,8 @@ GetTDSRequest(bool *resetProtocol)
 	uint8_t			messageType;
 	uint8_t			status;
 	TDSRequest		request;
-	StringInfoData	message;
-
-	initStringInfo(&message);
+	StringInfo		message;
+	StringInfoData	batchMessage;
 
 	/*
 	 * Setup error traceback support for ereport()
@@ -192,7 +193,8 @@ GetTDSRequest(bool *resetProtocol)
 		{
 			messageType = resetCon->messageType;
 			status = resetCon->status;
-			appendBinaryStringInfo(&message, resetCon->message->data, resetCon->message->len);
+			message = TdsGetMessageBuffer();
+			appendBinaryStringInfo(message, resetCon->message->data, resetCon->message->len);
 
 			/* cleanup and reset */
 			pfree(resetCon->message->data);
@@ -216,7 +218,8 @@ GetTDSRequest(bool *resetProtocol)
 				 * request.
 				 */
 				HOLD_CANCEL_INTERRUPTS();
-				ret = TdsReadNextRequest(&message, &status, &messageType);
+				message = TdsGetMessageBuffer();
+				ret = TdsReadNextRequest(message, &status, &messageType);
 				RESUME_CANCEL_INTERRUPTS();
 
 				if (ret != 0)
@@ -224,24 +227,26 @@ GetTDSRequest(bool *resetProtocol)
 					TdsErrorContext->reqType = 0;
 					TdsErrorContext->err_text = "EOF reached on TDS socket";
 					TDS_DEBUG(TDS_DEBUG1, "EOF on TDS socket");
-					pfree(message.data);
 					return NULL;
 				}
 				TdsErrorContext->err_text = "Fetching TDS Request";
 				TdsRequestCtrl->status = status;
 			}
 			else
-				RestoreRPCBatch(&message, &status, &messageType);
+			{
+				message = &batchMessage;
+				RestoreRPCBatch(message, &status, &messageType);
+			}
 		}
 
-		DebugPrintMessageData("Fetched message:", message);
+		DebugPrintMessage("Fetched message:", message);
 
 		TdsErrorContext->reqType = messageType;
 
 		#ifdef FAULT_INJECTOR
 		{
 			TdsMessageWrapper	wrapper;
-			wrapper.message = &message;
+			wrapper.message = message;
 			wrapper.messageType = messageType;
 
 			FAULT_INJECT(PreParsingType, &wrapper);
@@ -262,7 +267,7 @@ GetTDSRequest(bool *resetProtocol)
 				resetCon = palloc(sizeof(ResetConnectionData));
 
 			resetCon->message = makeStringInfo();
-			appendBinaryStringInfo(resetCon->message, message.data, message.len);
+			appendBinaryStringInfo(resetCon->message, message->data, message->len);
 			resetCon->messageType = messageType;
 			resetCon->status = (status & ~TDS_PACKET_HEADER_STATUS_RESETCON);
 
@@ -281,11 +286,10 @@ GetTDSRequest(bool *resetProtocol)
 					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 					 errmsg("RESETCONSKIPTRAN is not supported")));
 
-		/* An attention request can also have message.len = 0. */
-		if (message.len == 0 && messageType != TDS_ATTENTION)
+		/* An attention request can also have message->len = 0. */
+		if (message->len == 0 && messageType != TDS_ATTENTION)
 		{
 			TDS_DEBUG(TDS_DEBUG1, "zero byte client message on TDS socket");
-			pfree(message.data);
 			return NULL;
 		}
 
@@ -294,24 +298,22 @@ GetTDSRequest(bool *resetProtocol)
 		{
 			case TDS_QUERY:		/* Simple SQL BATCH */
 				{
-					request = GetSQLBatchRequest(&message);
-
-					pfree(message.data);
+					request = GetSQLBatchRequest(message);
 				}
 				break;
 			case TDS_RPC:		/* Remote procedure call */
 				{
-					request = GetRPCRequest(&message);
+					request = GetRPCRequest(message);
 				}
 				break;
 			case TDS_TXN:	/* Transaction management request */
 				{
-					request = GetTxnMgmtRequest(&message);
+					request = GetTxnMgmtRequest(message);
 				}
 				break;
 			case TDS_BULK_LOAD: /* Bulk Load request */
 				{
-					request = GetBulkLoadRequest(&message);
+					request = GetBulkLoadRequest(message);
 				}
 				break;
 			case TDS_ATTENTION: 	/* Attention request */
@@ -322,9 +324,9 @@ GetTDSRequest(bool *resetProtocol)
 				}
 				break;
 			default:
-				DebugPrintMessageData("Ignored message", message);
+				DebugPrintMessage("Ignored message", message);
 				elog(ERROR, "TDSRequest: ignoring request type 0x%02x",
-					 message.data[0]);
+					 message->data[0]);
 		}
 	}
 	PG_CATCH();
@@ -347,10 +349,14 @@ GetTDSRequest(bool *resetProtocol)
 static void
 ProcessTDSRequest(TDSRequest request)
 {
+	instr_time	start;
+	instr_time	duration;
+
 	/*
 	 * Setup error traceback support for ereport()
 	 */
 	TdsErrorContext->err_text = "Processing TDS Request";
+	INSTR_TIME_SET_CURRENT(start);
 
 	/*
 	 * We shouldn't be in this state as we handle the aborted case on
@@ -421,6 +427,58 @@ ProcessTDSRequest(TDSRequest request)
 		TdsSendDone(token_type, TDS_DONE_ERROR, command_type, 0);
 	}
 	PG_END_TRY();
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, start);
+	tdsstat_count_request(GetRequestStatType(request),
+						  INSTR_TIME_GET_MICROSEC(duration));
+}
+
+/*
+ * GetRequestStatType - the type a request is counted as in the wire stats
+ */
+static TdsStatRequestType
+GetRequestStatType(TDSRequest request)
+{
+	switch (request->reqType)
+	{
+		case TDS_REQUEST_SQL_BATCH:
+			return TDS_STAT_SQL_BATCH;
+		case TDS_REQUEST_TXN_MGMT:
+			return TDS_STAT_TXN_MGMT;
+		case TDS_REQUEST_BULK_LOAD:
+			return TDS_STAT_BULK_LOAD;
+		case TDS_REQUEST_ATTN:
+			return TDS_STAT_ATTENTION;
+		case TDS_REQUEST_SP_NUMBER:
+			break;
+	}
+
+	switch (((TDSRequestSP) request)->spType)
+	{
+		case SP_EXECUTESQL:
+			return TDS_STAT_SP_EXECUTESQL;
+		case SP_PREPARE:
+			return TDS_STAT_SP_PREPARE;
+		case SP_EXECUTE:
+			return TDS_STAT_SP_EXECUTE;
+		case SP_PREPEXEC:
+			return TDS_STAT_SP_PREPEXEC;
+		case SP_UNPREPARE:
+			return TDS_STAT_SP_UNPREPARE;
+		case SP_CURSOR:
+		case SP_CURSOROPEN:
+		case SP_CURSORPREPARE:
+		case SP_CURSOREXEC:
+		case SP_CURSORPREPEXEC:
+		case SP_CURSORUNPREPARE:
+		case SP_CURSORFETCH:
+		case SP_CURSOROPTION:
+		case SP_CURSORCLOSE:
+			return TDS_STAT_SP_CURSOR;
+		default:
+			return TDS_STAT_PROCEDURE;
+	}
 }
 
 void
@@ -637,9 +695,11 @@ TdsSocketBackend(void)
 						TdsErrorContext->phase = "TDS_REQUEST_PHASE_FLUSH";
 						/* Send the response now */
 						TdsFlush();
+						tdsstat_report_wire_stats();
 
 						/* Cleanups */
 						MemoryContextReset(TdsRequestCtrl->requestContext);
+						TdsReleaseMessageBuffer();
 
 						/* Reset the request */
 						TdsRequestCtrl->request = NULL;
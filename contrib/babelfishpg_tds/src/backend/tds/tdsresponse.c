@@ -94,6 +94,38 @@ typedef struct
 	MemoryContext tmpcontext;	/* Memory context for per-row workspace */
 } DR_printtup;
 
+/*
+ * Encodings TdsPrintTup() writes by itself instead of calling the send
+ * function of the column, for fixed-width types.
+ */
+typedef enum TdsFixedEncoding
+{
+	TDS_FIXED_NONE = 0,			/* use the send function */
+	TDS_FIXED_BIT,
+	TDS_FIXED_INT1,
+	TDS_FIXED_INT2,
+	TDS_FIXED_INT4,
+	TDS_FIXED_INT8,
+	TDS_FIXED_FLOAT4,
+	TDS_FIXED_FLOAT8
+} TdsFixedEncoding;
+
+/*
+ * Per-column row encoding plan, derived from colMetaData once per result
+ * set by PrintTupPrepareInfo() so that TdsPrintTup() doesn't have to look
+ * at the TDS type of every column for every row.
+ */
+typedef struct TdsColumnPlan
+{
+	bool		nullable;		/* NULL goes to the NBCROW null bitmap */
+	uint8		nullLen;		/* length of the NULL marker in a ROW token */
+	uint8		nullMarker[8];	/* the NULL marker itself */
+	TdsFixedEncoding fixed;		/* fixed-width fast path, if any */
+	uint8		fixedLen;		/* data length of the fast path */
+	bool		sendLength;		/* fast path sends a length prefix */
+	TdsSendTypeFunction sendFunc;
+} TdsColumnPlan;
+
 typedef struct TdsExecutionStateData
 {
 	int current_stack;
@@ -121,13 +153,63 @@ static TdsExecutionState tds_estate = NULL;
 static bool		markErrorFlag = false;
 
 static TdsColumnMetaData *colMetaData = NULL;
+static TdsColumnPlan *colPlan = NULL;		/* row encoding plan for colMetaData */
+static uint8_t *colPlanNullMap = NULL;		/* NBCROW null bitmap workspace */
+static bool colPlanAllFixed = false;		/* every column has a fast path */
 static List	*relMetaDataInfoList = NULL;
 
+/*
+ * Column metadata of the result sets of prepared statements and cursors,
+ * kept per handle so that sp_execute and sp_cursorfetch on a handle that
+ * has been described before don't need to work it out again.  A handle can
+ * produce several result sets, so each entry keeps a few result shapes.
+ * A shape is only reused for a result with exactly the same columns, hence
+ * entries of handles that went away are merely wasted memory.
+ */
+#define ROWDESC_CACHE_MAX_HANDLES	128
+#define ROWDESC_CACHE_MAX_SHAPES	8
+
+typedef struct RowDescCacheKey
+{
+	uint16		spType;
+	uint32		handle;
+} RowDescCacheKey;
+
+/* What the column metadata of one column is derived from */
+typedef struct RowDescColumn
+{
+	Oid			typid;
+	int32		typmod;
+	Oid			collation;
+	Oid			relOid;
+	AttrNumber	attrNum;
+	NameData	name;
+} RowDescColumn;
+
+typedef struct RowDescShape
+{
+	int			natts;
+	RowDescColumn *columns;
+	TdsColumnMetaData *colMetaData;
+} RowDescShape;
+
+typedef struct RowDescCacheEntry
+{
+	RowDescCacheKey key;
+	List	   *shapes;			/* RowDescShape, most recently used first */
+} RowDescCacheEntry;
+
+static HTAB *rowDescCache = NULL;
+static MemoryContext rowDescCacheContext = NULL;
+/* set by PrepareRowDescription() if its result only depends on RowDescColumn */
+static bool rowDescCacheable = false;
+
 static void FillTabNameWithNumParts(StringInfo buf, uint8 numParts, TdsRelationMetaDataInfo relMetaDataInfo);
 static void FillTabNameWithoutNumParts(StringInfo buf, uint8 numParts, TdsRelationMetaDataInfo relMetaDataInfo);
 static void SetTdsEstateErrorData(void);
 static void ResetTdsEstateErrorData(void);
 static void SetAttributesForColmetada(TdsColumnMetaData *col);
+static void PrepareColumnPlan(int natts);
 
 static inline void
 SendPendingDone(bool more)
@@ -194,6 +276,7 @@ SendPendingDone(bool more)
 		}
 
 		TDS_DEBUG(TDS_DEBUG3, "SendPendingDone: putbytes");
+		TdsWireCounters.doneTokens++;
 		TdsPutbytes(&TdsPendingDoneToken, sizeof(TdsPendingDoneToken));
 		TdsPutbytes(&TdsPendingDoneStatus, sizeof(TdsPendingDoneStatus));
 		TdsPutbytes(&TdsPendingDoneCurCmd, sizeof(TdsPendingDoneCurCmd));
@@ -368,6 +451,8 @@ PrintTupPrepareInfo(DR_printtup *myState, TupleDesc typeinfo, int numAttrs)
 	if (numAttrs <= 0)
 		return;
 
+	PrepareColumnPlan(numAttrs);
+
 	myState->myinfo = (PrinttupAttrInfo *)
 		palloc0(numAttrs * sizeof(PrinttupAttrInfo));
 
@@ -399,6 +484,174 @@ PrintTupPrepareInfo(DR_printtup *myState, TupleDesc typeinfo, int numAttrs)
 	}
 }
 
+/*
+ * Build the row encoding plan for the columns described by colMetaData.
+ * It lives as long as colMetaData does.
+ */
+static void
+PrepareColumnPlan(int natts)
+{
+	MemoryContext	oldContext;
+	int				attno;
+
+	if (colPlan)
+	{
+		pfree(colPlan);
+		pfree(colPlanNullMap);
+	}
+
+	oldContext = MemoryContextSwitchTo(GetMemoryChunkContext(colMetaData));
+	colPlan = palloc0(sizeof(TdsColumnPlan) * natts);
+	colPlanNullMap = palloc0((natts + 7) / 8);
+	MemoryContextSwitchTo(oldContext);
+
+	colPlanAllFixed = true;
+	for (attno = 0; attno < natts; attno++)
+	{
+		TdsColumnMetaData  *col = &colMetaData[attno];
+		TdsColumnPlan	   *plan = &colPlan[attno];
+
+		plan->nullable = (col->metaEntry.type1.flags & TDS_COLMETA_NULLABLE) != 0;
+		plan->sendFunc = col->sendFunc;
+
+		switch (col->metaEntry.type1.tdsTypeId)
+		{
+			case TDS_TYPE_VARCHAR:
+			case TDS_TYPE_NVARCHAR:
+				/*
+				 * To send NULL for VARCHAR(max) or NVARCHAR(max), we have to
+				 * indicate it using 0xffffffffffffffff (PLP_NULL). For regular
+				 * case of VARCHAR/NVARCHAR, we have to send 0xffff (CHARBIN_NULL).
+				 */
+				plan->nullLen = (col->metaEntry.type2.maxSize == 0xffff) ? 8 : 2;
+				memset(plan->nullMarker, 0xff, plan->nullLen);
+				break;
+			case TDS_TYPE_VARBINARY:
+				/* Same as above for VARBINARY(max) and VARBINARY */
+				plan->nullLen = (col->metaEntry.type7.maxSize == 0xffff) ? 8 : 2;
+				memset(plan->nullMarker, 0xff, plan->nullLen);
+				break;
+			case TDS_TYPE_CHAR:
+			case TDS_TYPE_NCHAR:
+			case TDS_TYPE_XML:
+			case TDS_TYPE_BINARY:
+				/* For these datatypes, we need to send 0xffff (CHARBIN_NULL) to indicate NULL */
+				plan->nullLen = 2;
+				memset(plan->nullMarker, 0xff, plan->nullLen);
+				break;
+			case TDS_TYPE_SQLVARIANT:
+				/* For sql_variant, we need to send 0x00000000 to indicate NULL */
+				plan->nullLen = 4;
+				break;
+			default:
+				/* for other datatypes, we need to send 0x00 (1 byte) only */
+				plan->nullLen = 1;
+				break;
+		}
+
+		/* fixed-width types that TdsPrintTup() can encode by itself */
+		if (col->sendFunc == TdsSendTypeBit)
+			plan->fixed = TDS_FIXED_BIT, plan->fixedLen = 1;
+		else if (col->sendFunc == TdsSendTypeTinyint)
+			plan->fixed = TDS_FIXED_INT1, plan->fixedLen = 1;
+		else if (col->sendFunc == TdsSendTypeSmallint)
+			plan->fixed = TDS_FIXED_INT2, plan->fixedLen = 2;
+		else if (col->sendFunc == TdsSendTypeInteger)
+			plan->fixed = TDS_FIXED_INT4, plan->fixedLen = 4;
+		else if (col->sendFunc == TdsSendTypeBigint)
+			plan->fixed = TDS_FIXED_INT8, plan->fixedLen = 8;
+		else if (col->sendFunc == TdsSendTypeFloat4)
+			plan->fixed = TDS_FIXED_FLOAT4, plan->fixedLen = 4;
+		else if (col->sendFunc == TdsSendTypeFloat8)
+			plan->fixed = TDS_FIXED_FLOAT8, plan->fixedLen = 8;
+		else
+			colPlanAllFixed = false;
+
+		/* same as the send functions: no length if the column is not null */
+		plan->sendLength = !col->attNotNull;
+	}
+}
+
+/*
+ * Encode a fixed-width value the way its send function would.
+ * Returns the number of bytes written to buf.
+ */
+static inline int
+EncodeFixedValue(char *buf, TdsColumnPlan *plan, Datum value)
+{
+	char	   *p = buf;
+
+	if (plan->sendLength)
+		*p++ = (char) plan->fixedLen;
+
+	switch (plan->fixed)
+	{
+		case TDS_FIXED_BIT:
+			*p++ = (char) DatumGetBool(value);
+			break;
+		case TDS_FIXED_INT1:
+			*p++ = (char) DatumGetUInt8(value);
+			break;
+		case TDS_FIXED_INT2:
+			{
+				uint16		tmp = htoLE16((uint16) DatumGetInt16(value));
+
+				memcpy(p, &tmp, sizeof(tmp));
+				p += sizeof(tmp);
+			}
+			break;
+		case TDS_FIXED_INT4:
+			{
+				uint32		tmp = htoLE32((uint32) DatumGetInt32(value));
+
+				memcpy(p, &tmp, sizeof(tmp));
+				p += sizeof(tmp);
+			}
+			break;
+		case TDS_FIXED_INT8:
+			{
+				uint64		tmp = htoLE64((uint64) DatumGetInt64(value));
+
+				memcpy(p, &tmp, sizeof(tmp));
+				p += sizeof(tmp);
+			}
+			break;
+		case TDS_FIXED_FLOAT4:
+			{
+				union
+				{
+					float4		f;
+					uint32		i;
+				}			swap;
+
+				swap.f = DatumGetFloat4(value);
+				swap.i = htoLE32(swap.i);
+				memcpy(p, &swap.i, sizeof(swap.i));
+				p += sizeof(swap.i);
+			}
+			break;
+		case TDS_FIXED_FLOAT8:
+			{
+				union
+				{
+					float8		f;
+					uint64		i;
+				}			swap;
+
+				swap.f = DatumGetFloat8(value);
+				swap.i = htoLE64(swap.i);
+				memcpy(p, &swap.i, sizeof(swap.i));
+				p += sizeof(swap.i);
+			}
+			break;
+		default:
+			Assert(false);
+			break;
+	}
+
+	return p - buf;
+}
+
 /* look for a typmod to return from a numeric expression */
 static int32
 resolve_numeric_typmod_from_exp(Node *expr)
@@ -1055,6 +1308,7 @@ SendColumnMetadataToken(int natts, bool sendRowStat)
 
       /* Now send out the COLMETADATA token */
       TDS_DEBUG(TDS_DEBUG2, "SendColumnMetadataToken: token=0x%02x", TDS_TOKEN_COLMETADATA);
+	TdsWireCounters.colMetadataTokens++;
 	TdsPutInt8(TDS_TOKEN_COLMETADATA);
 	TdsPutInt16LE(sendRowStat ? natts + 1 : natts);
 
@@ -1377,10 +1631,24 @@ PrepareRowDescription(TupleDesc typeinfo, List *targetlist, int16 *formats,
 	bool 			sendTableName = false;
 	uint8_t				precision = 18, scale = 0;
 
+	uint32_t		tdsVersion = GetClientTDSVersion();
+	coll_info_t		cinfo = TdsLookupCollationTableCallback(InvalidOid);
+	Oid				serverCollationOid = cinfo.oid;
+
 	relMetaDataInfoList = NIL;
 
 	TdsErrorContext->err_text = "Preparing to Send Back the Tds response";
 
+	if (unlikely(serverCollationOid == InvalidOid))
+		elog(FATAL, "Oid of default collation is not valid, This might mean that value of server_collation_name GUC is invalid");
+
+	/*
+	 * The catalog lookups for FMTONLY and the table names of TEXT, NTEXT and
+	 * IMAGE columns are not covered by the cache key.
+	 */
+	rowDescCacheable = !extendedInfo && pltsql_plugin_handler_ptr &&
+		!(*pltsql_plugin_handler_ptr->pltsql_is_fmtonly_stmt);
+
 	SendPendingDone(true);
 
 	/*
@@ -1390,6 +1658,8 @@ PrepareRowDescription(TupleDesc typeinfo, List *targetlist, int16 *formats,
 	 */
 	oldContext = MemoryContextSwitchTo(MessageContext);
 	colMetaData = palloc0(sizeof(TdsColumnMetaData) * natts);
+	colPlan = NULL;				/* rebuilt by TdsPrintTup() for the new columns */
+	colPlanNullMap = NULL;
 
 	/*
 	 * We collect all the information first so that we don't have
@@ -1398,19 +1668,12 @@ PrepareRowDescription(TupleDesc typeinfo, List *targetlist, int16 *formats,
 	 */
 	for (attno = 0; attno < natts; attno++)
 	{
-		Oid serverCollationOid;
 		TdsIoFunctionInfo	finfo;
 		Form_pg_attribute	att = TupleDescAttr(typeinfo, attno);
 		Oid					atttypid = att->atttypid;
 		int32				atttypmod = att->atttypmod;
 		TdsColumnMetaData  *col = &colMetaData[attno];
-		uint32_t 			tdsVersion = GetClientTDSVersion();
 		TargetEntry *tle = NULL;
-		coll_info_t cinfo = TdsLookupCollationTableCallback(InvalidOid);
-
-		serverCollationOid = cinfo.oid;
-		if (unlikely(serverCollationOid == InvalidOid))
-			elog(FATAL, "Oid of default collation is not valid, This might mean that value of server_collation_name GUC is invalid");
 
 		/*
 		 * Get the IO function info from our type cache
@@ -1515,14 +1778,20 @@ PrepareRowDescription(TupleDesc typeinfo, List *targetlist, int16 *formats,
 				break;
 			case TDS_SEND_CHAR:
 				if (atttypmod == -1 && tle != NULL)
+				{
 					atttypmod = TdsGetGenericTypmod((Node *)tle->expr);
+					rowDescCacheable = false;
+				}
 				
 				SetColMetadataForCharTypeHelper(col, TDS_TYPE_CHAR,
 												att->attcollation, (atttypmod - 4));
 				break;
 			case TDS_SEND_NCHAR:
 				if (atttypmod == -1 && tle != NULL)
+				{
 					atttypmod = TdsGetGenericTypmod((Node *)tle->expr);
+					rowDescCacheable = false;
+				}
 
 				SetColMetadataForCharTypeHelper(col, TDS_TYPE_NCHAR,
 												att->attcollation, (atttypmod - 4) * 2);
@@ -1583,7 +1852,10 @@ PrepareRowDescription(TupleDesc typeinfo, List *targetlist, int16 *formats,
 					 * TDS client requires a valid typmod other than -1.
 					 */
 					if (atttypmod == -1 && tle != NULL)
+					{
 						atttypmod = resolve_numeric_typmod_from_exp((Node *) tle->expr);
+						rowDescCacheable = false;
+					}
 
 					/*
 					 * Get the precision and scale out of the typmod value if typmod is valid
@@ -1630,6 +1902,8 @@ PrepareRowDescription(TupleDesc typeinfo, List *targetlist, int16 *formats,
 				if (atttypmod == -1 && tle != NULL && IsA(tle->expr, Const))
 				{
 					Const *con= (Const *) tle->expr;
+
+					rowDescCacheable = false;
 					if (!con->constisnull)
 					{
 						bytea *source = (bytea *) con->constvalue;
@@ -1730,6 +2004,9 @@ PrepareRowDescription(TupleDesc typeinfo, List *targetlist, int16 *formats,
 
 	MemoryContextSwitchTo(oldContext);
 
+	if (sendTableName)
+		rowDescCacheable = false;
+
 	if (extendedInfo || sendTableName)
 	{
 		uint8				tableNum = 0;
@@ -1845,6 +2122,7 @@ SendReturnValueTokenInternal(ParameterToken token, uint8 status,
 	/* token type */
       TDS_DEBUG(TDS_DEBUG2, "SendReturnValueTokenInternal: token=0x%02x", TDS_TOKEN_RETURNVALUE);
 	temp8 = TDS_TOKEN_RETURNVALUE;
+	TdsWireCounters.returnValueTokens++;
 	TdsPutbytes(&temp8, sizeof(temp8));
 
 	/* param ordinal */
@@ -2123,6 +2401,7 @@ TdsSendEnvChange(int envid, const char *new_val, const char *old_val)
 
       TDS_DEBUG(TDS_DEBUG2, "TdsSendEnvChange: token=0x%02x", TDS_TOKEN_ENVCHANGE);
 	temp8 = TDS_TOKEN_ENVCHANGE;
+	TdsWireCounters.envChangeTokens++;
 	TdsPutbytes(&temp8, sizeof(temp8));
 
 	TdsPutbytes(&totalLen, sizeof(totalLen));
@@ -2173,6 +2452,7 @@ TdsSendEnvChangeBinary(int envid, void *new, int newNbytes,
 
       TDS_DEBUG(TDS_DEBUG2, "TdsSendEnvChangeBinary: token=0x%02x", TDS_TOKEN_ENVCHANGE);
 	temp8 = TDS_TOKEN_ENVCHANGE;
+	TdsWireCounters.envChangeTokens++;
 	TdsPutbytes(&temp8, sizeof(temp8));
 
 	TdsPutbytes(&totalLen, sizeof(totalLen));
@@ -2288,6 +2568,10 @@ TdsSendInfoOrError(int token, int number, int state, int class,
 
       /* Send Info or Error Token. */
       TDS_DEBUG(TDS_DEBUG2, "TdsSendInfoOrError: token=0x%02x", token);
+	if (token == TDS_TOKEN_ERROR)
+		TdsWireCounters.errorTokens++;
+	else
+		TdsWireCounters.infoTokens++;
 	temp8 = token;
 	TdsPutbytes(&temp8, sizeof(temp8));
 	TdsPutbytes(&totalLen, sizeof(totalLen));
@@ -2327,17 +2611,223 @@ TdsSendInfoOrError(int token, int number, int state, int class,
 	pfree(procNameUtf16.data);
 }
 
+/*
+ * Find or make the row description cache entry of the prepared statement or
+ * cursor this request runs, if any.
+ */
+static RowDescCacheEntry *
+GetRowDescCacheEntry(TDSRequestSP req)
+{
+	RowDescCacheKey key;
+	RowDescCacheEntry *entry;
+	bool		found;
+
+	MemSet(&key, 0, sizeof(key));
+	key.spType = req->spType;
+	if (req->spType == SP_EXECUTE)
+		key.handle = req->handle;
+	else if (req->spType == SP_CURSORFETCH)
+		key.handle = req->cursorHandle;
+	else
+		return NULL;
+
+	if (rowDescCache == NULL)
+	{
+		HASHCTL		ctl;
+
+		rowDescCacheContext = AllocSetContextCreate(TopMemoryContext,
+													"TDS row description cache",
+													ALLOCSET_DEFAULT_SIZES);
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(RowDescCacheKey);
+		ctl.entrysize = sizeof(RowDescCacheEntry);
+		ctl.hcxt = rowDescCacheContext;
+		rowDescCache = hash_create("TDS row description cache",
+								   ROWDESC_CACHE_MAX_HANDLES, &ctl,
+								   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	entry = (RowDescCacheEntry *) hash_search(rowDescCache, &key, HASH_FIND, NULL);
+	if (entry)
+		return entry;
+
+	/* Handles are never reported as gone, so just start over when full */
+	if (hash_get_num_entries(rowDescCache) >= ROWDESC_CACHE_MAX_HANDLES)
+	{
+		hash_destroy(rowDescCache);
+		rowDescCache = NULL;
+		MemoryContextDelete(rowDescCacheContext);
+		rowDescCacheContext = NULL;
+		return GetRowDescCacheEntry(req);
+	}
+
+	entry = (RowDescCacheEntry *) hash_search(rowDescCache, &key, HASH_ENTER, &found);
+	Assert(!found);
+	entry->shapes = NIL;
+	return entry;
+}
+
+/*
+ * Collect what the column metadata of this result is derived from, in the
+ * way PrepareRowDescription() looks at it.
+ */
+static RowDescColumn *
+GetRowDescColumns(TupleDesc typeinfo, List *targetlist)
+{
+	RowDescColumn *columns = palloc0(sizeof(RowDescColumn) * typeinfo->natts);
+	ListCell   *tlist_item = list_head(targetlist);
+	int			attno;
+
+	for (attno = 0; attno < typeinfo->natts; attno++)
+	{
+		Form_pg_attribute att = TupleDescAttr(typeinfo, attno);
+		RowDescColumn *column = &columns[attno];
+
+		column->typid = att->atttypid;
+		column->typmod = att->atttypmod;
+		column->collation = att->attcollation;
+		namestrcpy(&column->name, NameStr(att->attname));
+
+		while (tlist_item &&
+			   ((TargetEntry *) lfirst(tlist_item))->resjunk)
+			tlist_item = lnext(targetlist, tlist_item);
+		if (tlist_item)
+		{
+			TargetEntry *tle = (TargetEntry *) lfirst(tlist_item);
+
+			column->relOid = tle->resorigtbl;
+			column->attrNum = tle->resorigcol;
+			tlist_item = lnext(targetlist, tlist_item);
+		}
+	}
+
+	return columns;
+}
+
+/*
+ * Set up colMetaData from a cached shape of the same columns, if there is
+ * one.  This does what PrepareRowDescription() would have done.
+ */
+static bool
+RestoreRowDescription(RowDescCacheEntry *entry, int natts, RowDescColumn *columns)
+{
+	ListCell   *lc;
+	RowDescShape *shape = NULL;
+	MemoryContext oldContext;
+	int			attno;
+
+	foreach(lc, entry->shapes)
+	{
+		RowDescShape *candidate = (RowDescShape *) lfirst(lc);
+
+		if (candidate->natts == natts &&
+			memcmp(candidate->columns, columns, sizeof(RowDescColumn) * natts) == 0)
+		{
+			shape = candidate;
+			break;
+		}
+	}
+	if (shape == NULL)
+		return false;
+
+	if (shape != linitial(entry->shapes))
+	{
+		oldContext = MemoryContextSwitchTo(rowDescCacheContext);
+		entry->shapes = lcons(shape, list_delete_ptr(entry->shapes, shape));
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	relMetaDataInfoList = NIL;
+	SendPendingDone(true);
+
+	oldContext = MemoryContextSwitchTo(MessageContext);
+	colMetaData = palloc(sizeof(TdsColumnMetaData) * natts);
+	memcpy(colMetaData, shape->colMetaData, sizeof(TdsColumnMetaData) * natts);
+	for (attno = 0; attno < natts; attno++)
+	{
+		TdsColumnMetaData *col = &colMetaData[attno];
+
+		initStringInfo(&col->colName);
+		appendBinaryStringInfo(&col->colName,
+							   shape->colMetaData[attno].colName.data,
+							   shape->colMetaData[attno].colName.len);
+	}
+	colPlan = NULL;				/* rebuilt by TdsPrintTup() for the new columns */
+	colPlanNullMap = NULL;
+	MemoryContextSwitchTo(oldContext);
+
+	return true;
+}
+
+/* Keep the colMetaData just prepared for the given columns */
+static void
+SaveRowDescription(RowDescCacheEntry *entry, int natts, RowDescColumn *columns)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(rowDescCacheContext);
+	RowDescShape *shape = palloc(sizeof(RowDescShape));
+	int			attno;
+
+	shape->natts = natts;
+	shape->columns = palloc(sizeof(RowDescColumn) * natts);
+	memcpy(shape->columns, columns, sizeof(RowDescColumn) * natts);
+	shape->colMetaData = palloc(sizeof(TdsColumnMetaData) * natts);
+	memcpy(shape->colMetaData, colMetaData, sizeof(TdsColumnMetaData) * natts);
+	for (attno = 0; attno < natts; attno++)
+	{
+		TdsColumnMetaData *col = &shape->colMetaData[attno];
+
+		initStringInfo(&col->colName);
+		appendBinaryStringInfo(&col->colName,
+							   colMetaData[attno].colName.data,
+							   colMetaData[attno].colName.len);
+		col->baseColName = NULL;
+		col->relinfo = NULL;
+	}
+
+	if (list_length(entry->shapes) >= ROWDESC_CACHE_MAX_SHAPES)
+	{
+		RowDescShape *oldest = (RowDescShape *) llast(entry->shapes);
+
+		for (attno = 0; attno < oldest->natts; attno++)
+			pfree(oldest->colMetaData[attno].colName.data);
+		pfree(oldest->colMetaData);
+		pfree(oldest->columns);
+		pfree(oldest);
+		entry->shapes = list_delete_last(entry->shapes);
+	}
+	entry->shapes = lcons(shape, entry->shapes);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
 void
 TdsSendRowDescription(TupleDesc typeinfo,
 						   List *targetlist, int16 *formats)
 {
 	TDSRequest		request = TdsRequestCtrl->request;
+	RowDescCacheEntry *cacheEntry = NULL;
 
 	/* If we reach here, typeinfo should not be null. */
 	Assert(typeinfo != NULL);
 
+	if (request->reqType == TDS_REQUEST_SP_NUMBER)
+		cacheEntry = GetRowDescCacheEntry((TDSRequestSP) request);
+
 	/* Prepare the column metadata first */
-	PrepareRowDescription(typeinfo, targetlist, formats, false, false);
+	if (cacheEntry == NULL)
+		PrepareRowDescription(typeinfo, targetlist, formats, false, false);
+	else
+	{
+		RowDescColumn *columns = GetRowDescColumns(typeinfo, targetlist);
+
+		if (!RestoreRowDescription(cacheEntry, typeinfo->natts, columns))
+		{
+			PrepareRowDescription(typeinfo, targetlist, formats, false, false);
+			if (rowDescCacheable)
+				SaveRowDescription(cacheEntry, typeinfo->natts, columns);
+		}
+		pfree(columns);
+	}
 
 	/*
 	 * If fNoMetadata flags is set in RPC header flag, the server doesn't need
@@ -2354,6 +2844,7 @@ TdsSendRowDescription(TupleDesc typeinfo,
 			&& (req->spType != SP_PREPEXEC) && (req->spType != SP_EXECUTE) && (req->spType != SP_EXECUTESQL))
 		{
                       TDS_DEBUG(TDS_DEBUG2, "SendColumnMetadataToken: token=0x%02x", TDS_TOKEN_COLMETADATA);
+			TdsWireCounters.colMetadataTokens++;
 			TdsPutInt8(TDS_TOKEN_COLMETADATA);
 			TdsPutInt8(0xFF);
 			TdsPutInt8(0xFF);
@@ -2375,10 +2866,15 @@ TdsPrintTup(TupleTableSlot *slot, DestReceiver *self)
 	uint8_t			rowToken;
 	TDSRequest              request = TdsRequestCtrl->request;
 	bool			sendRowStat = false;
+	bool			rowAllFixed;
 	int 			nullMapSize = 0;
 	int 			simpleRowSize = 0;
+	int				fixedRowSize = 0;
+	int				nullRowSize = 0;
+	int				rowSize;
 	uint32_t		tdsVersion = GetClientTDSVersion();
 	uint8_t		   *nullMap = NULL;
+	char		   *rowBuf;
 
 	TdsErrorContext->err_text = "Writing the Tds response to the socket";
 	if (request->reqType == TDS_REQUEST_SP_NUMBER)
@@ -2391,7 +2887,7 @@ TdsPrintTup(TupleTableSlot *slot, DestReceiver *self)
 	}
 
 	/* Set or update my derived attribute info, if needed */
-	if (myState->attrinfo != typeinfo || myState->nattrs != natts)
+	if (myState->attrinfo != typeinfo || myState->nattrs != natts || colPlan == NULL)
 		PrintTupPrepareInfo(myState, typeinfo, natts);
 
 	/* Make sure the tuple is fully deconstructed */
@@ -2400,98 +2896,106 @@ TdsPrintTup(TupleTableSlot *slot, DestReceiver *self)
 	/* Switch into per-row context so we can recover memory below */
 	oldContext = MemoryContextSwitchTo(myState->tmpcontext);
 
+	/*
+	 * Determine the row type we send and, for rows that consist of fixed-width
+	 * columns only, the size of the encoded row.  NBCROW token was introduced
+	 * in TDS version 7.3B.  For rows that don't contain any NULL values in
+	 * variable size columns (like NVARCHAR) we can send the simple ROW (0xD1)
+	 * format. Rows that do (specifically NVARCHAR/VARCHAR/CHAR/NCHAR/BINARY
+	 * datatypes) need to be sent as NBCROW (0xD2). Count the number of
+	 * nullable columns and build the null bitmap just in case while we are
+	 * at it.
+	 */
+	rowAllFixed = colPlanAllFixed;
 	if (tdsVersion >= TDS_VERSION_7_3_B)
 	{
-		/*
-		 * NBCROW token was introduced in TDS version 7.3B.
-		 * Determine the row type we send. For rows that don't contain any
-		 * NULL values in variable size columns (like NVARCHAR) we can send
-		 * the simple ROW (0xD1) format. Rows that do (specifically
-		 * NVARCHAR/VARCHAR/CHAR/NCHAR/BINARY datatypes) need to be sent as
-		 * NBCROW (0xD2). Count the number of nullable columns and build the
-		 * null bitmap just in case while we are at it.
-		 */
 		nullMapSize = (natts + 7) / 8;
-		nullMap = palloc0(nullMapSize);
-		MemSet(nullMap, 0, nullMapSize * sizeof(int8_t));
-		for (attno = 0; attno < natts; attno++)
-		{
-			TdsColumnMetaData  *col = &colMetaData[attno];
+		nullMap = colPlanNullMap;
+		MemSet(nullMap, 0, nullMapSize);
+	}
+
+	for (attno = 0; attno < natts; attno++)
+	{
+		TdsColumnPlan  *plan = &colPlan[attno];
 
-			if (col->metaEntry.type1.flags & TDS_COLMETA_NULLABLE)
+		if (slot->tts_isnull[attno])
+		{
+			if (nullMap != NULL && plan->nullable)
 			{
-				if (slot->tts_isnull[attno])
-				{
-					nullMap[attno / 8] |= (0x01 << (attno & 0x07));
-					switch (col->metaEntry.type1.tdsTypeId)
-					{
-						case TDS_TYPE_VARCHAR:
-						case TDS_TYPE_NVARCHAR:
-							if (col->metaEntry.type2.maxSize == 0xffff)
-								/* 
-								 * To send NULL for VARCHAR(max) or NVARCHAR(max),
-								 * we have to indicate it using 0xffffffffffffffff (PLP_NULL)
-								 */
-								simpleRowSize += 8;
-							else
-								/* 
-								 * For regular case of VARCHAR/NVARCHAR, 
-								 * we have to send 0xffff (CHARBIN_NULL) to indicate NULL
-								 */
-								simpleRowSize += 2;
-							break;
-						case TDS_TYPE_VARBINARY:
-							if (col->metaEntry.type7.maxSize == 0xffff)
-								/* To send NULL for VARBINARY(max),we have to indicate it using 0xffffffffffffffff (PLP_NULL) */
-								simpleRowSize += 8;
-							else
-								/* For regular case of VARBINARY,we have to send 0xffff (CHARBIN_NULL) to indicate NULL */
-								simpleRowSize += 2;
-							break;
-						case TDS_TYPE_CHAR:
-						case TDS_TYPE_NCHAR:
-						case TDS_TYPE_XML:
-						case TDS_TYPE_BINARY:
-							/* For these datatypes, we need to send 0xffff (CHARBIN_NULL) to indicate NULL */
-							simpleRowSize += 2;
-							break;
-						case TDS_TYPE_SQLVARIANT:
-							/* For sql_variant, we need to send 0x00000000 to indicate NULL */
-							simpleRowSize += 4;
-							break;
-						default:
-							/* for other datatypes, we need to send 0x00 (1 byte) only */
-							simpleRowSize += 1;
-							break;
-					}
-				}
+				nullMap[attno / 8] |= (0x01 << (attno & 0x07));
+				simpleRowSize += plan->nullLen;
 			}
+			nullRowSize += plan->nullLen;
+		}
+		else if (rowAllFixed)
+			fixedRowSize += plan->fixedLen + (plan->sendLength ? 1 : 0);
+	}
+
+	if (nullMap != NULL && nullMapSize < simpleRowSize)
+		rowToken = TDS_TOKEN_NBCROW;
+	else
+		/* ROW is only token to send data for TDS version lower or equal to 7.3A. */
+		rowToken = TDS_TOKEN_ROW;
+
+	TDS_DEBUG(TDS_DEBUG2, "rowToken = 0x%02x", rowToken);
+	TdsWireCounters.rowTokens++;
+	if (rowToken == TDS_TOKEN_NBCROW)
+		TDSInstrumentation(INSTR_TDS_TOKEN_NBCROW);
+
+	/*
+	 * Fast path: a row of fixed-width columns is encoded straight into the
+	 * send buffer if it fits in the current packet.  With NBCROW, NULL values
+	 * are sent using NULL bitmap only.
+	 */
+	rowSize = sizeof(rowToken) + (sendRowStat ? sizeof(int32_t) : 0);
+	if (rowToken == TDS_TOKEN_NBCROW)
+		rowSize += nullMapSize + fixedRowSize;
+	else
+		rowSize += fixedRowSize + nullRowSize;
+
+	if (rowAllFixed && (rowBuf = TdsReserveSendBuffer(rowSize)) != NULL)
+	{
+		char	   *p = rowBuf;
+
+		*p++ = (char) rowToken;
+		if (rowToken == TDS_TOKEN_NBCROW)
+		{
+			memcpy(p, nullMap, nullMapSize);
+			p += nullMapSize;
 		}
 
-		if (nullMapSize < simpleRowSize)
+		for (attno = 0; attno < natts; attno++)
 		{
-			rowToken = TDS_TOKEN_NBCROW;
+			TdsColumnPlan  *plan = &colPlan[attno];
+
+			if (!slot->tts_isnull[attno])
+				p += EncodeFixedValue(p, plan, slot->tts_values[attno]);
+			else if (rowToken == TDS_TOKEN_ROW)
+			{
+				memcpy(p, plan->nullMarker, plan->nullLen);
+				p += plan->nullLen;
+			}
 		}
-		else
+
+		if (sendRowStat)
 		{
-			rowToken = TDS_TOKEN_ROW;
+			uint32		tmp = htoLE32(SP_CURSOR_FETCH_SUCCEEDED);
+
+			memcpy(p, &tmp, sizeof(tmp));
+			p += sizeof(tmp);
 		}
+		Assert(p - rowBuf == rowSize);
+
+		MemoryContextSwitchTo(oldContext);
+		(void) TdsSendPending();
+		return true;
 	}
-	else
-		/* ROW is only token to send data for TDS version lower or equal to 7.3A. */
-		rowToken = TDS_TOKEN_ROW;
+
 	/* Send the row token and the NULL bitmap if it is NBCROW */
-	TDS_DEBUG(TDS_DEBUG2, "rowToken = 0x%02x", rowToken);
 	TdsPutbytes(&rowToken, sizeof(rowToken));
 
 	if (rowToken == TDS_TOKEN_NBCROW)
-	{
 		TdsPutbytes(nullMap, nullMapSize);
-		TDSInstrumentation(INSTR_TDS_TOKEN_NBCROW);
-	}
-
-	if (nullMap != NULL)
-		pfree(nullMap);
 
 	/* And finally send the actual column values */
 	for (attno = 0; attno < natts; attno++)
@@ -2499,6 +3003,7 @@ TdsPrintTup(TupleTableSlot *slot, DestReceiver *self)
 		PrinttupAttrInfo   *thisState;
 		Datum				attr;
 		TdsColumnMetaData  *col = &colMetaData[attno];
+		TdsColumnPlan	   *plan = &colPlan[attno];
 
 		if (slot->tts_isnull[attno])
 		{
@@ -2507,49 +3012,7 @@ TdsPrintTup(TupleTableSlot *slot, DestReceiver *self)
 			 * sent using NULL bitmap only
 			 */
 			if (rowToken == TDS_TOKEN_ROW)
-			{
-				switch (col->metaEntry.type1.tdsTypeId)
-				{
-					case TDS_TYPE_VARCHAR:
-					case TDS_TYPE_NVARCHAR:
-						if (col->metaEntry.type2.maxSize == 0xffff)
-							/* 
-							 * To send NULL for VARCHAR(max) or NVARCHAR(max),
-							 * we have to indicate it using 0xffffffffffffffff (PLP_NULL)
-							 */
-							TdsPutUInt64LE(0xffffffffffffffff);
-						else
-							/* 
-							 * For regular case of VARCHAR/NVARCHAR, 
-							 * we have to send 0xffff (CHARBIN_NULL) to indicate NULL
-							 */
-							TdsPutInt16LE(0xffff);
-						break;
-					case TDS_TYPE_VARBINARY:
-						if (col->metaEntry.type7.maxSize == 0xffff)
-							/* To send NULL for VARBINARY(max),we have to indicate it using 0xffffffffffffffff (PLP_NULL) */
-							TdsPutUInt64LE(0xffffffffffffffff);
-						else
-							/* For regular case of VARBINARY,we have to send 0xffff (CHARBIN_NULL) to indicate NULL */
-							TdsPutInt16LE(0xffff);
-						break;
-					case TDS_TYPE_CHAR:
-					case TDS_TYPE_NCHAR:
-					case TDS_TYPE_XML:
-					case TDS_TYPE_BINARY:
-						/* In case of TDS version lower than or equal to 7.3A, we need to send 0xffff (CHARBIN_NULL)*/
-						TdsPutInt16LE(0xffff);
-						break;
-					case TDS_TYPE_SQLVARIANT:
-						/* For sql_variant, we need to send 0x00000000 to indicate NULL */
-						TdsPutInt32LE(0);
-						break;
-					default:
-						/* for these datatypes, we need to send 0x00 (1 byte) only */
-						TdsPutUInt8(0);
-						break;
-				}
-			}
+				TdsPutbytes(plan->nullMarker, plan->nullLen);
 			continue;
 		}
 
@@ -2568,7 +3031,7 @@ TdsPrintTup(TupleTableSlot *slot, DestReceiver *self)
 										  VARSIZE_ANY(attr));
 
 		/* Call the type specific output function */
-		(col->sendFunc)(&thisState->finfo, attr, (void *)col);
+		(plan->sendFunc)(&thisState->finfo, attr, (void *)col);
 	}
 
 	/*
@@ -2592,12 +3055,22 @@ TdsPrintTup(TupleTableSlot *slot, DestReceiver *self)
 	MemoryContextSwitchTo(oldContext);
 	MemoryContextReset(myState->tmpcontext);
 
+	/* Let the client have whatever complete packets we have produced */
+	(void) TdsSendPending();
+
 	return true;
 }
 
 void
 TdsPrintTupShutdown(void)
 {
+	if (colPlan)
+	{
+		pfree(colPlan);
+		pfree(colPlanNullMap);
+	}
+	colPlan = NULL;
+	colPlanNullMap = NULL;
 	pfree(colMetaData);
 	colMetaData = NULL;
 }
@@ -2617,6 +3090,7 @@ TdsSendReturnStatus(int status)
 
       TDS_DEBUG(TDS_DEBUG2, "TdsSendReturnStatus: token=0x%02x", TDS_TOKEN_RETURNSTATUS);
 	temp8 = TDS_TOKEN_RETURNSTATUS;
+	TdsWireCounters.returnStatusTokens++;
 	TdsPutbytes(&temp8, sizeof(temp8));
 
 	tmp = htoLE32(status);
@@ -20,6 +20,7 @@
 #include <fcntl.h>
 #include <ctype.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #ifdef HAVE_NETINET_TCP_H
@@ -431,3 +432,56 @@ retry:
 
 	return n;
 }
+
+/*
+ *	Write data from several buffers to the connection with one system call.
+ *
+ *	Only for connections without TLS, where the TDS packet header and its
+ *	payload can go out without copying them together first.  Like
+ *	tds_secure_write(), may write less than asked for.
+ */
+ssize_t
+tds_secure_writev(Port *port, struct iovec *iov, int iovcnt)
+{
+	ssize_t		n;
+
+	Assert(!port->ssl_in_use);
+
+	/* Deal with any already-pending interrupt condition. */
+	ProcessClientWriteInterrupt(false);
+
+retry:
+	n = writev(port->sock, iov, iovcnt);
+
+	if (n < 0 && !port->noblock && (errno == EWOULDBLOCK || errno == EAGAIN))
+	{
+		WaitEvent	event;
+
+		ModifyWaitEvent(FeBeWaitSet, 0, WL_SOCKET_WRITEABLE, NULL);
+
+		WaitEventSetWait(FeBeWaitSet, -1 /* no timeout */ , &event, 1,
+						 WAIT_EVENT_CLIENT_WRITE);
+
+		/* See comments in secure_read. */
+		if (event.events & WL_POSTMASTER_DEATH)
+			ereport(FATAL,
+					(errcode(ERRCODE_ADMIN_SHUTDOWN),
+					 errmsg("terminating connection due to unexpected postmaster exit")));
+
+		/* Handle interrupt. */
+		if (event.events & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+			ProcessClientWriteInterrupt(true);
+		}
+		goto retry;
+	}
+
+	/*
+	 * Process interrupts that happened during a successful (or non-blocking,
+	 * or hard-failed) write.
+	 */
+	ProcessClientWriteInterrupt(false);
+
+	return n;
+}
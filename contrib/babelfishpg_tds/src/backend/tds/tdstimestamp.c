@@ -83,71 +83,67 @@ TdsGetDayDifferenceHelper(int day, int mon, int year, bool isDateType)
 	return numDays;
 }
 
+/*
+ * Split a timestamp into whole days since the PostgreSQL epoch and
+ * microseconds since midnight.  This is all the TDS encoders need, so we
+ * don't go through timestamp2tm().
+ */
 static inline void
-GetDateFromDatum(Datum date, struct pg_tm *tm)
+SplitTimestamp(Timestamp timestamp, int64 *days, int64 *usecs)
 {
-	if (!DATE_NOT_FINITE(date))
+	*days = timestamp / USECS_PER_DAY;
+	*usecs = timestamp - *days * USECS_PER_DAY;
+	if (*usecs < 0)
 	{
-		j2date(date + POSTGRES_EPOCH_JDATE,
-		&(tm->tm_year), &(tm->tm_mon), &(tm->tm_mday));
+		*usecs += USECS_PER_DAY;
+		(*days)--;
 	}
-	else
-		ereport(ERROR,
-		(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
-		errmsg("date out of range")));
 }
 
 static inline void
-GetDatetimeFromDatum(Datum value, fsec_t *fsec, struct pg_tm *tm)
+CheckDatetimeValidity(Timestamp timestamp)
 {
-	Timestamp timestamp = (Timestamp)value;
-
-	if (TIMESTAMP_NOT_FINITE(timestamp) ||
-		timestamp2tm(timestamp, NULL, tm, fsec, NULL, NULL) != 0)
+	if (TIMESTAMP_NOT_FINITE(timestamp) || !IS_VALID_TIMESTAMP(timestamp))
 		ereport(ERROR,
 		(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
 		errmsg("Datetime out of range")));
 }
 
 /*
- * Get numDays elapsed between client date and 1-1-0001
+ * Convert microseconds since midnight to units of 10^-scale seconds,
+ * rounding to the nearest unit.
  */
-uint32
-TdsDayDifference(Datum value)
+uint64
+TdsScaleTimeOfDay(int64 usecs, int scale)
 {
-	uint32 numDays = 0;
-	struct pg_tm tj, ti, *tm = &ti, *tt = &tj;
+	int64		divisor = 1;
 
-	GetDateFromDatum(value, tm);
+	if (scale >= 6)
+	{
+		while (scale-- > 6)
+			usecs *= 10;
+		return (uint64) usecs;
+	}
 
-	tt->tm_mday = 1, tt->tm_mon = 1, tt->tm_year = 1;
-	numDays = GetDayDifference(tt, tm);
-	return numDays;
+	while (scale++ < 6)
+		divisor *= 10;
+	return (uint64) ((usecs + divisor / 2) / divisor);
 }
 
 /*
- * Decides whether the effective date to consider is the next day
- * based on hour, minute, second value 23:59:59
+ * Get numDays elapsed between client date and 1-1-0001
  */
-static inline void
-GetNumDaysHelper(struct pg_tm *tm)
+uint32
+TdsDayDifference(Datum value)
 {
-	tm->tm_hour = tm->tm_min = tm->tm_sec = 0;
-	if (tm->tm_mday == DaycountInMonth[tm->tm_mon - 1] &&
-		tm->tm_mon == 12)
-	{
-		tm->tm_year++;
-		tm->tm_mon = tm->tm_mday = 1;
-	}
-	else if ((tm->tm_mday == DaycountInMonth[tm->tm_mon - 1] && tm->tm_mon != 2) ||
-		(tm->tm_mon == 2 && tm->tm_mday == 29 && IsLeap(tm->tm_year)) ||
-		(tm->tm_mon == 2 && tm->tm_mday == 28 && !IsLeap(tm->tm_year)))
-	{
-		tm->tm_mon++;
-		tm->tm_mday = 1;
-	}
-	else
-		tm->tm_mday++;
+	DateADT		date = DatumGetDateADT(value);
+
+	if (DATE_NOT_FINITE(date))
+		ereport(ERROR,
+		(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+		errmsg("date out of range")));
+
+	return (uint32) (date + POSTGRES_EPOCH_JDATE - date2j(1, 1, 1));
 }
 
 /*
@@ -158,25 +154,28 @@ void
 TdsTimeDifferenceSmalldatetime(Datum value, uint16 *numDays, 
 							uint16 *numMins)
 {
-	struct pg_tm tj, ti, *tm = &ti, *tt = &tj;
-	fsec_t fsec = 0;
+	int64		days, usecs;
+	int			secs, fsec;
 
-	GetDatetimeFromDatum(value, &fsec, tm);
-	tt->tm_mday = 1, tt->tm_mon = 1, tt->tm_year = 1900;
+	CheckDatetimeValidity((Timestamp) value);
+	SplitTimestamp((Timestamp) value, &days, &usecs);
 
-	*numDays = (uint16)GetDayDifference(tt, tm);
+	*numDays = (uint16) (days + POSTGRES_EPOCH_JDATE - date2j(1900, 1, 1));
+	secs = (int) (usecs / USECS_PER_SEC);
+	fsec = (int) (usecs % USECS_PER_SEC);
 
-	if (tm->tm_hour == 23 && tm->tm_min == 59 && tm->tm_sec == 59)
+	if (secs / SECS_PER_MINUTE == MINS_PER_HOUR * HOURS_PER_DAY - 1 &&
+		secs % SECS_PER_MINUTE == 59)
 	{
-		fsec = 0;
-		GetNumDaysHelper(tm);
+		/* 23:59:59 rounds up to midnight of the next day */
 		(*numDays)++;
+		*numMins = 0;
+		return;
 	}
-	else if ((tm->tm_sec == 29 && (fsec/1000) > 998) || tm->tm_sec > 29)
-		tm->tm_min++;
 
-	tm->tm_sec = 0;
-	*numMins = (tm->tm_hour * 60) + tm->tm_min;	
+	*numMins = secs / SECS_PER_MINUTE;
+	if ((secs % SECS_PER_MINUTE == 29 && (fsec/1000) > 998) || secs % SECS_PER_MINUTE > 29)
+		(*numMins)++;
 }
 
 /*
@@ -188,20 +187,21 @@ TdsTimeDifferenceDatetime(Datum value, uint32 *numDays,
 					uint32 *numTicks)
 {
 	uint32 milliCount = 0;
-	struct pg_tm tj, ti, *tm = &ti, *tt = &tj;
-	fsec_t fsec;
+	int64		days, usecs;
+	int			secs, fsec;
 	int unit = 0;
 
-	GetDatetimeFromDatum(value, &fsec, tm);
-	tt->tm_mday = 1, tt->tm_mon = 1, tt->tm_year = 1900;
-	
-	*numDays = GetDayDifference(tt, tm);
+	CheckDatetimeValidity((Timestamp) value);
+	SplitTimestamp((Timestamp) value, &days, &usecs);
+
+	*numDays = (uint32) (days + POSTGRES_EPOCH_JDATE - date2j(1900, 1, 1));
+	secs = (int) (usecs / USECS_PER_SEC);
+	fsec = (int) (usecs % USECS_PER_SEC);
 
-	if (tm->tm_hour == 23 && tm->tm_min == 59 && tm->tm_sec == 59 &&
-		fsec == 999000)
+	if (secs == SECS_PER_DAY - 1 && fsec == 999000)
 	{
-		fsec = 0;
-		GetNumDaysHelper(tm);
+		/* 23:59:59.999 rounds up to midnight of the next day */
+		secs = fsec = 0;
 		(*numDays)++;
 	}
 	else
@@ -214,8 +214,7 @@ TdsTimeDifferenceDatetime(Datum value, uint32 *numDays,
 		else if (unit == 5)
 			fsec = ((fsec/1000)+2) * 1000;
 	}
-	milliCount = (((tm->tm_hour * 60 + tm->tm_min) * 60 +
-			tm->tm_sec) * 1000 + (int)fsec/1000);
+	milliCount = secs * 1000 + fsec/1000;
 	
 	*numTicks = (int)(milliCount/3.3333333);
 }
@@ -408,25 +407,16 @@ void
 TdsGetDayTimeFromTimestamp(Timestamp value, uint32 *numDays, uint64 *numSec,
 								int scale)
 {
-	struct pg_tm	ti, tj, *tm = &ti, *tt = &tj;
-	fsec_t		fsec = 0;
-	double		res = 0;
+	int64		days, usecs;
 
-	if (timestamp2tm((Timestamp)value, NULL, tm, &fsec, NULL, NULL) != 0)
+	if (TIMESTAMP_NOT_FINITE(value) || !IS_VALID_TIMESTAMP(value))
 		ereport(ERROR,(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
 		errmsg("timestamp out of range")));
 
-	tt->tm_mday = 1, tt->tm_mon = 1, tt->tm_year = 1;
-	*numDays = (uint32)GetDayDifference(tt, tm);
+	SplitTimestamp(value, &days, &usecs);
 
-	res = (double)(((tm->tm_hour * 60 + tm->tm_min) * 60 + tm->tm_sec) +
-			((double)fsec/ 1000000));
-	while (scale--)
-		res *= 10;
-	/* Round res to the nearest integer */
-	res += 0.5;
-	
-	*numSec = (uint64_t)res;
+	*numDays = (uint32) (days + POSTGRES_EPOCH_JDATE - date2j(1, 1, 1));
+	*numSec = TdsScaleTimeOfDay(usecs, scale);
 }
 
 void TdsGetTimestampFromDayTime(uint32 numDays, uint64 numMicro, int tz,
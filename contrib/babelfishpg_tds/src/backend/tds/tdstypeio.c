@@ -16,22 +16,33 @@
 
 #include "postgres.h"
 
+#include "access/detoast.h"
+#include "access/heapam.h"
 #include "access/htup_details.h"
+#include "access/table.h"
+#include "access/tableam.h"
 #include "access/xact.h"
 #include "catalog/pg_authid.h"
 #include "catalog/pg_type.h"
 #include "catalog/pg_namespace.h"
+#include "executor/executor.h"
+#include "executor/nodeModifyTable.h"
 #include "executor/spi.h"
 #include "fmgr.h"
 #include "mb/pg_wchar.h"
 #include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "optimizer/optimizer.h"
+#include "parser/parse_coerce.h"
 #include "parser/scansup.h"
+#include "rewrite/rewriteHandler.h"
 #include "utils/cash.h"
 #include "utils/hsearch.h"
 #include "utils/builtins.h"				/* for format_type_be() */
 #include "utils/guc.h"
 #include "utils/lsyscache.h"				/* for getTypeInputInfo() and OidInputFunctionCall()*/
 #include "utils/numeric.h"
+#include "utils/rel.h"
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
 #include "utils/uuid.h"
@@ -1989,6 +2000,305 @@ TdsRecvTypeNumeric(const char *message, const ParameterToken token)
 	PG_RETURN_NUMERIC(res);
 }
 
+/* Rows of a table-valued parameter buffered per table_multi_insert call. */
+#define TVP_MAX_BUFFERED_ROWS	1000
+
+/* Number of table-valued parameters received by this backend. */
+static uint32 tvpTempTableCount = 0;
+
+/*
+ * TvpColumnToDatum - converts one received cell of a table-valued parameter
+ * into a Datum of the column's TDS type.
+ */
+static Datum
+TvpColumnToDatum(StringInfo buf, TvpColMetaData *col)
+{
+	switch (col->columnTdsType)
+	{
+		case TDS_TYPE_CHAR:
+		case TDS_TYPE_VARCHAR:
+			return TdsTypeVarcharToDatum(buf, col->collation, col->columnTdsType);
+		case TDS_TYPE_NCHAR:
+			return TdsTypeNCharToDatum(buf);
+		case TDS_TYPE_NVARCHAR:
+			/* Already converted to UTF-8 while the row was read. */
+			return PointerGetDatum(tds_varchar_input(buf->data, buf->len, -1));
+		case TDS_TYPE_INTEGER:
+		case TDS_TYPE_BIT:
+			return TdsTypeIntegerToDatum(buf, col->maxLen);
+		case TDS_TYPE_FLOAT:
+			return TdsTypeFloatToDatum(buf, col->maxLen);
+		case TDS_TYPE_NUMERICN:
+		case TDS_TYPE_DECIMALN:
+			return TdsTypeNumericToDatum(buf, col->scale);
+		case TDS_TYPE_VARBINARY:
+		case TDS_TYPE_BINARY:
+			return TdsTypeVarbinaryToDatum(buf);
+		case TDS_TYPE_DATE:
+			return TdsTypeDateToDatum(buf);
+		case TDS_TYPE_TIME:
+			return TdsTypeTimeToDatum(buf, col->scale, buf->len);
+		case TDS_TYPE_DATETIMEOFFSET:
+			return TdsTypeDatetimeoffsetToDatum(buf, col->scale, buf->len);
+		case TDS_TYPE_DATETIME2:
+			return TdsTypeDatetime2ToDatum(buf, col->scale, buf->len);
+		case TDS_TYPE_DATETIMEN:
+			if (col->maxLen == TDS_MAXLEN_SMALLDATETIME)
+				return TdsTypeSmallDatetimeToDatum(buf);
+			return TdsTypeDatetimeToDatum(buf);
+		case TDS_TYPE_MONEYN:
+			if (col->maxLen == TDS_MAXLEN_SMALLMONEY)
+				return TdsTypeSmallMoneyToDatum(buf);
+			return TdsTypeMoneyToDatum(buf);
+		case TDS_TYPE_XML:
+			return TdsTypeXMLToDatum(buf);
+		case TDS_TYPE_UNIQUEIDENTIFIER:
+			return TdsTypeUIDToDatum(buf);
+		case TDS_TYPE_SQLVARIANT:
+			return TdsTypeSqlVariantToDatum(buf);
+	}
+	return (Datum) 0;
+}
+
+/*
+ * TvpFlushRows - writes the buffered rows of a table-valued parameter to its
+ * temp table and updates the indexes.
+ */
+static void
+TvpFlushRows(ResultRelInfo *resultRelInfo, EState *estate, TupleTableSlot **slots,
+			 int nslots, CommandId mycid, BulkInsertState bistate)
+{
+	MemoryContext oldcontext;
+
+	/* table_multi_insert may leak memory, so use the per-tuple context. */
+	oldcontext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+	table_multi_insert(resultRelInfo->ri_RelationDesc, slots, nslots,
+					   mycid, 0, bistate);
+	MemoryContextSwitchTo(oldcontext);
+
+	for (int i = 0; i < nslots; i++)
+	{
+		if (resultRelInfo->ri_NumIndices > 0)
+		{
+			List	   *recheckIndexes;
+
+			recheckIndexes = ExecInsertIndexTuples(resultRelInfo, slots[i], estate,
+												   false, false, NULL, NIL);
+			list_free(recheckIndexes);
+		}
+		ExecClearTuple(slots[i]);
+	}
+}
+
+/*
+ * TvpInsertRows - inserts the rows of a table-valued parameter into the temp
+ * table created for it.
+ *
+ * Rows are decoded straight into slots and written in batches with
+ * table_multi_insert, the way COPY FROM does, so no INSERT statement has to
+ * be built and parsed. A value whose type or typmod differs from its column
+ * gets the same assignment coercion INSERT would apply to it, and columns
+ * beyond the ones sent by the client get their defaults.
+ */
+static void
+TvpInsertRows(const char *tableName, ParameterToken token)
+{
+	TvpData    *tvpInfo = token->tvpInfo;
+	TvpColMetaData *colMetaData = tvpInfo->colMetaData;
+	int			colCount = tvpInfo->colCount;
+	Relation	rel;
+	TupleDesc	tupDesc;
+	RangeTblEntry *rte;
+	EState	   *estate;
+	ExprContext *econtext;
+	ResultRelInfo *resultRelInfo;
+	ParamListInfo params;
+	ExprState **colexprs;
+	TupleTableSlot **slots;
+	BulkInsertState bistate;
+	CommandId	mycid = GetCurrentCommandId(true);
+	MemoryContext oldcontext;
+	int			nslots = 0;
+	TvpRowData *row;
+
+	rel = table_openrv(makeRangeVar(NULL, (char *) tableName, -1), RowExclusiveLock);
+	tupDesc = RelationGetDescr(rel);
+
+	if (colCount > tupDesc->natts)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("INSERT has more expressions than target columns")));
+
+	estate = CreateExecutorState();
+	rte = makeNode(RangeTblEntry);
+	rte->rtekind = RTE_RELATION;
+	rte->relid = RelationGetRelid(rel);
+	rte->relkind = rel->rd_rel->relkind;
+	rte->rellockmode = RowExclusiveLock;
+	ExecInitRangeTable(estate, list_make1(rte));
+
+	resultRelInfo = makeNode(ResultRelInfo);
+	InitResultRelInfo(resultRelInfo, rel, 1, NULL, 0);
+	ExecOpenIndices(resultRelInfo, false);
+
+	/* Received values reach the coercion expressions as extern params. */
+	params = makeParamList(colCount);
+	econtext = GetPerTupleExprContext(estate);
+	econtext->ecxt_param_list_info = params;
+
+	/*
+	 * Build, per attribute, the expression producing its value: a coercion of
+	 * the received value where one is needed, or the column default for
+	 * attributes the client did not send. NULL means the received value is
+	 * stored as is.
+	 */
+	colexprs = (ExprState **) palloc0(tupDesc->natts * sizeof(ExprState *));
+	for (int i = 0; i < tupDesc->natts; i++)
+	{
+		Form_pg_attribute att = TupleDescAttr(tupDesc, i);
+		Node	   *expr;
+
+		if (att->attisdropped)
+			continue;
+
+		if (i < colCount)
+		{
+			TdsIoFunctionInfo finfo;
+			Param	   *param;
+			Oid			srctype;
+
+			finfo = TdsLookupTypeFunctionsByTdsId(colMetaData[i].columnTdsType,
+												  colMetaData[i].maxLen);
+			if (colMetaData[i].columnTdsType == TDS_TYPE_VARBINARY ||
+				colMetaData[i].columnTdsType == TDS_TYPE_BINARY)
+				srctype = finfo->ttmtypeid;
+			else
+				GetPgOid(srctype, finfo);
+
+			params->params[i].ptype = srctype;
+			params->params[i].pflags = PARAM_FLAG_CONST;
+
+			if (srctype == att->atttypid && att->atttypmod < 0)
+				continue;
+
+			param = makeNode(Param);
+			param->paramkind = PARAM_EXTERN;
+			param->paramid = i + 1;
+			param->paramtype = srctype;
+			param->paramtypmod = -1;
+			param->paramcollid = get_typcollation(srctype);
+			param->location = -1;
+
+			expr = coerce_to_target_type(NULL, (Node *) param, srctype,
+										 att->atttypid, att->atttypmod,
+										 COERCION_ASSIGNMENT,
+										 COERCE_IMPLICIT_CAST, -1);
+
+			/*
+			 * NVARCHAR values used to reach the table as quoted literals, so
+			 * keep accepting whatever the column's input function accepts.
+			 */
+			if (expr == NULL && colMetaData[i].columnTdsType == TDS_TYPE_NVARCHAR)
+				expr = coerce_to_target_type(NULL, (Node *) param, srctype,
+											 att->atttypid, att->atttypmod,
+											 COERCION_EXPLICIT,
+											 COERCE_IMPLICIT_CAST, -1);
+			if (expr == NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_DATATYPE_MISMATCH),
+						 errmsg("column \"%s\" is of type %s but expression is of type %s",
+								NameStr(att->attname),
+								format_type_be(att->atttypid),
+								format_type_be(srctype))));
+			if (expr == (Node *) param)
+				continue;
+		}
+		else
+		{
+			expr = build_column_default(rel, i + 1);
+			if (expr == NULL)
+				continue;
+		}
+
+		colexprs[i] = ExecInitExpr(expression_planner((Expr *) expr), NULL);
+	}
+
+	slots = (TupleTableSlot **) palloc0(TVP_MAX_BUFFERED_ROWS * sizeof(TupleTableSlot *));
+	bistate = GetBulkInsertState();
+
+	for (row = tvpInfo->rowData; row; row = row->nextRow)
+	{
+		TupleTableSlot *slot;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (slots[nslots] == NULL)
+			slots[nslots] = table_slot_create(rel, &estate->es_tupleTable);
+		slot = slots[nslots];
+
+		ResetPerTupleExprContext(estate);
+		oldcontext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+		ExecClearTuple(slot);
+
+		for (int i = 0; i < colCount; i++)
+		{
+			ParamExternData *prm = &params->params[i];
+
+			prm->isnull = (row->isNull[i] == 'n');
+			prm->value = prm->isnull ? (Datum) 0 :
+				TvpColumnToDatum(&row->columnValues[i], &colMetaData[i]);
+		}
+
+		for (int i = 0; i < tupDesc->natts; i++)
+		{
+			if (colexprs[i] != NULL)
+				slot->tts_values[i] = ExecEvalExpr(colexprs[i], econtext,
+												   &slot->tts_isnull[i]);
+			else if (i < colCount)
+			{
+				slot->tts_values[i] = params->params[i].value;
+				slot->tts_isnull[i] = params->params[i].isnull;
+			}
+			else
+			{
+				slot->tts_values[i] = (Datum) 0;
+				slot->tts_isnull[i] = true;
+			}
+		}
+
+		ExecStoreVirtualTuple(slot);
+		slot->tts_tableOid = RelationGetRelid(rel);
+		MemoryContextSwitchTo(oldcontext);
+
+		if (tupDesc->constr && tupDesc->constr->has_generated_stored)
+			ExecComputeStoredGenerated(resultRelInfo, estate, slot, CMD_INSERT);
+
+		if (tupDesc->constr)
+			ExecConstraints(resultRelInfo, slot, estate);
+
+		/* The values point into the per-tuple context, keep a copy. */
+		ExecMaterializeSlot(slot);
+
+		if (++nslots == TVP_MAX_BUFFERED_ROWS)
+		{
+			TvpFlushRows(resultRelInfo, estate, slots, nslots, mycid, bistate);
+			nslots = 0;
+		}
+	}
+
+	if (nslots > 0)
+		TvpFlushRows(resultRelInfo, estate, slots, nslots, mycid, bistate);
+
+	FreeBulkInsertState(bistate);
+	ExecResetTupleTable(estate->es_tupleTable, false);
+	ExecCloseIndices(resultRelInfo);
+	FreeExecutorState(estate);
+	table_close(rel, NoLock);
+
+	/* Make the rows visible to the statement that reads the parameter. */
+	CommandCounterIncrement();
+}
+
 /* --------------------------------
  * TdsRecvTypeTable - creates a temp-table from the data being recevied on the wire
  * and sends this temp-table's name to the engine.
@@ -1999,24 +2309,24 @@ TdsRecvTypeTable(const char *message, const ParameterToken token)
 {
 	char * tableName;
 	char * query;
-	StringInfo temp;
 	int rc;
-	TvpRowData *row = token->tvpInfo->rowData;
-	TvpColMetaData *colMetaData = token->tvpInfo->colMetaData;
 	bool xactStarted = IsTransactionOrTransactionBlock();
 	char *finalTableName;
 	TvpLookupItem *item; 
-	temp = palloc(sizeof(StringInfoData));
-	initStringInfo(temp);
 
 	TDSInstrumentation(INSTR_TDS_DATATYPE_TABLE_VALUED_PARAMETER);
 
-	 /* Setting a unique name for TVP temp table. */
-	tableName = psprintf("%s_TDS_TVP_TEMP_TABLE_%d", token->tvpInfo->tableName, rand());
+	/*
+	 * Setting a unique name for TVP temp table. A per-backend counter never
+	 * hands out a name twice, and keeps the names reported by constraint
+	 * errors on the table stable.
+	 */
+	tableName = psprintf("%s_TDS_TVP_TEMP_TABLE_%u", token->tvpInfo->tableName,
+						 ++tvpTempTableCount);
 
 	/*
-	 * We change the dialect to postgres to create temp tables
-	 * and execute a prep/exec insert query via SPI.
+	 * We change the dialect to postgres to create the temp table
+	 * via SPI.
 	 */
 	set_config_option("babelfishpg_tsql.sql_dialect", "postgres",
 						  (superuser() ? PGC_SUSET : PGC_USERSET),
@@ -2051,136 +2361,25 @@ TdsRecvTypeTable(const char *message, const ParameterToken token)
 	if (!xactStarted)
 		CommitTransactionCommand();
 
-	{
-		char *src;
-		int nargs = token->tvpInfo->colCount * token->tvpInfo->rowCount;
-		Datum *values = palloc(nargs * sizeof(Datum));
-		char *nulls = palloc(nargs * sizeof(char));
-		Oid *argtypes= palloc(nargs * sizeof(Datum));
-		int i = 0;
-		query = " ";
+	finalTableName = downcase_truncate_identifier(tableName, strlen(tableName), true);
 
+	if (token->tvpInfo->rowData) /* If any row in TVP */
+	{
 		if (!xactStarted)
 			StartTransactionCommand();
 		PushActiveSnapshot(GetTransactionSnapshot());
 
-		while (row) /* Create the prep/exec query to insert the rows. */
-		{
-			TdsIoFunctionInfo tempFuncInfo;
-			int currentColumn = 0;
-			char *currentQuery = " ";
-
-			while(currentColumn != token->tvpInfo->colCount)
-			{
-				temp = &(row->columnValues[currentColumn]);
-				tempFuncInfo = TdsLookupTypeFunctionsByTdsId(colMetaData[currentColumn].columnTdsType, colMetaData[currentColumn].maxLen);
-				GetPgOid(argtypes[i], tempFuncInfo);
-				if (row->isNull[currentColumn] == 'n')
-					nulls[i] = row->isNull[currentColumn];
-				else
-					switch(colMetaData[currentColumn].columnTdsType)
-					{
-						case TDS_TYPE_CHAR:
-						case TDS_TYPE_VARCHAR:
-							values[i] = TdsTypeVarcharToDatum(temp, colMetaData[currentColumn].collation, colMetaData[currentColumn].columnTdsType);
-						break;
-						case TDS_TYPE_NCHAR:
-							values[i] = TdsTypeNCharToDatum(temp);
-						break;
-						case TDS_TYPE_NVARCHAR:
-							if (!row->isNull[currentColumn]) /* NULL. */
-								currentQuery = psprintf("%s,\'NULL\'", currentQuery);
-							else
-								currentQuery = psprintf("%s,\'%s\'", currentQuery, temp->data);
-							nargs--;
-						break;
-						case TDS_TYPE_INTEGER:
-						case TDS_TYPE_BIT:
-							values[i] = TdsTypeIntegerToDatum(temp, colMetaData[currentColumn].maxLen);
-						break;
-						case TDS_TYPE_FLOAT:
-							values[i] = TdsTypeFloatToDatum(temp, colMetaData[currentColumn].maxLen);
-						break;
-						case TDS_TYPE_NUMERICN:
-						case TDS_TYPE_DECIMALN:
-							values[i] = TdsTypeNumericToDatum(temp, colMetaData[currentColumn].scale);
-						break;
-						case TDS_TYPE_VARBINARY:
-						case TDS_TYPE_BINARY:
-							values[i] = TdsTypeVarbinaryToDatum(temp);
-							argtypes[i] = tempFuncInfo->ttmtypeid;
-						break;
-						case TDS_TYPE_DATE:
-							values[i] = TdsTypeDateToDatum(temp);
-						break;
-						case TDS_TYPE_TIME:
-							values[i] = TdsTypeTimeToDatum(temp, colMetaData[currentColumn].scale, temp->len);
-						break;
-						case TDS_TYPE_DATETIMEOFFSET:
-							values[i] = TdsTypeDatetimeoffsetToDatum(temp, colMetaData[currentColumn].scale, temp->len);
-						break;
-						case TDS_TYPE_DATETIME2:
-							values[i] = TdsTypeDatetime2ToDatum(temp, colMetaData[currentColumn].scale, temp->len);
-						break;
-						case TDS_TYPE_DATETIMEN:
-							values[i] = TdsTypeDatetimeToDatum(temp);
-						break;
-						case TDS_TYPE_MONEYN:
-							values[i] = TdsTypeMoneyToDatum(temp);
-						break;
-						case TDS_TYPE_XML:
-							values[i] = TdsTypeXMLToDatum(temp);
-						break;
-						case TDS_TYPE_UNIQUEIDENTIFIER:
-							values[i] = TdsTypeUIDToDatum(temp);
-						break;
-						case TDS_TYPE_SQLVARIANT:
-							values[i] = TdsTypeSqlVariantToDatum(temp);
-						break;
-					}
-				/* Build a string for bind parameters. */
-				if (colMetaData[currentColumn].columnTdsType != TDS_TYPE_NVARCHAR || row->isNull[currentColumn] == 'n')
-				{
-					currentQuery = psprintf("%s,$%d", currentQuery, i + 1);
-					i++;
-				}
-				currentColumn++;
-			}
-			row = row->nextRow;
-			currentQuery[1] = ' '; /* Convert the first ',' into a blank space. */
-
-			/* Add each row values in a single insert query so that we call SPI only once. */
-			query = psprintf("%s,(%s)", query, currentQuery);
-		}
-
-		if (token->tvpInfo->rowData) /* If any row in TVP */
-		{
-			query[1] = ' '; /* Convert the first ',' into a blank space. */
-
-			src = psprintf("Insert into %s values %s", tableName, query);
-			if ((rc = SPI_connect()) < 0)
-				elog(ERROR, "SPI_connect() failed in TDS Listener "
-							"with return code %d", rc);
-
-			rc = SPI_execute_with_args(src,
-				  nargs, argtypes,
-				  values, nulls,
-				  false, 1);
-
-			if (rc != SPI_OK_INSERT)
-				elog(ERROR, "Failed to insert in the underlying table for table-valued parameter: %d", rc);
-
-			SPI_finish();
-			PopActiveSnapshot();
-			if (!xactStarted)
-				CommitTransactionCommand();
-		}
+		TvpInsertRows(finalTableName, token);
 
-		set_config_option("babelfishpg_tsql.sql_dialect", "tsql",
-								(superuser() ? PGC_SUSET : PGC_USERSET),
-									PGC_S_SESSION, GUC_ACTION_SAVE, true, 0, false);
+		PopActiveSnapshot();
+		if (!xactStarted)
+			CommitTransactionCommand();
 	}
 
+	set_config_option("babelfishpg_tsql.sql_dialect", "tsql",
+					  (superuser() ? PGC_SUSET : PGC_USERSET),
+					  PGC_S_SESSION, GUC_ACTION_SAVE, true, 0, false);
+
 	/* Free all the pointers. */
 	while (token->tvpInfo->rowData)
 	{
@@ -2190,8 +2389,6 @@ TdsRecvTypeTable(const char *message, const ParameterToken token)
 	}
 	pfree(token->tvpInfo->colMetaData);
 
-	finalTableName = downcase_truncate_identifier(tableName, strlen(tableName), true);
-
 	item = (TvpLookupItem *) palloc(sizeof(TvpLookupItem));
 	item->name = downcase_truncate_identifier(token->paramMeta.colName.data,
 			strlen(token->paramMeta.colName.data),
@@ -2361,6 +2558,130 @@ TdsSendPlpDataHelper(char *data, int len)
 	return rc;
 }
 
+/*
+ * PlpValueIsSliceable - can we fetch a MAX value in slices?
+ *
+ * That is the case for values that are stored out of line without
+ * compression.  Anything else has to be detoasted as a whole anyway.
+ */
+static bool
+PlpValueIsSliceable(Datum value)
+{
+	struct varlena *attr = (struct varlena *) DatumGetPointer(value);
+	struct varatt_external toast_pointer;
+
+	if (!VARATT_IS_EXTERNAL_ONDISK(attr))
+		return false;
+
+	VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
+	return !VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer);
+}
+
+/*
+ * TdsSendPlpSlices - send an out of line MAX value as PLP chunks
+ *
+ * The value is fetched from the TOAST table a chunk at a time, so we never
+ * hold more than one chunk of it in memory.  Binary data goes out as it is,
+ * with the total length known up front.  Character data is converted to
+ * UTF-16 chunk by chunk, and since we can't tell the length of the result
+ * before we're done we send PLP_UNKNOWN_LEN instead.
+ */
+static int
+TdsSendPlpSlices(Datum value, bool toUtf16)
+{
+	struct varlena *attr = (struct varlena *) DatumGetPointer(value);
+	struct varatt_external toast_pointer;
+	int32		totalLen;
+	int32		offset;
+	int			rc;
+	char		carry[MAX_MULTIBYTE_CHAR_LEN];
+	int			carryLen = 0;
+	StringInfoData utf8;
+	StringInfoData utf16;
+
+	Assert(PlpValueIsSliceable(value));
+	VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
+	totalLen = VARATT_EXTERNAL_GET_EXTSIZE(toast_pointer);
+
+	if (!toUtf16)
+		rc = TdsPutInt64LE(totalLen);
+	else
+	{
+		rc = TdsPutUInt64LE(PLP_UNKNOWN_LEN);
+		initStringInfo(&utf8);
+		initStringInfo(&utf16);
+	}
+
+	for (offset = 0; rc == 0 && offset < totalLen; offset += PLP_CHUNCK_LEN)
+	{
+		struct varlena *slice;
+		char	   *data;
+		int			len;
+
+		slice = detoast_attr_slice(attr, offset, PLP_CHUNCK_LEN);
+		data = VARDATA_ANY(slice);
+		len = VARSIZE_ANY_EXHDR(slice);
+
+		if (toUtf16)
+		{
+			int			complete;
+			int			i;
+
+			/*
+			 * Prepend what is left of a character that was cut off at the end
+			 * of the previous slice, and hold back the beginning of a
+			 * character that is cut off at the end of this one.
+			 */
+			resetStringInfo(&utf8);
+			appendBinaryStringInfo(&utf8, carry, carryLen);
+			appendBinaryStringInfo(&utf8, data, len);
+
+			complete = utf8.len;
+			for (i = utf8.len - 1; i >= 0 && i >= utf8.len - MAX_MULTIBYTE_CHAR_LEN; i--)
+			{
+				unsigned char c = (unsigned char) utf8.data[i];
+
+				if ((c & 0xC0) != 0x80)
+				{
+					/* lead byte, is the character complete? */
+					if (i + pg_utf_mblen(&c) > utf8.len)
+						complete = i;
+					break;
+				}
+			}
+			carryLen = utf8.len - complete;
+			memcpy(carry, utf8.data + complete, carryLen);
+
+			resetStringInfo(&utf16);
+			TdsUTF8toUTF16StringInfo(&utf16, utf8.data, complete);
+			data = utf16.data;
+			len = utf16.len;
+		}
+
+		if (len > 0 && (rc = TdsPutUInt32LE(len)) == 0)
+			rc = TdsPutbytes(data, len);
+
+		pfree(slice);
+	}
+
+	if (toUtf16)
+	{
+		/* Let the conversion complain about a truncated character */
+		if (rc == 0 && carryLen > 0)
+		{
+			resetStringInfo(&utf16);
+			TdsUTF8toUTF16StringInfo(&utf16, carry, carryLen);
+		}
+		pfree(utf8.data);
+		pfree(utf16.data);
+	}
+
+	if (rc == 0)
+		rc = TdsPutInt32LE(PLP_TERMINATOR);
+
+	return rc;
+}
+
 int
 TdsSendTypeXml(FmgrInfo *finfo, Datum value, void *vMetaData)
 {
@@ -2472,11 +2793,21 @@ int
 TdsSendTypeVarbinary(FmgrInfo *finfo, Datum value, void *vMetaData)
 {
 	int			rc = EOF, len = 0, maxlen = 0;
-	bytea			*vlena = DatumGetByteaPCopy(value);
-	char			*buf = VARDATA_ANY(vlena);
+	bytea			*vlena;
+	char			*buf;
 	TdsColumnMetaData	*col = (TdsColumnMetaData *)vMetaData;
 
 	maxlen = col->metaEntry.type7.maxSize;
+
+	/* Large out of line values are streamed without detoasting them */
+	if (maxlen == 0xffff && PlpValueIsSliceable(value))
+	{
+		TDSInstrumentation(INSTR_TDS_DATATYPE_VARBINARY_MAX);
+		return TdsSendPlpSlices(value, false);
+	}
+
+	vlena = DatumGetByteaPCopy(value);
+	buf = VARDATA_ANY(vlena);
 	len = VARSIZE_ANY_EXHDR(vlena);
 
 	if (maxlen != 0xffff)
@@ -2591,13 +2922,27 @@ TdsSendTypeNVarchar(FmgrInfo *finfo, Datum value, void *vMetaData)
 {
 
 	int			rc, maxlen;
-	char			*out = OutputFunctionCall(finfo, value);
+	char			*out;
 	TdsColumnMetaData	*col = (TdsColumnMetaData *)vMetaData;
 	StringInfoData		buf;
 
+	maxlen = col->metaEntry.type2.maxSize;
+
+	/*
+	 * Large out of line values are streamed without detoasting them, if the
+	 * output function would return the stored string as it is.
+	 */
+	if (maxlen == 0xffff &&
+		(finfo->fn_addr == varcharout || finfo->fn_addr == textout) &&
+		PlpValueIsSliceable(value))
+	{
+		TDSInstrumentation(INSTR_TDS_DATATYPE_NVARCHAR_MAX);
+		return TdsSendPlpSlices(value, true);
+	}
+
+	out = OutputFunctionCall(finfo, value);
 	initStringInfo(&buf);
 	TdsUTF8toUTF16StringInfo(&buf, out, strlen(out));
-	maxlen = col->metaEntry.type2.maxSize;
 
 	if (maxlen != 0xffff)
 	{
@@ -2793,13 +3138,13 @@ TdsSendTypeDatetime(FmgrInfo *finfo, Datum value, void *vMetaData)
 }
 
 /*
- * TdsSendTypeNumeric() formats  response for numeric
- * data in TDS listener side before writing it to wire.
- * Based on numeric prescision, TdsSendTypeNumeric()  generates
- * 4-16 byte data followed by data length and sign bytes and writes to wire.
+ * TdsSendTypeNumericFromString() is the text based variant of
+ * TdsSendTypeNumeric(), used for the values TdsNumericToScaledInteger()
+ * can't convert.  It formats the value with the output function and
+ * parses the digits back.
  */
-int
-TdsSendTypeNumeric(FmgrInfo *finfo, Datum value, void *vMetaData)
+static int
+TdsSendTypeNumericFromString(FmgrInfo *finfo, Datum value, void *vMetaData)
 {
 	int	rc = EOF, precision = 0, scale = -1;
 	uint8	sign = 1, length = 0;
@@ -2876,6 +3221,48 @@ TdsSendTypeNumeric(FmgrInfo *finfo, Datum value, void *vMetaData)
 	return rc;
 }
 
+/*
+ * TdsSendTypeNumeric() formats  response for numeric
+ * data in TDS listener side before writing it to wire.
+ * Based on numeric prescision, TdsSendTypeNumeric()  generates
+ * 4-16 byte data followed by data length and sign bytes and writes to wire.
+ * The TDS integer is computed from the numeric digits directly.
+ */
+int
+TdsSendTypeNumeric(FmgrInfo *finfo, Datum value, void *vMetaData)
+{
+	int	rc = EOF, precision = 0;
+	uint8	length = 0;
+	bool	negative = false;
+	uint128	num = 0;
+	TdsColumnMetaData  *col = (TdsColumnMetaData *)vMetaData;
+	uint8_t max_scale = col->metaEntry.type5.scale;
+	uint8_t max_precision = col->metaEntry.type5.precision;
+
+	if (!TdsNumericToScaledInteger(DatumGetNumeric(value), max_scale,
+								   &num, &negative, &precision))
+		return TdsSendTypeNumericFromString(finfo, value, vMetaData);
+
+	if (precision > TDS_MAX_NUM_PRECISION ||
+		precision > max_precision)
+		ereport(ERROR, (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+				errmsg("Arithmetic overflow error for data type numeric.")));
+
+	if (precision >= 1 && precision < 10)
+		length = 4;
+	else if (precision < 20)
+		length = 8;
+	else if (precision < 29)
+		length = 12;
+	else if (precision < 39)
+		length = 16;
+
+	if (TdsPutInt8(length + 1) == 0 && TdsPutInt8(negative ? 0 : 1) == 0)
+		rc = TdsPutbytes(&num, length);
+
+	return rc;
+}
+
 static void
 SwapData(StringInfo buf, int st, int end)
 {
@@ -2893,23 +3280,26 @@ int
 TdsSendTypeUniqueIdentifier(FmgrInfo *finfo, Datum value, void *vMetaData)
 {
 	pg_uuid_t  *uuid = DatumGetUUIDP(value);
+	unsigned char buf[UUID_LEN];
 	int			rc;
-	StringInfoData buf;
-
-	initStringInfo(&buf);
-	resetStringInfo(&buf);
-	appendBinaryStringInfo(&buf, (char *) uuid->data, UUID_LEN);
 
-	/* SWAP to match TSQL behaviour */
-	SwapData(&buf, 0, 3);
-	SwapData(&buf, 1, 2);
-	SwapData(&buf, 4, 5);
-	SwapData(&buf, 6, 7);
+	/*
+	 * SWAP to match TSQL behaviour: the first three groups are sent in
+	 * little endian byte order.
+	 */
+	buf[0] = uuid->data[3];
+	buf[1] = uuid->data[2];
+	buf[2] = uuid->data[1];
+	buf[3] = uuid->data[0];
+	buf[4] = uuid->data[5];
+	buf[5] = uuid->data[4];
+	buf[6] = uuid->data[7];
+	buf[7] = uuid->data[6];
+	memcpy(&buf[8], &uuid->data[8], UUID_LEN - 8);
 
 	if ((rc = TdsPutInt8(UUID_LEN)) == 0)
-		TdsPutbytes(buf.data, UUID_LEN);
+		rc = TdsPutbytes(buf, UUID_LEN);
 
-	pfree(buf.data);
 	return rc;
 }
 
@@ -2918,7 +3308,6 @@ TdsSendTypeTime(FmgrInfo *finfo, Datum value, void *vMetaData)
 {
 	int		rc = EOF, length = 0, scale = 0;
 	uint64_t	res = 0;
-	double		numSec = 0;
 	TdsColumnMetaData  *col = (TdsColumnMetaData *)vMetaData;
 
 	if (GetClientTDSVersion() < TDS_VERSION_7_3_A)
@@ -2944,13 +3333,7 @@ TdsSendTypeTime(FmgrInfo *finfo, Datum value, void *vMetaData)
 	else if (scale >= 5 && scale <= 7)
 		length = 5;
 
-	numSec = (double)value / 1000000;
-	while (scale--)
-		numSec *= 10;
-	/* Round res to the nearest integer */
-	numSec += 0.5;
-
-	res = (uint64_t)numSec;
+	res = TdsScaleTimeOfDay(DatumGetTimeADT(value), scale);
 	if ((rc = TdsPutInt8(length)) == 0)
 		rc = TdsPutbytes(&res, length);
 	return rc;
@@ -35,6 +35,12 @@
 #include "miscadmin.h"
 #include "utils/builtins.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 static int FindMatchingParam(List *params, const char *name);
 static Node * TransformParamRef(ParseState *pstate, ParamRef *pref);
 Node * TdsFindParam(ParseState *pstate, ColumnRef *cref);
@@ -230,81 +236,250 @@ GetUTF16CodePoint(const unsigned char *in, int len, int *consumed)
 }
 
 /*
- * AddUTF8ToStringInfo - Add Unicode code point to a StringInfo in UTF-8
+ * CheckUnicodeCodePoint - reject code points we can't convert
  */
 static inline void
-AddUTF8ToStringInfo(int32_t code, StringInfo buf)
+CheckUnicodeCodePoint(int32_t code)
 {
-	/* Check that this is a valid code point */
 	if ((code > 0xD800 && code < 0xE000) || code < 0x0001 || code > 0x10FFFF)
 		ereport(ERROR,
 				(errcode(ERRCODE_DATA_EXCEPTION),
 				 errmsg("invalid Unicode code point 0x%x", code)));
+}
+
+/*
+ * PutUTF8 - Store Unicode code point at 'dst' in UTF-8, returns the
+ *			 position after it
+ */
+static inline unsigned char *
+PutUTF8(int32_t code, unsigned char *dst)
+{
+	CheckUnicodeCodePoint(code);
 
 	/* Range U+0000 .. U+007F (7 bit)*/
 	if (code <= 0x7F)
 	{
-		appendStringInfoChar(buf, code);
-		return;
+		*dst++ = code;
+		return dst;
 	}
 
 	/* Range U+0080 .. U+07FF (11 bit) */
 	if (code <= 0x7ff)
 	{
-		appendStringInfoChar(buf, 0xC0 | (code >> 6));
-		appendStringInfoChar(buf, 0x80 | (code & 0x3F));
-		return;
+		*dst++ = 0xC0 | (code >> 6);
+		*dst++ = 0x80 | (code & 0x3F);
+		return dst;
 	}
 
 	/* Range U+0800 .. U+FFFF (16 bit) */
 	if (code <= 0xFFFF)
 	{
-		appendStringInfoChar(buf, 0xE0 | (code >> 12));
-		appendStringInfoChar(buf, 0x80 | ((code >> 6) & 0x3F));
-		appendStringInfoChar(buf, 0x80 | (code & 0x3F));
-		return;
+		*dst++ = 0xE0 | (code >> 12);
+		*dst++ = 0x80 | ((code >> 6) & 0x3F);
+		*dst++ = 0x80 | (code & 0x3F);
+		return dst;
 	}
 
 	/* Range U+10000 .. U+10FFFF (21 bit) */
-	appendStringInfoChar(buf, 0xF0 | (code >> 18));
-	appendStringInfoChar(buf, 0x80 | ((code >> 12) & 0x3F));
-	appendStringInfoChar(buf, 0x80 | ((code >> 6) & 0x3F));
-	appendStringInfoChar(buf, 0x80 | (code & 0x3F));
+	*dst++ = 0xF0 | (code >> 18);
+	*dst++ = 0x80 | ((code >> 12) & 0x3F);
+	*dst++ = 0x80 | ((code >> 6) & 0x3F);
+	*dst++ = 0x80 | (code & 0x3F);
+	return dst;
 }
 
 /*
- * AddUTF16ToStringInfo - Add Unicode code point to a StringInfo in UTF-16
+ * PutUTF16 - Store Unicode code point at 'dst' in UTF-16LE, returns the
+ *			  position after it
  */
-static inline void
-AddUTF16ToStringInfo(int32_t code, StringInfo buf)
+static inline unsigned char *
+PutUTF16(int32_t code, unsigned char *dst)
 {
-	union {
-		uint16_t	value;
-		uint8_t		half[2];
-	} temp16;
+	uint16_t	high;
+	uint16_t	low;
 
-	/* Check that this is a valid code point */
-	if ((code > 0xD800 && code < 0xE000) || code < 0x0001 || code > 0x10FFFF)
-		ereport(ERROR,
-				(errcode(ERRCODE_DATA_EXCEPTION),
-				 errmsg("invalid Unicode code point 0x%x", code)));
+	CheckUnicodeCodePoint(code);
 
 	/* Handle single 16-bit code point */
 	if (code <= 0xFFFF)
 	{
-		appendStringInfoChar(buf, code & 0xFF);
-		appendStringInfoChar(buf, (code >> 8) & 0xFF);
-		return;
+		*dst++ = code & 0xFF;
+		*dst++ = (code >> 8) & 0xFF;
+		return dst;
+	}
+
+	high = 0xD800 + (((code - 0x010000) >> 10) & 0x03FF);
+	low = 0xDC00 + ((code - 0x010000) & 0x03FF);
+	*dst++ = high & 0xFF;
+	*dst++ = high >> 8;
+	*dst++ = low & 0xFF;
+	*dst++ = low >> 8;
+	return dst;
+}
+
+/*
+ * ASCII fast paths
+ *
+ *	Most character data that goes over the wire is plain ASCII. The functions
+ *	below convert the leading run of ASCII characters in whole blocks, using
+ *	AVX2 or SSE2 when the compiler targets them and 64-bit words otherwise,
+ *	and stop at the first block that contains anything else.  NUL is not
+ *	treated as ASCII here, the per code point path reports it.  The caller
+ *	converts whatever is left.
+ */
+#define ASCII_HIGH_BITS_8	UINT64CONST(0x8080808080808080)
+#define ASCII_LOW_BITS_8	UINT64CONST(0x0101010101010101)
+#define ASCII_HIGH_BITS_16	UINT64CONST(0xFF80FF80FF80FF80)
+#define ASCII_LOW_BITS_16	UINT64CONST(0x0001000100010001)
+#define ASCII_SIGN_BITS_16	UINT64CONST(0x8000800080008000)
+
+/*
+ * Utf8AsciiToUtf16 - widen the leading ASCII run of UTF-8 'in' into 'dst',
+ *					  returns the number of input bytes converted
+ */
+static inline size_t
+Utf8AsciiToUtf16(const unsigned char *in, size_t len, unsigned char *dst)
+{
+	size_t		n = 0;
+
+#if defined(__AVX2__)
+	{
+		const __m256i zero256 = _mm256_setzero_si256();
+
+		while (len - n >= 32)
+		{
+			__m256i		v = _mm256_loadu_si256((const __m256i *) (in + n));
+
+			if (_mm256_movemask_epi8(v) != 0 ||
+				_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero256)) != 0)
+				break;
+			_mm256_storeu_si256((__m256i *) (dst + 2 * n),
+								_mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+			_mm256_storeu_si256((__m256i *) (dst + 2 * n + 32),
+								_mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+			n += 32;
+		}
+	}
+#endif
+#if defined(__SSE2__)
+	{
+		const __m128i zero128 = _mm_setzero_si128();
+
+		while (len - n >= 16)
+		{
+			__m128i		v = _mm_loadu_si128((const __m128i *) (in + n));
+
+			if (_mm_movemask_epi8(v) != 0 ||
+				_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero128)) != 0)
+				break;
+			_mm_storeu_si128((__m128i *) (dst + 2 * n),
+							 _mm_unpacklo_epi8(v, zero128));
+			_mm_storeu_si128((__m128i *) (dst + 2 * n + 16),
+							 _mm_unpackhi_epi8(v, zero128));
+			n += 16;
+		}
+	}
+#endif
+	while (len - n >= 8)
+	{
+		uint64		w;
+		int			k;
+
+		memcpy(&w, in + n, sizeof(w));
+		/* any byte with the high bit set, or any zero byte? */
+		if ((w & ASCII_HIGH_BITS_8) != 0 ||
+			((w - ASCII_LOW_BITS_8) & ~w & ASCII_HIGH_BITS_8) != 0)
+			break;
+		for (k = 0; k < 8; k++)
+		{
+			dst[2 * (n + k)] = in[n + k];
+			dst[2 * (n + k) + 1] = 0;
+		}
+		n += 8;
+	}
+
+	return n;
+}
+
+/*
+ * Utf16AsciiToUtf8 - narrow the leading ASCII run of UTF-16LE 'in' into
+ *					  'dst', returns the number of input bytes converted
+ */
+static inline size_t
+Utf16AsciiToUtf8(const unsigned char *in, size_t len, unsigned char *dst)
+{
+	size_t		n = 0;
+
+#if defined(__AVX2__)
+	{
+		const __m256i zero256 = _mm256_setzero_si256();
+		const __m256i high256 = _mm256_set1_epi16((short) 0xFF80);
+
+		while (len - n >= 64)
+		{
+			__m256i		a = _mm256_loadu_si256((const __m256i *) (in + n));
+			__m256i		b = _mm256_loadu_si256((const __m256i *) (in + n + 32));
+
+			if (!_mm256_testz_si256(_mm256_or_si256(a, b), high256) ||
+				_mm256_movemask_epi8(_mm256_cmpeq_epi16(a, zero256)) != 0 ||
+				_mm256_movemask_epi8(_mm256_cmpeq_epi16(b, zero256)) != 0)
+				break;
+			/* packus works per 128-bit lane, put the quadwords back in order */
+			_mm256_storeu_si256((__m256i *) (dst + n / 2),
+								_mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8));
+			n += 64;
+		}
 	}
+#endif
+#if defined(__SSE2__)
+	{
+		const __m128i zero128 = _mm_setzero_si128();
+		const __m128i high128 = _mm_set1_epi16((short) 0xFF80);
 
-	temp16.value = 0xD800 + (((code - 0x010000) >> 10) & 0x03FF);
-	appendStringInfoChar(buf, temp16.half[0]);
-	appendStringInfoChar(buf, temp16.half[1]);
-	temp16.value = 0xDC00 + ((code - 0x010000) & 0x03FF);
-	appendStringInfoChar(buf, temp16.half[0]);
-	appendStringInfoChar(buf, temp16.half[1]);
+		while (len - n >= 32)
+		{
+			__m128i		a = _mm_loadu_si128((const __m128i *) (in + n));
+			__m128i		b = _mm_loadu_si128((const __m128i *) (in + n + 16));
+			__m128i		ascii;
+
+			ascii = _mm_cmpeq_epi16(_mm_and_si128(_mm_or_si128(a, b), high128),
+									zero128);
+			if (_mm_movemask_epi8(ascii) != 0xFFFF ||
+				_mm_movemask_epi8(_mm_cmpeq_epi16(a, zero128)) != 0 ||
+				_mm_movemask_epi8(_mm_cmpeq_epi16(b, zero128)) != 0)
+				break;
+			_mm_storeu_si128((__m128i *) (dst + n / 2), _mm_packus_epi16(a, b));
+			n += 32;
+		}
+	}
+#endif
+#ifndef WORDS_BIGENDIAN
+	while (len - n >= 8)
+	{
+		uint64		w;
+		int			k;
+
+		memcpy(&w, in + n, sizeof(w));
+		/* any unit above 0x7F, or any zero unit? */
+		if ((w & ASCII_HIGH_BITS_16) != 0 ||
+			((w - ASCII_LOW_BITS_16) & ~w & ASCII_SIGN_BITS_16) != 0)
+			break;
+		for (k = 0; k < 4; k++)
+			dst[n / 2 + k] = in[n + 2 * k];
+		n += 8;
+	}
+#endif
+
+	return n;
 }
 
+/*
+ * Input is converted in slices of this many bytes, so that we can size the
+ * output for a whole slice up front without reserving (for large values)
+ * much more memory than the result needs.
+ */
+#define TDS_TRANSCODE_SLICE		(1024 * 1024)
+
 /*
  * TdsUTF16toUTF8StringInfo - convert UTF16 data into UTF8 and
  * 								 add it to a StringInfo.
@@ -313,7 +488,7 @@ void
 TdsUTF16toUTF8StringInfo(StringInfo out, void *vin, int len)
 {
 	unsigned char  *in = vin;
-	int				i;
+	size_t			i;
 	int				consumed;
 	int32_t			code;
 
@@ -324,11 +499,44 @@ TdsUTF16toUTF8StringInfo(StringInfo out, void *vin, int len)
 				 errmsg("invalid UTF16 byte sequence - "
 						"input data has odd number of bytes")));
 
-	for (i = 0; i < len;)
+	for (i = 0; i < (size_t) len;)
 	{
-		code = GetUTF16CodePoint(&in[i], len - i, &consumed);
-		AddUTF8ToStringInfo(code, out);
-		i += consumed;
+		size_t			end = Min((size_t) len, i + TDS_TRANSCODE_SLICE);
+		unsigned char  *dst;
+
+		/*
+		 * A 16-bit unit turns into at most 3 bytes of UTF-8, a surrogate pair
+		 * into 4.  Leave room for a pair that starts at the end of the slice.
+		 */
+		enlargeStringInfo(out, (end - i) / 2 * 3 + 4);
+		dst = (unsigned char *) out->data + out->len;
+
+		while (i < end)
+		{
+			/* Only try the block path when it is likely to pay off */
+			if (in[i + 1] == 0 && in[i] < 0x80 && in[i] != 0)
+			{
+				size_t		n = Utf16AsciiToUtf8(&in[i], end - i, dst);
+
+				i += n;
+				dst += n / 2;
+				if (i >= end)
+					break;
+				if (in[i + 1] == 0 && in[i] < 0x80 && in[i] != 0)
+				{
+					*dst++ = in[i];
+					i += 2;
+					continue;
+				}
+			}
+
+			code = GetUTF16CodePoint(&in[i], len - i, &consumed);
+			dst = PutUTF8(code, dst);
+			i += consumed;
+		}
+
+		out->len = (char *) dst - out->data;
+		out->data[out->len] = '\0';
 	}
 }
 
@@ -346,9 +554,41 @@ TdsUTF8toUTF16StringInfo(StringInfo out, const void *vin, size_t len)
 
 	for (i = 0; i < len;)
 	{
-		code = GetUTF8CodePoint(&in[i], len - i, &consumed);
-		AddUTF16ToStringInfo(code, out);
-		i += consumed;
+		size_t			end = Min(len, i + TDS_TRANSCODE_SLICE);
+		unsigned char  *dst;
+
+		/*
+		 * No UTF-8 sequence becomes more than twice its length in UTF-16.
+		 * Leave room for a sequence that starts at the end of the slice.
+		 */
+		enlargeStringInfo(out, (end - i) * 2 + 4);
+		dst = (unsigned char *) out->data + out->len;
+
+		while (i < end)
+		{
+			if (in[i] < 0x80 && in[i] != 0)
+			{
+				size_t		n = Utf8AsciiToUtf16(&in[i], end - i, dst);
+
+				i += n;
+				dst += 2 * n;
+				if (i >= end)
+					break;
+				if (in[i] < 0x80 && in[i] != 0)
+				{
+					*dst++ = in[i++];
+					*dst++ = 0;
+					continue;
+				}
+			}
+
+			code = GetUTF8CodePoint(&in[i], len - i, &consumed);
+			dst = PutUTF16(code, dst);
+			i += consumed;
+		}
+
+		out->len = (char *) dst - out->data;
+		out->data[out->len] = '\0';
 	}
 }
 
@@ -368,13 +608,25 @@ TdsUTF8LengthInUTF16(const void *vin, int len)
 
 	for (i = 0; i < len;)
 	{
+		/* Skip over ASCII a word at a time, one unit per byte */
+		while (len - i >= 8)
+		{
+			uint64		w;
+
+			memcpy(&w, in + i, sizeof(w));
+			if ((w & ASCII_HIGH_BITS_8) != 0 ||
+				((w - ASCII_LOW_BITS_8) & ~w & ASCII_HIGH_BITS_8) != 0)
+				break;
+			result += 8;
+			i += 8;
+		}
+		if (i >= len)
+			break;
+
 		code = GetUTF8CodePoint(&in[i], len - i, &consumed);
 
 		/* Check that this is a valid code point */
-		if ((code > 0xD800 && code < 0xE000) || code < 0x0001 || code > 0x10FFFF)
-			ereport(ERROR,
-					(errcode(ERRCODE_DATA_EXCEPTION),
-					 errmsg("invalid Unicode code point 0x%x", code)));
+		CheckUnicodeCodePoint(code);
 
 		if (code <= 0xFFFF)
 			/* This code point would result in a single 16-bit output */
@@ -305,8 +305,6 @@ GetTxnMgmtRequest(const StringInfo message)
 	initStringInfo(&(request->query));
 	BuildTxnMgmtRequestQuery((TDSRequest)request, &(request->query));
 
-	pfree(message->data);
-
 	return (TDSRequest)request;
 
 }
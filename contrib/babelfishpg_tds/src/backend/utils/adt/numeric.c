@@ -794,3 +794,74 @@ numeric_get_typmod(Numeric num)
 
 	return (((precision & 0xFFFF) << 16 ) | (scale & 0xFFFF)) + VARHDRSZ;
 }
+
+/*
+ * Convert a numeric to the unsigned integer that TDS sends for DECIMAL and
+ * NUMERIC data, i.e. its absolute value scaled by 10^scale.  Fraction digits
+ * beyond scale are truncated.  *precision is set to the number of digits of
+ * the integral part (none for a zero integral part) plus scale; the value is
+ * only meaningful if that does not exceed TDS_MAX_NUM_PRECISION.
+ *
+ * This works on the digit array directly, so no text form of the value is
+ * built.  Returns false for NaN, which has no TDS representation.
+ */
+bool
+TdsNumericToScaledInteger(Numeric num, int scale, uint128 *result,
+						  bool *negative, int *precision)
+{
+	static const int dec_powers[DEC_DIGITS] = {1, 10, 100, 1000};
+	NumericDigit *digits;
+	int			ndigits;
+	int			weight;
+	int			int_digits = 0;
+	uint128		value = 0;
+	int			i;
+
+	if (NUMERIC_IS_NAN(num))
+		return false;
+
+	digits = NUMERIC_DIGITS(num);
+	ndigits = NUMERIC_NDIGITS(num);
+	weight = NUMERIC_WEIGHT(num);
+	*negative = (NUMERIC_SIGN(num) == NUMERIC_NEG);
+
+	/* integral part, NBASE digits 0 .. weight */
+	for (i = 0; i <= weight; i++)
+	{
+		NumericDigit dig = (i < ndigits) ? digits[i] : 0;
+
+		if (int_digits == 0)
+		{
+			if (dig == 0)
+				continue;
+			int_digits = dig >= 1000 ? 4 : dig >= 100 ? 3 : dig >= 10 ? 2 : 1;
+		}
+		else
+			int_digits += DEC_DIGITS;
+
+		if (int_digits > TDS_MAX_NUM_PRECISION)
+		{
+			/* doesn't fit, the caller will complain about the precision */
+			*precision = int_digits + scale;
+			*result = 0;
+			return true;
+		}
+		value = value * NBASE + dig;
+	}
+
+	/* fractional part, truncated to scale decimal digits */
+	for (i = weight + 1; scale - (i - weight - 1) * DEC_DIGITS > 0; i++)
+	{
+		NumericDigit dig = (i >= 0 && i < ndigits) ? digits[i] : 0;
+		int			remaining = scale - (i - weight - 1) * DEC_DIGITS;
+
+		if (remaining >= DEC_DIGITS)
+			value = value * NBASE + dig;
+		else
+			value = value * dec_powers[remaining] + dig / dec_powers[DEC_DIGITS - remaining];
+	}
+
+	*precision = int_digits + scale;
+	*result = value;
+	return true;
+}
@@ -29,7 +29,9 @@
 #include "tcop/utility.h"
 #include "utils/memutils.h"
 #include "utils/numeric.h"
+#include "utils/tuplestore.h"
 #include <libxml/uri.h>
+#include <sys/uio.h>
 
 #include "tds_typeio.h"
 #include "guc.h"
@@ -236,6 +238,7 @@ extern TdsErrorContextData *TdsErrorContext;
 
 /* Socket functions */
 typedef ssize_t (*TdsSecureSocketApi)(Port *port, void *ptr, size_t len);
+typedef ssize_t (*TdsSecureSocketVecApi)(Port *port, struct iovec *iov, int iovcnt);
 
 /* Globals in backend/tds/tdsutils.c */
 extern object_access_hook_type next_object_access_hook;
@@ -245,20 +248,89 @@ extern ProcessUtility_hook_type next_ProcessUtility;
 #define PUBLIC_ROLE_NAME "public"
 #define BABELFISH_SYSADMIN "sysadmin"
 
+/* Request types counted in TdsWireStats */
+typedef enum TdsStatRequestType
+{
+	TDS_STAT_SQL_BATCH = 0,
+	TDS_STAT_SP_EXECUTESQL,
+	TDS_STAT_SP_PREPARE,
+	TDS_STAT_SP_EXECUTE,
+	TDS_STAT_SP_PREPEXEC,
+	TDS_STAT_SP_UNPREPARE,
+	TDS_STAT_SP_CURSOR,			/* any of the sp_cursor* procedures */
+	TDS_STAT_PROCEDURE,			/* RPC of a procedure called by name */
+	TDS_STAT_BULK_LOAD,
+	TDS_STAT_TXN_MGMT,
+	TDS_STAT_ATTENTION
+} TdsStatRequestType;
+
+#define TDS_STAT_NUM_REQUEST_TYPES	(TDS_STAT_ATTENTION + 1)
+
+/*
+ * Request latency histogram: under 100us, 1ms, 10ms, 100ms, 1s and the rest
+ */
+#define TDS_STAT_NUM_LATENCY_BUCKETS	6
+
+typedef struct TdsRequestStats
+{
+	uint64		count;
+	uint64		totalUs;
+	uint64		maxUs;
+	uint64		latency[TDS_STAT_NUM_LATENCY_BUCKETS];
+} TdsRequestStats;
+
+/*
+ * Wire-level counters of a connection.  They are kept in TdsWireCounters
+ * by the backend itself and published to shared memory after each response,
+ * see tdsstat_report_wire_stats().
+ */
+typedef struct TdsWireStats
+{
+	uint64		bytesSent;
+	uint64		packetsSent;
+	uint64		writes;			/* write calls it took to send them */
+	uint64		flushes;		/* times we blocked until everything was sent */
+	uint64		sendWaitUs;		/* time spent in those, in microseconds */
+	uint64		stalls;			/* times we waited for room in the ring */
+
+	uint64		bytesReceived;
+	uint64		packetsReceived;
+	uint64		reads;			/* read calls, waits for a new request excluded */
+	uint64		recvWaitUs;		/* time spent in those, in microseconds */
+
+	uint64		rowTokens;		/* ROW and NBCROW */
+	uint64		colMetadataTokens;
+	uint64		doneTokens;		/* DONE, DONEPROC and DONEINPROC */
+	uint64		infoTokens;
+	uint64		errorTokens;
+	uint64		envChangeTokens;
+	uint64		returnValueTokens;
+	uint64		returnStatusTokens;
+
+	TdsRequestStats requests[TDS_STAT_NUM_REQUEST_TYPES];
+} TdsWireStats;
+
+extern TdsWireStats TdsWireCounters;
+
+#define TDS_MAX_SEND_RING_DEPTH	64
+
 /* Functions in backend/tds/tdscomm.c */
 extern void TdsSetMessageType(uint8_t msgType);
 extern void TdsCommInit(uint32_t bufferSize,
 						   TdsSecureSocketApi secure_read,
-						   TdsSecureSocketApi secure_write);
+						   TdsSecureSocketApi secure_write,
+						   TdsSecureSocketVecApi secure_writev);
 extern void TdsSetMessageType(uint8_t msgType);
 extern void TdsCommReset(void);
 extern void TdsCommShutdown(void);
 extern int TdsPeekbyte(void);
 extern int TdsReadNextBuffer(void);
 extern int TdsSocketFlush(void);
+extern int TdsSendPending(void);
 extern int TdsGetbytes(char *s, size_t len);
 extern int TdsDiscardbytes(size_t len);
 extern int TdsPutbytes(void *s, size_t len);
+extern char *TdsReserveSendBuffer(size_t len);
 extern int TdsPutInt8(int8_t value);
 extern int TdsPutUInt8(uint8_t value);
 extern int TdsPutInt16LE(int16_t value);
@@ -269,6 +341,8 @@ extern int TdsPutInt64LE(int64_t value);
 extern int TdsPutFloat4LE(float4 value);
 extern int TdsPutFloat8LE(float8 value);
 extern bool TdsCheckMessageType(uint8_t messageType);
+extern StringInfo TdsGetMessageBuffer(void);
+extern void TdsReleaseMessageBuffer(void);
 extern int TdsReadNextRequest(StringInfo message, uint8_t *status, uint8_t *messageType);
 extern int TdsReadMessage(StringInfo message, uint8_t messageType);
 extern int TdsReadNextPendingBcpRequest(StringInfo message);
@@ -321,10 +395,14 @@ extern void TdsDefineGucs(void);
 
 extern void tdsstat_initialize(void);
 extern void tdsstat_bestart(void);
+extern void tdsstat_report_wire_stats(void);
+extern void tdsstat_count_request(TdsStatRequestType type, uint64 durationUs);
 extern void TdsSetGucStatVariable(const char *guc, bool boolVal, const char *strVal, int intVal);
 extern void TdsSetAtAtStatVariable(const char *at_at_var, int intVal, uint64 bigintVal);
 extern void TdsSetDatabaseStatVariable(int16 db_id);
 extern bool tds_stat_get_activity(Datum *values, bool *nulls, int len, int pid, int curr_backend);
+extern void tds_stat_get_wire_stats(Tuplestorestate *tupstore, TupleDesc tupdesc, int pid);
+extern void tds_stat_get_request_stats(Tuplestorestate *tupstore, TupleDesc tupdesc, int pid);
 extern void invalidate_stat_table(void);
 extern char* get_tds_host_name(void);
 
@@ -347,6 +425,8 @@ extern void pe_fin(void);
 /* Functions in backend/utils/adt/numeric.c */
 extern Numeric TdsSetVarFromStrWrapper(const char *str);
 extern int32_t numeric_get_typmod(Numeric num);
+extern bool TdsNumericToScaledInteger(Numeric num, int scale, uint128 *result,
+									  bool *negative, int *precision);
 
 /* Functions in backend/utils/adt/varchar.c */
 extern void *tds_varchar_input(const char *s, size_t len, int32 atttypmod);
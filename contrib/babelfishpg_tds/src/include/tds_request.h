@@ -184,7 +184,16 @@ typedef struct TDSRequestBulkLoadData
 	int 					currentBatchSize; /* Current Batch Size in byes */
 
 	BulkLoadColMetaData 	*colMetaData; /* Array of each column's metadata. */
-	List 					*rowData;     /* List holding each row. */
+
+	/*
+	 * Rows of the current batch, flattened to rowCount x colCount. The arrays
+	 * are reused across batches; the values they point to live in
+	 * batchContext, which is reset before each batch is decoded.
+	 */
+	int 					rowCapacity;
+	Datum 					*rowValues;
+	bool 					*rowNulls;
+	MemoryContext 			batchContext;
 } TDSRequestBulkLoadData;
 typedef TDSRequestBulkLoadData *TDSRequestBulkLoad;
 
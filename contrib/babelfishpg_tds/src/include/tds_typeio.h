@@ -252,14 +252,6 @@ typedef struct BulkLoadColMetaData
 	bool 		variantType;
 } BulkLoadColMetaData;
 
-typedef struct BulkLoadRowData
-{
-	/* Array of length col count, holds value of each column in that row. */
-	Datum *columnValues;
-
-	bool *isNull;
-} BulkLoadRowData;
-
 /* Map TVP to its underlying table, either by relid or by table name. */
 typedef struct TvpLookupItem
 {
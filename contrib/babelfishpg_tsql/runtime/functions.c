@@ -68,6 +68,8 @@ PG_FUNCTION_INFO_V1(tsql_exp);
 PG_FUNCTION_INFO_V1(host_os);
 PG_FUNCTION_INFO_V1(tsql_stat_get_activity_deprecated_in_2_2_0);
 PG_FUNCTION_INFO_V1(tsql_stat_get_activity);
+PG_FUNCTION_INFO_V1(tsql_stat_get_tds_wire);
+PG_FUNCTION_INFO_V1(tsql_stat_get_tds_requests);
 PG_FUNCTION_INFO_V1(get_current_full_xact_id);
 PG_FUNCTION_INFO_V1(checksum);
 PG_FUNCTION_INFO_V1(has_dbaccess);
@@ -868,6 +870,81 @@ tsql_stat_get_activity(PG_FUNCTION_ARGS)
 	return (Datum) 0;
 }
 
+/*
+ * Common part of the TDS wire stats functions.  A sysadmin sees all the
+ * connections, anyone else only their own one, like in sys.dm_exec_sessions.
+ */
+static Datum
+tsql_stat_get_tds_stats(FunctionCallInfo fcinfo, bool requests)
+{
+	Oid			sysadmin_oid = get_role_oid("sysadmin", false);
+	int			pid;
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	if (has_privs_of_role(GetSessionUserId(), sysadmin_oid))
+		pid = -1;
+	else
+		pid = MyProcPid;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupdesc = CreateTupleDescCopy(tupdesc);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* No rows unless the TDS extension is loaded */
+	if (*pltsql_protocol_plugin_ptr)
+	{
+		if (requests && (*pltsql_protocol_plugin_ptr)->get_request_stats)
+			(*pltsql_protocol_plugin_ptr)->get_request_stats(tupstore, tupdesc, pid);
+		else if (!requests && (*pltsql_protocol_plugin_ptr)->get_wire_stats)
+			(*pltsql_protocol_plugin_ptr)->get_wire_stats(tupstore, tupdesc, pid);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	if (*pltsql_protocol_plugin_ptr && (*pltsql_protocol_plugin_ptr)->invalidate_stat_view)
+		(*pltsql_protocol_plugin_ptr)->invalidate_stat_view();
+
+	return (Datum) 0;
+}
+
+Datum
+tsql_stat_get_tds_wire(PG_FUNCTION_ARGS)
+{
+	return tsql_stat_get_tds_stats(fcinfo, false);
+}
+
+Datum
+tsql_stat_get_tds_requests(PG_FUNCTION_ARGS)
+{
+	return tsql_stat_get_tds_stats(fcinfo, true);
+}
+
 Datum
 get_current_full_xact_id(PG_FUNCTION_ARGS)
 {
@@ -2739,6 +2739,46 @@ RETURNS SETOF RECORD
 AS 'babelfishpg_tsql', 'tsql_stat_get_activity'
 LANGUAGE C VOLATILE STRICT;
 
+CREATE OR REPLACE FUNCTION sys.tsql_stat_get_tds_wire(
+  OUT procid int,
+  OUT bytes_sent bigint,
+  OUT packets_sent bigint,
+  OUT writes bigint,
+  OUT flushes bigint,
+  OUT send_wait_us bigint,
+  OUT ring_stalls bigint,
+  OUT bytes_received bigint,
+  OUT packets_received bigint,
+  OUT reads bigint,
+  OUT recv_wait_us bigint,
+  OUT row_tokens bigint,
+  OUT colmetadata_tokens bigint,
+  OUT done_tokens bigint,
+  OUT info_tokens bigint,
+  OUT error_tokens bigint,
+  OUT envchange_tokens bigint,
+  OUT returnvalue_tokens bigint,
+  OUT returnstatus_tokens bigint)
+RETURNS SETOF RECORD
+AS 'babelfishpg_tsql', 'tsql_stat_get_tds_wire'
+LANGUAGE C VOLATILE STRICT;
+
+CREATE OR REPLACE FUNCTION sys.tsql_stat_get_tds_requests(
+  OUT procid int,
+  OUT request_type VARCHAR(32),
+  OUT requests bigint,
+  OUT total_us bigint,
+  OUT max_us bigint,
+  OUT under_100us bigint,
+  OUT under_1ms bigint,
+  OUT under_10ms bigint,
+  OUT under_100ms bigint,
+  OUT under_1s bigint,
+  OUT over_1s bigint)
+RETURNS SETOF RECORD
+AS 'babelfishpg_tsql', 'tsql_stat_get_tds_requests'
+LANGUAGE C VOLATILE STRICT;
+
 /*
  * Table type can identified by reverse dependency between table and
  * type in pg_depend.
@@ -3297,3 +3337,54 @@ END;
 $BODY$
 LANGUAGE plpgsql;
 GRANT EXECUTE ON FUNCTION sys.INDEXPROPERTY(IN object_id INT, IN index_or_statistics_name sys.nvarchar(128),  IN property sys.varchar(128)) TO PUBLIC;
+
+CREATE OR REPLACE FUNCTION sys.babelfish_antlr_parse_stats(
+    OUT sll_parses BIGINT,
+    OUT ll_fallbacks BIGINT,
+    OUT ll_parses BIGINT,
+    OUT sll_time_us BIGINT,
+    OUT ll_time_us BIGINT)
+AS 'babelfishpg_tsql', 'babelfish_antlr_parse_stats'
+LANGUAGE C VOLATILE STRICT;
+GRANT EXECUTE ON FUNCTION sys.babelfish_antlr_parse_stats() TO PUBLIC;
+
+CREATE OR REPLACE FUNCTION sys.babelfish_antlr_dfa_cache_stats(
+    OUT lexer_dfa_states BIGINT,
+    OUT parser_decisions BIGINT,
+    OUT parser_dfa_states BIGINT,
+    OUT prediction_contexts BIGINT,
+    OUT warmup_statements BIGINT)
+AS 'babelfishpg_tsql', 'babelfish_antlr_dfa_cache_stats'
+LANGUAGE C VOLATILE STRICT;
+GRANT EXECUTE ON FUNCTION sys.babelfish_antlr_dfa_cache_stats() TO PUBLIC;
+
+CREATE OR REPLACE FUNCTION sys.babelfish_table_variable_pool_stats(
+    OUT hits BIGINT,
+    OUT misses BIGINT,
+    OUT evictions BIGINT,
+    OUT pooled INT,
+    OUT idle INT)
+AS 'babelfishpg_tsql', 'babelfish_table_variable_pool_stats'
+LANGUAGE C VOLATILE STRICT;
+GRANT EXECUTE ON FUNCTION sys.babelfish_table_variable_pool_stats() TO PUBLIC;
+
+CREATE OR REPLACE FUNCTION sys.babelfish_applock_stats(
+    OUT capacity INT,
+    OUT entries BIGINT,
+    OUT partitions INT,
+    OUT collisions BIGINT,
+    OUT lock_waits BIGINT)
+AS 'babelfishpg_tsql', 'babelfish_applock_stats'
+LANGUAGE C VOLATILE STRICT;
+GRANT EXECUTE ON FUNCTION sys.babelfish_applock_stats() TO PUBLIC;
+
+CREATE OR REPLACE FUNCTION sys.babelfish_batch_cache_stats(
+    OUT hits BIGINT,
+    OUT misses BIGINT,
+    OUT evictions BIGINT,
+    OUT entries INT,
+    OUT parameterized_entries INT,
+    OUT kilobytes BIGINT)
+AS 'babelfishpg_tsql', 'babelfish_batch_cache_stats'
+LANGUAGE C VOLATILE STRICT;
+GRANT EXECUTE ON FUNCTION sys.babelfish_batch_cache_stats() TO PUBLIC;
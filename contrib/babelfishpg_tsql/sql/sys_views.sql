@@ -2092,6 +2092,49 @@ create or replace view sys.dm_exec_connections
  RIGHT JOIN sys.tsql_stat_get_activity('connections') AS d ON (a.pid = d.procid);
  GRANT SELECT ON sys.dm_exec_connections TO PUBLIC;
 
+-- Wire-level counters per TDS connection.  The row with a NULL session_id
+-- holds the totals of the connections that have ended.
+create or replace view sys.babelfish_tds_stats
+as
+select d.procid as session_id
+  , d.bytes_sent
+  , d.packets_sent
+  , d.writes
+  , d.flushes
+  , d.send_wait_us
+  , d.ring_stalls
+  , d.bytes_received
+  , d.packets_received
+  , d.reads
+  , d.recv_wait_us
+  , d.row_tokens
+  , d.colmetadata_tokens
+  , d.done_tokens
+  , d.info_tokens
+  , d.error_tokens
+  , d.envchange_tokens
+  , d.returnvalue_tokens
+  , d.returnstatus_tokens
+from sys.tsql_stat_get_tds_wire() AS d;
+GRANT SELECT ON sys.babelfish_tds_stats TO PUBLIC;
+
+-- Requests per TDS connection and type, with a histogram of their latency
+create or replace view sys.babelfish_tds_request_stats
+as
+select d.procid as session_id
+  , d.request_type
+  , d.requests
+  , d.total_us
+  , d.max_us
+  , d.under_100us
+  , d.under_1ms
+  , d.under_10ms
+  , d.under_100ms
+  , d.under_1s
+  , d.over_1s
+from sys.tsql_stat_get_tds_requests() AS d;
+GRANT SELECT ON sys.babelfish_tds_request_stats TO PUBLIC;
+
 CREATE OR REPLACE VIEW sys.configurations
 AS
 SELECT  configuration_id, 
@@ -0,0 +1,65 @@
+SELECT 1
+GO
+DECLARE @i INT = 0, @s NVARCHAR(100), @d DATETIME2(7), @m MONEY, @n DECIMAL(18, 4)
+SET @i = @i + 1
+SET @s = N'value'
+SELECT @i, @s, @d, @m, @n
+GO
+SELECT TOP 10 a.name, b.name AS type_name, COUNT(*) AS cnt
+FROM sys.objects AS a
+INNER JOIN sys.types b ON a.object_id = b.user_type_id
+LEFT OUTER JOIN sys.schemas s ON s.schema_id = a.schema_id
+WHERE a.name LIKE N'%abc%' OR a.type IN ('U', 'V', 'P') AND a.parent_object_id IS NOT NULL
+GROUP BY a.name, b.name
+HAVING COUNT(*) > 1
+ORDER BY a.name DESC, 2 ASC
+GO
+SELECT o.name,
+	CASE WHEN o.type = 'U' THEN 'table' WHEN o.type = 'V' THEN 'view' ELSE 'other' END AS kind,
+	CAST(o.object_id AS NVARCHAR(50)),
+	CONVERT(VARCHAR(10), o.create_date, 120),
+	ISNULL(o.principal_id, 0),
+	COALESCE(o.name, o.type_desc, 'z'),
+	ROW_NUMBER() OVER (PARTITION BY o.type ORDER BY o.name) AS rn
+FROM sys.objects o
+WHERE EXISTS (SELECT 1 FROM sys.schemas s WHERE s.schema_id = o.schema_id)
+GO
+DECLARE @i INT = 0
+WHILE @i < 10
+BEGIN
+	SET @i += 1
+	IF @i = 5
+		CONTINUE
+	ELSE IF @i = 8
+		BREAK
+	ELSE
+	BEGIN
+		PRINT 'iteration'
+	END
+END
+GO
+BEGIN TRY
+	DECLARE @x INT
+	SET @x = 1 / 0
+END TRY
+BEGIN CATCH
+	IF @@TRANCOUNT > 0
+		ROLLBACK TRANSACTION
+	SELECT ERROR_NUMBER(), ERROR_MESSAGE(), ERROR_LINE()
+END CATCH
+GO
+CREATE PROCEDURE babel_parse_benchmark_p @a INT, @b NVARCHAR(10) = NULL, @c INT OUTPUT
+AS
+BEGIN
+	SET NOCOUNT ON
+	DECLARE @t TABLE (id INT PRIMARY KEY, name VARCHAR(100) NOT NULL DEFAULT '')
+	INSERT INTO @t (id, name) VALUES (1, 'one'), (2, 'two'), (@a, @b)
+	UPDATE @t SET name = UPPER(LTRIM(RTRIM(name))) WHERE id > @a
+	DELETE FROM @t WHERE name IS NULL
+	SELECT @c = COUNT(*) FROM @t
+	RETURN 0
+END
+GO
+DECLARE @sql NVARCHAR(MAX) = N'SELECT name FROM sys.objects WHERE object_id = @id'
+EXECUTE sp_executesql @sql, N'@id INT', @id = 1
+GO
@@ -0,0 +1,16 @@
+-- Driver for 'make parse-benchmark', run with psql -v script=... -v iterations=...
+-- The benchmark function is not part of the extension; it is created in
+-- pg_temp so that it goes away with the benchmark session.  Creating it
+-- requires superuser.
+CREATE FUNCTION pg_temp.babelfish_antlr_parse_benchmark(
+    IN script TEXT,
+    IN num_iterations INT,
+    OUT bytes BIGINT,
+    OUT batches INT,
+    OUT iterations INT,
+    OUT total_us BIGINT,
+    OUT us_per_kb FLOAT8)
+AS 'babelfishpg_tsql', 'babelfish_antlr_parse_benchmark'
+LANGUAGE C VOLATILE STRICT;
+
+SELECT * FROM pg_temp.babelfish_antlr_parse_benchmark(:'script', :iterations);
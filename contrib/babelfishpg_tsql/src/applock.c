@@ -8,32 +8,68 @@
 
 #include "postgres.h"
 
+#include "access/htup_details.h"
 #include "access/xact.h"
+#include "common/hashfn.h"
 #include "executor/spi.h"
 #include "fmgr.h"
+#include "funcapi.h"
 #include "miscadmin.h"
 #include "parser/parser.h"
 #include "pltsql.h"
+#include "port/atomics.h"
+#include "lib/dshash.h"
 #include "storage/lmgr.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
 #include "utils/builtins.h"
+#include "utils/dsa.h"
 #include "utils/guc.h"
+#include "utils/memutils.h"
 #include "utils/timeout.h"
 #include "datatypes.h"
+#include "guc.h"
 
 
 PG_FUNCTION_INFO_V1(sp_getapplock_function);
 PG_FUNCTION_INFO_V1(sp_releaseapplock_function);
 PG_FUNCTION_INFO_V1(APPLOCK_MODE);
 PG_FUNCTION_INFO_V1(APPLOCK_TEST);
+PG_FUNCTION_INFO_V1(babelfish_applock_stats);
 
 /* 
  * Applock local and global hashmaps. The local one keeps track of applock 
  * that the current session owns. The global one resolves hash conflict if
  * two different lock resource name are hashed to the same integer key.
  * Both uses the same cache entry structure for convenience.
+ *
+ * The global hashmap is a dshash table in a DSA area created by the first
+ * backend that uses applocks, so it grows on demand up to
+ * babelfishpg_tsql.applock_table_size entries without having to reserve
+ * shared memory at server start. Lookups of a resource are serialized by
+ * APPLOCK_NUM_PARTITIONS LWLocks, the same way the PG lock manager
+ * partitions its lock table, so that all the candidate keys of a resource
+ * can be checked atomically.
  */
+static dshash_table * appLockCacheGlobal = NULL;
 static HTAB * appLockCacheLocal = NULL;
-static HTAB * appLockCacheGlobal = NULL;
+static dsa_area * appLockArea = NULL;
+
+/* Number of partitions of the global hashmap, must be a power of 2 */
+#define APPLOCK_NUM_PARTITIONS 16
+
+typedef struct ApplockSharedState
+{
+	int			tranche_id;
+	LWLockPadded locks[APPLOCK_NUM_PARTITIONS];
+	dsa_handle	area;			/* DSA area of the global hashmap */
+	dshash_table_handle table;	/* the global hashmap itself */
+	pg_atomic_uint64 entries;	/* entries in the global hashmap */
+	pg_atomic_uint64 collisions;	/* candidate keys taken by other resources */
+	pg_atomic_uint64 lock_waits;	/* partition lock requests that had to wait */
+} ApplockSharedState;
+
+static ApplockSharedState *applockShared = NULL;
 
 /* Max length of applock resource name string (including the ending '\0') */
 #define APPLOCK_MAX_RESOURCE_LENGTH 256
@@ -48,7 +84,7 @@ static HTAB * appLockCacheGlobal = NULL;
  * Max number of retries to search for usable key when hash collision happens.
  * The chance of multiple strings being hashed to the same key is roughly
  * (1/2^63)*(#_of_strings-1). So a small APPLOCK_MAX_TRY_SEARCH_KEY should be
- * enough. Also, because we have to scan all the possible candidate keys when 
+ * enough. See applock_next_key() for the candidate keys tried. Also, because we have to scan all the possible candidate keys when 
  * looking for a usable key (see ApplockGetUsableKey()), a small 
  * APPLOCK_MAX_TRY_SEARCH_KEY is preferred too.
  */
@@ -284,29 +320,59 @@ static pg_attribute_printf(1, 2) void ApplockPrintMessage(const char *fmt, ...)
 static void ApplockRemoveCache(bool release_session);
 
 /* 
- * Simple consistent hashing function to convert a string to an int.
- * We'll avoid return non-negative values because that will be used for errors.
+ * Convert a resource name to a lock key with a 64-bit hash.
+ * We'll avoid returning negative values because those are used for errors.
  * The chance of 2 strings colliding with the same key is about 1/2^63.
- * See https://cp-algorithms.com/string/string-hashing.html
  */
 static int64
-applock_simple_hash(char *str)
+applock_hash_resource(const char *resource)
+{
+	return (int64) (hash_bytes_extended((const unsigned char *) resource,
+										strlen(resource), 0) & INT64_MAX);
+}
+
+/*
+ * Next candidate key after a collision. Only the low 32 bits change, so that
+ * all the candidates of a resource fall in the same partition of the global
+ * hashmap (see applock_key_hash()).
+ */
+static int64
+applock_next_key(int64 key)
+{
+	return (key & ~((int64) PG_UINT32_MAX)) | (int64) ((uint32) key + 1);
+}
+
+/* Partition hash code of a key: the high half of the key. */
+static uint32
+applock_key_hash(const void *key, Size keysize)
+{
+	Assert(keysize == sizeof(int64));
+	return (uint32) (*((const int64 *) key) >> 32);
+}
+
+#define ApplockPartitionLock(hashcode) \
+	(&applockShared->locks[(hashcode) % APPLOCK_NUM_PARTITIONS].lock)
+
+/* Take a partition lock, counting the times we had to wait for it. */
+static void
+ApplockAcquirePartition(LWLock *lock, LWLockMode mode)
 {
-	const int p = 31;
-	const int64 m = INT64_MAX;
-	uint64 hash_value = 0;
-	int64 p_pow = 1;
-	char c;
-
-	c = *str;
-	while (c) {
-		hash_value = (hash_value + (c - 'a' + 1) * p_pow) % m;
-		p_pow = (p_pow * p) % m;
-		c = *++str;
+	if (!LWLockConditionalAcquire(lock, mode))
+	{
+		pg_atomic_fetch_add_u64(&applockShared->lock_waits, 1);
+		LWLockAcquire(lock, mode);
 	}
-    return hash_value;
 }
 
+/* Parameters of the global hashmap, tranche_id is set at attach time. */
+static dshash_parameters applock_dshash_params = {
+	sizeof(int64),
+	sizeof(AppLockCacheEnt),
+	dshash_memcmp,
+	dshash_memhash,
+	0
+};
+
 /* 
  * Get PG Lock mode for corresponding Applock mode. 
  * See AppLockConflicts[] defined in backend/storage/lmgr/lock.c.
@@ -335,25 +401,64 @@ static short getPGLockMode(short applockmode)
 static void initApplockCache()
 {
 	HASHCTL         ctl;
-
-	/* Local cache */
-	MemSet(&ctl, 0, sizeof(ctl));
-	ctl.keysize = sizeof(int64);
-	ctl.entrysize = sizeof(AppLockCacheEnt);
-	appLockCacheLocal = hash_create("Applock Cache", 16, 
-				&ctl, HASH_ELEM | HASH_BLOBS);
+	bool            found;
+	MemoryContext   oldcontext;
 
 	/* Global cache */
 	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	applockShared = (ApplockSharedState *) ShmemInitStruct("Applock State",
+														   sizeof(ApplockSharedState),
+														   &found);
+	if (!found)
+	{
+		int i;
+
+		applockShared->tranche_id = LWLockNewTrancheId();
+		for (i = 0; i < APPLOCK_NUM_PARTITIONS; i++)
+			LWLockInitialize(&applockShared->locks[i].lock, applockShared->tranche_id);
+		applockShared->area = DSM_HANDLE_INVALID;
+		applockShared->table = InvalidDsaPointer;
+		pg_atomic_init_u64(&applockShared->entries, 0);
+		pg_atomic_init_u64(&applockShared->collisions, 0);
+		pg_atomic_init_u64(&applockShared->lock_waits, 0);
+	}
+	LWLockRegisterTranche(applockShared->tranche_id, "babelfish_applock");
+	applock_dshash_params.tranche_id = applockShared->tranche_id;
+
+	/*
+	 * The first backend creates the area and the hashmap, pinned so that they
+	 * outlive it; the others attach. The mappings are kept for the lifetime
+	 * of the backend.
+	 */
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	if (applockShared->area == DSM_HANDLE_INVALID)
+	{
+		appLockArea = dsa_create(applockShared->tranche_id);
+		dsa_pin(appLockArea);
+		dsa_pin_mapping(appLockArea);
+		appLockCacheGlobal = dshash_create(appLockArea, &applock_dshash_params, NULL);
+		applockShared->table = dshash_get_hash_table_handle(appLockCacheGlobal);
+		applockShared->area = dsa_get_handle(appLockArea);
+	}
+	else
+	{
+		appLockArea = dsa_attach(applockShared->area);
+		dsa_pin_mapping(appLockArea);
+		appLockCacheGlobal = dshash_attach(appLockArea, &applock_dshash_params,
+										   applockShared->table, NULL);
+	}
+	MemoryContextSwitchTo(oldcontext);
+	LWLockRelease(AddinShmemInitLock);
+
+	/*
+	 * Local cache, set up last because its presence tells that the global
+	 * one is attached too.
+	 */
 	MemSet(&ctl, 0, sizeof(ctl));
 	ctl.keysize = sizeof(int64);
 	ctl.entrysize = sizeof(AppLockCacheEnt);
-	appLockCacheGlobal = (HTAB*)ShmemInitHash("Applock",
-										/*table size*/ 32,
-										/*max table size*/ 32,
-										&ctl,
-										HASH_ELEM | HASH_BLOBS);
-	LWLockRelease(AddinShmemInitLock);
+	appLockCacheLocal = hash_create("Applock Cache", 16, 
+				&ctl, HASH_ELEM | HASH_BLOBS);
 
 	/* 
 	 * Init this function handler to be called when PG implicitly
@@ -369,15 +474,14 @@ static int64 AppLockSearchKeyLocal(char *resource)
 	int64 key;
 	int try_search = 0;
 
-	key = applock_simple_hash(resource);
+	key = applock_hash_resource(resource);
 	while (try_search++ < APPLOCK_MAX_TRY_SEARCH_KEY) {
 		entry = (AppLockCacheEnt*) hash_search(appLockCacheLocal,
                                                     (void *) &key,
                                                     HASH_FIND, NULL);
 		if (entry && strcmp(entry->resource, resource) == 0)
 			return key;
-		/* be mindful of overflow */
-		key = (key % INT64_MAX) + 1;
+		key = applock_next_key(key);
 	}
 
 	return -1;
@@ -388,24 +492,31 @@ static int64 AppLockSearchKeyGlobal(char *resource)
 {
 	AppLockCacheEnt *entry;
 	int64 key;
+	uint32 hashcode;
+	LWLock *partitionLock;
 	int try_search = 0;
 
-	LWLockAcquire(TsqlApplockSyncLock, LW_SHARED);
+	key = applock_hash_resource(resource);
+	hashcode = applock_key_hash(&key, sizeof(key));
+	partitionLock = ApplockPartitionLock(hashcode);
+
+	ApplockAcquirePartition(partitionLock, LW_SHARED);
 
-	key = applock_simple_hash(resource);
 	while (try_search++ < APPLOCK_MAX_TRY_SEARCH_KEY) {
-		entry = (AppLockCacheEnt*) hash_search(appLockCacheGlobal,
-                                                    (void *) &key,
-                                                    HASH_FIND, NULL);
-		if (entry && strcmp(entry->resource, resource) == 0) {
-			LWLockRelease(TsqlApplockSyncLock);
-			return key;
+		entry = (AppLockCacheEnt*) dshash_find(appLockCacheGlobal, &key, false);
+		if (entry) {
+			bool match = strcmp(entry->resource, resource) == 0;
+
+			dshash_release_lock(appLockCacheGlobal, entry);
+			if (match) {
+				LWLockRelease(partitionLock);
+				return key;
+			}
 		}
-		/* be mindful of overflow */
-		key = (key % INT64_MAX) + 1;
+		key = applock_next_key(key);
 	}
 
-	LWLockRelease(TsqlApplockSyncLock);
+	LWLockRelease(partitionLock);
 	return -1;
 }
 
@@ -416,18 +527,18 @@ static int64 AppLockSearchKeyGlobal(char *resource)
 static void ApplockUnrefGlobalCache(int64 key)
 {
 	AppLockCacheEnt *entry;
+	uint32 hashcode = applock_key_hash(&key, sizeof(key));
+	LWLock *partitionLock = ApplockPartitionLock(hashcode);
 
-	LWLockAcquire(TsqlApplockSyncLock, LW_EXCLUSIVE);
-    entry = (AppLockCacheEnt *) hash_search(appLockCacheGlobal,
-                                                (void *) &key,
-                                                HASH_FIND, NULL);
+	ApplockAcquirePartition(partitionLock, LW_EXCLUSIVE);
+	entry = (AppLockCacheEnt *) dshash_find(appLockCacheGlobal, &key, true);
 	if (entry && --entry->refcount == 0) {
-		hash_search(appLockCacheGlobal,
-											(void *) &key,
-											HASH_REMOVE, NULL);
-		entry->resource[0] = '\0';
+		dshash_delete_entry(appLockCacheGlobal, entry);
+		pg_atomic_fetch_sub_u64(&applockShared->entries, 1);
 	}
-	LWLockRelease(TsqlApplockSyncLock);
+	else if (entry)
+		dshash_release_lock(appLockCacheGlobal, entry);
+	LWLockRelease(partitionLock);
 }
 
 /* 
@@ -438,66 +549,71 @@ static void ApplockUnrefGlobalCache(int64 key)
 static int64 ApplockGetUsableKey(char *resource)
 {
 	int64			key, usable_key;
-    bool			found;
+	uint32			hashcode;
+	LWLock		   *partitionLock;
+	bool			found;
 	AppLockCacheEnt *entry;
 	int				try_search = 0;
 
-	/* Firstly, try search in the global cache to see if it's available already*/
-	if ((key = AppLockSearchKeyGlobal(resource)) != -1) {
-		LWLockAcquire(TsqlApplockSyncLock, LW_EXCLUSIVE);
-		entry = (AppLockCacheEnt*) hash_search(appLockCacheGlobal,
-													(void *) &key,
-													HASH_ENTER, &found);
-		/* Someone might've just deleted it. So check it before modify.*/
-		if (found) {
-			++entry->refcount;
-			LWLockRelease(TsqlApplockSyncLock);
-			return key;
-		}
-		LWLockRelease(TsqlApplockSyncLock);
-	}
-
-	/* Otherwise, try generating a new key for this resource */
-
 	/* convert resource string to key integer */
-	key = applock_simple_hash(resource);
+	key = applock_hash_resource(resource);
 	usable_key = -1;
 
-	LWLockAcquire(TsqlApplockSyncLock, LW_EXCLUSIVE);
+	/* All the candidate keys of a resource share the hash code. */
+	hashcode = applock_key_hash(&key, sizeof(key));
+	partitionLock = ApplockPartitionLock(hashcode);
+
+	ApplockAcquirePartition(partitionLock, LW_EXCLUSIVE);
 
 	/* 
 	 * Some different resource name may have been hashed to the same key. 
-	 * In that case, we keep incrementing key until we find a usable one. 
+	 * In that case, we keep trying the next candidate key until we find a
+	 * usable one.
 	 *
 	 * NB: it's not very meaningful to try too many times because if it
 	 * turns out that a couple of random keys have somehow all been used,
 	 * we probably have a bug somewhere so it's better to error out.
 	 * Also, we have to search all the possible candidate keys for the resource
-	 * to make sure someone else did not just insert the same resource with 
+	 * to make sure someone else did not already insert the same resource with 
 	 * some key unknown to the caller.
 	 */
 	while (try_search++ < APPLOCK_MAX_TRY_SEARCH_KEY) {
-		entry = (AppLockCacheEnt*) hash_search(appLockCacheGlobal,
-                                                    (void *) &key,
-                                                    HASH_FIND, NULL);
-		/* Someone might've just inserted an entry for this resource. */
+		entry = (AppLockCacheEnt*) dshash_find(appLockCacheGlobal, &key, true);
+		/* Someone already holds a lock on this resource. */
 		if (entry && strcmp(entry->resource, resource) == 0) {
 			entry->refcount++;
-			LWLockRelease(TsqlApplockSyncLock);
+			dshash_release_lock(appLockCacheGlobal, entry);
+			LWLockRelease(partitionLock);
 			return key;
 		}
+		if (entry) {
+			dshash_release_lock(appLockCacheGlobal, entry);
+			/* Key taken by another resource. */
+			if (usable_key == -1)
+				pg_atomic_fetch_add_u64(&applockShared->collisions, 1);
+		}
 		/* Key usable, record it if not done so. */
-		if (!entry && usable_key == -1)
+		else if (usable_key == -1)
 			usable_key = key;
 
-		/* Keep searching, be mindful of overflow */
-		key = (key % INT64_MAX) + 1;
+		key = applock_next_key(key);
 	}
 
 	if (usable_key != -1) {
-		entry = (AppLockCacheEnt*) hash_search(appLockCacheGlobal,
-													(void *) &usable_key,
-													HASH_ENTER, &found);
+		/* The table is full, don't let it grow past the configured limit. */
+		if (pg_atomic_fetch_add_u64(&applockShared->entries, 1) >= pltsql_applock_table_size) {
+			pg_atomic_fetch_sub_u64(&applockShared->entries, 1);
+			LWLockRelease(partitionLock);
+			ereport(ERROR,
+					(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+					 errmsg("too many application lock resources are held"),
+					 errdetail("At most %d application lock resources can be held at the same time.",
+							   pltsql_applock_table_size),
+					 errhint("Increase babelfishpg_tsql.applock_table_size.")));
+		}
+
+		entry = (AppLockCacheEnt*) dshash_find_or_insert(appLockCacheGlobal,
+													&usable_key, &found);
 		/* It must be non-existing at this point. */
 		Assert(!found);
 
@@ -505,9 +621,10 @@ static int64 ApplockGetUsableKey(char *resource)
 		entry->refcount = 1;
 		entry->resource[0] = '\0';
 		strncat(entry->resource, resource, strlen(resource));
+		dshash_release_lock(appLockCacheGlobal, entry);
 	}
 
-	LWLockRelease(TsqlApplockSyncLock);
+	LWLockRelease(partitionLock);
 	return usable_key;
 }
 
@@ -685,7 +802,6 @@ static int _sp_releaseapplock_internal(char *resource, char *lockowner,
 	if ((key = AppLockSearchKeyGlobal(resource)) == -1) {
 		if (!suppress_warning)
 			ApplockPrintMessage("No lock resource \'%s\' acquired before.", resource);
-		LWLockRelease(TsqlApplockSyncLock);
 		return -999;
 	}
 
@@ -929,3 +1045,29 @@ ApplockRemoveCache(bool release_session)
 	/* Release all applocks too. */
 	LockReleaseAll(APPLOCK_LOCKMETHOD, release_session);
 }
+
+/*
+ * Report the occupancy and contention of the shared applock hashmap.
+ */
+Datum
+babelfish_applock_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[5];
+	bool		nulls[5] = {false, false, false, false, false};
+
+	/* Init applock hash table if not yet done. */
+	if (!appLockCacheLocal)
+		initApplockCache();
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	values[0] = Int32GetDatum(pltsql_applock_table_size);
+	values[1] = Int64GetDatum((int64) pg_atomic_read_u64(&applockShared->entries));
+	values[2] = Int32GetDatum(APPLOCK_NUM_PARTITIONS);
+	values[3] = Int64GetDatum((int64) pg_atomic_read_u64(&applockShared->collisions));
+	values[4] = Int64GetDatum((int64) pg_atomic_read_u64(&applockShared->lock_waits));
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
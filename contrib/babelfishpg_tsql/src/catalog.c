@@ -17,7 +17,10 @@
 #include "tcop/utility.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/syscache.h"
 #include "utils/tuplestore.h"
 #include "utils/rel.h"
@@ -51,6 +54,27 @@ Oid namespace_ext_oid = InvalidOid;
 Oid namespace_ext_idx_oid_oid = InvalidOid;
 int namespace_ext_num_cols = 4;
 
+/*
+ * Backend-local cache of babelfish_namespace_ext, keyed by physical schema
+ * name. Schemas without a row are cached as well.
+ *
+ * A row is only added or removed together with its pg_namespace entry, and
+ * whoever changes the catalog also sends a relcache invalidation for it.
+ * Either invalidation marks the whole cache stale; it is emptied on the next
+ * lookup rather than inside the callback, which may run mid-lookup.
+ */
+typedef struct SchemaNameCacheEntry
+{
+	char		physical_name[NAMEDATALEN];	/* hash key */
+	bool		found;			/* has a babelfish_namespace_ext row? */
+	int16		dbid;
+	char	   *logical_name;
+} SchemaNameCacheEntry;
+
+static HTAB *schema_name_cache = NULL;
+static MemoryContext schema_name_cache_cxt = NULL;
+static bool schema_name_cache_valid = false;
+
 /*****************************************
  *			LOGIN EXT
  *****************************************/
@@ -417,20 +441,73 @@ babelfish_helpdb(PG_FUNCTION_ARGS)
  *			NAMESPACE_EXT
  *****************************************/
 
-const char *
-get_logical_schema_name(const char *physical_schema_name, bool missingOk)
+static void
+schema_name_cache_syscache_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	schema_name_cache_valid = false;
+}
+
+static void
+schema_name_cache_relcache_callback(Datum arg, Oid relid)
+{
+	if (!OidIsValid(relid) || relid == namespace_ext_oid)
+		schema_name_cache_valid = false;
+}
+
+/*
+ * Find the babelfish_namespace_ext row of a physical schema, going through
+ * the cache when the name fits in its key. The returned logical name is not
+ * a copy.
+ */
+static void
+lookup_namespace_ext(const char *physical_schema_name, bool *found,
+					 int16 *dbid, const char **logical_name)
 {
 	Relation 	rel;
 	HeapTuple	tuple;
 	ScanKeyData scanKey;
 	SysScanDesc scan;
-	Datum		datum;
-	const char  *logical_name;
 	TupleDesc	dsc;
 	bool 		isnull;
+	bool		cacheable = strlen(physical_schema_name) < NAMEDATALEN;
+	SchemaNameCacheEntry *entry;
 
-	if (get_namespace_oid(physical_schema_name, false) == InvalidOid)
-		return NULL;
+	if (cacheable)
+	{
+		if (schema_name_cache == NULL || !schema_name_cache_valid)
+		{
+			HASHCTL		ctl;
+
+			if (schema_name_cache_cxt == NULL)
+			{
+				schema_name_cache_cxt = AllocSetContextCreate(CacheMemoryContext,
+															  "Babelfish schema name cache",
+															  ALLOCSET_SMALL_SIZES);
+				CacheRegisterSyscacheCallback(NAMESPACEOID, schema_name_cache_syscache_callback, (Datum) 0);
+				CacheRegisterRelcacheCallback(schema_name_cache_relcache_callback, (Datum) 0);
+			}
+			else
+				MemoryContextReset(schema_name_cache_cxt);
+
+			MemSet(&ctl, 0, sizeof(ctl));
+			ctl.keysize = NAMEDATALEN;
+			ctl.entrysize = sizeof(SchemaNameCacheEntry);
+			ctl.hcxt = schema_name_cache_cxt;
+			schema_name_cache = hash_create("Babelfish schema name cache", 64, &ctl,
+											HASH_ELEM | HASH_STRINGS | HASH_CONTEXT);
+			schema_name_cache_valid = true;
+		}
+
+		entry = (SchemaNameCacheEntry *) hash_search(schema_name_cache, physical_schema_name,
+													 HASH_FIND, NULL);
+		if (entry)
+		{
+			*found = entry->found;
+			*dbid = entry->dbid;
+			*logical_name = entry->logical_name;
+			return;
+		}
+	}
 
 	rel = table_open(namespace_ext_oid, AccessShareLock);
 	dsc = RelationGetDescr(rel);
@@ -444,66 +521,70 @@ get_logical_schema_name(const char *physical_schema_name, bool missingOk)
 							  NULL, 1, &scanKey);
 
 	tuple = systable_getnext(scan);
-	if (!HeapTupleIsValid(tuple))
+	*found = HeapTupleIsValid(tuple);
+	*dbid = InvalidDbid;
+	*logical_name = NULL;
+	if (*found)
+	{
+		*dbid = DatumGetInt16(heap_getattr(tuple, Anum_namespace_ext_dbid, dsc, &isnull));
+		*logical_name = TextDatumGetCString(heap_getattr(tuple, Anum_namespace_ext_orig_name, dsc, &isnull));
+	}
+
+	systable_endscan(scan);
+	table_close(rel, AccessShareLock);
+
+	/* Opening the catalog may have accepted invalidations; don't cache then. */
+	if (cacheable && schema_name_cache_valid)
+	{
+		entry = (SchemaNameCacheEntry *) hash_search(schema_name_cache, physical_schema_name,
+													 HASH_ENTER, NULL);
+		entry->found = *found;
+		entry->dbid = *dbid;
+		entry->logical_name = *found ? MemoryContextStrdup(schema_name_cache_cxt, *logical_name) : NULL;
+	}
+}
+
+const char *
+get_logical_schema_name(const char *physical_schema_name, bool missingOk)
+{
+	bool		found;
+	int16		dbid;
+	const char *logical_name;
+
+	if (get_namespace_oid(physical_schema_name, false) == InvalidOid)
+		return NULL;
+
+	lookup_namespace_ext(physical_schema_name, &found, &dbid, &logical_name);
+	if (!found)
 	{
-		systable_endscan(scan);
-		table_close(rel, AccessShareLock);
 		if (!missingOk)
 			ereport(ERROR,
 				(errcode(ERRCODE_INTERNAL_ERROR),
 				 errmsg("Could find logical schema name for: \"%s\"", physical_schema_name)));
 		return NULL;
 	}
-	datum = heap_getattr(tuple, Anum_namespace_ext_orig_name, dsc, &isnull);
-	logical_name = pstrdup(TextDatumGetCString(datum));
-
-	systable_endscan(scan);
-	table_close(rel, AccessShareLock);
-	return logical_name;
+	return pstrdup(logical_name);
 }
 
 int16
 get_dbid_from_physical_schema_name(const char *physical_schema_name, bool missingOk)
 {
-	Relation 	rel;
-	HeapTuple	tuple;
-	ScanKeyData	scanKey;
-	SysScanDesc	scan;
-	Datum		datum;
+	bool		found;
 	int16		dbid;
-	TupleDesc	dsc;
-	bool		isnull;
+	const char *logical_name;
 
 	if (get_namespace_oid(physical_schema_name, false) == InvalidOid)
 		return InvalidDbid;
 
-	rel = table_open(namespace_ext_oid, AccessShareLock);
-	dsc = RelationGetDescr(rel);
-
-	ScanKeyInit(&scanKey,
-				Anum_namespace_ext_namespace,
-				BTEqualStrategyNumber, F_NAMEEQ,
-				CStringGetDatum(physical_schema_name));
-
-	scan = systable_beginscan(rel, namespace_ext_idx_oid_oid, true,
-							  NULL, 1, &scanKey);
-
-	tuple = systable_getnext(scan);
-	if (!HeapTupleIsValid(tuple))
+	lookup_namespace_ext(physical_schema_name, &found, &dbid, &logical_name);
+	if (!found)
 	{
-		systable_endscan(scan);
-		table_close(rel, AccessShareLock);
 		if (!missingOk)
 			ereport(ERROR,
 				(errcode(ERRCODE_INTERNAL_ERROR),
 				 errmsg("Could not find db id for: \"%s\"", physical_schema_name)));
 		return InvalidDbid;
 	}
-	datum = heap_getattr(tuple, Anum_namespace_ext_dbid, dsc, &isnull);
-	dbid = DatumGetInt16(datum);
-
-	systable_endscan(scan);
-	table_close(rel, AccessShareLock);
 	return dbid;
 }
 
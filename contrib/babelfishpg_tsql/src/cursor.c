@@ -60,12 +60,30 @@ typedef struct cursorhashent
 	int32 cursor_handle;
 	bool api_cursor; /* only used in cursor_list now. can be deprecated once we supprot global cursor */
 	TupleDesc tupdesc;
-	Tuplestorestate *fetch_buffer;
+	Tuplestorestate *fetch_buffer; /* rows of the last fetch, non-scrollable cursors only */
 	char *textptr_only_bitmap;
+	/* last fetch, replayed on scrollable cursors in place of fetch_buffer */
+	bool last_fetch_valid;
+	FetchDirection last_fetch_direction;
+	long last_fetch_count;
+	uint64 last_fetch_pos;
+	bool last_fetch_at_end;
 } CursorHashEnt;
 
 static HTAB *CursorHashTable = NULL;
 
+/*
+ * DestReceiver for sp_cursorfetch on non-scrollable cursors: sends the rows
+ * to the client and keeps a copy of them in the cursor's fetch buffer, since
+ * they can't be fetched again for sp_cursor REFRESH.
+ */
+typedef struct
+{
+	DestReceiver pub;
+	DestReceiver *client;
+	Tuplestorestate *buffer;
+} FetchBufferReceiver;
+
 typedef struct cursorpreparedhandlehashent
 {
 	uint32 handle;
@@ -107,6 +125,14 @@ static int validate_and_get_sp_cursoropen_params(int scrollopt, int ccopt);
 static void validate_and_get_sp_cursorfetch_params(int *fetchtype_in, int *rownum_in, int *nrows_in, int *fetchtype_out, int *rownum_out, int *nrows_out);
 static void validate_sp_cursoroption_params(int code, int value);
 
+static void fetch_buffer_startup(DestReceiver *self, int operation, TupleDesc typeinfo);
+static bool fetch_buffer_receive(TupleTableSlot *slot, DestReceiver *self);
+static void fetch_buffer_shutdown(DestReceiver *self);
+static void fetch_buffer_destroy(DestReceiver *self);
+static void cursor_save_position(Portal portal, uint64 *pos, bool *at_end);
+static void cursor_restore_position(Portal portal, uint64 pos, bool at_end);
+static void cursor_fetch_to_client(CursorHashEnt *hentry, Portal portal, FetchDirection direction, long count);
+
 /* cursor functions and procedures */
 PG_FUNCTION_INFO_V1(cursor_rows);
 PG_FUNCTION_INFO_V1(cursor_status);
@@ -472,6 +498,7 @@ CursorHashEnt *pltsql_insert_cursor_entry(char *curname, PLtsql_expr *explicit_e
 	hentry->tupdesc = NULL;
 	hentry->fetch_buffer = NULL;
 	hentry->textptr_only_bitmap = NULL;
+	hentry->last_fetch_valid = false;
 
 	return hentry;
 }
@@ -984,14 +1011,38 @@ int execute_sp_cursor(int cursor_handle, int opttype, int rownum, const char *ta
 
 	if (opttype & SP_CURSOR_OPTTYPE_REFRESH)
 	{
-		if (hentry->fetch_buffer == NULL)
-			elog(ERROR, "cursor \"%s\" has no fetch buffer", curname);
-
 		portal = SPI_cursor_find(hentry->curname);
+		if (portal == NULL)
+			elog(ERROR, "portal \"%s\" does not exist", hentry->curname);
 
 		receiver = CreateDestReceiver(DestRemote);
 		SetRemoteDestReceiverParams(receiver, portal);
 
+		if (hentry->last_fetch_valid)
+		{
+			uint64 pos;
+			bool at_end;
+
+			/*
+			 * Scrollable cursor: go back to where the last fetch started, run
+			 * it again straight to the client and return to where we were.
+			 */
+			cursor_save_position(portal, &pos, &at_end);
+			cursor_restore_position(portal, hentry->last_fetch_pos, hentry->last_fetch_at_end);
+			SPI_scroll_cursor_fetch_dest(portal, hentry->last_fetch_direction, hentry->last_fetch_count, receiver);
+			if (SPI_result != 0)
+				elog(ERROR, "error in SPI_scroll_cursor_fetch: %d", SPI_result);
+			cursor_restore_position(portal, pos, at_end);
+
+			if ((rc = SPI_finish()) != SPI_OK_FINISH)
+				elog(ERROR, "SPI_finish failed: %s", SPI_result_code_string(rc));
+
+			return 0;
+		}
+
+		if (hentry->fetch_buffer == NULL)
+			elog(ERROR, "cursor \"%s\" has no fetch buffer", curname);
+
 		tuplestore_rescan(hentry->fetch_buffer);
 		slot = MakeSingleTupleTableSlot(hentry->tupdesc, &TTSOpsMinimalTuple);
 		receiver->rStartup(receiver, (int) CMD_SELECT, hentry->tupdesc);
@@ -1076,10 +1127,6 @@ int execute_sp_cursorfetch(int cursor_handle, int *pfetchtype, int *prownum, int
 	int fetchtype;
 	int rownum;
 	int nrows;
-	DestReceiver *receiver;
-	TupleTableSlot *slot;
-	int rno;
-	MemoryContext oldcontext;
 	MemoryContext savedPortalCxt;
 
 	/* Connect to SPI manager. should be handled in the same way with pltsql_inline_handler() */
@@ -1098,15 +1145,7 @@ int execute_sp_cursorfetch(int cursor_handle, int *pfetchtype, int *prownum, int
 
 	validate_and_get_sp_cursorfetch_params(pfetchtype, prownum, pnrows, &fetchtype, &rownum, &nrows);
 
-	/* prepare fetch buffer if not exists */
-	if (hentry->fetch_buffer == NULL)
-	{
-		oldcontext = MemoryContextSwitchTo(CursorHashtabContext);
-		hentry->fetch_buffer = tuplestore_begin_heap(true, true, 1024);
-		MemoryContextSwitchTo(oldcontext);
-	}
-
-	/* actual fetch */
+	/* actual fetch, the rows go straight from the portal to the client */
 	portal = SPI_cursor_find(hentry->curname);
 	if (portal == NULL)
 		elog(ERROR, "portal \"%s\" does not exist", hentry->curname);
@@ -1118,31 +1157,31 @@ int execute_sp_cursorfetch(int cursor_handle, int *pfetchtype, int *prownum, int
 			SPI_scroll_cursor_move(portal, FETCH_ABSOLUTE, 0);
 			/* if needed, return some rows */
 			if (nrows > 0)
-				SPI_scroll_cursor_fetch_dest(portal, FETCH_FORWARD, nrows, CreateDestReceiver(DestSPI));
+				cursor_fetch_to_client(hentry, portal, FETCH_FORWARD, nrows);
 			break;
 		case SP_CURSOR_FETCH_NEXT:
 			Assert(nrows > 0);
 			/* fetch in forward direction */
-			SPI_scroll_cursor_fetch_dest(portal, FETCH_FORWARD, nrows, CreateDestReceiver(DestSPI));
+			cursor_fetch_to_client(hentry, portal, FETCH_FORWARD, nrows);
 			break;
 		case SP_CURSOR_FETCH_PREV:
 			Assert(nrows > 0);
 			/* fetch in backward direction */
-			SPI_scroll_cursor_fetch_dest(portal, FETCH_BACKWARD, nrows, CreateDestReceiver(DestSPI));
+			cursor_fetch_to_client(hentry, portal, FETCH_BACKWARD, nrows);
 			break;
 		case SP_CURSOR_FETCH_LAST:
 			/* advance to end, back up abs(nrows)-1 rows */
 			SPI_scroll_cursor_move(portal, FETCH_ABSOLUTE, -nrows - 1);
 			/* if needed, return some rows */
 			if (nrows > 0)
-				SPI_scroll_cursor_fetch_dest(portal, FETCH_FORWARD, nrows, CreateDestReceiver(DestSPI));
+				cursor_fetch_to_client(hentry, portal, FETCH_FORWARD, nrows);
 			break;
 		case SP_CURSOR_FETCH_ABSOLUTE:
 			/* rewind to start, advance count-1 rows */
 			SPI_scroll_cursor_move(portal, FETCH_ABSOLUTE, rownum - 1);
 			Assert(nrows > 0);
 			/* fetch in forward direction */
-			SPI_scroll_cursor_fetch_dest(portal, FETCH_FORWARD, nrows, CreateDestReceiver(DestSPI));
+			cursor_fetch_to_client(hentry, portal, FETCH_FORWARD, nrows);
 			break;
 		case SP_CURSOR_FETCH_RELATIVE:
 		case SP_CURSOR_FETCH_REFRESH:
@@ -1156,30 +1195,6 @@ int execute_sp_cursorfetch(int cursor_handle, int *pfetchtype, int *prownum, int
 	if (SPI_result != 0)
 		elog(ERROR, "error in SPI_scroll_cursor_fetch: %d", SPI_result);
 
-	/* In case of FETCH_FIRST/FETCH_LAST with 0 nrows, we just moved cursor and no actual fetch is called. SPI_tuptable can be NULL. skip storing the result */
-	if (SPI_tuptable)
-	{
-		/* store result in fetch buffer */
-		tuplestore_clear(hentry->fetch_buffer);
-
-		oldcontext = MemoryContextSwitchTo(CursorHashtabContext);
-		for (rno = 0; rno < SPI_processed; ++rno)
-			tuplestore_puttuple(hentry->fetch_buffer, SPI_tuptable->vals[rno]);
-		MemoryContextSwitchTo(oldcontext);
-
-		tuplestore_rescan(hentry->fetch_buffer);
-
-		/* send result to DestRemote */
-		receiver = CreateDestReceiver(DestRemote);
-		SetRemoteDestReceiverParams(receiver, portal);
-
-		slot = MakeSingleTupleTableSlot(hentry->tupdesc, &TTSOpsMinimalTuple);
-		receiver->rStartup(receiver, (int) CMD_SELECT, hentry->tupdesc);
-		while (tuplestore_gettupleslot(hentry->fetch_buffer, true, false, slot))
-			receiver->receiveSlot(slot, receiver);
-		receiver->rShutdown(receiver);
-	}
-
 	/* update cursor status */
 	pltsql_update_cursor_fetch_status(curname, SPI_processed == 0 ? -1 : 0);
 	pltsql_update_cursor_row_count(curname, SPI_processed);
@@ -1198,6 +1213,109 @@ int execute_sp_cursorfetch(int cursor_handle, int *pfetchtype, int *prownum, int
 	return 0;
 }
 
+static void
+fetch_buffer_startup(DestReceiver *self, int operation, TupleDesc typeinfo)
+{
+	FetchBufferReceiver *receiver = (FetchBufferReceiver *) self;
+
+	receiver->client->rStartup(receiver->client, operation, typeinfo);
+}
+
+static bool
+fetch_buffer_receive(TupleTableSlot *slot, DestReceiver *self)
+{
+	FetchBufferReceiver *receiver = (FetchBufferReceiver *) self;
+
+	/* tuplestore copies the row into its own memory context */
+	tuplestore_puttupleslot(receiver->buffer, slot);
+	return receiver->client->receiveSlot(slot, receiver->client);
+}
+
+static void
+fetch_buffer_shutdown(DestReceiver *self)
+{
+	FetchBufferReceiver *receiver = (FetchBufferReceiver *) self;
+
+	receiver->client->rShutdown(receiver->client);
+}
+
+static void
+fetch_buffer_destroy(DestReceiver *self)
+{
+	pfree(self);
+}
+
+/*
+ * Remember the position of a portal in a form cursor_restore_position can
+ * go back to. When the portal ran off the end, its position is the row count.
+ */
+static void
+cursor_save_position(Portal portal, uint64 *pos, bool *at_end)
+{
+	*pos = portal->portalPos;
+	*at_end = portal->atEnd;
+}
+
+static void
+cursor_restore_position(Portal portal, uint64 pos, bool at_end)
+{
+	if (at_end)
+		SPI_scroll_cursor_move(portal, FETCH_FORWARD, FETCH_ALL);
+	else
+		SPI_scroll_cursor_move(portal, FETCH_ABSOLUTE, (long) pos);
+}
+
+/*
+ * Fetch count rows from the portal straight to the client.
+ *
+ * A scrollable cursor can fetch the same rows again, so all we keep for
+ * sp_cursor REFRESH is where the fetch started. Other cursors copy the rows
+ * into the fetch buffer on their way to the client.
+ */
+static void
+cursor_fetch_to_client(CursorHashEnt *hentry, Portal portal, FetchDirection direction, long count)
+{
+	DestReceiver *client;
+
+	client = CreateDestReceiver(DestRemote);
+	SetRemoteDestReceiverParams(client, portal);
+
+	if (portal->cursorOptions & CURSOR_OPT_SCROLL)
+	{
+		cursor_save_position(portal, &hentry->last_fetch_pos, &hentry->last_fetch_at_end);
+		hentry->last_fetch_direction = direction;
+		hentry->last_fetch_count = count;
+		hentry->last_fetch_valid = true;
+
+		SPI_scroll_cursor_fetch_dest(portal, direction, count, client);
+	}
+	else
+	{
+		FetchBufferReceiver *receiver;
+
+		if (hentry->fetch_buffer == NULL)
+		{
+			MemoryContext oldcontext = MemoryContextSwitchTo(CursorHashtabContext);
+
+			hentry->fetch_buffer = tuplestore_begin_heap(true, true, 1024);
+			MemoryContextSwitchTo(oldcontext);
+		}
+		else
+			tuplestore_clear(hentry->fetch_buffer);
+
+		receiver = (FetchBufferReceiver *) palloc0(sizeof(FetchBufferReceiver));
+		receiver->pub.receiveSlot = fetch_buffer_receive;
+		receiver->pub.rStartup = fetch_buffer_startup;
+		receiver->pub.rShutdown = fetch_buffer_shutdown;
+		receiver->pub.rDestroy = fetch_buffer_destroy;
+		receiver->pub.mydest = client->mydest;
+		receiver->client = client;
+		receiver->buffer = hentry->fetch_buffer;
+
+		SPI_scroll_cursor_fetch_dest(portal, direction, count, (DestReceiver *) receiver);
+	}
+}
+
 #define BITMAPSIZE(natts) (((natts-1)/8)+1)
 
 int execute_sp_cursoroption(int cursor_handle, int code, int value)
@@ -25,6 +25,7 @@
 #include "utils/acl.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
@@ -837,6 +838,7 @@ drop_related_bbf_namespace_entries(int16 dbid)
 		tuple = heap_getnext(scan, ForwardScanDirection);
 	}
 	table_endscan(scan);
+	CacheInvalidateRelcacheByRelid(namespace_ext_oid);
 	table_close(namespace_rel, RowExclusiveLock);
 }
 
@@ -16,13 +16,40 @@
 #include "parser/parser.h"
 #include "utils/builtins.h"
 #include "utils/json.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/syscache.h"
+#include "catalog/namespace.h"
 #include "catalog/pg_type.h"
 
+/* Number of rows pulled from the query at a time */
+#define FORJSON_FETCH_SIZE 1000
+
+/* How a column value is turned into JSON, decided once per query */
+typedef enum
+{
+	FORJSON_COL_PLAIN,			/* as is, by its own type */
+	FORJSON_COL_BIT,			/* sys.bit, as boolean */
+	FORJSON_COL_DATETIME,		/* datetime, smalldatetime, datetime2 */
+	FORJSON_COL_DATETIMEOFFSET,
+	FORJSON_COL_MONEY			/* money and smallmoney, as numeric */
+} ForJsonColumnKind;
+
+typedef struct ForJsonColumn
+{
+	char	   *colname;
+	ForJsonColumnKind kind;
+	Oid			json_typid;		/* type the value is built as */
+	FmgrInfo	typoutput;		/* output function, for text conversions */
+} ForJsonColumn;
+
 static StringInfo tsql_query_to_json_internal(const char *query, int mode, bool include_null_value,
 								bool without_array_wrapper, const char *root_name);
-static void SPI_sql_row_to_json_path(uint64 rownum, StringInfo result, bool include_null_value);
-static void tsql_unsupported_datatype_check(void);
+static ForJsonColumn *for_json_plan_columns(TupleDesc tupdesc, Oid sys_nspoid);
+static void SPI_sql_row_to_json_path(uint64 rownum, ForJsonColumn *columns, StringInfo result,
+									 bool include_null_value);
+static char *get_sys_type_name(Oid typid, Oid sys_nspoid);
+static void tsql_unsupported_datatype_check(TupleDesc tupdesc, Oid sys_nspoid);
 static void for_json_datetime_format(StringInfo format_output, char *outputstr);
 static void for_json_datetimeoffset_format(StringInfo format_output, char *outputstr);
 
@@ -52,110 +79,145 @@ tsql_query_to_json_text(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * Work out how each column of the query is formatted, so that rows don't
+ * have to look up types.
+ */
+static ForJsonColumn *
+for_json_plan_columns(TupleDesc tupdesc, Oid sys_nspoid)
+{
+	ForJsonColumn *columns = palloc0(sizeof(ForJsonColumn) * tupdesc->natts);
+
+	for (int i = 0; i < tupdesc->natts; i++)
+	{
+		ForJsonColumn *col = &columns[i];
+		char	   *typename;
+
+		col->colname = SPI_fname(tupdesc, i + 1);
+
+		if (!strcmp(col->colname,"\?column\?")) /* When column name or alias is not provided */
+		{
+			ereport(ERROR,
+							(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							 errmsg("column expressions and data sources without names or aliases cannot be formatted as JSON text using FOR JSON clause. Add alias to the unnamed column or table")));
+		}
+
+		col->kind = FORJSON_COL_PLAIN;
+		col->json_typid = SPI_gettypeid(tupdesc, i + 1);
+
+		typename = get_sys_type_name(col->json_typid, sys_nspoid);
+		if (typename == NULL)
+			continue;
+
+		/* check for bit datatype, and if so, change type to BOOL */
+		if (strcmp(typename, "bit")  == 0)
+			col->kind = FORJSON_COL_BIT;
+		/* convert datetime, smalldatetime, and datetime2 to appropriate text values,
+		 * as T-SQL has a different text conversion than postgres.
+		 */
+		else if (strcmp(typename, "datetime")  == 0 ||
+			strcmp(typename, "smalldatetime") == 0 ||
+			strcmp(typename, "datetime2") == 0)
+			col->kind = FORJSON_COL_DATETIME;
+		/* datetimeoffset has two behaviors:
+		 * if offset is 0, just return the datetime with 'Z' at the end
+		 * otherwise, append the offset
+		 */
+		else if (strcmp(typename, "datetimeoffset") == 0)
+			col->kind = FORJSON_COL_DATETIMEOFFSET;
+		/* convert money and smallmoney to numeric */
+		else if (strcmp(typename, "money") == 0 ||
+			strcmp(typename, "smallmoney") == 0)
+			col->kind = FORJSON_COL_MONEY;
+
+		if (col->kind != FORJSON_COL_PLAIN && col->kind != FORJSON_COL_BIT)
+		{
+			Oid 	typoutput;
+			bool	typisvarlena;
+
+			getTypeOutputInfo(col->json_typid, &typoutput, &typisvarlena);
+			fmgr_info(typoutput, &col->typoutput);
+		}
+
+		switch (col->kind)
+		{
+			case FORJSON_COL_BIT:
+				col->json_typid = BOOLOID;
+				break;
+			case FORJSON_COL_DATETIME:
+			case FORJSON_COL_DATETIMEOFFSET:
+				col->json_typid = CSTRINGOID;
+				break;
+			case FORJSON_COL_MONEY:
+				col->json_typid = NUMERICOID;
+				break;
+			default:
+				break;
+		}
+	}
+
+	return columns;
+}
+
 /*
  * Map an SQL row to an JSON element, taking the row from the active
  * SPI cursor.
  */
 static void
-SPI_sql_row_to_json_path(uint64 rownum, StringInfo result, bool include_null_value)
+SPI_sql_row_to_json_path(uint64 rownum, ForJsonColumn *columns, StringInfo result,
+						 bool include_null_value)
 {
 	int			i;
 	const char  *sep="";
 	bool 		isnull;
 
 	appendStringInfoChar(result,'{');
-	for (i = 1; i <= SPI_tuptable->tupdesc->natts; i++)
+	for (i = 0; i < SPI_tuptable->tupdesc->natts; i++)
 	{
-		char	*colname;
+		ForJsonColumn *col = &columns[i];
 		Datum	colval;
-		Oid 	nspoid;
-		Oid 	tsql_datatype_oid;
-		Oid 	datatype_oid;
-		char	*typename;
-		
-		colname = SPI_fname(SPI_tuptable->tupdesc, i);
-		
-		if (!strcmp(colname,"\?column\?")) /* When column name or alias is not provided */
-		{
-			ereport(ERROR,
-							(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-							 errmsg("column expressions and data sources without names or aliases cannot be formatted as JSON text using FOR JSON clause. Add alias to the unnamed column or table")));
-		}
-		
+
 		colval = SPI_getbinval(SPI_tuptable->vals[rownum],
 							   SPI_tuptable->tupdesc,
-							   i,
-							   &isnull);	
+							   i + 1,
+							   &isnull);
 
 		if (isnull && !include_null_value)
 			continue;
 
-		datatype_oid = SPI_gettypeid(SPI_tuptable->tupdesc, i);
-		typename = SPI_gettype(SPI_tuptable->tupdesc, i);
-		nspoid = get_namespace_oid("sys", true);
-		Assert(nspoid != InvalidOid);
-
-		tsql_datatype_oid = GetSysCacheOid2(TYPENAMENSP, Anum_pg_type_oid, CStringGetDatum(typename), ObjectIdGetDatum(nspoid));
-		
-		if (tsql_datatype_oid == datatype_oid)
+		if (!isnull && col->kind == FORJSON_COL_DATETIME)
 		{
-			/* check for bit datatype, and if so, change type to BOOL */
-			if (strcmp(typename, "bit")  == 0)
-			{
-				datatype_oid = BOOLOID;
-			}
-			/* convert datetime, smalldatetime, and datetime2 to appropriate text values, 
-			 * as T-SQL has a different text conversion than postgres.
-			 */
-			else if (strcmp(typename, "datetime")  == 0 ||
-				strcmp(typename, "smalldatetime") == 0 ||
-				strcmp(typename, "datetime2") == 0)
-			{
-				char *val = SPI_getvalue(SPI_tuptable->vals[rownum], SPI_tuptable->tupdesc, i);
-				StringInfo format_output = makeStringInfo();
-				for_json_datetime_format(format_output, val);
-				colval = CStringGetDatum(format_output->data);
-
-				datatype_oid = CSTRINGOID;
-			}
-			/* datetimeoffset has two behaviors:
-			 * if offset is 0, just return the datetime with 'Z' at the end
-			 * otherwise, append the offset
-			 */
-			else if (strcmp(typename, "datetimeoffset") == 0)
-			{
-				char *val = SPI_getvalue(SPI_tuptable->vals[rownum], SPI_tuptable->tupdesc, i);
-				StringInfo format_output = makeStringInfo();
-				for_json_datetimeoffset_format(format_output, val);
-				colval = CStringGetDatum(format_output->data);
-
-				datatype_oid = CSTRINGOID;
-			}
-			/* convert money and smallmoney to numeric */
-			else if (strcmp(typename, "money") == 0 ||
-				strcmp(typename, "smallmoney") == 0)
-			{
-				char *val = SPI_getvalue(SPI_tuptable->vals[rownum], SPI_tuptable->tupdesc, i);
-				colval = DirectFunctionCall3(numeric_in, CStringGetDatum(val), ObjectIdGetDatum(InvalidOid), Int32GetDatum(-1));
-				datatype_oid = NUMERICOID;
-			}
+			char *val = OutputFunctionCall(&col->typoutput, colval);
+			StringInfo format_output = makeStringInfo();
+			for_json_datetime_format(format_output, val);
+			colval = CStringGetDatum(format_output->data);
+		}
+		else if (!isnull && col->kind == FORJSON_COL_DATETIMEOFFSET)
+		{
+			char *val = OutputFunctionCall(&col->typoutput, colval);
+			StringInfo format_output = makeStringInfo();
+			for_json_datetimeoffset_format(format_output, val);
+			colval = CStringGetDatum(format_output->data);
+		}
+		else if (!isnull && col->kind == FORJSON_COL_MONEY)
+		{
+			char *val = OutputFunctionCall(&col->typoutput, colval);
+			colval = DirectFunctionCall3(numeric_in, CStringGetDatum(val), ObjectIdGetDatum(InvalidOid), Int32GetDatum(-1));
 		}
 
-
-		appendStringInfo(result,sep);
+		appendStringInfoString(result,sep);
 		sep = ",";
-		tsql_json_build_object(result, CStringGetDatum(colname), colval, datatype_oid, isnull);
+		tsql_json_build_object(result, CStringGetDatum(col->colname), colval, col->json_typid, isnull);
 
 	}
 	appendStringInfoChar(result,'}');
-	if (rownum != SPI_processed-1)
-	{
-		appendStringInfoString(result,",");
-	}
 }
 
 /*
  * Perform the operation based on the mode and directives in the input query
+ *
+ * Rows are pulled through a cursor in batches and each batch is freed once
+ * it has been appended, so only the JSON text grows with the result size.
  */
 static StringInfo
 tsql_query_to_json_internal(const char *query, int mode, bool include_null_value,
@@ -163,25 +225,39 @@ tsql_query_to_json_internal(const char *query, int mode, bool include_null_value
 {
 	StringInfo	result;
 	uint64		i;
+	SPIPlanPtr	plan;
+	Portal		portal;
+	Oid			sys_nspoid;
+	ForJsonColumn *columns = NULL;
+	bool		first_row = true;
+	MemoryContext rowcxt;
+	MemoryContext oldcxt;
 	set_config_option("babelfishpg_tsql.sql_dialect", "tsql",
 					  (superuser() ? PGC_SUSET : PGC_USERSET),
 					  PGC_S_SESSION, GUC_ACTION_SAVE, true, 0, false);
 	result = makeStringInfo();
 
 	SPI_connect();
-	if (SPI_execute(query, true, 0) != SPI_OK_SELECT)
+	plan = SPI_prepare(query, 0, NULL);
+	if (plan == NULL || !SPI_is_cursor_plan(plan))
 		ereport(ERROR,
 				(errcode(ERRCODE_DATA_EXCEPTION),
 				 errmsg("invalid query")));
-	
+	portal = SPI_cursor_open(NULL, plan, NULL, NULL, true);
+
+	SPI_cursor_fetch(portal, true, FORJSON_FETCH_SIZE);
 	if (SPI_processed==0)
 	{
+		SPI_cursor_close(portal);
 		SPI_finish();
 		return NULL;
 	}
 
+	sys_nspoid = get_namespace_oid("sys", true);
+	Assert(sys_nspoid != InvalidOid);
+
 	// To check if query output table has columns with datatypes that are currently not supported in FOR JSON
-	tsql_unsupported_datatype_check();
+	tsql_unsupported_datatype_check(SPI_tuptable->tupdesc, sys_nspoid);
 
 	/* If root_name is present then WITHOUT_ARRAY_WRAPPER will be FALSE */
 	if(root_name)
@@ -198,8 +274,7 @@ tsql_query_to_json_internal(const char *query, int mode, bool include_null_value
 							 errmsg("AUTO mode is not supported")));
 			break;
 		case TSQL_FORJSON_PATH: /* FOR JSON PATH */
-			for (i = 0; i < SPI_processed; i++)
-				SPI_sql_row_to_json_path(i, result, include_null_value);
+			columns = for_json_plan_columns(SPI_tuptable->tupdesc, sys_nspoid);
 			break;
 		default:
 			/* Invalid mode, should not happen, report internal error */
@@ -208,6 +283,28 @@ tsql_query_to_json_internal(const char *query, int mode, bool include_null_value
 							errmsg("invalid FOR JSON mode")));
 	}
 
+	rowcxt = AllocSetContextCreate(CurrentMemoryContext,
+								   "FOR JSON row context",
+								   ALLOCSET_DEFAULT_SIZES);
+	do
+	{
+		for (i = 0; i < SPI_processed; i++)
+		{
+			if (!first_row)
+				appendStringInfoChar(result, ',');
+			first_row = false;
+
+			oldcxt = MemoryContextSwitchTo(rowcxt);
+			SPI_sql_row_to_json_path(i, columns, result, include_null_value);
+			MemoryContextSwitchTo(oldcxt);
+			MemoryContextReset(rowcxt);
+		}
+
+		SPI_freetuptable(SPI_tuptable);
+		SPI_cursor_fetch(portal, true, FORJSON_FETCH_SIZE);
+	} while (SPI_processed > 0);
+
+	SPI_cursor_close(portal);
 	SPI_finish();
 
 
@@ -218,42 +315,54 @@ tsql_query_to_json_internal(const char *query, int mode, bool include_null_value
 	return result;
 }
 
+/*
+ * Return the name of typid if it is one of the T-SQL datatypes in the sys
+ * schema, NULL otherwise.
+ */
+static char *
+get_sys_type_name(Oid typid, Oid sys_nspoid)
+{
+	HeapTuple	tuple;
+	Form_pg_type typform;
+	char	   *typename = NULL;
+
+	tuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typid));
+	if (!HeapTupleIsValid(tuple))
+		elog(ERROR, "cache lookup failed for type %u", typid);
+	typform = (Form_pg_type) GETSTRUCT(tuple);
+
+	/*
+	 * Datatypes can be in different namespaces but with the same name.
+	 * Examples: bigint, int, etc.
+	 */
+	if (typform->typnamespace == sys_nspoid)
+		typename = pstrdup(NameStr(typform->typname));
+
+	ReleaseSysCache(tuple);
+	return typename;
+}
+
 /*
  * For now report an ERROR if any attribute is binary datatype since they are not implemented yet.
  */
 static void
-tsql_unsupported_datatype_check(void)
+tsql_unsupported_datatype_check(TupleDesc tupdesc, Oid sys_nspoid)
 {
-	for (int i = 1; i <= SPI_tuptable->tupdesc->natts; i++)
+	for (int i = 1; i <= tupdesc->natts; i++)
 	{
-		/* 
-		 * This part of code is a workaround for is_tsql_x_datatype() which does not work as expected.
-		 * It compares the datatype oid of the columns with the tsql_datatype_oid and
-		 * then throw feature not supported error based on the typename.
-		 */
-		Oid tsql_datatype_oid;
-		Oid datatype_oid = SPI_gettypeid(SPI_tuptable->tupdesc, i);
-		char* typename = SPI_gettype(SPI_tuptable->tupdesc, i);
-		Oid nspoid = get_namespace_oid("sys", true);
-		Assert(nspoid != InvalidOid);
+		char* typename = get_sys_type_name(SPI_gettypeid(tupdesc, i), sys_nspoid);
 
-		tsql_datatype_oid = GetSysCacheOid2(TYPENAMENSP, Anum_pg_type_oid, CStringGetDatum(typename), ObjectIdGetDatum(nspoid));
+		if (typename == NULL)
+			continue;
 
-		/*
-		 * tsql_datatype_oid can be different from datatype_oid when there are datatypes in different namespaces
-		 * but with the same name. Examples: bigint, int, etc.
-		 */
-		if (tsql_datatype_oid == datatype_oid)
-		{
-			if (strcmp(typename, "binary") == 0 ||
-				strcmp(typename, "varbinary") == 0 ||
-				strcmp(typename, "image") == 0 ||
-				strcmp(typename, "timestamp") == 0 ||
-				strcmp(typename, "rowversion") == 0)
-				ereport(ERROR,
-						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-							errmsg("binary types are not supported with FOR JSON")));
-		}
+		if (strcmp(typename, "binary") == 0 ||
+			strcmp(typename, "varbinary") == 0 ||
+			strcmp(typename, "image") == 0 ||
+			strcmp(typename, "timestamp") == 0 ||
+			strcmp(typename, "rowversion") == 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("binary types are not supported with FOR JSON")));
 	}
 }
 
@@ -28,12 +28,39 @@
 #include "utils/date.h"
 #include "utils/datetime.h"
 #include "catalog/pg_type_d.h"
+#include "utils/float.h"
 #include "utils/guc.h"
 
 #include "catalog/pg_collation.h"
 
 size_t CULTURE_COUNT = sizeof(datetimeformats)/sizeof(datetimeformat);
 
+/*
+ * What FORMAT() derived from its format and culture arguments during the
+ * previous call, kept in fn_extra. Those arguments are nearly always
+ * constants, so rows after the first skip the culture validation, the
+ * format parsing and, as long as the locale GUCs keep their value, the
+ * GUC changes.
+ */
+typedef struct FormatCache
+{
+	MemoryContext mcxt;
+	char	   *culture;		/* culture argument as given */
+	char	   *valid_culture;	/* locale it maps to, e.g. "en_US.UTF-8" */
+	char	   *pattern;		/* format argument the fields below are for */
+	char	   *data_type;
+	int			fmt_res;		/* FORMAT(datetime): translation result */
+	char	   *mask;			/* FORMAT(datetime): to_char() mask */
+	char		spec;			/* FORMAT(numeric): format specifier */
+	char	   *precision_string;	/* FORMAT(numeric): precision after it */
+} FormatCache;
+
+static FormatCache *format_get_cache(FunctionCallInfo fcinfo);
+static char *format_cache_culture(FormatCache *cache, const char *culture, const char *config_name);
+static bool format_cache_has_pattern(FormatCache *cache, const char *pattern, const char *data_type);
+static void format_cache_set_pattern(FormatCache *cache, const char *pattern, const char *data_type);
+static void match_time_value(const char *data_val, int *time_res, int *milli_time_res);
+
 PG_FUNCTION_INFO_V1(format_datetime);
 PG_FUNCTION_INFO_V1(format_numeric);
 
@@ -50,16 +77,18 @@ format_datetime(PG_FUNCTION_ARGS)
 	const char 	*data_type;
 	int 	fmt_res = 0;
 	const char 	*data_str;
-	const char 	*valid_culture;
 	StringInfo 	buf;
 	VarChar *result;
+	FormatCache *cache;
+	bool	value_dependent;
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
 	culture = text_to_cstring(PG_GETARG_TEXT_P(2));
 
-	valid_culture = format_validate_and_culture(culture, "LC_TIME");
+	cache = format_get_cache(fcinfo);
+	format_cache_culture(cache, culture, "LC_TIME");
 
 	buf = makeStringInfo();
 
@@ -83,22 +112,42 @@ format_datetime(PG_FUNCTION_ARGS)
 		data_type = "";
 	}
 
-	if (strlen(format_pattern) <= 1)
+	/* Standard time formats are chosen by looking at the value */
+	value_dependent = strlen(format_pattern) <= 1 && strcmp(data_type, "time") == 0;
+
+	if (!value_dependent && format_cache_has_pattern(cache, format_pattern, data_type))
+	{
+		fmt_res = cache->fmt_res;
+		if (fmt_res > 0)
+			appendStringInfoString(buf, cache->mask);
+	}
+	else
 	{
-		if (arg_type_oid == TIMEOID)
+		if (strlen(format_pattern) <= 1)
 		{
-			data_str = DatumGetCString(DirectFunctionCall1(time_out, PG_GETARG_DATUM(0)));
+			if (arg_type_oid == TIMEOID)
+			{
+				data_str = DatumGetCString(DirectFunctionCall1(time_out, PG_GETARG_DATUM(0)));
+			}
+			else
+			{
+				data_str = "";
+			}
+
+			fmt_res = format_datetimeformats(buf, format_pattern, culture, data_type, data_str);
 		}
 		else
 		{
-			data_str = "";
+			fmt_res = process_format_pattern(buf, format_pattern, data_type);
 		}
 
-		fmt_res = format_datetimeformats(buf, format_pattern, culture, data_type, data_str);
-	}
-	else
-	{
-		fmt_res = process_format_pattern(buf, format_pattern, data_type);
+		if (!value_dependent)
+		{
+			format_cache_set_pattern(cache, format_pattern, data_type);
+			cache->fmt_res = fmt_res;
+			if (fmt_res > 0)
+				cache->mask = MemoryContextStrdup(cache->mcxt, buf->data);
+		}
 	}
 
 	if (fmt_res <= 0)
@@ -174,30 +223,39 @@ format_numeric(PG_FUNCTION_ARGS)
 	char 	upper_pattern;
 	const 	char *format_re = "^[cdefgnprxCDEFGNPRX]{1}[0-9]*$";
 	VarChar *result;
+	FormatCache *cache;
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
 	culture = text_to_cstring(PG_GETARG_TEXT_P(2));
 
-	valid_culture = format_validate_and_culture(culture, "LC_NUMERIC");
+	cache = format_get_cache(fcinfo);
+	valid_culture = format_cache_culture(cache, culture, "LC_NUMERIC");
 
 	format_pattern = text_to_cstring(PG_GETARG_TEXT_P(1));
+	data_type = text_to_cstring(PG_GETARG_TEXT_P(3));
 
-	if (match(format_pattern, format_re) == 0)
+	if (!format_cache_has_pattern(cache, format_pattern, data_type))
 	{
-		ereport(ERROR,
-				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-				 errmsg("%s is not supported/invalid format when converting from NUMERIC to a character string.", format_pattern),
-				 errdetail("Use of incorrect \"format\" parameter value during conversion process."),
-				 errhint("Change \"format\" parameter value and try again.")));
+		if (match(format_pattern, format_re) == 0)
+		{
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("%s is not supported/invalid format when converting from NUMERIC to a character string.", format_pattern),
+					 errdetail("Use of incorrect \"format\" parameter value during conversion process."),
+					 errhint("Change \"format\" parameter value and try again.")));
+		}
+
+		format_cache_set_pattern(cache, format_pattern, data_type);
+		cache->spec = format_pattern[0];
+		/* the format is plain ASCII, so the precision starts at its second byte */
+		cache->precision_string = MemoryContextStrdup(cache->mcxt, format_pattern + 1);
 	}
 
-	pattern = format_pattern[0];
+	pattern = cache->spec;
 	upper_pattern = toupper(pattern);
-	precision_string = TextDatumGetCString(DirectFunctionCall2(text_substr_no_len, PG_GETARG_DATUM(1), Int32GetDatum((int32)2)));
-
-	data_type = text_to_cstring(PG_GETARG_TEXT_P(3));
+	precision_string = cache->precision_string;
 	arg_type_oid = get_fn_expr_argtype(fcinfo->flinfo, 0);
 
 	switch (arg_type_oid)
@@ -211,7 +269,8 @@ format_numeric(PG_FUNCTION_ARGS)
 		numeric_val = PG_GETARG_NUMERIC(0);
 		break;
 	case FLOAT4OID:
-		set_config_option("extra_float_digits", "1", PGC_USERSET, PGC_S_SESSION, GUC_ACTION_LOCAL, true, 0, false);
+		if (extra_float_digits != 1)
+			set_config_option("extra_float_digits", "1", PGC_USERSET, PGC_S_SESSION, GUC_ACTION_LOCAL, true, 0, false);
 
 		if (upper_pattern == 'R')
 		{
@@ -274,7 +333,8 @@ format_numeric(PG_FUNCTION_ARGS)
 		}
 		break;
 	case FLOAT8OID:
-		set_config_option("extra_float_digits", "1", PGC_USERSET, PGC_S_SESSION, GUC_ACTION_LOCAL, true, 0, false);
+		if (extra_float_digits != 1)
+			set_config_option("extra_float_digits", "1", PGC_USERSET, PGC_S_SESSION, GUC_ACTION_LOCAL, true, 0, false);
 
 		if (upper_pattern == 'R')
 		{
@@ -332,8 +392,8 @@ format_numeric_handler(Datum value, Numeric numeric_val, StringInfo format_res,
 	switch (upper_pattern)
 	{
 	case 'C':
-		if (set_culture(valid_culture, "LC_MONETARY", culture) == 1)
-			format_currency(numeric_val, format_res, upper_pattern, precision_string, culture);
+		set_culture(valid_culture, "LC_MONETARY");
+		format_currency(numeric_val, format_res, upper_pattern, precision_string, culture);
 		break;
 	case 'D':
 		format_decimal(numeric_val, format_res, upper_pattern, precision_string, arg_type_oid);
@@ -367,33 +427,27 @@ format_numeric_handler(Datum value, Numeric numeric_val, StringInfo format_res,
 
 /*
  * Function for setting validated input locales for LC_TIME, LC_NUMERIC, LC_MONETARY
+ * Setting a locale GUC validates the locale with setlocale(), so leave it alone
+ * when it already has the value.
  */
-static int
-set_culture(char *valid_culture, const char *config_name, char *culture)
+static void
+set_culture(const char *valid_culture, const char *config_name)
 {
-	if (valid_culture != NULL && strlen(valid_culture) > 0)
-	{
-		if (pg_strcasecmp(config_name, "LC_MONETARY") != 0)
-		{
-			strncat(valid_culture, ".UTF-8", 7);
-		}
+	const char *current = GetConfigOption(config_name, false, false);
 
-		set_config_option(config_name, valid_culture,
-						  PGC_USERSET, PGC_S_SESSION,
-						  GUC_ACTION_LOCAL, true, 0, false);
-	}
-	else
-	{
-		return 0;
-	}
-	return 1;
+	if (current != NULL && strcmp(current, valid_culture) == 0)
+		return;
+
+	set_config_option(config_name, valid_culture,
+					  PGC_USERSET, PGC_S_SESSION,
+					  GUC_ACTION_LOCAL, true, 0, false);
 }
 
 /*
- * format the given input locale to supported locale format and set it accordingly
+ * Map the given input culture to a supported locale name, e.g. "en-us" to "en_US.UTF-8"
  */
 static char *
-format_validate_and_culture(char *culture, const char *config_name)
+format_validate_culture(const char *culture)
 {
 	int 	culture_len = 0;
 	char 	*token;
@@ -448,8 +502,9 @@ format_validate_and_culture(char *culture, const char *config_name)
 
 		locale_pos = find_locale((const char *)temp_res);
 
-		if (locale_pos >= 0 && set_culture(temp_res, config_name, culture) == 1)
+		if (locale_pos >= 0 && strlen(temp_res) > 0)
 		{
+			strncat(temp_res, ".UTF-8", 7);
 			return temp_res;
 		}
 
@@ -467,6 +522,80 @@ format_validate_and_culture(char *culture, const char *config_name)
 	}
 }
 
+static FormatCache *
+format_get_cache(FunctionCallInfo fcinfo)
+{
+	FormatCache *cache = (FormatCache *) fcinfo->flinfo->fn_extra;
+
+	if (cache == NULL)
+	{
+		cache = MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt, sizeof(FormatCache));
+		cache->mcxt = fcinfo->flinfo->fn_mcxt;
+		fcinfo->flinfo->fn_extra = cache;
+	}
+	return cache;
+}
+
+/*
+ * Validate the culture, unless it is the one of the previous call, and set
+ * config_name to it. Returns the locale name.
+ */
+static char *
+format_cache_culture(FormatCache *cache, const char *culture, const char *config_name)
+{
+	if (cache->culture == NULL || strcmp(cache->culture, culture) != 0)
+	{
+		char	   *valid_culture = format_validate_culture(culture);
+
+		/* standard datetime masks depend on the culture */
+		format_cache_set_pattern(cache, NULL, NULL);
+
+		if (cache->culture)
+		{
+			pfree(cache->culture);
+			pfree(cache->valid_culture);
+		}
+		cache->culture = MemoryContextStrdup(cache->mcxt, culture);
+		cache->valid_culture = MemoryContextStrdup(cache->mcxt, valid_culture);
+	}
+
+	set_culture(cache->valid_culture, config_name);
+	return cache->valid_culture;
+}
+
+static bool
+format_cache_has_pattern(FormatCache *cache, const char *pattern, const char *data_type)
+{
+	return cache->pattern != NULL &&
+		strcmp(cache->pattern, pattern) == 0 &&
+		strcmp(cache->data_type, data_type) == 0;
+}
+
+/*
+ * Make the cache describe pattern and data_type, with all derived fields
+ * cleared for the caller to fill in. NULL pattern empties it.
+ */
+static void
+format_cache_set_pattern(FormatCache *cache, const char *pattern, const char *data_type)
+{
+	if (cache->pattern)
+	{
+		pfree(cache->pattern);
+		pfree(cache->data_type);
+	}
+	if (cache->mask)
+		pfree(cache->mask);
+	if (cache->precision_string)
+		pfree(cache->precision_string);
+
+	cache->pattern = pattern ? MemoryContextStrdup(cache->mcxt, pattern) : NULL;
+	cache->data_type = pattern ? MemoryContextStrdup(cache->mcxt, data_type) : NULL;
+	cache->fmt_res = 0;
+	cache->mask = NULL;
+	cache->spec = '\0';
+	cache->precision_string = NULL;
+}
+
 /*
  * Compile and match a regular expression pattern to a const string
  */
@@ -486,6 +615,47 @@ match(const char *string, const char *pattern)
 	return !status;
 }
 
+/*
+ * Same as matching data_val against ^[0-9]{1,2}:[0-9]{1,2}:[0-9]{1,2}$ and
+ * ^[0-9]{1,2}:[0-9]{1,2}:[0-9]{1,2}.[0-9]{1,7}$, without compiling the
+ * regular expressions for every value.
+ */
+static void
+match_time_value(const char *data_val, int *time_res, int *milli_time_res)
+{
+	const char *sec = data_val;
+
+	*time_res = 0;
+	*milli_time_res = 0;
+
+	for (int field = 0; field < 2; field++)
+	{
+		int 	n = 0;
+
+		while (n < 2 && isdigit((unsigned char) sec[n]))
+			n++;
+		if (n == 0 || sec[n] != ':')
+			return;
+		sec += n + 1;
+	}
+
+	/* the seconds take one or two digits, "." is any character */
+	for (int n = 1; n <= 2 && isdigit((unsigned char) sec[n - 1]); n++)
+	{
+		int 	frac_len;
+
+		if (sec[n] == '\0')
+		{
+			*time_res = 1;
+			continue;
+		}
+
+		frac_len = strspn(sec + n + 1, "0123456789");
+		if (frac_len >= 1 && frac_len <= 7 && sec[n + 1 + frac_len] == '\0')
+			*milli_time_res = 1;
+	}
+}
+
 /*
  * Base function for getting the standard format mask for date and time data types
  * Returns  0 if the format is invalid
@@ -500,8 +670,6 @@ format_datetimeformats(StringInfo buf, const char *format_pattern, const char *c
 	char 		*pattern;
 	int 		milli_time_res;
 	int 		time_res;
-	const char 	*milli_time_re = "^[0-9]{1,2}:[0-9]{1,2}:[0-9]{1,2}.[0-9]{1,7}$";
-	const char 	*time_re = "^[0-9]{1,2}:[0-9]{1,2}:[0-9]{1,2}$";
 
 	if (pg_strcasecmp(format_pattern, "O") == 0)
 	{
@@ -510,8 +678,7 @@ format_datetimeformats(StringInfo buf, const char *format_pattern, const char *c
 
 	if (strcmp(data_type, "time") == 0)
 	{
-		milli_time_res = match(data_val, milli_time_re);
-		time_res = match(data_val, time_re);
+		match_time_value(data_val, &time_res, &milli_time_res);
 
 		switch (format_pattern[0])
 		{
@@ -14,13 +14,18 @@
 #include "miscadmin.h"
 #include "parser/parser.h"
 #include "utils/builtins.h"
+#include "utils/memutils.h"
 #include "utils/xml.h"
 
+/* Number of rows pulled from the query at a time */
+#define FORXML_FETCH_SIZE 1000
+
 static xmltype *stringinfo_to_xmltype(StringInfo buf);
+static char **for_xml_column_names(TupleDesc tupdesc, bool binary_base64);
 static void SPI_sql_row_to_xmlelement_raw(uint64 rownum, StringInfo result,
-						  const char *element_name, bool binary_base64);
+						  const char *element_name, char **colnames);
 static void SPI_sql_row_to_xmlelement_path(uint64 rownum, StringInfo result,
-						const char* element_name, bool binary_base64);
+						const char* element_name, char **colnames);
 static StringInfo tsql_query_to_xml_internal(const char *query, int mode,
 								const char *element_name, bool binary_base64,
 								const char *root_name);
@@ -63,13 +68,13 @@ tsql_query_to_xml_text(PG_FUNCTION_ARGS)
 }
 
 /*
- * Map an SQL row to an XML element, taking the row from the active
- * SPI cursor. RAW mode, default element name is "row" if not specified.
+ * Return the XML names of the query's columns, checked once per query
+ * rather than for every row.
  */
-static void
-SPI_sql_row_to_xmlelement_raw(uint64 rownum, StringInfo result,
-						const char* element_name, bool binary_base64)
+static char **
+for_xml_column_names(TupleDesc tupdesc, bool binary_base64)
 {
+	char	  **colnames = palloc(sizeof(char *) * tupdesc->natts);
 	int			i;
 
 	if (binary_base64)
@@ -81,9 +86,9 @@ SPI_sql_row_to_xmlelement_raw(uint64 rownum, StringInfo result,
 		 * For now report an ERROR if any attribute is binary data type since base64
 		 * encoding is not implemented yet.
 		 */
-		for (i = 1; i <= SPI_tuptable->tupdesc->natts; i++)
+		for (i = 1; i <= tupdesc->natts; i++)
 		{
-			char* typename = SPI_gettype(SPI_tuptable->tupdesc, i);
+			char* typename = SPI_gettype(tupdesc, i);
 			if (strcmp(typename, "binary") == 0 ||
 				strcmp(typename, "varbinary") == 0 ||
 				strcmp(typename, "image") == 0)
@@ -93,16 +98,30 @@ SPI_sql_row_to_xmlelement_raw(uint64 rownum, StringInfo result,
 		}
 	}
 
+	for (i = 1; i <= tupdesc->natts; i++)
+		colnames[i - 1] = map_sql_identifier_to_xml_name(SPI_fname(tupdesc, i),
+														 true, false);
+
+	return colnames;
+}
+
+/*
+ * Map an SQL row to an XML element, taking the row from the active
+ * SPI cursor. RAW mode, default element name is "row" if not specified.
+ */
+static void
+SPI_sql_row_to_xmlelement_raw(uint64 rownum, StringInfo result,
+						const char* element_name, char **colnames)
+{
+	int			i;
+
 	appendStringInfo(result, "<%s", element_name);
 
 	for (i = 1; i <= SPI_tuptable->tupdesc->natts; i++)
 	{
-		char	   *colname;
 		Datum		colval;
 		bool		isnull;
 
-		colname = map_sql_identifier_to_xml_name(SPI_fname(SPI_tuptable->tupdesc, i),
-												 true, false);
 		colval = SPI_getbinval(SPI_tuptable->vals[rownum],
 							   SPI_tuptable->tupdesc,
 							   i,
@@ -110,7 +129,7 @@ SPI_sql_row_to_xmlelement_raw(uint64 rownum, StringInfo result,
 		if (!isnull)
 		{
 			appendStringInfo(result, " %s=\"%s\"",
-							 colname,
+							 colnames[i - 1],
 							 map_sql_value_to_xml_value(colval,
 														SPI_gettypeid(SPI_tuptable->tupdesc, i), true));
 		}
@@ -125,43 +144,20 @@ SPI_sql_row_to_xmlelement_raw(uint64 rownum, StringInfo result,
  */
 static void
 SPI_sql_row_to_xmlelement_path(uint64 rownum, StringInfo result,
-						const char* element_name, bool binary_base64)
+						const char* element_name, char **colnames)
 {
 	int i;
 	bool allnull = true;
 
-	if (binary_base64)
-	{
-		/*
-		 * TODO: encode binary/varbinary/image data values using base64 encoding.
-		 * Refer to how BYTEA type is handed in map_sql_value_to_xml_value().
-		 * Also, pg_b64_encode function might be useful.
-		 * For now report an ERROR if any attribute is binary data type since base64
-		 * encoding is not implemented yet.
-		 */
-		for (i = 1; i <= SPI_tuptable->tupdesc->natts; i++)
-		{
-			char* typename = SPI_gettype(SPI_tuptable->tupdesc, i);
-			if (strcmp(typename, "binary") == 0 ||
-				strcmp(typename, "varbinary") == 0 ||
-				strcmp(typename, "image") == 0)
-				ereport(ERROR,
-						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						 errmsg("option binary base64 is not supported")));
-		}
-	}
-
 	if (element_name[0] != '\0') // if "''" is the input path, ignore it per SQL Server behavior
 		appendStringInfo(result, "<%s>", element_name);
 
 	for (i = 1; i <= SPI_tuptable->tupdesc->natts; i++)
 	{
-		char	   *colname;
+		char	   *colname = colnames[i - 1];
 		Datum		colval;
 		bool		isnull;
 
-		colname = map_sql_identifier_to_xml_name(SPI_fname(SPI_tuptable->tupdesc, i),
-												 true, false);
 		colval = SPI_getbinval(SPI_tuptable->vals[rownum],
 							   SPI_tuptable->tupdesc,
 							   i,
@@ -190,6 +186,10 @@ SPI_sql_row_to_xmlelement_path(uint64 rownum, StringInfo result,
 		appendStringInfo(result, "</%s>", element_name);
 }
 
+/*
+ * Rows are pulled through a cursor in batches and each batch is freed once
+ * it has been appended, so only the XML text grows with the result size.
+ */
 static StringInfo
 tsql_query_to_xml_internal(const char *query, int mode,
 												const char *element_name, bool binary_base64,
@@ -197,6 +197,11 @@ tsql_query_to_xml_internal(const char *query, int mode,
 {
 	StringInfo	result;
 	uint64		i;
+	SPIPlanPtr	plan;
+	Portal		portal;
+	char	  **colnames = NULL;
+	MemoryContext rowcxt;
+	MemoryContext oldcxt;
 
 	set_config_option("babelfishpg_tsql.sql_dialect", "tsql",
 					  (superuser() ? PGC_SUSET : PGC_USERSET),
@@ -204,10 +209,15 @@ tsql_query_to_xml_internal(const char *query, int mode,
 	result = makeStringInfo();
 
 	SPI_connect();
-	if (SPI_execute(query, true, 0) != SPI_OK_SELECT)
+	plan = SPI_prepare(query, 0, NULL);
+	if (plan == NULL || !SPI_is_cursor_plan(plan))
 		ereport(ERROR,
 				(errcode(ERRCODE_DATA_EXCEPTION),
 				 errmsg("invalid query")));
+	portal = SPI_cursor_open(NULL, plan, NULL, NULL, true);
+	rowcxt = AllocSetContextCreate(CurrentMemoryContext,
+								   "FOR XML row context",
+								   ALLOCSET_DEFAULT_SIZES);
 
 	if (root_name != NULL && strlen(root_name) > 0)
 		appendStringInfo(result, "<%s>", root_name);
@@ -220,8 +230,28 @@ tsql_query_to_xml_internal(const char *query, int mode,
 	switch (mode)
 	{
 		case TSQL_FORXML_RAW: /* FOR XML RAW */
-			for (i = 0; i < SPI_processed; i++)
-				SPI_sql_row_to_xmlelement_raw(i, result, element_name, binary_base64);
+		case TSQL_FORXML_PATH: /* FOR XML PATH */
+			for (;;)
+			{
+				SPI_cursor_fetch(portal, true, FORXML_FETCH_SIZE);
+				if (SPI_processed == 0)
+					break;
+
+				if (colnames == NULL)
+					colnames = for_xml_column_names(SPI_tuptable->tupdesc, binary_base64);
+
+				for (i = 0; i < SPI_processed; i++)
+				{
+					oldcxt = MemoryContextSwitchTo(rowcxt);
+					if (mode == TSQL_FORXML_RAW)
+						SPI_sql_row_to_xmlelement_raw(i, result, element_name, colnames);
+					else
+						SPI_sql_row_to_xmlelement_path(i, result, element_name, colnames);
+					MemoryContextSwitchTo(oldcxt);
+					MemoryContextReset(rowcxt);
+				}
+				SPI_freetuptable(SPI_tuptable);
+			}
 			break;
 		case TSQL_FORXML_AUTO:
 			/*
@@ -233,10 +263,6 @@ tsql_query_to_xml_internal(const char *query, int mode,
 							(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 							 errmsg("AUTO mode is not supported")));
 			break;
-		case TSQL_FORXML_PATH: /* FOR XML PATH */
-			for (i = 0; i < SPI_processed; i++)
-				SPI_sql_row_to_xmlelement_path(i, result, element_name, binary_base64);
-			break;
 		case TSQL_FORXML_EXPLICIT:
 			/*
 			 * TODO: EXPLICIT mode is quite different from the other mode and is
@@ -255,6 +281,7 @@ tsql_query_to_xml_internal(const char *query, int mode,
 
 	if (root_name != NULL && strlen(root_name) > 0)
 		appendStringInfo(result, "</%s>", root_name);
+	SPI_cursor_close(portal);
 	SPI_finish();
 
 	return result;
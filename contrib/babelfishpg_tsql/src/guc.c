@@ -21,6 +21,11 @@ bool enable_metadata_inconsistency_check = true;
 bool pltsql_dump_antlr_query_graph = false;
 bool pltsql_enable_antlr_detailed_log = false;
 bool pltsql_allow_antlr_to_unsupported_grammar_for_testing = false;
+bool pltsql_enable_sll_parse_mode = true;
+bool pltsql_enable_antlr_warmup = true;
+char* pltsql_antlr_warmup_corpus = NULL;
+int pltsql_table_variable_pool_size = 32;
+int pltsql_applock_table_size = 1024;
 char* pltsql_default_locale = NULL;
 char* pltsql_server_collation_name = NULL;
 bool  pltsql_ansi_defaults = true;
@@ -611,6 +616,51 @@ define_custom_variables(void)
 				 GUC_NO_SHOW_ALL,
 				 NULL, NULL, NULL);
 
+	DefineCustomBoolVariable("babelfishpg_tsql.enable_sll_parse_mode",
+				 gettext_noop("Parses T-SQL with SLL prediction first and falls back to full LL prediction only on failure"),
+				 NULL,
+				 &pltsql_enable_sll_parse_mode,
+				 true,
+				 PGC_USERSET,
+				 GUC_NOT_IN_SAMPLE,
+				 NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("babelfishpg_tsql.enable_antlr_warmup",
+				 gettext_noop("Warms up the ANTLR parser caches before the first parse of each session"),
+				 NULL,
+				 &pltsql_enable_antlr_warmup,
+				 true,
+				 PGC_SIGHUP,
+				 GUC_NOT_IN_SAMPLE,
+				 NULL, NULL, NULL);
+
+	DefineCustomStringVariable("babelfishpg_tsql.antlr_warmup_corpus",
+				   gettext_noop("File with additional T-SQL batches, separated by GO, used to warm up the ANTLR parser caches."),
+				   NULL,
+				   &pltsql_antlr_warmup_corpus,
+				   "",
+				   PGC_SIGHUP,
+				   GUC_NOT_IN_SAMPLE | GUC_SUPERUSER_ONLY,
+				   NULL, NULL, NULL);
+
+	DefineCustomIntVariable("babelfishpg_tsql.table_variable_pool_size",
+				 gettext_noop("Sets the maximum number of table variable tables kept for reuse by a session."),
+				 NULL,
+				 &pltsql_table_variable_pool_size,
+				 32, 0, 10000,
+				 PGC_USERSET,
+				 GUC_NOT_IN_SAMPLE,
+				 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("babelfishpg_tsql.applock_table_size",
+				 gettext_noop("Sets the maximum number of application lock resources held at the same time."),
+				 NULL,
+				 &pltsql_applock_table_size,
+				 1024, 32, 1048576,
+				 PGC_SIGHUP,
+				 GUC_NOT_IN_SAMPLE,
+				 NULL, NULL, NULL);
+
 	DefineCustomStringVariable("babelfishpg_tsql.server_collation_name",
 				   gettext_noop("Name of the default server collation."),
 				   NULL,
@@ -1110,6 +1160,33 @@ define_custom_variables(void)
 				NULL, NULL, NULL);
 
 
+	DefineCustomBoolVariable("babelfishpg_tsql.enable_batch_cache",
+				 gettext_noop("Keeps compiled SQL batches for reuse when the same batch text is sent again"),
+				 NULL,
+				 &pltsql_enable_batch_cache,
+				 true,
+				 PGC_USERSET,
+				 GUC_NOT_IN_SAMPLE,
+				 NULL, NULL, NULL);
+
+	DefineCustomIntVariable("babelfishpg_tsql.batch_cache_max_entries",
+				gettext_noop("Sets the maximum number of compiled SQL batches kept per session"),
+				NULL,
+				&pltsql_batch_cache_max_entries,
+				DEFAULT_BATCH_CACHE_MAX_ENTRIES, 0, INT_MAX,
+				PGC_USERSET,
+				GUC_NOT_IN_SAMPLE,
+				NULL, NULL, NULL);
+
+	DefineCustomIntVariable("babelfishpg_tsql.batch_cache_max_kilobytes",
+				gettext_noop("Sets the maximum memory used by compiled SQL batches kept per session"),
+				NULL,
+				&pltsql_batch_cache_max_kilobytes,
+				DEFAULT_BATCH_CACHE_MAX_KILOBYTES, 0, INT_MAX / 1024,
+				PGC_USERSET,
+				GUC_NOT_IN_SAMPLE | GUC_UNIT_KB,
+				NULL, NULL, NULL);
+
 	DefineCustomBoolVariable("babelfishpg_tsql.enable_metadata_inconsistency_check",
 				 gettext_noop("Enables babelfish_inconsistent_metadata"),
 				 NULL,
@@ -1491,6 +1568,60 @@ define_escape_hatch_variables(void)
 							  NULL, NULL, NULL);
 }
 
+/*
+ * Escape hatches are consulted while a batch is parsed, so the compiled
+ * batch cache keys its entries on their values.
+ */
+static int *const escape_hatch_variables[] = {
+	&escape_hatch_storage_options,
+	&escape_hatch_storage_on_partition,
+	&escape_hatch_database_misc_options,
+	&escape_hatch_language_non_english,
+	&escape_hatch_login_hashed_password,
+	&escape_hatch_login_old_password,
+	&escape_hatch_login_password_must_change,
+	&escape_hatch_login_password_unlock,
+	&escape_hatch_login_misc_options,
+	&escape_hatch_compatibility_level,
+	&escape_hatch_fulltext,
+	&escape_hatch_schemabinding_function,
+	&escape_hatch_schemabinding_trigger,
+	&escape_hatch_schemabinding_procedure,
+	&escape_hatch_schemabinding_view,
+	&escape_hatch_index_clustering,
+	&escape_hatch_index_columnstore,
+	&escape_hatch_for_replication,
+	&escape_hatch_rowguidcol_column,
+	&escape_hatch_nocheck_add_constraint,
+	&escape_hatch_nocheck_existing_constraint,
+	&escape_hatch_constraint_name_for_default,
+	&escape_hatch_table_hints,
+	&escape_hatch_query_hints,
+	&escape_hatch_join_hints,
+	&escape_hatch_session_settings,
+	&escape_hatch_unique_constraint,
+	&escape_hatch_ignore_dup_key,
+	&escape_hatch_rowversion,
+	&escape_hatch_showplan_all,
+	&escape_hatch_checkpoint,
+};
+
+uint64
+get_escape_hatch_state(void)
+{
+	uint64		state = 0;
+	int			i;
+
+	StaticAssertStmt(lengthof(escape_hatch_variables) <= 64,
+					 "escape hatch state does not fit in uint64");
+
+	for (i = 0; i < lengthof(escape_hatch_variables); i++)
+		if (*escape_hatch_variables[i] == EH_IGNORE)
+			state |= UINT64CONST(1) << i;
+
+	return state;
+}
+
 void
 pltsql_validate_set_config_function(char *name, char *value)
 {
@@ -6,6 +6,10 @@ typedef enum EscapeHatchOption { EH_STRICT, EH_IGNORE, EH_NULL } EscapeHatchOpti
 
 extern bool pltsql_fmtonly;
 extern bool pltsql_enable_create_alter_view_from_pg;
+extern bool pltsql_enable_antlr_warmup;
+extern char *pltsql_antlr_warmup_corpus;
+extern int pltsql_table_variable_pool_size;
+extern int pltsql_applock_table_size;
 
 extern void define_custom_variables(void);
 extern void pltsql_validate_set_config_function(char *name, char *value);
@@ -14,6 +18,7 @@ extern void pltsql_validate_set_config_function(char *name, char *value);
  * 				Getters
  ************************************/
 extern MigrationMode get_migration_mode(void);
+extern uint64 get_escape_hatch_state(void);
 
 extern bool metadata_inconsistency_check_enabled(void); 
 
@@ -10,6 +10,10 @@
 #include "utils/acl.h"
 #include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
 
 #include "catalog.h"
 #include "guc.h"
@@ -36,6 +40,35 @@ static bool rewrite_relation_walker(Node *node, void *context);
 /* helper functions */
 static void truncate_tsql_identifier(char *ident);
 
+/*
+ * Backend-local cache of get_physical_schema_name() results. A result only
+ * depends on the migration mode, the names and, in single-db mode, on the
+ * database existing, so any sysdatabases change empties the cache.
+ */
+#define PHYSICAL_SCHEMA_CACHE_MAX_ENTRIES 1024
+
+typedef struct PhysicalSchemaCacheKey
+{
+	int			migration_mode;
+	char		db_name[MAX_BBF_NAMEDATALEND];
+	char		schema_name[MAX_BBF_NAMEDATALEND];
+} PhysicalSchemaCacheKey;
+
+typedef struct PhysicalSchemaCacheEntry
+{
+	PhysicalSchemaCacheKey key;		/* hash key */
+	char		physical_name[MAX_BBF_NAMEDATALEND];
+} PhysicalSchemaCacheEntry;
+
+static HTAB *physical_schema_cache = NULL;
+static MemoryContext physical_schema_cache_cxt = NULL;
+static bool physical_schema_cache_valid = false;
+
+static bool physical_schema_cache_make_key(PhysicalSchemaCacheKey *key,
+										   const char *db_name, const char *schema_name);
+static const char *physical_schema_cache_lookup(PhysicalSchemaCacheKey *key);
+static void physical_schema_cache_store(PhysicalSchemaCacheKey *key, const char *physical_name);
+
 
 /*************************************************************
  * 					Toggle for Rewriting
@@ -938,6 +971,9 @@ get_physical_schema_name(char *db_name, const char *schema_name)
 	char *name;
 	char *result;
 	int		len;
+	PhysicalSchemaCacheKey key;
+	bool	cacheable;
+	const char *cached;
 
 	if (!schema_name)
 		return NULL;
@@ -953,6 +989,13 @@ get_physical_schema_name(char *db_name, const char *schema_name)
 	if (is_shared_schema(name))
 		return name;
 
+	cacheable = physical_schema_cache_make_key(&key, db_name, schema_name);
+	if (cacheable && (cached = physical_schema_cache_lookup(&key)) != NULL)
+	{
+		strlcpy(name, cached, MAX_BBF_NAMEDATALEND);
+		return name;
+	}
+
 	/* Parser guarantees identifier will alsways be truncated to 64B.
 	 * Schema name that comes from other source (e.g scheam_id function)
 	 * needs one more truncate function call
@@ -980,6 +1023,8 @@ get_physical_schema_name(char *db_name, const char *schema_name)
 			 * under SINGLE_DB this is only possible 
 			 * when target db is the customer db.
 			 * in such case we only return the schema_name name */
+			if (cacheable)
+				physical_schema_cache_store(&key, name);
 			return name;
 		}
 	}
@@ -991,9 +1036,91 @@ get_physical_schema_name(char *db_name, const char *schema_name)
 
 	truncate_tsql_identifier(result);
 
+	if (cacheable)
+		physical_schema_cache_store(&key, result);
+
 	return result;
 }
 
+static void
+physical_schema_cache_syscache_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	physical_schema_cache_valid = false;
+}
+
+static void
+physical_schema_cache_relcache_callback(Datum arg, Oid relid)
+{
+	if (!OidIsValid(relid) || relid == sysdatabases_oid)
+		physical_schema_cache_valid = false;
+}
+
+static bool
+physical_schema_cache_make_key(PhysicalSchemaCacheKey *key,
+							   const char *db_name, const char *schema_name)
+{
+	if (strlen(db_name) >= MAX_BBF_NAMEDATALEND ||
+		strlen(schema_name) >= MAX_BBF_NAMEDATALEND)
+		return false;
+
+	MemSet(key, 0, sizeof(*key));
+	key->migration_mode = get_migration_mode();
+	strlcpy(key->db_name, db_name, MAX_BBF_NAMEDATALEND);
+	strlcpy(key->schema_name, schema_name, MAX_BBF_NAMEDATALEND);
+	return true;
+}
+
+static const char *
+physical_schema_cache_lookup(PhysicalSchemaCacheKey *key)
+{
+	PhysicalSchemaCacheEntry *entry;
+
+	if (physical_schema_cache == NULL || !physical_schema_cache_valid)
+		return NULL;
+
+	entry = (PhysicalSchemaCacheEntry *) hash_search(physical_schema_cache, key, HASH_FIND, NULL);
+	return entry ? entry->physical_name : NULL;
+}
+
+/*
+ * Remember a result. This runs after the result was computed, so the cache is
+ * (re)built here rather than in the lookup, where a catalog access done
+ * in between could invalidate it.
+ */
+static void
+physical_schema_cache_store(PhysicalSchemaCacheKey *key, const char *physical_name)
+{
+	PhysicalSchemaCacheEntry *entry;
+
+	if (physical_schema_cache == NULL || !physical_schema_cache_valid ||
+		hash_get_num_entries(physical_schema_cache) >= PHYSICAL_SCHEMA_CACHE_MAX_ENTRIES)
+	{
+		HASHCTL		ctl;
+
+		if (physical_schema_cache_cxt == NULL)
+		{
+			physical_schema_cache_cxt = AllocSetContextCreate(CacheMemoryContext,
+															  "Babelfish physical schema name cache",
+															  ALLOCSET_DEFAULT_SIZES);
+			CacheRegisterSyscacheCallback(SYSDATABASEOID, physical_schema_cache_syscache_callback, (Datum) 0);
+			CacheRegisterRelcacheCallback(physical_schema_cache_relcache_callback, (Datum) 0);
+		}
+		else
+			MemoryContextReset(physical_schema_cache_cxt);
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(PhysicalSchemaCacheKey);
+		ctl.entrysize = sizeof(PhysicalSchemaCacheEntry);
+		ctl.hcxt = physical_schema_cache_cxt;
+		physical_schema_cache = hash_create("Babelfish physical schema name cache", 64, &ctl,
+											HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+		physical_schema_cache_valid = true;
+	}
+
+	entry = (PhysicalSchemaCacheEntry *) hash_search(physical_schema_cache, key, HASH_ENTER, NULL);
+	strlcpy(entry->physical_name, physical_name, MAX_BBF_NAMEDATALEND);
+}
+
 /*
  * db_name is the logical database name to rewrite to
  * user_name is the logical user name
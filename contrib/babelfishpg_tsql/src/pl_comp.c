@@ -20,15 +20,20 @@
 #include <unistd.h>	/* FIXME: for debugging only - feel free to remove */
 
 #include "access/htup_details.h"
+#include "access/transam.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_namespace.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
+#include "common/hashfn.h"
 #include "funcapi.h"
+#include "lib/ilist.h"
 #include "nodes/makefuncs.h"
 #include "parser/parse_relation.h"
 #include "parser/parse_type.h"
 #include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/regproc.h"
@@ -39,9 +44,12 @@
 #include "pltsql.h"
 #include "pltsql-2.h"
 #include "analyzer.h"
+#include "catalog.h"
 #include "codegen.h"
+#include "guc.h"
 #include "iterative_exec.h"
 #include "multidb.h"
+#include "session.h"
 
 /* ----------
  * Our own local and global variables
@@ -100,6 +108,55 @@ static const ExceptionLabelMap exception_label_map[] = {
 
 static int cur_handle_id = 1;
 
+/* ----------
+ * Ad-hoc batch cache
+ *
+ * Compiled SQL batches are kept in a per-backend LRU so that a batch sent
+ * again with the same text and the same compile-relevant session state does
+ * not need to be parsed and compiled again.  Statements run through
+ * sp_executesql are kept too, keyed additionally by their parameter
+ * signature; their SPI plans stay with the compiled function, so the
+ * plancache gets to pick between custom and generic plans across calls.
+ * See pltsql_batch_cache_lookup().
+ * ----------
+ */
+typedef struct pltsql_batch_cache_key
+{
+	uint32		text_hash;		/* hash of the batch source text */
+	uint32		state_hash;		/* hash of the session state string */
+	uint32		params_hash;	/* hash of the parameter signature */
+} pltsql_batch_cache_key;
+
+typedef struct pltsql_batch_cache_ent
+{
+	pltsql_batch_cache_key key;
+	char	   *source_text;	/* full text, to resolve hash collisions */
+	char	   *state;			/* session state the batch was compiled in */
+	char	   *params;			/* parameter signature, NULL for a plain batch */
+	PLtsql_function *function;
+	Size		mem_size;		/* memory held by function->fn_cxt */
+	uint64		generation;		/* batch_cache_generation at insert time */
+	dlist_node	lru_node;		/* most recently used entries first */
+} pltsql_batch_cache_ent;
+
+#define BATCH_CACHE_INIT_SIZE	64
+
+bool		pltsql_enable_batch_cache = true;
+int			pltsql_batch_cache_max_entries = DEFAULT_BATCH_CACHE_MAX_ENTRIES;
+int			pltsql_batch_cache_max_kilobytes = DEFAULT_BATCH_CACHE_MAX_KILOBYTES;
+
+static HTAB *batch_cache_htab = NULL;
+static MemoryContext batch_cache_cxt = NULL;
+static dlist_head batch_cache_lru = DLIST_STATIC_INIT(batch_cache_lru);
+static int	batch_cache_nentries = 0;
+static Size batch_cache_mem = 0;
+static uint64 batch_cache_generation = 1;
+static uint64 batch_cache_swept_generation = 1;
+static int	batch_cache_nparameterized = 0;
+static uint64 batch_cache_hits = 0;
+static uint64 batch_cache_misses = 0;
+static uint64 batch_cache_evictions = 0;
+
 /* ----------
  * static prototypes
  * ----------
@@ -3199,4 +3256,468 @@ void reset_cached_batch()
 	while (cur_handle_id > 0)
 		delete_cached_batch(cur_handle_id--);
 	cur_handle_id = 1;
+
+	pltsql_batch_cache_reset();
+}
+
+/*
+ * Session settings which change how a batch is parsed or compiled.  They
+ * are folded into the cache key together with the batch text.
+ */
+extern bool pltsql_quoted_identifier;
+extern bool pltsql_ansi_nulls;
+extern bool pltsql_ansi_padding;
+extern bool pltsql_ansi_warnings;
+extern bool pltsql_arithabort;
+extern bool pltsql_arithignore;
+extern bool pltsql_concat_null_yields_null;
+extern bool pltsql_numeric_roundabort;
+
+static void batch_cache_init(void);
+static void batch_cache_inval_callback(Datum arg, int cacheid, uint32 hashvalue);
+static void batch_cache_relcache_callback(Datum arg, Oid relid);
+static char *batch_cache_session_state(void);
+static char *batch_cache_param_signature(InlineCodeBlockArgs *args);
+static void batch_cache_make_key(pltsql_batch_cache_key *key, const char *source_text,
+								 const char *state, const char *params);
+static bool batch_cache_is_cacheable(InlineCodeBlock *codeblock, InlineCodeBlockArgs *args);
+static bool batch_uses_user_types(PLtsql_function *func);
+static void batch_cache_remove_entry(pltsql_batch_cache_ent *entry);
+static void batch_cache_sweep(bool all);
+static void batch_cache_enforce_limits(void);
+
+static void
+batch_cache_init(void)
+{
+	HASHCTL		ctl;
+
+	Assert(batch_cache_htab == NULL);
+
+	batch_cache_cxt = AllocSetContextCreate(TopMemoryContext,
+											"PL/tsql batch cache",
+											ALLOCSET_DEFAULT_SIZES);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(pltsql_batch_cache_key);
+	ctl.entrysize = sizeof(pltsql_batch_cache_ent);
+	ctl.hcxt = batch_cache_cxt;
+	batch_cache_htab = hash_create("PLtsql batch cache",
+								   BATCH_CACHE_INIT_SIZE,
+								   &ctl,
+								   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	/*
+	 * SPI plans held by a cached batch are revalidated by the plancache, but
+	 * the compiled tree itself embeds namespace and procedure lookups done at
+	 * compile time.  Throw it away when any of those catalogs change.
+	 */
+	CacheRegisterSyscacheCallback(NAMESPACEOID, batch_cache_inval_callback, (Datum) 0);
+	CacheRegisterSyscacheCallback(PROCOID, batch_cache_inval_callback, (Datum) 0);
+	CacheRegisterRelcacheCallback(batch_cache_relcache_callback, (Datum) 0);
+}
+
+/*
+ * Invalidation callbacks may run at any point where catalog access happens,
+ * including in the middle of executing a cached batch, so they only bump
+ * the generation counter.  Stale entries are removed by batch_cache_sweep().
+ */
+static void
+batch_cache_inval_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	batch_cache_generation++;
+}
+
+static void
+batch_cache_relcache_callback(Datum arg, Oid relid)
+{
+	/* Only babelfish catalogs affect name resolution done at compile time */
+	if (!OidIsValid(relid) ||
+		relid == sysdatabases_oid ||
+		relid == namespace_ext_oid)
+		batch_cache_generation++;
+}
+
+static char *
+batch_cache_session_state(void)
+{
+	return psprintf("%d|%u|%s|%d%d%d%d%d%d%d%d|%d|" UINT64_FORMAT,
+					get_cur_db_id(),
+					GetUserId(),
+					namespace_search_path ? namespace_search_path : "",
+					pltsql_quoted_identifier,
+					pltsql_ansi_nulls,
+					pltsql_ansi_padding,
+					pltsql_ansi_warnings,
+					pltsql_arithabort,
+					pltsql_arithignore,
+					pltsql_concat_null_yields_null,
+					pltsql_numeric_roundabort,
+					pltsql_variable_conflict,
+					get_escape_hatch_state());
+}
+
+/*
+ * Parameter types, modes and names are all that compilation takes from the
+ * sp_executesql parameter definition; typmods are only applied to the
+ * values, so statements differing only in e.g. string lengths share an
+ * entry.
+ */
+static char *
+batch_cache_param_signature(InlineCodeBlockArgs *args)
+{
+	StringInfoData buf;
+	int			i;
+
+	if (args == NULL)
+		return NULL;
+
+	initStringInfo(&buf);
+	for (i = 0; i < args->numargs; i++)
+		appendStringInfo(&buf, "%u %c %s,",
+						 args->argtypes[i],
+						 args->argmodes[i],
+						 (args->argnames && args->argnames[i]) ? args->argnames[i] : "");
+	return buf.data;
+}
+
+static void
+batch_cache_make_key(pltsql_batch_cache_key *key, const char *source_text,
+					 const char *state, const char *params)
+{
+	key->text_hash = hash_bytes((const unsigned char *) source_text,
+								strlen(source_text));
+	key->state_hash = hash_bytes((const unsigned char *) state, strlen(state));
+	key->params_hash = params ? hash_bytes((const unsigned char *) params,
+										   strlen(params)) : 0;
+}
+
+static bool
+batch_cache_is_cacheable(InlineCodeBlock *codeblock, InlineCodeBlockArgs *args)
+{
+	if (!pltsql_enable_batch_cache ||
+		pltsql_batch_cache_max_entries <= 0 ||
+		pltsql_batch_cache_max_kilobytes <= 0)
+		return false;
+
+	/*
+	 * Arguments without any option come from sp_executesql.  Prepared
+	 * batches are handled by their own handle based cache.  INSERT ...
+	 * EXECUTE blocks are compiled against a specific target relation and
+	 * are not worth keeping either.
+	 */
+	if ((args != NULL && args->options != 0) ||
+		codeblock->relation || codeblock->dest)
+		return false;
+
+	return true;
+}
+
+/*
+ * Variables of user-defined types (including table types) capture the type
+ * OID at compile time.  Such types can be dropped and recreated under the
+ * same name, so we do not keep batches that use them.
+ */
+static bool
+batch_uses_user_types(PLtsql_function *func)
+{
+	int			i;
+
+	for (i = 0; i < func->ndatums; i++)
+	{
+		PLtsql_datum *datum = func->datums[i];
+		Oid			typoid = InvalidOid;
+		HeapTuple	tuple;
+		Oid			typnamespace;
+
+		switch (datum->dtype)
+		{
+			case PLTSQL_DTYPE_VAR:
+				typoid = ((PLtsql_var *) datum)->datatype->typoid;
+				break;
+			case PLTSQL_DTYPE_TBL:
+				typoid = ((PLtsql_tbl *) datum)->tbltypeid;
+				break;
+			case PLTSQL_DTYPE_REC:
+				typoid = ((PLtsql_rec *) datum)->rectypeid;
+				break;
+			default:
+				break;
+		}
+
+		if (!OidIsValid(typoid) || typoid == RECORDOID || typoid < FirstNormalObjectId)
+			continue;
+
+		tuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typoid));
+		if (!HeapTupleIsValid(tuple))
+			return true;
+		typnamespace = ((Form_pg_type) GETSTRUCT(tuple))->typnamespace;
+		ReleaseSysCache(tuple);
+
+		if (typnamespace != sys_schema_oid && typnamespace != PG_CATALOG_NAMESPACE)
+			return true;
+	}
+
+	return false;
+}
+
+static void
+batch_cache_remove_entry(pltsql_batch_cache_ent *entry)
+{
+	PLtsql_function *func = entry->function;
+
+	Assert(func->use_count == 0);
+
+	dlist_delete(&entry->lru_node);
+	batch_cache_nentries--;
+	batch_cache_mem -= entry->mem_size;
+
+	pfree(entry->source_text);
+	pfree(entry->state);
+	if (entry->params)
+	{
+		pfree(entry->params);
+		batch_cache_nparameterized--;
+	}
+	hash_search(batch_cache_htab, (void *) &entry->key, HASH_REMOVE, NULL);
+
+	pltsql_free_function_memory(func);
+}
+
+/*
+ * Remove stale entries, or every entry if "all" is set.  Entries that are
+ * currently executing are left alone; they will be picked up next time.
+ */
+static void
+batch_cache_sweep(bool all)
+{
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &batch_cache_lru)
+	{
+		pltsql_batch_cache_ent *entry = dlist_container(pltsql_batch_cache_ent,
+														lru_node, iter.cur);
+
+		if (entry->function->use_count > 0)
+			continue;
+		if (all || entry->generation != batch_cache_generation)
+		{
+			if (!all)
+				batch_cache_evictions++;
+			batch_cache_remove_entry(entry);
+		}
+	}
+	batch_cache_swept_generation = batch_cache_generation;
+}
+
+static void
+batch_cache_enforce_limits(void)
+{
+	Size		max_mem = (Size) pltsql_batch_cache_max_kilobytes * 1024;
+	dlist_mutable_iter iter;
+
+	dlist_reverse_foreach_modify(iter, &batch_cache_lru)
+	{
+		pltsql_batch_cache_ent *entry;
+
+		if (batch_cache_nentries <= pltsql_batch_cache_max_entries &&
+			batch_cache_mem <= max_mem)
+			break;
+
+		entry = dlist_container(pltsql_batch_cache_ent, lru_node, iter.cur);
+		if (entry->function->use_count > 0)
+			continue;
+		batch_cache_evictions++;
+		batch_cache_remove_entry(entry);
+	}
+}
+
+/*
+ * pltsql_batch_cache_lookup
+ *
+ * Return a previously compiled function for this batch, or NULL if there is
+ * none that can be reused in the current session state.
+ */
+PLtsql_function *
+pltsql_batch_cache_lookup(InlineCodeBlock *codeblock, InlineCodeBlockArgs *args)
+{
+	pltsql_batch_cache_key key;
+	pltsql_batch_cache_ent *entry;
+	char	   *state;
+	char	   *params;
+	bool		match;
+
+	if (!batch_cache_is_cacheable(codeblock, args))
+		return NULL;
+
+	if (batch_cache_htab == NULL)
+	{
+		batch_cache_misses++;
+		return NULL;
+	}
+
+	if (batch_cache_swept_generation != batch_cache_generation)
+		batch_cache_sweep(false);
+
+	state = batch_cache_session_state();
+	params = batch_cache_param_signature(args);
+	batch_cache_make_key(&key, codeblock->source_text, state, params);
+
+	entry = (pltsql_batch_cache_ent *) hash_search(batch_cache_htab,
+												   (void *) &key,
+												   HASH_FIND,
+												   NULL);
+	match = (entry != NULL &&
+			 strcmp(entry->source_text, codeblock->source_text) == 0 &&
+			 strcmp(entry->state, state) == 0 &&
+			 (entry->params == NULL ? params == NULL :
+			  params != NULL && strcmp(entry->params, params) == 0));
+	pfree(state);
+	if (params)
+		pfree(params);
+
+	/* The same batch can be running already, e.g. through EXEC(...) */
+	if (!match || entry->function->use_count > 0)
+	{
+		batch_cache_misses++;
+		return NULL;
+	}
+
+	/* Invalidated while it was running, so the sweep could not remove it */
+	if (entry->generation != batch_cache_generation)
+	{
+		batch_cache_evictions++;
+		batch_cache_misses++;
+		batch_cache_remove_entry(entry);
+		return NULL;
+	}
+
+	batch_cache_hits++;
+	dlist_move_head(&batch_cache_lru, &entry->lru_node);
+	return entry->function;
+}
+
+/*
+ * pltsql_batch_cache_insert
+ *
+ * Take ownership of a freshly compiled batch.  Must be called before the
+ * batch is executed, so that the session state recorded in the key is the
+ * one the batch was compiled in.  Returns true if the function has been
+ * cached, in which case the caller must not free it.
+ */
+bool
+pltsql_batch_cache_insert(InlineCodeBlock *codeblock, InlineCodeBlockArgs *args,
+						  PLtsql_function *func)
+{
+	pltsql_batch_cache_key key;
+	pltsql_batch_cache_ent *entry;
+	char	   *state;
+	char	   *params;
+	Size		mem_size;
+	bool		found;
+	MemoryContext oldcxt;
+
+	if (!batch_cache_is_cacheable(codeblock, args))
+		return false;
+
+	mem_size = MemoryContextMemAllocated(func->fn_cxt, true);
+	if (mem_size > (Size) pltsql_batch_cache_max_kilobytes * 1024)
+		return false;
+
+	if (batch_uses_user_types(func))
+		return false;
+
+	if (batch_cache_htab == NULL)
+		batch_cache_init();
+
+	state = batch_cache_session_state();
+	params = batch_cache_param_signature(args);
+	batch_cache_make_key(&key, codeblock->source_text, state, params);
+
+	entry = (pltsql_batch_cache_ent *) hash_search(batch_cache_htab,
+												   (void *) &key,
+												   HASH_FIND,
+												   NULL);
+	if (entry)
+	{
+		/* Either a hash collision or a concurrent copy is still running */
+		if (entry->function->use_count > 0)
+		{
+			pfree(state);
+			if (params)
+				pfree(params);
+			return false;
+		}
+		batch_cache_remove_entry(entry);
+	}
+
+	entry = (pltsql_batch_cache_ent *) hash_search(batch_cache_htab,
+												   (void *) &key,
+												   HASH_ENTER,
+												   &found);
+	Assert(!found);
+
+	oldcxt = MemoryContextSwitchTo(batch_cache_cxt);
+	entry->source_text = pstrdup(codeblock->source_text);
+	entry->state = pstrdup(state);
+	entry->params = params ? pstrdup(params) : NULL;
+	MemoryContextSwitchTo(oldcxt);
+	pfree(state);
+	if (params)
+	{
+		pfree(params);
+		batch_cache_nparameterized++;
+	}
+
+	/* The function now lives as long as the cache entry does */
+	MemoryContextSetParent(func->fn_cxt, batch_cache_cxt);
+
+	entry->function = func;
+	entry->mem_size = mem_size;
+	entry->generation = batch_cache_generation;
+	dlist_push_head(&batch_cache_lru, &entry->lru_node);
+	batch_cache_nentries++;
+	batch_cache_mem += mem_size;
+
+	batch_cache_enforce_limits();
+
+	return true;
+}
+
+/*
+ * pltsql_batch_cache_reset
+ *
+ * Drop every cached batch, e.g. on sp_reset_connection.
+ */
+void
+pltsql_batch_cache_reset(void)
+{
+	if (batch_cache_htab == NULL)
+		return;
+
+	batch_cache_sweep(true);
+}
+
+PG_FUNCTION_INFO_V1(babelfish_batch_cache_stats);
+
+/*
+ * Report the counters of the batch cache of the current backend.
+ */
+Datum
+babelfish_batch_cache_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[6];
+	bool		nulls[6] = {false, false, false, false, false, false};
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	values[0] = Int64GetDatum((int64) batch_cache_hits);
+	values[1] = Int64GetDatum((int64) batch_cache_misses);
+	values[2] = Int64GetDatum((int64) batch_cache_evictions);
+	values[3] = Int32GetDatum(batch_cache_nentries);
+	values[4] = Int32GetDatum(batch_cache_nparameterized);
+	values[5] = Int64GetDatum((int64) (batch_cache_mem / 1024));
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
 }
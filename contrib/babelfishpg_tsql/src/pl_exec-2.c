@@ -4,10 +4,14 @@
 #include "funcapi.h"
 
 #include "access/table.h"
+#include "catalog/dependency.h"
+#include "catalog/heap.h"
 #include "catalog/namespace.h"
 #include "catalog/pg_language.h"
 #include "commands/proclang.h"
+#include "common/hashfn.h"
 #include "executor/tstoreReceiver.h"
+#include "lib/ilist.h"
 #include "nodes/parsenodes.h"
 #include "pltsql_bulkcopy.h"
 
@@ -15,6 +19,9 @@
 #include "dbcmds.h"
 #include "pl_explain.h"
 #include "session.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/syscache.h"
 
 /* helper function to get current T-SQL estate */
 PLtsql_execstate *get_current_tsql_estate(void);
@@ -656,14 +663,12 @@ exec_stmt_exec(PLtsql_execstate *estate, PLtsql_stmt_exec *stmt)
 	SimpleEcontextStackEntry *topEntry;
 	SPIExecuteOptions options;
 	bool		need_path_reset = false;
+	bool		need_role_reset = false;
+	char	   *old_search_path = NULL;
 
 	Oid current_user_id = GetUserId();
 	char *cur_dbname = get_cur_db_name();
 
-	/* fetch current search_path */
-	List *path_oids = fetch_search_path(false);
-	char *old_search_path = flatten_search_path(path_oids);
-	char *new_search_path;
 	estate->db_name = NULL;
 	if (stmt->proc_name == NULL)
 		stmt->proc_name = "";
@@ -694,14 +699,28 @@ exec_stmt_exec(PLtsql_execstate *estate, PLtsql_stmt_exec *stmt)
 		if (strncmp(stmt->proc_name, "sp_", 3) == 0 && strcmp(cur_dbname, "master") != 0
 			&& (stmt->schema_name == '\0' || strncmp(stmt->schema_name, "dbo", strlen(stmt->schema_name)) == 0))
 			{
-				new_search_path = psprintf("%s, master_dbo", old_search_path);
+				Oid master_dbo_oid = get_namespace_oid("master_dbo", true);
+				List *path_oids = fetch_search_path(false);
+
+				/*
+				 * Add master_dbo to the new search path, unless it's already
+				 * there, e.g. in an sp_ procedure called by another one.
+				 * Changing search_path resets the namespace lookup cache.
+				 */
+				if (!list_member_oid(path_oids, master_dbo_oid))
+				{
+					char *new_search_path = get_sp_exec_search_path(stmt);
+
+					old_search_path = pstrdup(namespace_search_path);
+					(void) set_config_option("search_path", new_search_path,
+									PGC_USERSET, PGC_S_SESSION,
+									GUC_ACTION_SAVE, true, 0, false);
+					need_path_reset = true;
+				}
+				list_free(path_oids);
 
-				/* Add master_dbo to the new search path */
-				(void) set_config_option("search_path", new_search_path,
-								PGC_USERSET, PGC_S_SESSION,
-								GUC_ACTION_SAVE, true, 0, false);
 				SetCurrentRoleId(GetSessionUserId(), false);
-				need_path_reset = true;
+				need_role_reset = true;
 			}
 	}
 	if (stmt->schema_name != '\0')
@@ -1051,12 +1070,11 @@ exec_stmt_exec(PLtsql_execstate *estate, PLtsql_stmt_exec *stmt)
 	PG_CATCH();
 	{
 		if (need_path_reset)
-		{
 			(void) set_config_option("search_path", old_search_path,
 						PGC_USERSET, PGC_S_SESSION,
 						GUC_ACTION_SAVE, true, 0, false);
+		if (need_role_reset)
 			SetCurrentRoleId(current_user_id, false);
-		}
 
 		if (stmt->is_cross_db)
 			SetCurrentRoleId(current_user_id, false);
@@ -1082,9 +1100,10 @@ exec_stmt_exec(PLtsql_execstate *estate, PLtsql_stmt_exec *stmt)
 		(void) set_config_option("search_path", old_search_path,
 							PGC_USERSET, PGC_S_SESSION,
 							GUC_ACTION_SAVE, true, 0, false);
-		SetCurrentRoleId(current_user_id, false);
+		pfree(old_search_path);
 	}
-	list_free(path_oids);
+	if (need_role_reset)
+		SetCurrentRoleId(current_user_id, false);
 
 	if (expr->plan && !expr->plan->saved)
 	{
@@ -1120,6 +1139,302 @@ exec_stmt_exec(PLtsql_execstate *estate, PLtsql_stmt_exec *stmt)
 	return PLTSQL_RC_OK;
 }
 
+/*
+ * Bumped whenever pg_namespace changes, so that the search paths cached in
+ * EXEC statements are rebuilt when a schema on them is created, dropped or
+ * renamed.
+ */
+static uint64 exec_search_path_generation = 1;
+static bool exec_search_path_callback_registered = false;
+
+static void
+exec_search_path_inval_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	exec_search_path_generation++;
+}
+
+/*
+ * Return the search_path to call an sp_ procedure with: the current one with
+ * master_dbo appended. It is built once per statement and kept until the
+ * search_path, the user or the schemas change.
+ */
+static char *
+get_sp_exec_search_path(PLtsql_stmt_exec *stmt)
+{
+	Oid			user_id = GetUserId();
+
+	if (!exec_search_path_callback_registered)
+	{
+		CacheRegisterSyscacheCallback(NAMESPACEOID, exec_search_path_inval_callback, (Datum) 0);
+		exec_search_path_callback_registered = true;
+	}
+
+	if (stmt->sp_search_path == NULL ||
+		stmt->sp_search_path_user != user_id ||
+		stmt->sp_search_path_generation != exec_search_path_generation ||
+		strcmp(stmt->sp_search_path_src, namespace_search_path) != 0)
+	{
+		MemoryContext oldcontext;
+		List	   *path_oids = fetch_search_path(false);
+		char	   *flat_search_path = flatten_search_path(path_oids);
+
+		if (stmt->sp_search_path)
+		{
+			pfree(stmt->sp_search_path);
+			pfree(stmt->sp_search_path_src);
+		}
+
+		oldcontext = MemoryContextSwitchTo(GetMemoryChunkContext(stmt));
+		stmt->sp_search_path = psprintf("%s, master_dbo", flat_search_path);
+		stmt->sp_search_path_src = pstrdup(namespace_search_path);
+		MemoryContextSwitchTo(oldcontext);
+
+		stmt->sp_search_path_user = user_id;
+		stmt->sp_search_path_generation = exec_search_path_generation;
+
+		pfree(flat_search_path);
+		list_free(path_oids);
+	}
+
+	return stmt->sp_search_path;
+}
+
+/*
+ * Pool of the underlying tables of table variables.
+ *
+ * Instead of dropping the table of a table variable when the function that
+ * declared it exits, we truncate it and keep it, keyed by its name
+ * "<varname>_<@@NESTLEVEL>". The next DECLARE of the same name with the same
+ * definition - typically the next call of the same procedure - then reuses
+ * the table and no DDL is run at all.
+ *
+ * Idle tables must not get in the way of DDL on the objects they depend on
+ * (types, sequences, functions used in defaults...), so they are all dropped
+ * before any such DROP or ALTER statement runs.
+ */
+typedef struct TableVariablePoolEntry
+{
+	char		tblname[NAMEDATALEN];	/* hash key */
+	Oid			relid;			/* OID of the table */
+	char	   *query;			/* CREATE statement that built the table */
+	bool		in_use;			/* bound to a declared table variable? */
+} TableVariablePoolEntry;
+
+static HTAB *table_variable_pool = NULL;
+static int	table_variable_pool_idle = 0;
+static uint64 table_variable_pool_hits = 0;
+static uint64 table_variable_pool_misses = 0;
+static uint64 table_variable_pool_evictions = 0;
+
+/*
+ * Look up a pool entry, forgetting it if its table no longer exists, e.g.
+ * because the transaction that created it was rolled back.
+ */
+static TableVariablePoolEntry *
+table_variable_pool_lookup(const char *tblname)
+{
+	TableVariablePoolEntry *entry;
+
+	if (table_variable_pool == NULL)
+		return NULL;
+
+	entry = (TableVariablePoolEntry *) hash_search(table_variable_pool, tblname, HASH_FIND, NULL);
+	if (entry && RelnameGetRelid(tblname) != entry->relid)
+	{
+		if (!entry->in_use)
+			table_variable_pool_idle--;
+		pfree(entry->query);
+		hash_search(table_variable_pool, tblname, HASH_REMOVE, NULL);
+		entry = NULL;
+	}
+	return entry;
+}
+
+static void
+table_variable_pool_remove(TableVariablePoolEntry *entry)
+{
+	if (!entry->in_use)
+		table_variable_pool_idle--;
+	pfree(entry->query);
+	hash_search(table_variable_pool, entry->tblname, HASH_REMOVE, NULL);
+}
+
+/* Drop the table of an idle pool entry and forget the entry. */
+static void
+table_variable_pool_evict(TableVariablePoolEntry *entry)
+{
+	ObjectAddress object;
+
+	Assert(!entry->in_use);
+	ObjectAddressSet(object, RelationRelationId, entry->relid);
+	performDeletion(&object, DROP_RESTRICT,
+					PERFORM_DELETION_INTERNAL | PERFORM_DELETION_QUIETLY);
+	table_variable_pool_remove(entry);
+	table_variable_pool_evictions++;
+}
+
+/*
+ * Remember a newly created table so it can be reused once its table variable
+ * goes out of scope. Nothing is remembered once the pool is full.
+ */
+static void
+table_variable_pool_add(const char *tblname, const char *query)
+{
+	TableVariablePoolEntry *entry;
+	bool		found;
+
+	if (table_variable_pool == NULL)
+	{
+		HASHCTL		ctl;
+
+		ctl.keysize = NAMEDATALEN;
+		ctl.entrysize = sizeof(TableVariablePoolEntry);
+		ctl.hcxt = TopMemoryContext;
+		table_variable_pool = hash_create("T-SQL table variable pool", 64, &ctl,
+										  HASH_ELEM | HASH_STRINGS | HASH_CONTEXT);
+	}
+
+	if (hash_get_num_entries(table_variable_pool) >= pltsql_table_variable_pool_size ||
+		strlen(tblname) >= NAMEDATALEN)
+		return;
+
+	entry = (TableVariablePoolEntry *) hash_search(table_variable_pool, tblname, HASH_ENTER, &found);
+	Assert(!found);
+	entry->relid = RelnameGetRelid(tblname);
+	entry->query = MemoryContextStrdup(TopMemoryContext, query);
+	entry->in_use = true;
+}
+
+/*
+ * Restart the sequences owned by a table, as TRUNCATE ... RESTART IDENTITY
+ * does, so that the IDENTITY column of a reused table variable counts from its
+ * seed again. setval is used instead of ResetSequence because, like the
+ * truncation, it is not undone if the transaction rolls back.
+ */
+static void
+table_variable_pool_restart_identity(Oid relid)
+{
+	List	   *seqs = getOwnedSequences(relid);
+	ListCell   *lc;
+
+	foreach(lc, seqs)
+	{
+		Oid			seqid = lfirst_oid(lc);
+		int64		seq_start = 1;
+		ListCell   *seq_lc;
+
+		foreach(seq_lc, sequence_options(seqid))
+		{
+			DefElem    *defel = (DefElem *) lfirst(seq_lc);
+
+			if (strcmp(defel->defname, "start") == 0)
+				seq_start = defGetInt64(defel);
+		}
+
+		DirectFunctionCall3(setval3_oid,
+							ObjectIdGetDatum(seqid),
+							Int64GetDatum(seq_start),
+							BoolGetDatum(false));
+	}
+	list_free(seqs);
+}
+
+/*
+ * Give back the table of a table variable going out of scope. Returns true
+ * if it was emptied and kept in the pool, false if the caller has to drop it.
+ *
+ * The table is truncated in place: the contents of a table variable are not
+ * subject to transaction rollback, and this leaves the catalogs untouched.
+ * Its IDENTITY sequence, if any, is restarted.
+ */
+static bool
+table_variable_pool_release(const char *tblname)
+{
+	TableVariablePoolEntry *entry = table_variable_pool_lookup(tblname);
+	Relation	rel;
+
+	if (entry == NULL)
+		return false;
+
+	if (!entry->in_use || pltsql_table_variable_pool_size <= 0)
+	{
+		table_variable_pool_remove(entry);
+		return false;
+	}
+
+	rel = table_open(entry->relid, AccessExclusiveLock);
+	if (rel->rd_refcnt != 1)
+	{
+		/* Still referenced, e.g. by an open cursor. */
+		table_close(rel, NoLock);
+		table_variable_pool_remove(entry);
+		return false;
+	}
+	heap_truncate_one_rel(rel);
+	table_close(rel, NoLock);
+	table_variable_pool_restart_identity(entry->relid);
+
+	entry->in_use = false;
+	table_variable_pool_idle++;
+	return true;
+}
+
+/*
+ * Drop every idle table in the pool. Called before DDL that might need to
+ * drop or change an object one of them depends on.
+ */
+void
+pltsql_flush_table_variable_pool(void)
+{
+	HASH_SEQ_STATUS status;
+	TableVariablePoolEntry *entry;
+	List	   *idle = NIL;
+	ListCell   *lc;
+
+	if (table_variable_pool_idle == 0)
+		return;
+
+	hash_seq_init(&status, table_variable_pool);
+	while ((entry = (TableVariablePoolEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (!entry->in_use)
+			idle = lappend(idle, pstrdup(entry->tblname));
+	}
+
+	foreach(lc, idle)
+	{
+		entry = table_variable_pool_lookup((char *) lfirst(lc));
+		if (entry && !entry->in_use)
+			table_variable_pool_evict(entry);
+	}
+	list_free_deep(idle);
+	CommandCounterIncrement();
+}
+
+PG_FUNCTION_INFO_V1(babelfish_table_variable_pool_stats);
+
+/*
+ * Report the counters of the table variable pool of the current backend.
+ */
+Datum
+babelfish_table_variable_pool_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[5];
+	bool		nulls[5] = {false, false, false, false, false};
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	values[0] = Int64GetDatum((int64) table_variable_pool_hits);
+	values[1] = Int64GetDatum((int64) table_variable_pool_misses);
+	values[2] = Int64GetDatum((int64) table_variable_pool_evictions);
+	values[3] = Int32GetDatum(table_variable_pool ? (int32) hash_get_num_entries(table_variable_pool) : 0);
+	values[4] = Int32GetDatum(table_variable_pool_idle);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
 /*
  * Execute a DECLARE TABLE VARIABLE statement
  * Create an underlying temporary table for the table variable, with name
@@ -1134,21 +1449,21 @@ exec_stmt_decl_table(PLtsql_execstate *estate, PLtsql_stmt_decl_table *stmt)
 	char *query;
 	PLtsql_tbl *var = (PLtsql_tbl *) (estate->datums[stmt->dno]);
 	int rc;
-	bool isnull;
 	int old_client_min_messages;
 	bool old_pltsql_explain_only = pltsql_explain_only;
+	TableVariablePoolEntry *entry;
+	bool reused = false;
 
 	pltsql_explain_only = false; /* Create temporary table even in EXPLAIN ONLY mode */
 
 	PG_TRY();
 	{
+		/*
+		 * @@NESTLEVEL is the number of T-SQL frames on the call stack, which
+		 * we can count directly instead of running a query for it.
+		 */
 		if (estate->nestlevel == -1)
-		{
-			rc = SPI_execute("SELECT @@nestlevel", true, 0);
-			if (rc != SPI_OK_SELECT || SPI_processed != 1)
-				elog(ERROR, "Failed to get @@NESTLEVEL when declaring table variable %s", var->refname);
-			estate->nestlevel = DatumGetInt32(SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull));
-		}
+			(void) get_outermost_tsql_estate(&estate->nestlevel);
 
 		tblname = psprintf("%s_%d", var->refname, estate->nestlevel);
 		if (stmt->tbltypname)
@@ -1159,15 +1474,52 @@ exec_stmt_decl_table(PLtsql_execstate *estate, PLtsql_stmt_decl_table *stmt)
 							tblname, stmt->coldef);
 
 		/*
-		* If a table with the same name already exists, we should just use that
-		* table, and ignore the NOTICE of "relation already exists, skipping".
-		*/
-		old_client_min_messages = client_min_messages;
-		client_min_messages = WARNING;
-		rc = SPI_execute(query, false, 0);
-		client_min_messages = old_client_min_messages;
-		if (rc != SPI_OK_UTILITY)
-			elog(ERROR, "Failed to create the underlying table for table variable %s", var->refname);
+		 * Reuse an idle pooled table built by the same statement. One built
+		 * for a different definition of the name has to go first, otherwise
+		 * the CREATE below would silently pick it up.
+		 */
+		entry = table_variable_pool_lookup(tblname);
+		if (entry && !entry->in_use)
+		{
+			if (!old_pltsql_explain_only && pltsql_table_variable_pool_size > 0 &&
+				strcmp(entry->query, query) == 0)
+			{
+				entry->in_use = true;
+				table_variable_pool_idle--;
+				table_variable_pool_hits++;
+				reused = true;
+			}
+			else
+			{
+				table_variable_pool_evict(entry);
+				CommandCounterIncrement();
+				entry = NULL;
+			}
+		}
+
+		if (!reused)
+		{
+			Oid existing = RelnameGetRelid(tblname);
+
+			/*
+			* If a table with the same name already exists, we should just use that
+			* table, and ignore the NOTICE of "relation already exists, skipping".
+			*/
+			old_client_min_messages = client_min_messages;
+			client_min_messages = WARNING;
+			rc = SPI_execute(query, false, 0);
+			client_min_messages = old_client_min_messages;
+			if (rc != SPI_OK_UTILITY)
+				elog(ERROR, "Failed to create the underlying table for table variable %s", var->refname);
+
+			/* Only pool tables we have just built from this very statement. */
+			if (entry == NULL && !OidIsValid(existing) &&
+				!old_pltsql_explain_only && pltsql_table_variable_pool_size > 0)
+			{
+				table_variable_pool_misses++;
+				table_variable_pool_add(tblname, query);
+			}
+		}
 
 		if (old_pltsql_explain_only)
 		{
@@ -2203,6 +2555,367 @@ is_char_identpart(char c)
 	        (c >= '0' && c <= '9'));
 }
 
+/*
+ * Parameter definition cache
+ *
+ * Dynamic SQL tends to run the same sp_executesql parameter definition over
+ * and over, so the resolved parameters of recently used definitions are kept
+ * in a small per-backend LRU.  Type names are resolved through the search
+ * path, which is therefore part of the key along with the current user since
+ * the search path may contain "$user"; any type or schema change drops the
+ * whole cache.
+ */
+#define PARAM_DEF_CACHE_SIZE	64
+
+typedef struct ParamDefCacheEntry
+{
+	uint32		hash;			/* hash key, must be first */
+	char	   *paramdefstr;	/* full definition, to resolve collisions */
+	char	   *search_path;	/* search path the types were resolved in */
+	Oid			userid;			/* user the search path was expanded for */
+	int			numargs;
+	Oid		   *argtypes;
+	int32	   *argtypmods;
+	char	  **argnames;
+	char	   *argmodes;
+	dlist_node	lru_node;		/* most recently used entries first */
+} ParamDefCacheEntry;
+
+static HTAB *param_def_cache = NULL;
+static MemoryContext param_def_cache_cxt = NULL;
+static dlist_head param_def_cache_lru = DLIST_STATIC_INIT(param_def_cache_lru);
+static bool param_def_cache_valid = true;
+static uint64 param_def_cache_generation = 1;
+
+static void
+param_def_cache_inval_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	param_def_cache_valid = false;
+	param_def_cache_generation++;
+}
+
+static uint32
+param_def_cache_hash(const char *paramdefstr, const char *search_path, Oid userid)
+{
+	uint32		hash;
+
+	hash = hash_bytes((const unsigned char *) paramdefstr, strlen(paramdefstr));
+	hash = hash_combine(hash, hash_bytes((const unsigned char *) search_path,
+										 strlen(search_path)));
+	return hash_combine(hash, hash_bytes_uint32((uint32) userid));
+}
+
+static void
+param_def_cache_remove(ParamDefCacheEntry *entry)
+{
+	int			i;
+
+	dlist_delete(&entry->lru_node);
+	pfree(entry->paramdefstr);
+	pfree(entry->search_path);
+	for (i = 0; i < entry->numargs; i++)
+		pfree(entry->argnames[i]);
+	if (entry->numargs > 0)
+	{
+		pfree(entry->argtypes);
+		pfree(entry->argtypmods);
+		pfree(entry->argnames);
+		pfree(entry->argmodes);
+	}
+	hash_search(param_def_cache, &entry->hash, HASH_REMOVE, NULL);
+}
+
+static void
+param_def_cache_flush(void)
+{
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &param_def_cache_lru)
+		param_def_cache_remove(dlist_container(ParamDefCacheEntry, lru_node, iter.cur));
+	param_def_cache_valid = true;
+}
+
+/*
+ * Set up the cache, or drop it if it was invalidated, and return the current
+ * generation.  Callers take it before resolving any type name, so that
+ * param_def_cache_store() can tell whether an invalidation arrived meanwhile.
+ */
+static uint64
+param_def_cache_begin(void)
+{
+	if (param_def_cache == NULL)
+	{
+		HASHCTL		ctl;
+
+		param_def_cache_cxt = AllocSetContextCreate(TopMemoryContext,
+													"T-SQL parameter definition cache",
+													ALLOCSET_SMALL_SIZES);
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(uint32);
+		ctl.entrysize = sizeof(ParamDefCacheEntry);
+		ctl.hcxt = param_def_cache_cxt;
+		param_def_cache = hash_create("T-SQL parameter definition cache",
+									  PARAM_DEF_CACHE_SIZE, &ctl,
+									  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		CacheRegisterSyscacheCallback(TYPEOID, param_def_cache_inval_callback, (Datum) 0);
+		CacheRegisterSyscacheCallback(NAMESPACEOID, param_def_cache_inval_callback, (Datum) 0);
+	}
+	else if (!param_def_cache_valid)
+		param_def_cache_flush();
+
+	return param_def_cache_generation;
+}
+
+/*
+ * Fill args from the cache.  Everything is copied, since callers adjust the
+ * parameter modes afterwards.
+ */
+static bool
+param_def_cache_lookup(InlineCodeBlockArgs *args, const char *paramdefstr)
+{
+	const char *search_path = namespace_search_path ? namespace_search_path : "";
+	Oid			userid = GetUserId();
+	uint32		hash;
+	ParamDefCacheEntry *entry;
+	int			i;
+
+	hash = param_def_cache_hash(paramdefstr, search_path, userid);
+	entry = (ParamDefCacheEntry *) hash_search(param_def_cache, &hash, HASH_FIND, NULL);
+	if (entry == NULL ||
+		entry->userid != userid ||
+		strcmp(entry->paramdefstr, paramdefstr) != 0 ||
+		strcmp(entry->search_path, search_path) != 0)
+		return false;
+
+	dlist_move_head(&param_def_cache_lru, &entry->lru_node);
+
+	args->numargs = entry->numargs;
+	args->argtypes = (Oid *) palloc(sizeof(Oid) * args->numargs);
+	args->argtypmods = (int32 *) palloc(sizeof(int32) * args->numargs);
+	args->argnames = (char **) palloc(sizeof(char *) * args->numargs);
+	args->argmodes = (char *) palloc(sizeof(char) * args->numargs);
+	memcpy(args->argtypes, entry->argtypes, sizeof(Oid) * args->numargs);
+	memcpy(args->argtypmods, entry->argtypmods, sizeof(int32) * args->numargs);
+	memcpy(args->argmodes, entry->argmodes, sizeof(char) * args->numargs);
+	for (i = 0; i < args->numargs; i++)
+		args->argnames[i] = pstrdup(entry->argnames[i]);
+
+	return true;
+}
+
+/*
+ * Remember resolved parameters.  Nothing is stored if a type or schema
+ * invalidation arrived since param_def_cache_begin() returned generation,
+ * since the types may have been resolved against the old catalog state.
+ */
+static void
+param_def_cache_store(InlineCodeBlockArgs *args, const char *paramdefstr,
+					  uint64 generation)
+{
+	const char *search_path = namespace_search_path ? namespace_search_path : "";
+	Oid			userid = GetUserId();
+	uint32		hash;
+	ParamDefCacheEntry *entry;
+	MemoryContext oldcxt;
+	bool		found;
+	int			i;
+
+	if (generation != param_def_cache_generation)
+		return;
+
+	hash = param_def_cache_hash(paramdefstr, search_path, userid);
+	entry = (ParamDefCacheEntry *) hash_search(param_def_cache, &hash, HASH_FIND, NULL);
+	if (entry)
+		param_def_cache_remove(entry);
+	else if (hash_get_num_entries(param_def_cache) >= PARAM_DEF_CACHE_SIZE)
+		param_def_cache_remove(dlist_container(ParamDefCacheEntry, lru_node,
+											   dlist_tail_node(&param_def_cache_lru)));
+
+	entry = (ParamDefCacheEntry *) hash_search(param_def_cache, &hash, HASH_ENTER, &found);
+	Assert(!found);
+
+	oldcxt = MemoryContextSwitchTo(param_def_cache_cxt);
+	entry->paramdefstr = pstrdup(paramdefstr);
+	entry->search_path = pstrdup(search_path);
+	entry->userid = userid;
+	entry->numargs = args->numargs;
+	if (args->numargs > 0)
+	{
+		entry->argtypes = (Oid *) palloc(sizeof(Oid) * args->numargs);
+		entry->argtypmods = (int32 *) palloc(sizeof(int32) * args->numargs);
+		entry->argnames = (char **) palloc(sizeof(char *) * args->numargs);
+		entry->argmodes = (char *) palloc(sizeof(char) * args->numargs);
+		memcpy(entry->argtypes, args->argtypes, sizeof(Oid) * args->numargs);
+		memcpy(entry->argtypmods, args->argtypmods, sizeof(int32) * args->numargs);
+		memcpy(entry->argmodes, args->argmodes, sizeof(char) * args->numargs);
+		for (i = 0; i < args->numargs; i++)
+			entry->argnames[i] = pstrdup(args->argnames[i]);
+	}
+	MemoryContextSwitchTo(oldcxt);
+
+	dlist_push_head(&param_def_cache_lru, &entry->lru_node);
+}
+
+static inline bool
+param_def_is_ident_char(char c)
+{
+	return isalnum((unsigned char) c) || c == '_' || c == '$' || IS_HIGHBIT_SET(c);
+}
+
+/* Does the word ending right before *end match kw, case-insensitively? */
+static bool
+param_def_ends_with_word(const char *start, const char **end, const char *kw)
+{
+	int			len = strlen(kw);
+	const char *p = *end - len;
+
+	if (p <= start || pg_strncasecmp(p, kw, len) != 0)
+		return false;
+	/* the keyword must be a word of its own */
+	if (!scanner_isspace(p[-1]) && p[-1] != ')' && p[-1] != ']' && p[-1] != '"')
+		return false;
+
+	while (p > start && scanner_isspace(p[-1]))
+		p--;
+	*end = p;
+	return true;
+}
+
+/*
+ * Parse one "@name [AS] type [OUT | OUTPUT]" definition.  Only the type is
+ * left to the grammar.  Returns false for anything else the CREATE PROCEDURE
+ * syntax allows (defaults, NULL, READONLY), which the caller then handles
+ * the slow way.
+ */
+static bool
+parse_one_param_def(const char *start, const char *end, char **name,
+					char *mode, char **typestr)
+{
+	const char *p = start;
+
+	while (p < end && scanner_isspace(*p))
+		p++;
+	while (end > p && scanner_isspace(end[-1]))
+		end--;
+
+	if (p >= end || *p != '@')
+		return false;
+	for (start = p++; p < end && param_def_is_ident_char(*p); p++)
+		;
+	if (p == start + 1 || p >= end || !scanner_isspace(*p))
+		return false;
+	*name = downcase_truncate_identifier(start, p - start, true);
+
+	while (p < end && scanner_isspace(*p))
+		p++;
+	if (end - p > 2 && pg_strncasecmp(p, "as", 2) == 0 && scanner_isspace(p[2]))
+	{
+		p += 2;
+		while (p < end && scanner_isspace(*p))
+			p++;
+	}
+
+	*mode = FUNC_PARAM_IN;
+	if (param_def_ends_with_word(p, &end, "output") ||
+		param_def_ends_with_word(p, &end, "out"))
+		*mode = FUNC_PARAM_INOUT;
+
+	if (p >= end ||
+		param_def_ends_with_word(p, &end, "readonly") ||
+		param_def_ends_with_word(p, &end, "null") ||
+		param_def_ends_with_word(p, &end, "output") ||
+		param_def_ends_with_word(p, &end, "out"))
+		return false;
+
+	*typestr = pnstrdup(p, end - p);
+	return true;
+}
+
+/*
+ * Split a parameter definition string at its top level commas and resolve
+ * each parameter.  Returns false if the string needs the full grammar.
+ */
+static bool
+parse_param_def(InlineCodeBlockArgs *args, const char *paramdefstr)
+{
+	List	   *names = NIL;
+	List	   *modes = NIL;
+	List	   *typestrs = NIL;
+	const char *start = paramdefstr;
+	const char *p;
+	int			depth = 0;
+	char		quote = '\0';
+	ListCell   *lc1,
+			   *lc2,
+			   *lc3;
+	int			i = 0;
+
+	for (p = paramdefstr;; p++)
+	{
+		if (quote != '\0' && *p != '\0')
+		{
+			if (*p == quote)
+				quote = '\0';
+			continue;
+		}
+
+		if (*p == '[')
+			quote = ']';
+		else if (*p == '"')
+			quote = '"';
+		else if (*p == '(')
+			depth++;
+		else if (*p == ')')
+			depth--;
+		else if (*p == '\'' || *p == '=' ||
+				 (*p == '-' && p[1] == '-') || (*p == '/' && p[1] == '*'))
+			return false;
+		else if ((*p == ',' && depth == 0) || *p == '\0')
+		{
+			char	   *name;
+			char		mode;
+			char	   *typestr;
+
+			if (quote != '\0' || depth != 0 ||
+				!parse_one_param_def(start, p, &name, &mode, &typestr))
+				return false;
+
+			names = lappend(names, name);
+			modes = lappend_int(modes, mode);
+			typestrs = lappend(typestrs, typestr);
+
+			if (*p == '\0')
+				break;
+			start = p + 1;
+		}
+	}
+
+	if (list_length(names) > FUNC_MAX_ARGS)
+		ereport(ERROR,
+				(errcode(ERRCODE_PROTOCOL_VIOLATION),
+				 errmsg("Too many arguments were provided: %d. The maximum allowed limit is %d",
+						list_length(names), FUNC_MAX_ARGS)));
+
+	args->numargs = list_length(names);
+	args->argtypes = (Oid *) palloc(sizeof(Oid) * args->numargs);
+	args->argtypmods = (int32 *) palloc(sizeof(int32) * args->numargs);
+	args->argnames = (char **) palloc(sizeof(char *) * args->numargs);
+	args->argmodes = (char *) palloc(sizeof(char) * args->numargs);
+
+	forthree(lc1, names, lc2, modes, lc3, typestrs)
+	{
+		TypeName   *typeName = typeStringToTypeName((char *) lfirst(lc3));
+
+		args->argnames[i] = (char *) lfirst(lc1);
+		args->argmodes[i] = (char) lfirst_int(lc2);
+		typenameTypeIdAndMod(NULL, typeName, &(args->argtypes[i]), &(args->argtypmods[i]));
+		i++;
+	}
+
+	return true;
+}
+
 /*
  * Read parameter definitions
  */
@@ -2216,6 +2929,7 @@ read_param_def(InlineCodeBlockArgs *args, const char *paramdefstr)
 	const char  *str1 = "CREATE PROC p_tmp_spexecutesql (";
 	const char  *str2 = ") AS BEGIN END; DROP PROC p_tmp_spexecutesql;";
 	StringInfoData proc_stmt;
+	uint64	    generation;
 
 	Assert(args);
 
@@ -2225,6 +2939,16 @@ read_param_def(InlineCodeBlockArgs *args, const char *paramdefstr)
 		return;
 	}
 
+	generation = param_def_cache_begin();
+	if (param_def_cache_lookup(args, paramdefstr))
+		return;
+
+	if (parse_param_def(args, paramdefstr))
+	{
+		param_def_cache_store(args, paramdefstr, generation);
+		return;
+	}
+
 	/*
 	 * Create a fake CREATE PROCEDURE statement to get the param
 	 * definition parse tree.
@@ -2265,6 +2989,8 @@ read_param_def(InlineCodeBlockArgs *args, const char *paramdefstr)
 		typenameTypeIdAndMod(NULL, p->argType, &(args->argtypes[i]), &(args->argtypmods[i]));
 		i++;
 	}
+
+	param_def_cache_store(args, paramdefstr, generation);
 }
 
 InlineCodeBlockArgs *create_args(int numargs)
@@ -10025,6 +10025,11 @@ pltsql_clean_table_variables(PLtsql_execstate *estate, PLtsql_function *func)
 			tbl = (PLtsql_tbl *) estate->datums[n];
 			if (!tbl->need_drop)
 				continue;
+
+			/* Keep the table around for the next declaration of the variable. */
+			if (!old_pltsql_explain_only && table_variable_pool_release(tbl->tblname))
+				continue;
+
 			query = psprintf(query_fmt, tbl->tblname);
 
 			pltsql_explain_only = false; /* Drop temporary table even in EXPLAIN ONLY mode */
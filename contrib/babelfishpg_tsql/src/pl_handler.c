@@ -35,6 +35,7 @@
 #include "common/string.h"
 #include "funcapi.h"
 #include "mb/pg_wchar.h"
+#include "miscadmin.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "parser/analyze.h"
@@ -2053,6 +2054,34 @@ static void bbf_ProcessUtility(PlannedStmt *pstmt,
 	if (process_utility_stmt_explain_only_mode(queryString, parsetree))
 		return; /* Don't execute anything */
 
+	/*
+	 * Idle pooled table variables may still reference types, schemas or
+	 * other objects this statement is about to drop or alter; release them
+	 * first so they don't get in the way of the dependency checks.
+	 */
+	switch (nodeTag(parsetree))
+	{
+		case T_DropStmt:
+		{
+			ObjectType removeType = ((DropStmt *) parsetree)->removeType;
+
+			if (removeType != OBJECT_TABLE && removeType != OBJECT_INDEX &&
+				removeType != OBJECT_VIEW && removeType != OBJECT_MATVIEW &&
+				removeType != OBJECT_FOREIGN_TABLE)
+				pltsql_flush_table_variable_pool();
+			break;
+		}
+		case T_DropOwnedStmt:
+			pltsql_flush_table_variable_pool();
+			break;
+		case T_AlterTableStmt:
+			if (((AlterTableStmt *) parsetree)->objtype == OBJECT_TYPE)
+				pltsql_flush_table_variable_pool();
+			break;
+		default:
+			break;
+	}
+
 	/*
 	 * Block ALTER VIEW and CREATE OR REPLACE VIEW statements from PG dialect
 	 * executed on TSQL views which has entries in view_def catalog
@@ -3910,6 +3939,7 @@ pltsql_inline_handler(PG_FUNCTION_ARGS)
 	LOCAL_FCINFO(fake_fcinfo, FUNC_MAX_ARGS);
 	bool nonatomic;
 	bool support_tsql_trans = pltsql_support_tsql_transactions();
+	bool keep_func = false;	/* function outlives this call */
 	ReturnSetInfo rsinfo; /* for INSERT ... EXECUTE */
 
 	/* 
@@ -3931,7 +3961,10 @@ pltsql_inline_handler(PG_FUNCTION_ARGS)
 	pgstat_report_activity(STATE_RUNNING, codeblock->source_text);
 
 	if (nargs > 1)
+	{
 		codeblock_args = (InlineCodeBlockArgs *) DatumGetPointer(PG_GETARG_DATUM(1));
+		keep_func = OPTION_ENABLED(codeblock_args, NO_FREE);
+	}
 
 	sql_dialect = SQL_DIALECT_TSQL;
 	
@@ -3961,6 +3994,12 @@ pltsql_inline_handler(PG_FUNCTION_ARGS)
 			/* Mark the function as busy, just pro forma */
 			func->use_count++;
 		}
+		else if ((func = pltsql_batch_cache_lookup(codeblock, codeblock_args)) != NULL)
+		{
+			/* Same batch compiled earlier in this session, reuse it */
+			func->use_count++;
+			keep_func = true;
+		}
 		else
 		{
 			/* Compile the anonymous code block */
@@ -3984,6 +4023,9 @@ pltsql_inline_handler(PG_FUNCTION_ARGS)
 				fcinfo->isnull = false;
 				return (Datum) 0;
 			}
+
+			if (pltsql_batch_cache_insert(codeblock, codeblock_args, func))
+				keep_func = true;
 		}
 	}
 	PG_CATCH();
@@ -4010,7 +4052,7 @@ pltsql_inline_handler(PG_FUNCTION_ARGS)
 	}
 
 	/* Create a private EState for simple-expression execution */
-	if (OPTION_ENABLED(codeblock_args, NO_FREE))
+	if (keep_func)
 		simple_eval_estate = NULL;
 	else
 		simple_eval_estate = CreateExecutorState();
@@ -4084,7 +4126,7 @@ pltsql_inline_handler(PG_FUNCTION_ARGS)
 		Assert(func->use_count == 0);
 
 		/* ... so we can free subsidiary storage */
-		if (!OPTION_ENABLED(codeblock_args, NO_FREE))
+		if (!keep_func)
 		{
 			/* Clean up the private EState */
 			FreeExecutorState(simple_eval_estate);
@@ -4122,7 +4164,7 @@ pltsql_inline_handler(PG_FUNCTION_ARGS)
 	Assert(func->use_count == 0);
 
 	/* ... so we can free subsidiary storage */
-	if (!OPTION_ENABLED(codeblock_args, NO_FREE))
+	if (!keep_func)
 	{
 		FreeExecutorState(simple_eval_estate);
 		pltsql_free_function_memory(func);
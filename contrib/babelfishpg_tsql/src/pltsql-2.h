@@ -79,6 +79,12 @@ typedef struct PLtsql_stmt_exec
 	char			*db_name;
 	char            *proc_name;
 	char            *schema_name;
+
+	/* search_path used to call sp_ procedures, cached by exec_stmt_exec */
+	char		*sp_search_path;			/* search_path with master_dbo added */
+	char		*sp_search_path_src;		/* search_path it was built from */
+	Oid			sp_search_path_user;		/* user it was built for */
+	uint64		sp_search_path_generation;	/* schema catalog generation */
 } PLtsql_stmt_exec;
 
 typedef struct
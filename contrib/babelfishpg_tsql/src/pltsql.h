@@ -1538,6 +1538,8 @@ typedef struct PLtsql_protocol_plugin
 	bool		(*get_stat_values) (Datum *values, bool *nulls, int len, int pid, int curr_backend);
 	void		(*invalidate_stat_view) (void);
 	char*		(*get_host_name) (void);
+	void		(*get_wire_stats) (Tuplestorestate *tupstore, TupleDesc tupdesc, int pid);
+	void		(*get_request_stats) (Tuplestorestate *tupstore, TupleDesc tupdesc, int pid);
 
 	/* Function pointers set by PL/tsql itself */
 	Datum		(*sql_batch_callback) (PG_FUNCTION_ARGS);
@@ -1786,6 +1788,14 @@ extern int insert_bulk_rows_per_batch;
 extern int insert_bulk_kilobytes_per_batch;
 extern bool insert_bulk_keep_nulls;
 
+/* Ad-hoc batch cache options */
+#define DEFAULT_BATCH_CACHE_MAX_ENTRIES 256
+#define DEFAULT_BATCH_CACHE_MAX_KILOBYTES 16384
+
+extern bool pltsql_enable_batch_cache;
+extern int pltsql_batch_cache_max_entries;
+extern int pltsql_batch_cache_max_kilobytes;
+
 /**********************************************************************
  * Function declarations
  **********************************************************************/
@@ -1797,6 +1807,13 @@ extern PLtsql_function *pltsql_compile(FunctionCallInfo fcinfo,
 				bool forValidator);
 extern PLtsql_function *pltsql_compile_inline(char *proc_source,
 					      InlineCodeBlockArgs *args);
+extern PLtsql_function *pltsql_batch_cache_lookup(InlineCodeBlock *codeblock,
+					      InlineCodeBlockArgs *args);
+extern bool pltsql_batch_cache_insert(InlineCodeBlock *codeblock,
+					      InlineCodeBlockArgs *args,
+					      PLtsql_function *func);
+extern void pltsql_batch_cache_reset(void);
+extern void pltsql_flush_table_variable_pool(void);
 extern void pltsql_parser_setup(struct ParseState *pstate,
 					 PLtsql_expr *expr);
 extern bool pltsql_parse_word(char *word1, const char *yytxt,
@@ -1973,6 +1990,34 @@ typedef struct
 	const void *errargs[5]; /* support up to 5 args */
 } ANTLR_result;
 
+/*
+ * Counters for the two-stage ANTLR parse: SLL prediction first, full LL only
+ * when SLL fails.  Times are in microseconds.
+ */
+typedef struct ANTLR_parse_stats
+{
+	uint64		sll_parses;		/* parses attempted in SLL mode */
+	uint64		ll_fallbacks;	/* SLL parses that had to be redone in LL mode */
+	uint64		ll_parses;		/* parses done in LL mode, including fallbacks */
+	uint64		sll_time_us;	/* time spent in SLL parses */
+	uint64		ll_time_us;		/* time spent in LL parses */
+} ANTLR_parse_stats;
+
+extern ANTLR_parse_stats antlr_parse_stats;
+
+/* Sizes of the process-wide ANTLR DFA and prediction context caches */
+typedef struct ANTLR_dfa_cache_stats
+{
+	uint64		lexer_dfa_states;
+	uint64		parser_decisions;
+	uint64		parser_dfa_states;
+	uint64		prediction_contexts;
+} ANTLR_dfa_cache_stats;
+
+extern bool antlr_warmup_parse(const char *sourceText);
+extern void antlr_get_dfa_cache_stats(ANTLR_dfa_cache_stats *stats);
+extern void pltsql_warmup_antlr_dfa_cache(void);
+
 extern ANTLR_result antlr_parser_cpp(const char *sourceText);
 extern void report_antlr_error(ANTLR_result result);
 
@@ -554,7 +554,6 @@ static uint64
 ExecuteBulkCopy(BulkCopyState cstate, int rowCount, int colCount,
 				Datum *Values, bool *Nulls)
 {
-	int cur_index = 0;
 	int cur_row_in_batch = 0;
 	ResultRelInfo *resultRelInfo;
 	ResultRelInfo *target_resultRelInfo;
@@ -569,6 +568,7 @@ ExecuteBulkCopy(BulkCopyState cstate, int rowCount, int colCount,
 	CopyMultiInsertInfo multiInsertInfo = {0};	/* pacify compiler */
 	int64		processed = 0;
 	int		   *defmap = cstate->defmap;
+	int		   *attmap = cstate->attmap;
 	ExprState **defexprs = cstate->defexprs;
 
 	Assert(cstate->rel);
@@ -672,16 +672,20 @@ ExecuteBulkCopy(BulkCopyState cstate, int rowCount, int colCount,
 		 * Since Values/Nulls are flattened arrays, we extract only the next row's
 		 * values and store it in the slot.
 		 */
-		if (cur_index < rowCount * colCount)
+		if (cur_row_in_batch < rowCount)
 		{
-			/* Initialize all values for row to NULL. */
-			MemSet(myslot->tts_values, 0, myslot->tts_tupleDescriptor->natts * sizeof(Datum));
-			MemSet(myslot->tts_isnull, false, myslot->tts_tupleDescriptor->natts * sizeof(bool));
+			Datum	   *rowValues = &Values[cur_row_in_batch * colCount];
+			bool	   *rowNulls = &Nulls[cur_row_in_batch * colCount];
 
 			/* colCount could be less than natts if user wants to insert only in a subset of columns. */
-			for (int i = 0, j = 0; i < myslot->tts_tupleDescriptor->natts && j <= colCount; i++)
+			for (int i = 0; i < myslot->tts_tupleDescriptor->natts; i++)
 			{
-				if (!list_member_int(cstate->attnumlist, i + 1))
+				int			j = attmap[i];
+
+				myslot->tts_values[i] = (Datum) 0;
+				myslot->tts_isnull[i] = false;
+
+				if (j < 0)
 				{
 					/*
 					 * If there is an identity column then we should insert the value for seuqence.
@@ -698,19 +702,11 @@ ExecuteBulkCopy(BulkCopyState cstate, int rowCount, int colCount,
 				else
 				{
 					/* j will never be >= colCount since that is handled by protocol. */
-					if (Nulls[cur_row_in_batch * colCount + j])
-						myslot->tts_isnull[i] = Nulls[cur_row_in_batch * colCount + j];
+					Assert(j < colCount);
+					if (rowNulls[j])
+						myslot->tts_isnull[i] = true;
 					else
-					{
-						myslot->tts_values[i] = Values[cur_row_in_batch * colCount + j];
-					}
-					j++;
-					/*
-					 * We increment cur_index only for the columns we received data for.
-					 * We need not check for overflow (cur_index < rowCount * colCount)
-					 * for each loop since that is handled by the protocol.
-					 */
-					cur_index++;
+						myslot->tts_values[i] = rowValues[j];
 				}
 			}
 			cur_row_in_batch++;
@@ -830,6 +826,7 @@ BeginBulkCopy(Relation rel,
 	AttrNumber	num_phys_attrs,
 				num_defaults;
 	int			attnum;
+	int			ncols;
 	int		   *defmap;
 	ExprState **defexprs;
 	MemoryContext oldcontext;
@@ -936,6 +933,15 @@ BeginBulkCopy(Relation rel,
 		}
 	}
 
+	/*
+	 * Incoming rows carry the requested columns in attribute order; remember
+	 * where each attribute's value is so rows can be stored without searching
+	 * attnumlist for every column.
+	 */
+	cstate->attmap = (int *) palloc(num_phys_attrs * sizeof(int));
+	for (attnum = 1, ncols = 0; attnum <= num_phys_attrs; attnum++)
+		cstate->attmap[attnum - 1] = list_member_int(attnums, attnum) ? ncols++ : -1;
+
 	/* We keep those variables in cstate. */
 	cstate->defmap = defmap;
 	cstate->defexprs = defexprs;
@@ -6,6 +6,7 @@ typedef struct BulkCopyStateData
 {
 	Relation	rel;			/* relation to insert into */
 	List	   *attnumlist;		/* integer list of attnums to insert */
+	int		   *attmap;			/* input column of each attribute, or -1 */
 
 
 	/* these are just for error messages, see BulkCopyErrorCallback */
@@ -639,6 +639,8 @@ typedef enum PgTsqlInstrMetricType {
 	INSTR_UNSUPPORTED_TSQL_SELECT_COL_ALIAS,
 	INSTR_UNSUPPORTED_TSQL_SERVERNAME_IN_NAME,
 	INSTR_UNSUPPORTED_TSQL_OPTION_NO_BROWSETABLE,
+
+	INSTR_TSQL_ANTLR_LL_FALLBACK,
 	
 	INSTR_TSQL_COUNT
 } PgTsqlInstrMetricType;
@@ -12,6 +12,7 @@
 #include "nodes/parsenodes.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
+#include "utils/inval.h"
 #include "utils/rel.h"
 
 #include "catalog.h"
@@ -56,6 +57,8 @@ add_ns_ext_info(CreateSchemaStmt *stmt, const char *queryString, const char *ori
 	tuple = heap_form_tuple(RelationGetDescr(rel),
 							new_record, new_record_nulls);
 	CatalogTupleInsert(rel, tuple);
+	/* Let backends caching the catalog see the new row */
+	CacheInvalidateRelcacheByRelid(namespace_ext_oid);
 	table_close(rel, RowExclusiveLock);
 
 	/* Advance cmd counter to make the new meta visible */
@@ -94,6 +97,7 @@ del_ns_ext_info(const char *schemaname, bool missing_ok)
 	}
 
 	CatalogTupleDelete(rel, &tuple->t_self);
+	CacheInvalidateRelcacheByRelid(namespace_ext_oid);
 	systable_endscan(scan);
 	table_close(rel, RowExclusiveLock);
 
@@ -1,7 +1,13 @@
 #include "postgres.h"
+#include "access/htup_details.h"
+#include "executor/spi.h"
+#include "parser/parser.h"
+#include "portability/instr_time.h"
+#include "storage/fd.h"
 #include "utils/builtins.h"
 #include "funcapi.h"
 #include "pltsql.h"
+#include "guc.h"
 #if 0
 PG_MODULE_MAGIC;
 
@@ -28,3 +34,297 @@ antlr_parser(PG_FUNCTION_ARGS)
 
   PG_RETURN_TEXT_P(cstring_to_text((result.success ? "success" : result.errfmt)));
 }
+
+PG_FUNCTION_INFO_V1(babelfish_antlr_parse_stats);
+
+/*
+ * Report the counters of the two-stage (SLL, then LL) ANTLR parse for the
+ * current backend.
+ */
+Datum
+babelfish_antlr_parse_stats(PG_FUNCTION_ARGS)
+{
+  TupleDesc tupdesc;
+  Datum values[5];
+  bool nulls[5] = {false, false, false, false, false};
+
+  if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+    elog(ERROR, "return type must be a row type");
+
+  values[0] = Int64GetDatum((int64) antlr_parse_stats.sll_parses);
+  values[1] = Int64GetDatum((int64) antlr_parse_stats.ll_fallbacks);
+  values[2] = Int64GetDatum((int64) antlr_parse_stats.ll_parses);
+  values[3] = Int64GetDatum((int64) antlr_parse_stats.sll_time_us);
+  values[4] = Int64GetDatum((int64) antlr_parse_stats.ll_time_us);
+
+  PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * Representative statements used to warm up the ANTLR DFA caches before a
+ * backend parses its first batch.  Covers the statement shapes applications
+ * and drivers send most often.
+ */
+static const char *antlr_warmup_corpus[] = {
+  "SELECT 1",
+  "SELECT @@VERSION, @@SPID, @@TRANCOUNT, @@ROWCOUNT, @@ERROR, @@IDENTITY, SCOPE_IDENTITY()",
+  "SELECT TOP 10 a.col1, b.col2 AS c2, COUNT(*) AS cnt FROM dbo.t1 AS a WITH (NOLOCK) "
+    "INNER JOIN dbo.t2 b ON a.id = b.id LEFT OUTER JOIN t3 ON t3.id = b.id "
+    "WHERE a.col1 > @p1 AND b.col2 LIKE N'%abc%' OR a.col3 IN (1, 2, 3) AND a.col4 IS NOT NULL "
+    "GROUP BY a.col1, b.col2 HAVING COUNT(*) > 1 ORDER BY a.col1 DESC, 2 ASC",
+  "SELECT DISTINCT t.*, CASE WHEN t.a = 1 THEN 'x' WHEN t.a = 2 THEN 'y' ELSE NULL END AS c, "
+    "CAST(t.b AS NVARCHAR(50)), CONVERT(VARCHAR(10), t.d, 120), ISNULL(t.e, 0), COALESCE(t.f, t.g, 'z') "
+    "FROM [dbo].[t] t WHERE EXISTS (SELECT 1 FROM u WHERE u.id = t.id) AND t.h BETWEEN 1 AND 10",
+  "SELECT a, ROW_NUMBER() OVER (PARTITION BY b ORDER BY c) AS rn, SUM(d) OVER (ORDER BY c ROWS UNBOUNDED PRECEDING) "
+    "FROM t ORDER BY a OFFSET 10 ROWS FETCH NEXT 20 ROWS ONLY",
+  "WITH cte (id, parent) AS (SELECT id, parent FROM t WHERE parent IS NULL UNION ALL "
+    "SELECT t.id, t.parent FROM t JOIN cte ON t.parent = cte.id) SELECT * FROM cte",
+  "SELECT a INTO #tmp FROM t; SELECT * FROM #tmp UNION SELECT * FROM #tmp EXCEPT SELECT 1 INTERSECT SELECT 2",
+  "INSERT INTO dbo.t (a, b, c) VALUES (1, N'b', 0x01), (@a, @b, NULL)",
+  "INSERT INTO t SELECT a, b FROM u WHERE c = 1",
+  "INSERT INTO t (a) OUTPUT inserted.a INTO @out EXEC dbo.p",
+  "UPDATE t SET a = a + 1, b = @b OUTPUT deleted.a, inserted.a FROM t INNER JOIN u ON t.id = u.id WHERE u.c = 1",
+  "DELETE TOP (100) FROM t WHERE a < GETDATE()",
+  "DECLARE @i INT = 0, @s NVARCHAR(MAX), @d DATETIME2(7), @m MONEY, @n DECIMAL(18, 4); "
+    "SET @i = @i + 1; SELECT @s = name FROM sys.objects WHERE object_id = OBJECT_ID(N'dbo.t')",
+  "DECLARE @t TABLE (id INT PRIMARY KEY, name VARCHAR(100) NOT NULL DEFAULT '')",
+  "IF @a IS NULL BEGIN PRINT 'null'; RETURN; END ELSE IF @a > 1 SET @a = 1 ELSE BEGIN SET @a = 0 END",
+  "WHILE @i < 10 BEGIN SET @i += 1; IF @i = 5 CONTINUE; IF @i = 8 BREAK; END",
+  "BEGIN TRY BEGIN TRANSACTION; UPDATE t SET a = 1; COMMIT TRANSACTION; END TRY "
+    "BEGIN CATCH IF @@TRANCOUNT > 0 ROLLBACK TRANSACTION; "
+    "SELECT ERROR_NUMBER(), ERROR_MESSAGE(); THROW 50000, 'error', 1; END CATCH",
+  "BEGIN TRAN t1; SAVE TRANSACTION s1; ROLLBACK TRAN s1; COMMIT",
+  "RAISERROR('message %s %d', 16, 1, N'arg', 5) WITH NOWAIT",
+  "EXEC dbo.p @a = 1, @b = N'x', @c = @c OUTPUT",
+  "EXECUTE sp_executesql N'SELECT * FROM t WHERE a = @a', N'@a INT', @a = 1",
+  "EXEC ('SELECT 1')",
+  "DECLARE c CURSOR LOCAL FAST_FORWARD FOR SELECT a FROM t; OPEN c; FETCH NEXT FROM c INTO @a; "
+    "WHILE @@FETCH_STATUS = 0 FETCH NEXT FROM c INTO @a; CLOSE c; DEALLOCATE c",
+  "SET NOCOUNT ON; SET XACT_ABORT ON; SET TRANSACTION ISOLATION LEVEL READ COMMITTED; "
+    "SET QUOTED_IDENTIFIER ON; SET ANSI_NULLS ON; SET TEXTSIZE 2147483647; SET DATEFIRST 7",
+  "USE master",
+  "CREATE TABLE dbo.t (id INT IDENTITY(1, 1) NOT NULL PRIMARY KEY, name NVARCHAR(100) NULL, "
+    "amount DECIMAL(18, 2) DEFAULT 0, created DATETIME NOT NULL DEFAULT GETDATE(), "
+    "CONSTRAINT fk_t FOREIGN KEY (id) REFERENCES u(id))",
+  "ALTER TABLE t ADD c INT NULL",
+  "CREATE INDEX ix_t ON t (a, b) INCLUDE (c)",
+  "DROP TABLE IF EXISTS t",
+  "CREATE PROCEDURE dbo.p @a INT, @b NVARCHAR(10) = NULL, @c INT OUTPUT AS BEGIN "
+    "SET NOCOUNT ON; SELECT @c = COUNT(*) FROM t WHERE a = @a; RETURN 0; END",
+  "CREATE FUNCTION dbo.f (@a INT) RETURNS INT AS BEGIN RETURN @a + 1; END",
+  "CREATE FUNCTION dbo.tf (@a INT) RETURNS TABLE AS RETURN (SELECT * FROM t WHERE a = @a)",
+  "CREATE VIEW dbo.v AS SELECT a, b FROM t",
+  "CREATE TRIGGER tr ON t AFTER INSERT AS BEGIN UPDATE t SET b = 1 FROM inserted i WHERE t.id = i.id END",
+  "SELECT * FROM t FOR JSON PATH",
+  "SELECT * FROM t FOR XML PATH('row')",
+  "SELECT DATEADD(day, 1, GETDATE()), DATEDIFF(second, @a, @b), DATEPART(year, @d), "
+    "LEN(@s), SUBSTRING(@s, 1, 2), CHARINDEX('a', @s), REPLACE(@s, 'a', 'b'), UPPER(LTRIM(RTRIM(@s)))",
+  NULL
+};
+
+static int antlr_warmup_statements = 0;
+static bool antlr_warmup_done = false;
+
+/*
+ * Split a script into batches.  Batches are separated by lines consisting of
+ * GO only, like in sqlcmd scripts.  Returns a list of palloc'd strings.
+ */
+static List *
+split_go_batches(const char *script)
+{
+  List *batches = NIL;
+  StringInfoData batch;
+  const char *line = script;
+
+  initStringInfo(&batch);
+  while (*line != '\0')
+  {
+    const char *next = strchr(line, '\n');
+    int len = next ? next - line + 1 : strlen(line);
+
+    if (pg_strncasecmp(line, "GO", 2) == 0 && strspn(line + 2, " \t\r\n") >= len - 2)
+    {
+      if (batch.len > 0)
+        batches = lappend(batches, pstrdup(batch.data));
+      resetStringInfo(&batch);
+    }
+    else
+      appendBinaryStringInfo(&batch, line, len);
+
+    line += len;
+  }
+  if (batch.len > 0)
+    batches = lappend(batches, pstrdup(batch.data));
+
+  pfree(batch.data);
+  return batches;
+}
+
+/*
+ * Parse every batch of a warm-up corpus file.
+ */
+static void
+warmup_antlr_from_file(const char *filename)
+{
+  FILE *file;
+  StringInfoData script;
+  char buf[8192];
+  size_t nread;
+  ListCell *lc;
+
+  file = AllocateFile(filename, "r");
+  if (file == NULL)
+  {
+    ereport(WARNING,
+        (errcode_for_file_access(),
+         errmsg("could not open ANTLR warm-up corpus \"%s\": %m", filename)));
+    return;
+  }
+
+  initStringInfo(&script);
+  while ((nread = fread(buf, 1, sizeof(buf), file)) > 0)
+    appendBinaryStringInfo(&script, buf, nread);
+  FreeFile(file);
+
+  foreach(lc, split_go_batches(script.data))
+  {
+    if (antlr_warmup_parse((char *) lfirst(lc)))
+      antlr_warmup_statements++;
+  }
+
+  pfree(script.data);
+}
+
+/*
+ * Warm up the ANTLR DFA caches.  Called before every parse, only the first
+ * call of a backend does the work.  babelfishpg_tsql cannot be preloaded, so
+ * the caches can't be filled once in the postmaster and inherited instead.
+ */
+void
+pltsql_warmup_antlr_dfa_cache(void)
+{
+  int i;
+
+  if (antlr_warmup_done || !pltsql_enable_antlr_warmup)
+    return;
+  /* don't retry on every parse if the warm-up fails */
+  antlr_warmup_done = true;
+
+  for (i = 0; antlr_warmup_corpus[i] != NULL; i++)
+  {
+    if (antlr_warmup_parse(antlr_warmup_corpus[i]))
+      antlr_warmup_statements++;
+  }
+
+  if (pltsql_antlr_warmup_corpus && pltsql_antlr_warmup_corpus[0] != '\0')
+    warmup_antlr_from_file(pltsql_antlr_warmup_corpus);
+
+  elog(DEBUG1, "ANTLR DFA caches warmed up with %d statements", antlr_warmup_statements);
+}
+
+PG_FUNCTION_INFO_V1(babelfish_antlr_dfa_cache_stats);
+
+/*
+ * Report the sizes of the ANTLR DFA and prediction context caches of the
+ * current backend.
+ */
+Datum
+babelfish_antlr_dfa_cache_stats(PG_FUNCTION_ARGS)
+{
+  TupleDesc tupdesc;
+  ANTLR_dfa_cache_stats stats;
+  Datum values[5];
+  bool nulls[5] = {false, false, false, false, false};
+
+  if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+    elog(ERROR, "return type must be a row type");
+
+  antlr_get_dfa_cache_stats(&stats);
+
+  values[0] = Int64GetDatum((int64) stats.lexer_dfa_states);
+  values[1] = Int64GetDatum((int64) stats.parser_decisions);
+  values[2] = Int64GetDatum((int64) stats.parser_dfa_states);
+  values[3] = Int64GetDatum((int64) stats.prediction_contexts);
+  values[4] = Int64GetDatum((int64) antlr_warmup_statements);
+
+  PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+PG_FUNCTION_INFO_V1(babelfish_antlr_parse_benchmark);
+
+/*
+ * Compile every batch of the given T-SQL script (batches separated by GO)
+ * repeatedly and report the compile time per KB of source text.  Compiled
+ * functions are thrown away right after each compilation, so the batch cache
+ * never serves them.
+ */
+Datum
+babelfish_antlr_parse_benchmark(PG_FUNCTION_ARGS)
+{
+  char *script = text_to_cstring(PG_GETARG_TEXT_PP(0));
+  int iterations = PG_GETARG_INT32(1);
+  List *batches = split_go_batches(script);
+  int64 bytes = 0;
+  int saved_dialect = sql_dialect;
+  instr_time total;
+  TupleDesc tupdesc;
+  ListCell *lc;
+  Datum values[5];
+  bool nulls[5] = {false, false, false, false, false};
+  int rc;
+  int i;
+
+  if (iterations <= 0)
+    ereport(ERROR,
+        (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+         errmsg("number of iterations must be greater than zero")));
+
+  if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+    elog(ERROR, "return type must be a row type");
+
+  foreach(lc, batches)
+    bytes += strlen((char *) lfirst(lc));
+
+  if ((rc = SPI_connect()) != SPI_OK_CONNECT)
+    elog(ERROR, "SPI_connect failed: %s", SPI_result_code_string(rc));
+
+  INSTR_TIME_SET_ZERO(total);
+  sql_dialect = SQL_DIALECT_TSQL;
+  PG_TRY();
+  {
+    for (i = 0; i < iterations; i++)
+    {
+      foreach(lc, batches)
+      {
+        PLtsql_function *func;
+        instr_time start;
+        instr_time end;
+
+        CHECK_FOR_INTERRUPTS();
+
+        INSTR_TIME_SET_CURRENT(start);
+        func = pltsql_compile_inline((char *) lfirst(lc), NULL);
+        INSTR_TIME_SET_CURRENT(end);
+        INSTR_TIME_ACCUM_DIFF(total, end, start);
+
+        pltsql_free_function_memory(func);
+      }
+    }
+  }
+  PG_FINALLY();
+  {
+    sql_dialect = saved_dialect;
+  }
+  PG_END_TRY();
+
+  SPI_finish();
+
+  values[0] = Int64GetDatum(bytes);
+  values[1] = Int32GetDatum(list_length(batches));
+  values[2] = Int32GetDatum(iterations);
+  values[3] = Int64GetDatum((int64) INSTR_TIME_GET_MICROSEC(total));
+  values[4] = Float8GetDatum(bytes > 0 ?
+                 INSTR_TIME_GET_MICROSEC(total) / (double) iterations / (bytes / 1024.0) : 0.0);
+
+  PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
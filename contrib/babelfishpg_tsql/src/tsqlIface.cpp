@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <chrono>
 #include <functional>
 #include <iostream>
 #include <strstream>
@@ -32,6 +33,7 @@ extern "C" {
 #else
 #include "pltsql.h"
 #include "pltsql-2.h"
+#include "pltsql_instr.h"
 #include "pl_explain.h"
 #include "session.h"
 
@@ -69,6 +71,9 @@ extern "C"
 
 	extern bool pltsql_dump_antlr_query_graph;
 	extern bool pltsql_enable_antlr_detailed_log;
+	extern bool pltsql_enable_sll_parse_mode;
+
+	ANTLR_parse_stats antlr_parse_stats = {0, 0, 0, 0, 0};
 
 	extern bool pltsql_enable_tsql_information_schema;
 
@@ -2262,6 +2267,59 @@ public:
 	}
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// First pass walker
+//
+// Runs the unsupported feature checks node by node during the tsqlMutator
+// walk, so that the parse tree is traversed once for both. Errors found by
+// the checks are deferred until the walk completes, as instrumentation
+// is published for every unsupported feature in the batch.
+////////////////////////////////////////////////////////////////////////////////
+
+class tsqlFirstPassWalker : public antlr4::tree::ParseTreeWalker
+{
+public:
+	explicit tsqlFirstPassWalker(TsqlUnsupportedFeatureHandler *h)
+		: handler(h)
+	{
+	}
+
+protected:
+	void enterRule(antlr4::tree::ParseTreeListener *listener, antlr4::tree::ParseTree *r) const override
+	{
+		handler->visitNode(static_cast<antlr4::ParserRuleContext *>(r));
+
+		try
+		{
+			antlr4::tree::ParseTreeWalker::enterRule(listener, r);
+		}
+		catch (PGErrorWrapperException &)
+		{
+			/* unsupported feature error takes precedence, as if it was checked before mutation */
+			handler->raisePendingError();
+			throw;
+		}
+	}
+
+	void exitRule(antlr4::tree::ParseTreeListener *listener, antlr4::tree::ParseTree *r) const override
+	{
+		try
+		{
+			antlr4::tree::ParseTreeWalker::exitRule(listener, r);
+		}
+		catch (PGErrorWrapperException &)
+		{
+			handler->raisePendingError();
+			throw;
+		}
+
+		handler->leaveNode(static_cast<antlr4::ParserRuleContext *>(r));
+	}
+
+private:
+	TsqlUnsupportedFeatureHandler *handler;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // Error listener
 ////////////////////////////////////////////////////////////////////////////////
@@ -2424,6 +2482,171 @@ static void process_select_statement(
 	}
 }
 
+static tree::ParseTree *
+parseTsqlTree(TSqlParser &parser)
+{
+	/*
+	 * The sematnic of "RETURN SELECT ..." depends on whether it is used in Inlined Table Value Function or not.
+	 * In ITVF, they should be interpeted as return a result tuple of SELECT statement.
+	 * but in the other case (i.e. procedure or SQL batch), it should be interpreted as two separate statements like "RETURN; SELECT ..."
+	 *
+	 * Currently, we have only proc_body in input so accessing pltsql_curr_compile to check this is a body of ITVF or not.
+	 * If if it is ITVF, we parsed it with func_body_return_select_body grammar.
+	 */
+	if (pltsql_curr_compile && pltsql_curr_compile->is_itvf) /* special path to itvf */
+		return parser.func_body_return_select_body();
+	else /* normal path */
+		return parser.tsql_file();
+}
+
+static inline uint64
+elapsedMicroseconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * Parse the token stream, trying the cheaper SLL prediction mode first.
+ *
+ * SLL prediction does not need full-context lookahead, so it is much faster on
+ * long inputs, but it may fail on input that is valid under full LL. SLL never
+ * accepts invalid input, so on the first error we bail out, rewind the token
+ * stream and parse again in LL mode with the regular error listener. That way
+ * syntax errors are always reported by the LL parse.
+ */
+static tree::ParseTree *
+parseWithFallback(TSqlParser &parser, MyParserErrorListener &errorListener)
+{
+	auto interpreter = parser.getInterpreter<atn::ParserATNSimulator>();
+	tree::ParseTree *tree = nullptr;
+	auto start = std::chrono::steady_clock::now();
+
+	if (pltsql_enable_sll_parse_mode)
+	{
+		antlr_parse_stats.sll_parses++;
+
+		parser.removeErrorListeners();
+		parser.setErrorHandler(std::make_shared<BailErrorStrategy>());
+		interpreter->setPredictionMode(atn::PredictionMode::SLL);
+
+		try
+		{
+			tree = parseTsqlTree(parser);
+		}
+		catch (ParseCancellationException &)
+		{
+			tree = nullptr;
+		}
+
+		antlr_parse_stats.sll_time_us += elapsedMicroseconds(start);
+
+		if (tree)
+			return tree;
+
+		antlr_parse_stats.ll_fallbacks++;
+		TSQLInstrumentation(INSTR_TSQL_ANTLR_LL_FALLBACK);
+
+		/* rewind the token stream and reset the parser state for the second stage */
+		parser.reset();
+		CurrentLineNumber = 1;
+		start = std::chrono::steady_clock::now();
+	}
+
+	antlr_parse_stats.ll_parses++;
+
+	parser.removeErrorListeners();
+	parser.addErrorListener(&errorListener);
+	parser.setErrorHandler(std::make_shared<DefaultErrorStrategy>());
+	interpreter->setPredictionMode(atn::PredictionMode::LL);
+
+	try
+	{
+		tree = parseTsqlTree(parser);
+	}
+	catch (...)
+	{
+		antlr_parse_stats.ll_time_us += elapsedMicroseconds(start);
+		throw;
+	}
+
+	antlr_parse_stats.ll_time_us += elapsedMicroseconds(start);
+	return tree;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// DFA cache warm-up and statistics
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The lexer and parser DFA caches and the prediction context cache are static
+ * members of the generated TSqlLexer/TSqlParser classes, so they are shared by
+ * every parser instance in the process. Parsing a corpus of statements before
+ * the first real parse of a backend fills them once for the whole session.
+ *
+ * Only the parse step is run here. The mutator and builder passes need a
+ * compile context, and they do not touch the caches anyway.
+ */
+extern "C" bool
+antlr_warmup_parse(const char *sourceText)
+{
+	try
+	{
+		ANTLRInputStream sourceStream(sourceText);
+		TSqlLexer lexer(&sourceStream);
+		CommonTokenStream tokens(&lexer);
+		TSqlParser parser(&tokens);
+		auto interpreter = parser.getInterpreter<atn::ParserATNSimulator>();
+
+		lexer.removeErrorListeners();
+		parser.removeErrorListeners();
+
+		/* same two stages as parseWithFallback(), without reporting errors */
+		parser.setErrorHandler(std::make_shared<BailErrorStrategy>());
+		interpreter->setPredictionMode(atn::PredictionMode::SLL);
+		try
+		{
+			parser.tsql_file();
+			return true;
+		}
+		catch (ParseCancellationException &)
+		{
+		}
+
+		parser.reset();
+		parser.setErrorHandler(std::make_shared<DefaultErrorStrategy>());
+		interpreter->setPredictionMode(atn::PredictionMode::LL);
+		parser.tsql_file();
+
+		return parser.getNumberOfSyntaxErrors() == 0;
+	}
+	catch (...) /* never let an exception escape to the C layer */
+	{
+		return false;
+	}
+}
+
+extern "C" void
+antlr_get_dfa_cache_stats(ANTLR_dfa_cache_stats *stats)
+{
+	ANTLRInputStream sourceStream("");
+	TSqlLexer lexer(&sourceStream);
+	CommonTokenStream tokens(&lexer);
+	TSqlParser parser(&tokens);
+	auto lexerInterpreter = lexer.getInterpreter<atn::LexerATNSimulator>();
+	auto parserInterpreter = parser.getInterpreter<atn::ParserATNSimulator>();
+
+	stats->lexer_dfa_states = 0;
+	for (size_t mode = 0; mode < lexer.getModeNames().size(); ++mode)
+		stats->lexer_dfa_states += lexerInterpreter->getDFA(mode).states.size();
+
+	stats->parser_decisions = parserInterpreter->decisionToDFA.size();
+	stats->parser_dfa_states = 0;
+	for (auto &dfa : parserInterpreter->decisionToDFA)
+		stats->parser_dfa_states += dfa.states.size();
+
+	stats->prediction_contexts = parserInterpreter->getSharedContextCache().size();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Entry point for ANTLR parser
 ////////////////////////////////////////////////////////////////////////////////
@@ -2440,6 +2663,8 @@ antlr_parser_cpp(const char *sourceText)
 		return result;
 	}
 
+	pltsql_warmup_antlr_dfa_cache();
+
 	if (pltsql_enable_antlr_detailed_log)
 	{
 		std::string sep(120, '=');
@@ -2458,50 +2683,32 @@ antlr_parser_cpp(const char *sourceText)
 
         TSqlParser parser(&tokens);
 
-	parser.removeErrorListeners();
-	parser.addErrorListener(&errorListner);
-
 	/* initialize line number. Correspoding to location_lineno_init() in non-antlr path */
 	CurrentLineNumber = 1;
 
 	try
 	{
 		// TSqlParser::Tsql_fileContext *tree = parser.tsql_file();
-		tree::ParseTree *tree = nullptr;
-
-		/*
-		 * The sematnic of "RETURN SELECT ..." depends on whether it is used in Inlined Table Value Function or not.
-		 * In ITVF, they should be interpeted as return a result tuple of SELECT statement.
-		 * but in the other case (i.e. procedure or SQL batch), it should be interpreted as two separate statements like "RETURN; SELECT ..."
-		 *
-		 * Currently, we have only proc_body in input so accessing pltsql_curr_compile to check this is a body of ITVF or not.
-		 * If if it is ITVF, we parsed it with func_body_return_select_body grammar.
-		 */
-		if (pltsql_curr_compile && pltsql_curr_compile->is_itvf) /* special path to itvf */
-			tree = parser.func_body_return_select_body();
-		else /* normal path */
-			tree = parser.tsql_file();
+		tree::ParseTree *tree = parseWithFallback(parser, errorListner);
 
 		if (pltsql_enable_antlr_detailed_log)
 			std::cout << tree->toStringTree(&parser, true) << std::endl;
 
-		/* visit all the node and publish instrumentation for unsupported feature */
+		/*
+		 * Publish instrumentation for unsupported features while mutating the
+		 * tree, then throw an error for the first unsupported feature met.
+		 */
 		std::unique_ptr<TsqlUnsupportedFeatureHandler> unsupportedFeatureHandler = TsqlUnsupportedFeatureHandler::create();
 		unsupportedFeatureHandler->setPublishInstr(true);
-		unsupportedFeatureHandler->visit(tree);
-
-		if (unsupportedFeatureHandler->hasUnsupportedFeature())
-		{
-			/* revisit the parsed tree and throw an error when we meet the first unsupported feature */
-			unsupportedFeatureHandler->setPublishInstr(false);
-			unsupportedFeatureHandler->setThrowError(true);
-			unsupportedFeatureHandler->visit(tree);
-		}
+		unsupportedFeatureHandler->setThrowError(true);
+		unsupportedFeatureHandler->setDeferError(true);
 
 		std::unique_ptr<tsqlMutator> mutator = std::make_unique<tsqlMutator>(sourceStream);
-		antlr4::tree::ParseTreeWalker firstPass;
+		tsqlFirstPassWalker firstPass(unsupportedFeatureHandler.get());
 		firstPass.walk(mutator.get(), tree);
 
+		unsupportedFeatureHandler->raisePendingError();
+
 		// for batch-level statement (i.e. create procedure), we don't need to create actual PLtsql_stmt* by tsqlBuilder.
 		// We can just relay the query string to backend parser via one PLtsql_stmt_execsql.
 		TSqlParser::Tsql_fileContext *tsql_file = dynamic_cast<TSqlParser::Tsql_fileContext *>(tree);
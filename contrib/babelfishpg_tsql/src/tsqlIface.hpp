@@ -17,6 +17,12 @@ public:
 		virtual bool hasUnsupportedFeature() const = 0;
 		virtual void setPublishInstr(bool) = 0;
 		virtual void setThrowError(bool) = 0;
+		virtual void setDeferError(bool) = 0;
+
+		/* check one node without visiting its children, for use in a ParseTreeWalker */
+		virtual void visitNode(antlr4::ParserRuleContext *ctx) = 0;
+		virtual void leaveNode(antlr4::ParserRuleContext *ctx) = 0;
+		virtual void raisePendingError() = 0;
 
 		//void walk(antlr4::tree::ParseTree *tree);
 };
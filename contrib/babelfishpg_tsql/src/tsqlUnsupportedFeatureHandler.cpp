@@ -80,12 +80,24 @@ public:
 		bool hasUnsupportedFeature() const override { return count > 0; }
 		void setPublishInstr(bool b) override { publish_instr = b; }
 		void setThrowError(bool b) override{ throw_error = b; }
+		void setDeferError(bool b) override { defer_error = b; }
+
+		void visitNode(antlr4::ParserRuleContext *ctx) override;
+		void leaveNode(antlr4::ParserRuleContext *ctx) override;
+		void raisePendingError() override;
+
+		antlrcpp::Any visitChildren(antlr4::tree::ParseTree *node) override;
 
 protected:
 		bool publish_instr = false;
 		bool throw_error = false;
+		bool defer_error = false;
+		bool single_node = false; /* visit the given node only, the caller walks the tree */
 		int count = 0; /* record count to skip unnecessary visiting */
 		bool is_inside_trigger = false;
+		std::unique_ptr<PGErrorWrapperException> pending_error; /* first error met while errors are deferred */
+
+		void report(PGErrorWrapperException &&e);
 
 		/* handler */
 		void handle(PgTsqlInstrMetricType tm_type, antlr4::tree::TerminalNode *node, escape_hatch_t* eh);
@@ -238,6 +250,47 @@ std::unique_ptr<TsqlUnsupportedFeatureHandler> TsqlUnsupportedFeatureHandler::cr
 	return std::make_unique<TsqlUnsupportedFeatureHandlerImpl>();
 }
 
+void TsqlUnsupportedFeatureHandlerImpl::visitNode(antlr4::ParserRuleContext *ctx)
+{
+	single_node = true;
+	ctx->accept(this);
+	single_node = false;
+}
+
+void TsqlUnsupportedFeatureHandlerImpl::leaveNode(antlr4::ParserRuleContext *ctx)
+{
+	/* in single node mode, visitCreate_or_alter_trigger() can't reset the flag after visiting the children */
+	if (dynamic_cast<TSqlParser::Create_or_alter_triggerContext *>(ctx))
+		is_inside_trigger = false;
+}
+
+antlrcpp::Any TsqlUnsupportedFeatureHandlerImpl::visitChildren(antlr4::tree::ParseTree *node)
+{
+	if (single_node)
+		return defaultResult();
+	return TSqlParserBaseVisitor::visitChildren(node);
+}
+
+void TsqlUnsupportedFeatureHandlerImpl::report(PGErrorWrapperException &&e)
+{
+	if (!defer_error)
+		throw e;
+
+	/* keep the first error only. it is the one the second visit used to throw */
+	if (!pending_error)
+		pending_error = std::make_unique<PGErrorWrapperException>(std::move(e));
+}
+
+void TsqlUnsupportedFeatureHandlerImpl::raisePendingError()
+{
+	/*
+	 * An error is raised only if an unsupported feature was found, same as
+	 * the former revisit of the tree did.
+	 */
+	if (pending_error && count > 0)
+		throw *pending_error;
+}
+
 void TsqlUnsupportedFeatureHandlerImpl::handle(PgTsqlInstrMetricType tm_type, antlr4::tree::TerminalNode *node, escape_hatch_t* eh)
 {
 	handle(tm_type, (node ? node->getText().c_str() : ""), eh, getLineAndPos(node));
@@ -255,9 +308,9 @@ void TsqlUnsupportedFeatureHandlerImpl::handle(PgTsqlInstrMetricType tm_type, co
 	if (throw_error && (!eh || (*eh->val) != EH_IGNORE)) // if escape hatch is given, check the current value is 'ignore'
 	{
 		if (eh)
-			throw PGErrorWrapperException(ERROR, ERRCODE_FEATURE_NOT_SUPPORTED, format_errmsg("\'%s\' is not currently supported in Babelfish. please use babelfishpg_tsql.%s to ignore", featureName, eh->name), line_and_pos);
+			report(PGErrorWrapperException(ERROR, ERRCODE_FEATURE_NOT_SUPPORTED, format_errmsg("\'%s\' is not currently supported in Babelfish. please use babelfishpg_tsql.%s to ignore", featureName, eh->name), line_and_pos));
 		else
-			throw PGErrorWrapperException(ERROR, ERRCODE_FEATURE_NOT_SUPPORTED, format_errmsg("\'%s\' is not currently supported in Babelfish", featureName), line_and_pos);
+			report(PGErrorWrapperException(ERROR, ERRCODE_FEATURE_NOT_SUPPORTED, format_errmsg("\'%s\' is not currently supported in Babelfish", featureName), line_and_pos));
 	}
 }
 
@@ -287,10 +340,9 @@ antlrcpp::Any TsqlUnsupportedFeatureHandlerImpl::visitCreate_or_alter_function(T
 		if (!found)
 		{
 			/* SCHEMABINDING is different from other case because it should throw an error when it is *NOT* given. handle an error manually */
+			++count;
 			if (throw_error)
-				throw PGErrorWrapperException(ERROR, ERRCODE_FEATURE_NOT_SUPPORTED, format_errmsg("\'SCHEMABINDING\' option should be given to create a %s in Babelfish", "function"), getLineAndPos(ctx));
-			else
-				++count;
+				report(PGErrorWrapperException(ERROR, ERRCODE_FEATURE_NOT_SUPPORTED, format_errmsg("\'SCHEMABINDING\' option should be given to create a %s in Babelfish", "function"), getLineAndPos(ctx)));
 		}
 	}
 
@@ -328,10 +380,9 @@ antlrcpp::Any TsqlUnsupportedFeatureHandlerImpl::visitCreate_or_alter_procedure(
 		if (!found)
 		{
 			/* SCHEMABINDING is different from other case because it should throw an error when it is *NOT* given. handle an error manually */
+			++count;
 			if (throw_error)
-				throw PGErrorWrapperException(ERROR, ERRCODE_FEATURE_NOT_SUPPORTED, format_errmsg("\'SCHEMABINDING\' option should be given to create a %s in Babelfish", "procedure"), getLineAndPos(ctx));
-			else
-				++count;
+				report(PGErrorWrapperException(ERROR, ERRCODE_FEATURE_NOT_SUPPORTED, format_errmsg("\'SCHEMABINDING\' option should be given to create a %s in Babelfish", "procedure"), getLineAndPos(ctx)));
 		}
 	}
 
@@ -384,10 +435,9 @@ antlrcpp::Any TsqlUnsupportedFeatureHandlerImpl::visitCreate_or_alter_trigger(TS
 		if (!found)
 		{
 			/* SCHEMABINDING is different from other case because it should throw an error when it is *NOT* given. handle an error manually */
+			++count;
 			if (throw_error)
-				throw PGErrorWrapperException(ERROR, ERRCODE_FEATURE_NOT_SUPPORTED, format_errmsg("\'SCHEMABINDING\' option should be given to create a %s in Babelfish", "trigger"), getLineAndPos(ctx));
-			else
-				++count;
+				report(PGErrorWrapperException(ERROR, ERRCODE_FEATURE_NOT_SUPPORTED, format_errmsg("\'SCHEMABINDING\' option should be given to create a %s in Babelfish", "trigger"), getLineAndPos(ctx)));
 		}
 	}
 
@@ -433,7 +483,8 @@ antlrcpp::Any TsqlUnsupportedFeatureHandlerImpl::visitCreate_or_alter_trigger(TS
 
 	is_inside_trigger = true;
 	auto ret = visitChildren(ctx);
-	is_inside_trigger = false;
+	if (!single_node)
+		is_inside_trigger = false;
 	return ret;
 }
 
@@ -453,10 +504,9 @@ antlrcpp::Any TsqlUnsupportedFeatureHandlerImpl::visitCreate_or_alter_view(TSqlP
 		if (!found)
 		{
 			/* SCHEMABINDING is different from other case because it should throw an error when it is *NOT* given. handle an error manually */
+			++count;
 			if (throw_error)
-				throw PGErrorWrapperException(ERROR, ERRCODE_FEATURE_NOT_SUPPORTED, format_errmsg("\'SCHEMABINDING\' option should be given to create a %s in Babelfish", "view"), getLineAndPos(ctx));
-			else
-				++count;
+				report(PGErrorWrapperException(ERROR, ERRCODE_FEATURE_NOT_SUPPORTED, format_errmsg("\'SCHEMABINDING\' option should be given to create a %s in Babelfish", "view"), getLineAndPos(ctx)));
 		}
 	}
 
@@ -620,7 +670,7 @@ antlrcpp::Any TsqlUnsupportedFeatureHandlerImpl::visitIndex_option(TSqlParser::I
 		else
 		{
 			if (throw_error)
-				throw PGErrorWrapperException(ERROR, ERRCODE_SYNTAX_ERROR, format_errmsg("unknown index option: %s", id_str.c_str()), getLineAndPos(ctx->id()[0]));
+				report(PGErrorWrapperException(ERROR, ERRCODE_SYNTAX_ERROR, format_errmsg("unknown index option: %s", id_str.c_str()), getLineAndPos(ctx->id()[0])));
 		}
 	}
 
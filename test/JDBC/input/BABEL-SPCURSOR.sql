@@ -225,6 +225,27 @@ exec sp_cursorclose @p2;
 exec sp_cursorunprepare @p1;
 go
 
+-- sp_cursor REFRESH replays the last fetch and leaves the cursor where it was
+DECLARE @cursor_handle int;
+EXEC sp_cursoropen @cursor_handle OUTPUT, 'select i, c from babel_cursor_t1', 2, 1;
+EXEC sp_cursorfetch @cursor_handle, 2, 0, 2;
+EXEC sp_cursor @cursor_handle, 40, 1, '';
+EXEC sp_cursorfetch @cursor_handle, 2, 0, 1;
+EXEC sp_cursorfetch @cursor_handle, 4, 0, 2;
+EXEC sp_cursor @cursor_handle, 40, 1, '';
+EXEC sp_cursorfetch @cursor_handle, 2, 0, 1;
+EXEC sp_cursorclose @cursor_handle;
+GO
+
+-- sp_cursor REFRESH on a forward-only cursor
+DECLARE @cursor_handle int;
+EXEC sp_cursoropen @cursor_handle OUTPUT, 'select i, c from babel_cursor_t1', 4, 1;
+EXEC sp_cursorfetch @cursor_handle, 2, 0, 2;
+EXEC sp_cursor @cursor_handle, 40, 1, '';
+EXEC sp_cursorfetch @cursor_handle, 2, 0, 1;
+EXEC sp_cursorclose @cursor_handle;
+GO
+
 DROP TABLE babel_cursor_t1
 DROP TABLE t1812
 GO
@@ -0,0 +1,16 @@
+-- the built-in corpus is parsed before the first batch of every session
+SELECT CASE WHEN warmup_statements > 0 AND parser_dfa_states > 0 AND lexer_dfa_states > 0
+	THEN 'ok' ELSE 'not warmed up' END AS warmup_state
+FROM sys.babelfish_antlr_dfa_cache_stats();
+go
+
+SELECT warmup_statements INTO #babel_dfa_warmup FROM sys.babelfish_antlr_dfa_cache_stats();
+go
+
+-- later batches use the warm caches, the warm-up does not run again
+SELECT CASE WHEN s.warmup_statements = w.warmup_statements THEN 'ok' ELSE 'warmed up again' END AS warmup_state
+FROM sys.babelfish_antlr_dfa_cache_stats() s, #babel_dfa_warmup w;
+go
+
+DROP TABLE #babel_dfa_warmup;
+go
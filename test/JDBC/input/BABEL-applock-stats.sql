@@ -0,0 +1,59 @@
+-- many resources can be locked at once, each one takes an entry in the shared table
+exec sp_getapplock @Resource = 'babel_applock_stats_1', @LockMode = 'Exclusive', @LockOwner = 'Session';
+exec sp_getapplock @Resource = 'babel_applock_stats_2', @LockMode = 'Exclusive', @LockOwner = 'Session';
+exec sp_getapplock @Resource = 'babel_applock_stats_3', @LockMode = 'Shared', @LockOwner = 'Session';
+GO
+
+SELECT CASE WHEN entries >= 3 AND entries <= capacity THEN 'ok' ELSE 'wrong' END AS occupancy, partitions
+FROM sys.babelfish_applock_stats();
+GO
+
+SELECT APPLOCK_MODE('dbo', 'babel_applock_stats_2', 'Session');
+GO
+
+exec sp_releaseapplock @Resource = 'babel_applock_stats_1', @LockOwner = 'Session';
+exec sp_releaseapplock @Resource = 'babel_applock_stats_2', @LockOwner = 'Session';
+exec sp_releaseapplock @Resource = 'babel_applock_stats_3', @LockOwner = 'Session';
+GO
+
+SELECT APPLOCK_MODE('dbo', 'babel_applock_stats_2', 'Session');
+GO
+
+-- the table grows on demand, well past the 32 entries of the old fixed table
+DECLARE @i int = 1, @rc int, @failed int = 0, @res varchar(64);
+WHILE @i <= 200
+BEGIN
+    SET @res = 'babel_applock_many_' + CAST(@i AS varchar(10));
+    EXEC @rc = sp_getapplock @Resource = @res, @LockMode = 'Exclusive', @LockOwner = 'Session';
+    IF @rc < 0
+        SET @failed = @failed + 1;
+    SET @i = @i + 1;
+END
+SELECT @failed AS failed;
+GO
+
+SELECT capacity, CASE WHEN entries >= 200 THEN 'ok' ELSE 'wrong' END AS occupancy
+FROM sys.babelfish_applock_stats();
+GO
+
+SELECT APPLOCK_MODE('dbo', 'babel_applock_many_1', 'Session'), APPLOCK_MODE('dbo', 'babel_applock_many_200', 'Session');
+GO
+
+DECLARE @i int = 1, @rc int, @failed int = 0, @res varchar(64);
+WHILE @i <= 200
+BEGIN
+    SET @res = 'babel_applock_many_' + CAST(@i AS varchar(10));
+    EXEC @rc = sp_releaseapplock @Resource = @res, @LockOwner = 'Session';
+    IF @rc < 0
+        SET @failed = @failed + 1;
+    SET @i = @i + 1;
+END
+SELECT @failed AS failed;
+GO
+
+SELECT CASE WHEN entries < 200 THEN 'ok' ELSE 'wrong' END AS occupancy
+FROM sys.babelfish_applock_stats();
+GO
+
+SELECT APPLOCK_MODE('dbo', 'babel_applock_many_200', 'Session');
+GO
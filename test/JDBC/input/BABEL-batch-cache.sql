@@ -0,0 +1,108 @@
+-- identical batches are served from the compiled batch cache
+CREATE TABLE babel_batch_cache_t1 (a INT);
+go
+
+INSERT INTO babel_batch_cache_t1 VALUES (1);
+go
+
+SELECT a FROM babel_batch_cache_t1;
+go
+
+SELECT a FROM babel_batch_cache_t1;
+go
+
+-- cached batch must pick up the new table definition
+DROP TABLE babel_batch_cache_t1;
+go
+
+CREATE TABLE babel_batch_cache_t1 (a VARCHAR(10));
+go
+
+INSERT INTO babel_batch_cache_t1 VALUES ('one');
+go
+
+SELECT a FROM babel_batch_cache_t1;
+go
+
+-- cached batch must see a recreated procedure
+CREATE PROCEDURE babel_batch_cache_p1 AS SELECT 1 AS v;
+go
+
+EXEC babel_batch_cache_p1;
+go
+
+DROP PROCEDURE babel_batch_cache_p1;
+go
+
+CREATE PROCEDURE babel_batch_cache_p1 AS SELECT 2 AS v;
+go
+
+EXEC babel_batch_cache_p1;
+go
+
+-- variables are reinitialized on every execution of a cached batch
+DECLARE @v INT; SET @v = ISNULL(@v, 0) + 1; SELECT @v;
+go
+
+DECLARE @v INT; SET @v = ISNULL(@v, 0) + 1; SELECT @v;
+go
+
+-- cache can be disabled per session
+SELECT set_config('babelfishpg_tsql.enable_batch_cache', 'off', false);
+go
+
+SELECT a FROM babel_batch_cache_t1;
+go
+
+SELECT set_config('babelfishpg_tsql.enable_batch_cache', 'on', false);
+go
+
+-- escape hatches are checked when the batch is compiled
+SELECT a FROM babel_batch_cache_t1 WITH (INDEX=i1);
+go
+
+SELECT set_config('babelfishpg_tsql.escape_hatch_table_hints', 'strict', false);
+go
+
+SELECT a FROM babel_batch_cache_t1 WITH (INDEX=i1);
+go
+
+SELECT set_config('babelfishpg_tsql.escape_hatch_table_hints', 'ignore', false);
+go
+
+SELECT a FROM babel_batch_cache_t1 WITH (INDEX=i1);
+go
+
+-- repeating a batch is counted as a hit, not a miss
+CREATE TABLE babel_batch_cache_stats_t (id INT IDENTITY, hits BIGINT, misses BIGINT);
+go
+
+SELECT a FROM babel_batch_cache_t1 WHERE a IS NOT NULL;
+go
+
+INSERT INTO babel_batch_cache_stats_t (hits, misses) SELECT hits, misses FROM sys.babelfish_batch_cache_stats();
+go
+
+SELECT a FROM babel_batch_cache_t1 WHERE a IS NOT NULL;
+go
+
+SELECT a FROM babel_batch_cache_t1 WHERE a IS NOT NULL;
+go
+
+INSERT INTO babel_batch_cache_stats_t (hits, misses) SELECT hits, misses FROM sys.babelfish_batch_cache_stats();
+go
+
+SELECT CASE WHEN a.hits > b.hits THEN 'ok' ELSE 'hits did not increase' END,
+       CASE WHEN a.misses = b.misses THEN 'ok' ELSE 'misses increased' END
+FROM babel_batch_cache_stats_t a, babel_batch_cache_stats_t b
+WHERE a.id = 2 AND b.id = 1;
+go
+
+DROP TABLE babel_batch_cache_stats_t;
+go
+
+DROP PROCEDURE babel_batch_cache_p1;
+go
+
+DROP TABLE babel_batch_cache_t1;
+go
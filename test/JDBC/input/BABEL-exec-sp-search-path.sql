@@ -0,0 +1,40 @@
+-- sp_ procedures of master can be called from another database, also from
+-- each other, and search_path is left as it was
+create procedure sp_babel_exec_path_inner as select db_name();
+go
+
+create procedure sp_babel_exec_path_outer as exec sp_babel_exec_path_inner;
+go
+
+create database babel_exec_path_db;
+go
+
+use babel_exec_path_db;
+go
+
+SELECT current_setting('search_path');
+go
+
+exec sp_babel_exec_path_inner;
+go
+
+exec sp_babel_exec_path_outer;
+go
+
+exec sp_babel_exec_path_outer;
+go
+
+SELECT current_setting('search_path');
+go
+
+use master;
+go
+
+drop database babel_exec_path_db;
+go
+
+drop procedure sp_babel_exec_path_outer;
+go
+
+drop procedure sp_babel_exec_path_inner;
+go
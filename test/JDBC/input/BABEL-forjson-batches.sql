@@ -0,0 +1,35 @@
+-- FOR JSON reads the query result in batches, check rows across batches
+create table babel_forjson_batches_d (n int);
+go
+
+insert into babel_forjson_batches_d values (0), (1), (2), (3), (4), (5), (6), (7), (8), (9);
+go
+
+create table babel_forjson_batches_t (id int);
+go
+
+insert into babel_forjson_batches_t select a.n + 10 * b.n + 100 * c.n + 1
+	from babel_forjson_batches_d a, babel_forjson_batches_d b, babel_forjson_batches_d c;
+go
+
+insert into babel_forjson_batches_t select id + 1000 from babel_forjson_batches_t where id <= 500;
+go
+
+create view babel_forjson_batches_v as
+select (select id from babel_forjson_batches_t order by id for json path) as j;
+go
+
+select len(j), left(j, 19), right(j, 24) from babel_forjson_batches_v;
+go
+
+select charindex('{"id":1000},{"id":1001}', j) from babel_forjson_batches_v;
+go
+
+drop view babel_forjson_batches_v;
+go
+
+drop table babel_forjson_batches_t;
+go
+
+drop table babel_forjson_batches_d;
+go
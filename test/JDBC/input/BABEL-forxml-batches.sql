@@ -0,0 +1,89 @@
+-- FOR XML reads the query result in batches of 1000 rows, check rows across
+-- batches and a result that ends exactly at a batch boundary
+create table babel_forxml_batches_d (n int);
+go
+
+insert into babel_forxml_batches_d values (0), (1), (2), (3), (4), (5), (6), (7), (8), (9);
+go
+
+create table babel_forxml_batches_t1 (id int);
+go
+
+insert into babel_forxml_batches_t1 select a.n + 10 * b.n + 100 * c.n + 1
+	from babel_forxml_batches_d a, babel_forxml_batches_d b, babel_forxml_batches_d c;
+go
+
+create table babel_forxml_batches_t2 (id int);
+go
+
+insert into babel_forxml_batches_t2 select id from babel_forxml_batches_t1;
+go
+
+-- 1500 rows
+insert into babel_forxml_batches_t1 select id + 1000 from babel_forxml_batches_t1 where id <= 500;
+go
+
+-- 2000 rows, a multiple of the batch size
+insert into babel_forxml_batches_t2 select id + 1000 from babel_forxml_batches_t2;
+go
+
+create view babel_forxml_batches_t1_raw as
+select cast((select id from babel_forxml_batches_t1 order by id for xml raw) as nvarchar(max)) as x;
+go
+
+select len(x), left(x, 32), right(x, 32), (len(x) - len(replace(x, '<row', ''))) / 4 from babel_forxml_batches_t1_raw;
+go
+
+select charindex('<row id="1000"/><row id="1001"/>', x) from babel_forxml_batches_t1_raw;
+go
+
+create view babel_forxml_batches_t1_path as
+select cast((select id from babel_forxml_batches_t1 order by id for xml path) as nvarchar(max)) as x;
+go
+
+select len(x), left(x, 32), right(x, 32), (len(x) - len(replace(x, '<row', ''))) / 4 from babel_forxml_batches_t1_path;
+go
+
+select charindex('<row><id>1000</id></row><row><id>1001</id></row>', x) from babel_forxml_batches_t1_path;
+go
+
+create view babel_forxml_batches_t2_raw as
+select cast((select id from babel_forxml_batches_t2 order by id for xml raw) as nvarchar(max)) as x;
+go
+
+select len(x), left(x, 32), right(x, 32), (len(x) - len(replace(x, '<row', ''))) / 4 from babel_forxml_batches_t2_raw;
+go
+
+select charindex('<row id="1000"/><row id="1001"/>', x) from babel_forxml_batches_t2_raw;
+go
+
+create view babel_forxml_batches_t2_path as
+select cast((select id from babel_forxml_batches_t2 order by id for xml path) as nvarchar(max)) as x;
+go
+
+select len(x), left(x, 32), right(x, 32), (len(x) - len(replace(x, '<row', ''))) / 4 from babel_forxml_batches_t2_path;
+go
+
+select charindex('<row><id>1000</id></row><row><id>1001</id></row>', x) from babel_forxml_batches_t2_path;
+go
+
+drop view babel_forxml_batches_t1_raw;
+go
+
+drop view babel_forxml_batches_t1_path;
+go
+
+drop view babel_forxml_batches_t2_raw;
+go
+
+drop view babel_forxml_batches_t2_path;
+go
+
+drop table babel_forxml_batches_t1;
+go
+
+drop table babel_forxml_batches_t2;
+go
+
+drop table babel_forxml_batches_d;
+go
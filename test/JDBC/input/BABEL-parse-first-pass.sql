@@ -0,0 +1,30 @@
+-- unsupported session settings raise errors only in strict mode
+EXEC sp_babelfish_configure 'babelfishpg_tsql.escape_hatch_session_settings', 'strict';
+GO
+
+-- the first unsupported feature of the batch is reported
+SET SHOWPLAN_ALL ON;
+SET SHOWPLAN_TEXT ON;
+GO
+
+SELECT 1;
+SET STATISTICS IO ON;
+SET DATEFORMAT dmy;
+GO
+
+-- an unsupported feature found before the mutator fails takes precedence
+SET QUOTED_IDENTIFIER OFF;
+GO
+
+SELECT "f'oo";
+GO
+
+SET SHOWPLAN_ALL ON;
+SELECT "f'oo";
+GO
+
+SET QUOTED_IDENTIFIER ON;
+GO
+
+EXEC sp_babelfish_configure 'babelfishpg_tsql.escape_hatch_session_settings', 'ignore';
+GO
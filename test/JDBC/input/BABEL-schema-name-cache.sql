@@ -0,0 +1,73 @@
+-- schema names are mapped per database, and the mapping follows schemas and
+-- databases being dropped and created again
+create schema babel_schema_cache_s1;
+go
+
+create table babel_schema_cache_s1.t1 (a int);
+insert into babel_schema_cache_s1.t1 values (1);
+go
+
+create database babel_schema_cache_db;
+go
+
+use babel_schema_cache_db;
+go
+
+create schema babel_schema_cache_s1;
+go
+
+create table babel_schema_cache_s1.t1 (a int);
+insert into babel_schema_cache_s1.t1 values (2);
+go
+
+select a from babel_schema_cache_s1.t1;
+select a from master.babel_schema_cache_s1.t1;
+go
+
+select name, schema_name(schema_id(name)) from sys.schemas where name = 'babel_schema_cache_s1';
+go
+
+drop table babel_schema_cache_s1.t1;
+drop schema babel_schema_cache_s1;
+go
+
+select schema_id('babel_schema_cache_s1');
+select name from sys.schemas where name = 'babel_schema_cache_s1';
+go
+
+create schema babel_schema_cache_s1;
+go
+
+select name, schema_name(schema_id(name)) from sys.schemas where name = 'babel_schema_cache_s1';
+go
+
+drop schema babel_schema_cache_s1;
+go
+
+use master;
+go
+
+drop database babel_schema_cache_db;
+go
+
+create database babel_schema_cache_db;
+go
+
+use babel_schema_cache_db;
+go
+
+select schema_id('babel_schema_cache_s1');
+go
+
+use master;
+go
+
+select a from babel_schema_cache_s1.t1;
+go
+
+drop database babel_schema_cache_db;
+go
+
+drop table babel_schema_cache_s1.t1;
+drop schema babel_schema_cache_s1;
+go
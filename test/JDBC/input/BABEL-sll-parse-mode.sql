@@ -0,0 +1,52 @@
+-- results must not depend on the ANTLR prediction mode
+CREATE TABLE babel_sll_t1 (a INT, b VARCHAR(10));
+go
+
+INSERT INTO babel_sll_t1 VALUES (1, 'one'), (2, 'two');
+go
+
+SELECT a, b FROM babel_sll_t1 WHERE a = 2;
+go
+
+CREATE TABLE babel_sll_stats_t (id INT IDENTITY, ll_fallbacks BIGINT, ll_parses BIGINT);
+go
+
+INSERT INTO babel_sll_stats_t (ll_fallbacks, ll_parses) SELECT ll_fallbacks, ll_parses FROM sys.babelfish_antlr_parse_stats();
+go
+
+-- syntax errors are reported by the LL parse after SLL bails out
+DROP TABLE @t102;
+go
+
+INSERT INTO babel_sll_stats_t (ll_fallbacks, ll_parses) SELECT ll_fallbacks, ll_parses FROM sys.babelfish_antlr_parse_stats();
+go
+
+SELECT set_config('babelfishpg_tsql.enable_sll_parse_mode', 'off', false);
+go
+
+SELECT a, b FROM babel_sll_t1 WHERE a = 2;
+go
+
+DROP TABLE @t102;
+go
+
+SELECT set_config('babelfishpg_tsql.enable_sll_parse_mode', 'on', false);
+go
+
+INSERT INTO babel_sll_stats_t (ll_fallbacks, ll_parses) SELECT ll_fallbacks, ll_parses FROM sys.babelfish_antlr_parse_stats();
+go
+
+-- a syntax error is retried in LL mode; with SLL disabled there is no fallback
+SELECT CASE WHEN b.ll_fallbacks > a.ll_fallbacks THEN 'ok' ELSE 'no fallback counted' END,
+       CASE WHEN b.ll_parses > a.ll_parses THEN 'ok' ELSE 'no LL parse counted' END,
+       CASE WHEN c.ll_fallbacks = b.ll_fallbacks THEN 'ok' ELSE 'fallback counted with SLL off' END,
+       CASE WHEN c.ll_parses > b.ll_parses THEN 'ok' ELSE 'no LL parse counted with SLL off' END
+FROM babel_sll_stats_t a, babel_sll_stats_t b, babel_sll_stats_t c
+WHERE a.id = 1 AND b.id = 2 AND c.id = 3;
+go
+
+DROP TABLE babel_sll_stats_t;
+go
+
+DROP TABLE babel_sll_t1;
+go
@@ -0,0 +1,60 @@
+-- repeated sp_executesql calls reuse the compiled statement with new values
+CREATE TABLE babel_spexec_cache_t1 (a INT, b VARCHAR(10));
+go
+
+INSERT INTO babel_spexec_cache_t1 VALUES (1, 'one'), (2, 'two'), (3, 'three');
+go
+
+EXEC sp_executesql N'SELECT b FROM babel_spexec_cache_t1 WHERE a = @a', N'@a INT', @a = 1;
+go
+
+EXEC sp_executesql N'SELECT b FROM babel_spexec_cache_t1 WHERE a = @a', N'@a INT', @a = 3;
+go
+
+-- same text with a different parameter type is compiled on its own
+EXEC sp_executesql N'SELECT b FROM babel_spexec_cache_t1 WHERE a = @a', N'@a VARCHAR(10)', @a = '2';
+go
+
+-- OUTPUT parameters of a reused statement
+DECLARE @r VARCHAR(10);
+EXEC sp_executesql N'SELECT @r = b FROM babel_spexec_cache_t1 WHERE a = @a', N'@a INT, @r VARCHAR(10) OUTPUT', @a = 2, @r = @r OUTPUT;
+SELECT @r;
+go
+
+DECLARE @r VARCHAR(10);
+EXEC sp_executesql N'SELECT @r = b FROM babel_spexec_cache_t1 WHERE a = @a', N'@a INT, @r VARCHAR(10) OUTPUT', @a = 3, @r = @r OUTPUT;
+SELECT @r;
+go
+
+SELECT CASE WHEN parameterized_entries > 0 AND hits > 0 THEN 1 ELSE 0 END AS cached
+FROM sys.babelfish_batch_cache_stats();
+go
+
+-- a cached statement must pick up the new table definition
+DROP TABLE babel_spexec_cache_t1;
+go
+
+CREATE TABLE babel_spexec_cache_t1 (a INT, b INT);
+go
+
+INSERT INTO babel_spexec_cache_t1 VALUES (1, 100);
+go
+
+EXEC sp_executesql N'SELECT b FROM babel_spexec_cache_t1 WHERE a = @a', N'@a INT', @a = 1;
+go
+
+-- escape hatches are checked when the statement is compiled
+EXEC sp_executesql N'SELECT b FROM babel_spexec_cache_t1 WITH (INDEX=i1) WHERE a = @a', N'@a INT', @a = 1;
+go
+
+SELECT set_config('babelfishpg_tsql.escape_hatch_table_hints', 'strict', false);
+go
+
+EXEC sp_executesql N'SELECT b FROM babel_spexec_cache_t1 WITH (INDEX=i1) WHERE a = @a', N'@a INT', @a = 1;
+go
+
+SELECT set_config('babelfishpg_tsql.escape_hatch_table_hints', 'ignore', false);
+go
+
+DROP TABLE babel_spexec_cache_t1;
+go
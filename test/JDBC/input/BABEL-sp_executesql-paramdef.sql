@@ -0,0 +1,43 @@
+-- parameter definitions in the shapes the dedicated parser accepts
+EXEC sp_executesql N'SELECT @A + 1', N'@A INT', @A = 1;
+go
+
+EXEC sp_executesql N'SELECT @A + 1', N'@A INT', @A = 2;
+go
+
+EXEC sp_executesql N'SELECT @d * 2, @s', N'@d AS decimal(10, 2), @s varchar(max)', @d = 6.25, @s = 'abc';
+go
+
+EXEC sp_executesql N'SELECT @i + 1', N'  @i [int]  ', @i = 41;
+go
+
+DECLARE @o1 INT, @o2 NVARCHAR(20);
+EXEC sp_executesql N'SET @x = @a * 10; SET @y = N''done''', N'@a int, @x int OUTPUT, @y nvarchar(20) out', @a = 4, @x = @o1 OUTPUT, @y = @o2 OUTPUT;
+SELECT @o1, @o2;
+go
+
+-- shapes left to the full grammar
+EXEC sp_executesql N'SELECT @a', N'@a int = 5', @a = 7;
+go
+
+EXEC sp_executesql N'SELECT @a', N'@a int /* comment */', @a = 8;
+go
+
+-- a recreated user-defined type is looked up again
+CREATE TYPE babel_paramdef_type FROM INT;
+go
+
+EXEC sp_executesql N'SELECT @t', N'@t babel_paramdef_type', @t = 9;
+go
+
+DROP TYPE babel_paramdef_type;
+go
+
+CREATE TYPE babel_paramdef_type FROM VARCHAR(10);
+go
+
+EXEC sp_executesql N'SELECT @t', N'@t babel_paramdef_type', @t = 'ten';
+go
+
+DROP TYPE babel_paramdef_type;
+go
@@ -0,0 +1,82 @@
+-- the table of a table variable is emptied and kept when the procedure returns,
+-- the next call reuses it
+create procedure babel_tvp_pool_p1 @n int as
+begin
+	declare @t table (a int primary key, b varchar(10));
+	insert into @t values (@n, 'x'), (@n + 1, 'y');
+	select count(*) from @t;
+end
+go
+
+exec babel_tvp_pool_p1 1;
+go
+
+exec babel_tvp_pool_p1 10;
+go
+
+exec babel_tvp_pool_p1 100;
+go
+
+SELECT CASE WHEN hits >= 2 THEN 'reused' ELSE 'not reused' END AS pool_state
+FROM sys.babelfish_table_variable_pool_stats();
+go
+
+-- a table variable of the same name with another definition gets its own table
+create procedure babel_tvp_pool_p2 as
+begin
+	declare @t table (c datetime);
+	insert into @t values ('2000-01-01');
+	select * from @t;
+end
+go
+
+exec babel_tvp_pool_p2;
+go
+
+exec babel_tvp_pool_p1 5;
+go
+
+-- a reused table numbers its IDENTITY column from the seed again
+create procedure babel_tvp_pool_p4 as
+begin
+	declare @t table (id int identity(10, 5), v varchar(10));
+	insert into @t (v) values ('a'), ('b');
+	select id, v from @t order by id;
+end
+go
+
+exec babel_tvp_pool_p4;
+go
+
+exec babel_tvp_pool_p4;
+go
+
+drop procedure babel_tvp_pool_p4;
+go
+
+-- idle pooled tables don't block dropping a type they were built from
+create type babel_tvp_pool_type as table (a int);
+go
+
+create procedure babel_tvp_pool_p3 as
+begin
+	declare @t babel_tvp_pool_type;
+	insert into @t values (1);
+	select count(*) from @t;
+end
+go
+
+exec babel_tvp_pool_p3;
+go
+
+drop procedure babel_tvp_pool_p3;
+go
+
+drop type babel_tvp_pool_type;
+go
+
+drop procedure babel_tvp_pool_p1;
+go
+
+drop procedure babel_tvp_pool_p2;
+go
@@ -0,0 +1,24 @@
+-- numeric values are encoded from their digits, check the NBASE digit boundaries
+create table babel_tds_send_t1 (a numeric(38, 10), b numeric(10, 0), c decimal(5, 4));
+go
+
+insert into babel_tds_send_t1 values (0, 0, 0);
+insert into babel_tds_send_t1 values (-0.0000000001, 10000, 0.0001);
+insert into babel_tds_send_t1 values (1234567890123456789012345678.1234567890, -9999999999, -9.9999);
+insert into babel_tds_send_t1 values (-10000.00001, 100000000, 1.5);
+go
+
+select * from babel_tds_send_t1;
+go
+
+drop table babel_tds_send_t1;
+go
+
+-- temporal values before and after the PostgreSQL epoch
+select cast('1753-01-01 23:59:59.997' as datetime), cast('2079-06-06 23:59:00' as smalldatetime),
+	cast('0001-01-01 00:00:00.000001' as datetime2(7)), cast('23:59:59.123456' as time(7)),
+	cast('9999-12-31' as date);
+go
+
+select cast('6F9619FF-8B86-D011-B42D-00C04FC964FF' as uniqueidentifier);
+go
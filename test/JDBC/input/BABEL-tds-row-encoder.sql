@@ -0,0 +1,33 @@
+-- rows of fixed-width columns are encoded in one go, mixed rows per column
+create table babel_tds_row_t1 (a bit, b tinyint, c smallint, d int, e bigint, f real, g float);
+go
+
+insert into babel_tds_row_t1 values (1, 255, -32768, 2147483647, -9223372036854775808, 1.5, -2.25);
+insert into babel_tds_row_t1 values (0, 0, 32767, -2147483648, 9223372036854775807, -0.5, 3);
+insert into babel_tds_row_t1 values (NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+insert into babel_tds_row_t1 values (1, NULL, 1, NULL, 1, NULL, 1);
+go
+
+select * from babel_tds_row_t1;
+go
+
+-- NULLs in variable size columns switch the row token to NBCROW
+select a, d, cast(NULL as varchar(10)), g, cast(NULL as nvarchar(max)) from babel_tds_row_t1;
+go
+
+select d, cast(d as varchar(20)), e from babel_tds_row_t1;
+go
+
+create table babel_tds_row_t2 (a int not null, b bigint not null, c float not null);
+go
+
+insert into babel_tds_row_t2 values (1, 2, 3.5);
+insert into babel_tds_row_t2 values (-1, -2, -3.5);
+go
+
+select * from babel_tds_row_t2;
+go
+
+drop table babel_tds_row_t1;
+drop table babel_tds_row_t2;
+go
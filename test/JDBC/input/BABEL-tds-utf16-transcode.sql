@@ -0,0 +1,20 @@
+-- long ASCII runs around non-ASCII characters, in both directions
+create table babel_tds_utf16_t1 (a nvarchar(200), b nvarchar(max), c ntext);
+go
+
+insert into babel_tds_utf16_t1 values (N'abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ', N'0123456789abcdefghijklmnopqrstuvwxyzé0123456789abcdefghijklmnopqrstuvwxyz', N'abcdefghijklmnop日本語abcdefghijklmnop');
+insert into babel_tds_utf16_t1 values (N'ÀÁÂÃÄÅ abcdefghijklmnopqrstuvwxyz', N'𝄞abcdefghijklmnopqrstuvwxyz0123456789𝄞', N'abcdefghijklmnopqrstuvwxyz0123456789€');
+go
+
+select a, b, c from babel_tds_utf16_t1;
+go
+
+select len(a) from babel_tds_utf16_t1;
+go
+
+declare @p nvarchar(100) = N'abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ';
+select @p, len(@p);
+go
+
+drop table babel_tds_utf16_t1;
+go
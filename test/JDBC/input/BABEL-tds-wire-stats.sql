@@ -0,0 +1,24 @@
+-- the counters of this connection are published after each response
+select 1, 2, 3;
+go
+
+select count(*) from sys.babelfish_tds_stats where session_id = @@spid;
+go
+
+select case when bytes_sent > 0 and packets_sent > 0 and bytes_received > 0
+		and packets_received > 0 and flushes > 0 then 1 else 0 end,
+	case when row_tokens > 0 and colmetadata_tokens > 0 and done_tokens > 0 then 1 else 0 end
+from sys.babelfish_tds_stats where session_id = @@spid;
+go
+
+-- connections that have ended are summed up in the row without a session id
+select count(*) from sys.babelfish_tds_stats where session_id is null;
+go
+
+select request_type,
+	case when requests = under_100us + under_1ms + under_10ms + under_100ms + under_1s + over_1s
+		then 1 else 0 end,
+	case when max_us <= total_us then 1 else 0 end
+from sys.babelfish_tds_request_stats
+where session_id = @@spid and request_type = 'SQL_BATCH';
+go
@@ -0,0 +1,35 @@
+-- equality of ASCII strings under the default case-insensitive collation
+create table babel_ci_ascii_t1 (a varchar(50), b nvarchar(50));
+go
+
+insert into babel_ci_ascii_t1 values ('Apple', 'Apple');
+insert into babel_ci_ascii_t1 values ('APPLE', 'APPLE');
+insert into babel_ci_ascii_t1 values ('apple  ', 'apple  ');
+insert into babel_ci_ascii_t1 values ('Äpple', 'Äpple');
+insert into babel_ci_ascii_t1 values ('a_long_value_spanning_several_words', 'A_LONG_VALUE_SPANNING_SEVERAL_WORDS');
+insert into babel_ci_ascii_t1 values ('a-long-value-spanning-several-words', 'a-long-value-spanning-several-words');
+go
+
+select count(*) from babel_ci_ascii_t1 where a = 'apple';
+go
+
+select count(*) from babel_ci_ascii_t1 where a <> 'APPLE';
+go
+
+select count(*) from babel_ci_ascii_t1 where a = b;
+go
+
+select count(*) from babel_ci_ascii_t1 where a = 'A_LONG_VALUE_SPANNING_SEVERAL_WORDS';
+go
+
+select count(*) from babel_ci_ascii_t1 where a = 'äpple';
+go
+
+select count(*), min(len(a)) from babel_ci_ascii_t1 group by a order by 1, 2;
+go
+
+select count(*) from babel_ci_ascii_t1 t1 join babel_ci_ascii_t1 t2 on t1.a = t2.a;
+go
+
+drop table babel_ci_ascii_t1;
+go
@@ -679,6 +679,24 @@ GO
 drop table smallint_testing;
 GO
 
+-- format and culture that change from row to row
+CREATE TABLE format_args_testing(ti TINYINT, fmt VARCHAR(10), culture VARCHAR(10));
+GO
+INSERT INTO format_args_testing VALUES(31, 'N', 'en-us');
+GO
+INSERT INTO format_args_testing VALUES(31, 'N0', 'en-us');
+GO
+INSERT INTO format_args_testing VALUES(255, 'P0', 'en-us');
+GO
+INSERT INTO format_args_testing VALUES(255, 'X', 'en-us');
+GO
+
+SELECT FORMAT(ti, fmt, culture) from format_args_testing;
+GO
+
+drop table format_args_testing;
+GO
+
 drop table tinyint_testing;
 GO
 
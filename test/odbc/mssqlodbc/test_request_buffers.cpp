@@ -0,0 +1,264 @@
+#include "../src/odbc_handler.h"
+#include "../src/query_generator.h"
+#include "../src/drivers.h"
+#include <algorithm>
+#include <sqlext.h>
+#include <gtest/gtest.h>
+
+using std::vector;
+using std::pair;
+
+static const string REQ_BUF_TABLE = "request_buffers_table";
+static const vector<pair<string, string>> REQ_BUF_TABLE_COLUMNS = {
+  {"id", "INT"},
+  {"val", "VARCHAR(MAX)"}
+};
+
+static const string ALPHABET = "abcdefghijklmnopqrstuvwxyz";
+
+// Size of the large values, well past the 8KB a request buffer starts with
+static const int LARGE_REPEAT = 8000;
+
+// From msodbcsql.h: makes the driver flag its next request with RESETCONNECTION,
+// the way a connection pool does when it hands out a connection again
+#ifndef SQL_COPT_SS_RESET_CONNECTION
+#define SQL_COPT_SS_RESET_CONNECTION 1204
+#define SQL_RESET_CONNECTION_YES 1L
+#endif
+
+class MSSQL_Request_Buffers : public testing::Test {
+
+  void SetUp() override {
+    if (!Drivers::DriverExists(ServerType::MSSQL)) {
+      GTEST_SKIP() << "MSSQL Driver not present: skipping all tests for this fixture.";
+    }
+  }
+
+  protected:
+
+    static void SetUpTestSuite() {
+      if (!Drivers::DriverExists(ServerType::MSSQL)) {
+        GTEST_SKIP() << "MSSQL Driver not present: skipping set up.";
+      }
+      OdbcHandler test_setup(Drivers::GetDriver(ServerType::MSSQL));
+
+      test_setup.ConnectAndExecQuery(DropObjectStatement("TABLE", REQ_BUF_TABLE));
+      test_setup.ExecQuery(CreateTableStatement(REQ_BUF_TABLE, REQ_BUF_TABLE_COLUMNS));
+    }
+
+    static void TearDownTestSuite() {
+      if (!Drivers::DriverExists(ServerType::MSSQL)) {
+        GTEST_SKIP() << "MSSQL Driver not present: skipping tear down.";
+      }
+      OdbcHandler test_cleanup(Drivers::GetDriver(ServerType::MSSQL));
+
+      test_cleanup.ConnectAndExecQuery(DropObjectStatement("TABLE", REQ_BUF_TABLE));
+    }
+};
+
+// Returns the alphabet repeated the given number of times
+static string LargeValue(int repeat) {
+  string value;
+
+  value.reserve(ALPHABET.size() * repeat);
+  for (int i = 0; i < repeat; i++) {
+    value += ALPHABET;
+  }
+  return value;
+}
+
+// Connects with the given network packet size and allocates a statement handle
+static void ConnectWithPacketSize(OdbcHandler& odbcHandler, SQLULEN packet_size) {
+  RETCODE rcode;
+
+  ASSERT_NO_FATAL_FAILURE(odbcHandler.AllocateEnvironmentHandle());
+  ASSERT_NO_FATAL_FAILURE(odbcHandler.AllocateConnectionHandle());
+
+  rcode = SQLSetConnectAttr(odbcHandler.GetConnectionHandle(), SQL_ATTR_PACKET_SIZE, (SQLPOINTER) packet_size, 0);
+  ASSERT_TRUE(odbcHandler.IsSqlSuccess(rcode)) << odbcHandler.GetErrorMessage(SQL_HANDLE_DBC, rcode);
+
+  rcode = SQLDriverConnect(odbcHandler.GetConnectionHandle(),
+                           nullptr,
+                           (SQLCHAR *) odbcHandler.GetConnectionString().c_str(),
+                           SQL_NTS,
+                           nullptr,
+                           0,
+                           nullptr,
+                           SQL_DRIVER_COMPLETE);
+  ASSERT_TRUE(odbcHandler.IsSqlSuccess(rcode)) << odbcHandler.GetErrorMessage(SQL_HANDLE_DBC, rcode);
+
+  ASSERT_NO_FATAL_FAILURE(odbcHandler.AllocateStmtHandle());
+}
+
+// Inserts one row with a prepared INSERT, so that the value is sent as an RPC parameter
+static void InsertRow(OdbcHandler& odbcHandler, int id, const string& val) {
+  RETCODE rcode;
+  SQLINTEGER id_param = id;
+  SQLLEN id_indicator = 0;
+  SQLLEN val_indicator = val.size();
+  string query = "INSERT INTO " + REQ_BUF_TABLE + " (id, val) VALUES (?, ?)";
+
+  rcode = SQLBindParameter(odbcHandler.GetStatementHandle(), 1, SQL_PARAM_INPUT, SQL_C_LONG, SQL_INTEGER,
+                           0, 0, &id_param, 0, &id_indicator);
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+  rcode = SQLBindParameter(odbcHandler.GetStatementHandle(), 2, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR,
+                           val.size(), 0, (SQLPOINTER) val.c_str(), val.size() + 1, &val_indicator);
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+
+  rcode = SQLExecDirect(odbcHandler.GetStatementHandle(), (SQLCHAR*) query.c_str(), SQL_NTS);
+  ASSERT_TRUE(odbcHandler.IsSqlSuccess(rcode)) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+
+  rcode = SQLFreeStmt(odbcHandler.GetStatementHandle(), SQL_RESET_PARAMS);
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+}
+
+// Runs a query returning one integer and checks its value
+static void AssertCount(OdbcHandler& odbcHandler, const string& query, int expected) {
+  RETCODE rcode;
+  SQLINTEGER count = 0;
+  SQLLEN count_indicator;
+
+  ASSERT_NO_FATAL_FAILURE(odbcHandler.ExecQuery(query));
+  rcode = SQLBindCol(odbcHandler.GetStatementHandle(), 1, SQL_C_LONG, &count, 0, &count_indicator);
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+  rcode = SQLFetch(odbcHandler.GetStatementHandle());
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+  ASSERT_EQ(count, expected) << query;
+  odbcHandler.CloseStmt();
+  SQLFreeStmt(odbcHandler.GetStatementHandle(), SQL_UNBIND);
+}
+
+// Reads back the value of a row piece by piece and checks it
+static void AssertValue(OdbcHandler& odbcHandler, int id, const string& expected) {
+  RETCODE rcode;
+  const int BUFFER_SIZE = 8192;
+  char buffer[BUFFER_SIZE];
+  SQLLEN indicator;
+  string value;
+
+  ASSERT_NO_FATAL_FAILURE(odbcHandler.ExecQuery(
+    SelectStatement(REQ_BUF_TABLE, {"val"}, {}, "id = " + std::to_string(id))));
+  rcode = SQLFetch(odbcHandler.GetStatementHandle());
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+
+  while ((rcode = SQLGetData(odbcHandler.GetStatementHandle(), 1, SQL_C_CHAR, buffer, BUFFER_SIZE, &indicator)) != SQL_NO_DATA) {
+    ASSERT_TRUE(odbcHandler.IsSqlSuccess(rcode)) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+    value += buffer;
+  }
+  ASSERT_EQ(value.size(), expected.size());
+  ASSERT_TRUE(value == expected);
+  odbcHandler.CloseStmt();
+}
+
+// A large RPC grows the request buffer, more than a shrink window of small RPCs
+// after it shrinks it again, and a second large RPC grows it back
+TEST_F(MSSQL_Request_Buffers, LargeRequestThenSmallRequests) {
+  OdbcHandler odbcHandler(Drivers::GetDriver(ServerType::MSSQL));
+  const string large_value = LargeValue(LARGE_REPEAT);
+  const int SMALL_REQUESTS = 100;
+
+  ASSERT_NO_FATAL_FAILURE(odbcHandler.Connect(true));
+
+  ASSERT_NO_FATAL_FAILURE(InsertRow(odbcHandler, 0, large_value));
+  for (int i = 1; i <= SMALL_REQUESTS; i++) {
+    ASSERT_NO_FATAL_FAILURE(InsertRow(odbcHandler, i, "small" + std::to_string(i)));
+  }
+  ASSERT_NO_FATAL_FAILURE(InsertRow(odbcHandler, SMALL_REQUESTS + 1, large_value));
+
+  ASSERT_NO_FATAL_FAILURE(AssertCount(odbcHandler,
+    "SELECT COUNT(*) FROM " + REQ_BUF_TABLE + " WHERE id BETWEEN 1 AND 100 AND val = 'small' + CAST(id AS VARCHAR(10))",
+    SMALL_REQUESTS));
+  ASSERT_NO_FATAL_FAILURE(AssertValue(odbcHandler, 0, large_value));
+  ASSERT_NO_FATAL_FAILURE(AssertValue(odbcHandler, SMALL_REQUESTS + 1, large_value));
+}
+
+// A parameter array is sent as a batch of RPCs in one request, each of them is
+// read from the request buffer in turn
+TEST_F(MSSQL_Request_Buffers, RpcBatch) {
+  OdbcHandler odbcHandler(Drivers::GetDriver(ServerType::MSSQL));
+  RETCODE rcode;
+  const int ROWS = 10;
+  const int MAX_LEN = ROWS * 3000;
+  SQLINTEGER ids[ROWS];
+  SQLLEN id_indicators[ROWS];
+  vector<char> vals(ROWS * (MAX_LEN + 1));
+  SQLLEN val_indicators[ROWS];
+  SQLUSMALLINT statuses[ROWS];
+  SQLULEN processed = 0;
+  string query = "INSERT INTO " + REQ_BUF_TABLE + " (id, val) VALUES (?, ?)";
+
+  ASSERT_NO_FATAL_FAILURE(odbcHandler.Connect(true));
+
+  // Row i holds (i + 1) * 3000 times the (i + 1)th letter of the alphabet
+  for (int i = 0; i < ROWS; i++) {
+    ids[i] = 201 + i;
+    id_indicators[i] = 0;
+    val_indicators[i] = (i + 1) * 3000;
+    std::fill_n(vals.begin() + i * (MAX_LEN + 1), val_indicators[i], 'A' + i);
+  }
+
+  rcode = SQLSetStmtAttr(odbcHandler.GetStatementHandle(), SQL_ATTR_PARAM_BIND_TYPE, (SQLPOINTER) SQL_PARAM_BIND_BY_COLUMN, 0);
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+  rcode = SQLSetStmtAttr(odbcHandler.GetStatementHandle(), SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER) (SQLULEN) ROWS, 0);
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+  rcode = SQLSetStmtAttr(odbcHandler.GetStatementHandle(), SQL_ATTR_PARAM_STATUS_PTR, statuses, 0);
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+  rcode = SQLSetStmtAttr(odbcHandler.GetStatementHandle(), SQL_ATTR_PARAMS_PROCESSED_PTR, &processed, 0);
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+
+  rcode = SQLBindParameter(odbcHandler.GetStatementHandle(), 1, SQL_PARAM_INPUT, SQL_C_LONG, SQL_INTEGER,
+                           0, 0, ids, 0, id_indicators);
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+  rcode = SQLBindParameter(odbcHandler.GetStatementHandle(), 2, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR,
+                           MAX_LEN, 0, vals.data(), MAX_LEN + 1, val_indicators);
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+
+  rcode = SQLExecDirect(odbcHandler.GetStatementHandle(), (SQLCHAR*) query.c_str(), SQL_NTS);
+  ASSERT_TRUE(odbcHandler.IsSqlSuccess(rcode)) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+  ASSERT_EQ(processed, (SQLULEN) ROWS);
+  for (int i = 0; i < ROWS; i++) {
+    ASSERT_TRUE(statuses[i] == SQL_PARAM_SUCCESS || statuses[i] == SQL_PARAM_SUCCESS_WITH_INFO) << "row " << i;
+  }
+
+  rcode = SQLFreeStmt(odbcHandler.GetStatementHandle(), SQL_RESET_PARAMS);
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+  rcode = SQLSetStmtAttr(odbcHandler.GetStatementHandle(), SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER) 1, 0);
+  ASSERT_EQ(rcode, SQL_SUCCESS) << odbcHandler.GetErrorMessage(SQL_HANDLE_STMT, rcode);
+
+  ASSERT_NO_FATAL_FAILURE(AssertCount(odbcHandler,
+    "SELECT COUNT(*) FROM " + REQ_BUF_TABLE + " WHERE id BETWEEN 201 AND 210"
+    " AND val = REPLICATE(CAST(CHAR(65 + id - 201) AS VARCHAR(MAX)), (id - 200) * 3000)",
+    ROWS));
+}
+
+// A connection reset keeps the socket buffers, which have to keep the packet
+// size negotiated at login. The request carrying the reset is large, so it
+// spans many packets and is replayed from a saved copy after the reset.
+TEST_F(MSSQL_Request_Buffers, ResetConnectionAfterPacketSizeChange) {
+  const SQLULEN packet_sizes[] = {512, 32767};
+  int id = 301;
+
+  for (SQLULEN packet_size : packet_sizes) {
+    OdbcHandler odbcHandler(Drivers::GetDriver(ServerType::MSSQL));
+    const string large_value = LargeValue(LARGE_REPEAT + id);
+    RETCODE rcode;
+    string sql_state;
+
+    ASSERT_NO_FATAL_FAILURE(ConnectWithPacketSize(odbcHandler, packet_size));
+    ASSERT_NO_FATAL_FAILURE(odbcHandler.ExecQuery(CreateTableStatement("#reset_check", {{"a", "INT"}})));
+
+    rcode = SQLSetConnectAttr(odbcHandler.GetConnectionHandle(), SQL_COPT_SS_RESET_CONNECTION,
+                              (SQLPOINTER) SQL_RESET_CONNECTION_YES, SQL_IS_INTEGER);
+    ASSERT_TRUE(odbcHandler.IsSqlSuccess(rcode)) << odbcHandler.GetErrorMessage(SQL_HANDLE_DBC, rcode);
+
+    ASSERT_NO_FATAL_FAILURE(InsertRow(odbcHandler, id, large_value));
+
+    // The reset dropped the temp table
+    rcode = SQLExecDirect(odbcHandler.GetStatementHandle(), (SQLCHAR*) "SELECT * FROM #reset_check", SQL_NTS);
+    ASSERT_EQ(rcode, SQL_ERROR) << "packet size " << packet_size;
+    odbcHandler.CloseStmt();
+
+    ASSERT_NO_FATAL_FAILURE(AssertValue(odbcHandler, id, large_value)) << "packet size " << packet_size;
+    id++;
+  }
+}